@@ -22,6 +22,7 @@
 #include "c4Private.h"
 
 #include "Logging.hh"
+#include "Instrumentation.hh"
 #include "StringUtil.hh"
 
 #include "WebSocketInterface.hh"
@@ -379,6 +380,34 @@ void c4slog(C4LogDomain c4Domain, C4LogLevel level, C4Slice msg) noexcept {
 }
 // LCOV_EXCL_STOP
 
+#pragma mark - METRICS:
+
+
+void c4metrics_setEnabled(bool enabled) noexcept {
+    Metric::setEnabled(enabled);
+}
+
+bool c4metrics_isEnabled() noexcept {
+    return Metric::enabled();
+}
+
+C4StringResult c4metrics_getSnapshot() C4API {
+    return sliceResult(Metric::snapshotJSON());
+}
+
+void c4metrics_reset() noexcept {
+    Metric::resetAll();
+}
+
+void c4trace_setEnabled(bool enabled) noexcept {
+    Tracer::setEnabled(enabled);
+}
+
+C4StringResult c4trace_getEvents(bool clear) C4API {
+    return sliceResult(Tracer::eventsJSON(clear));
+}
+
+
 #pragma mark - INSTANCE COUNTED:
 
 
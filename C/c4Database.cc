@@ -153,6 +153,18 @@ bool c4db_compact(C4Database* database, C4Error *outError) noexcept {
 }
 
 
+bool c4db_rebuildBlobIndex(C4Database* database, C4Error *outError) noexcept {
+    return tryCatch(outError, bind(&Database::rebuildBlobIndex, database));
+}
+
+
+bool c4db_isBlobIndexValid(C4Database* database, C4Error *outError) noexcept {
+    if (outError)
+        *outError = {};     // isBlobIndexValid may return false w/o throwing an exception
+    return tryCatch<bool>(outError, bind(&Database::isBlobIndexValid, database));
+}
+
+
 bool c4db_rekey(C4Database* database, const C4EncryptionKey *newKey, C4Error *outError) noexcept {
     return tryCatch(outError, bind(&Database::rekey, database, newKey));
 }
@@ -278,15 +290,17 @@ C4RawDocument* c4raw_get(C4Database* database,
                          C4Error *outError) noexcept
 {
     return tryCatch<C4RawDocument*>(outError, [&]{
-        Record r = database->getRawDocument(toString(storeName), key);
-        if (!r.exists()) {
+        // Borrow the record instead of reading it into a Record, since it's copied anyway:
+        C4RawDocument *rawDoc = nullptr;
+        KeyStore &store = database->getKeyStore(toString(storeName));
+        store.getBorrowed(key, kDefaultContent, [&](const RecordLite &r) {
+            rawDoc = new C4RawDocument;
+            rawDoc->key = r.key.copy();
+            rawDoc->meta = r.version.copy();
+            rawDoc->body = r.body.copy();
+        });
+        if (!rawDoc)
             recordError(LiteCoreDomain, kC4ErrorNotFound, outError);
-            return (C4RawDocument*)nullptr;
-        }
-        auto rawDoc = new C4RawDocument;
-        rawDoc->key = r.key().copy();
-        rawDoc->meta = r.version().copy();
-        rawDoc->body = r.body().copy();
         return rawDoc;
     });
 }
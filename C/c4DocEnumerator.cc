@@ -62,6 +62,7 @@ struct C4DocEnumerator: C4InstanceCounted {
         RecordEnumerator::Options options;
         options.descending      = (c4options.flags & kC4Descending) != 0;
         options.includeDeleted  = (c4options.flags & kC4IncludeDeleted) != 0;
+        options.onlyConflicts   = (c4options.flags & kC4IncludeNonConflicted) == 0;
         if ((c4options.flags & kC4IncludeBodies) == 0)
             options.contentOptions = kMetaOnly;
         return options;
@@ -84,31 +85,34 @@ struct C4DocEnumerator: C4InstanceCounted {
     }
 
     bool getDocInfo(C4DocumentInfo *outInfo) {
-        if (!_e)
+        // Use the RecordLite, to avoid copying the record's data. Its docID stays valid until
+        // the next call to next(), same as when it pointed into a copied Record.
+        auto &rec = _e.recordLite();
+        if (!rec.key.buf)
             return false;
-        outInfo->docID = _e.record().key();
+        outInfo->docID = rec.key;
         outInfo->revID = _docRevID;
         outInfo->flags = _docFlags;
-        outInfo->sequence = _e.record().sequence();
-        outInfo->bodySize = _e.record().bodySize();
+        outInfo->sequence = rec.sequence;
+        outInfo->bodySize = rec.bodySize;
         return true;
     }
 
 private:
     inline bool useDoc() {
-        auto &rec = _e.record();
-        if (!rec.exists()) {
+        auto &rec = _e.recordLite();
+        if (!rec.exists) {
             // Client must be enumerating a list of docIDs, and this doc doesn't exist.
             // Return it anyway, without the kDocExists flag.
             _docFlags = 0;
             _docRevID = nullslice;
-            return (!_filter || _filter(rec, 0));
+            return (!_filter || _filter(_e.record(), 0));
         }
-        _docRevID = _database->documentFactory().revIDFromVersion(rec.version());
-        _docFlags = (C4DocumentFlags)rec.flags() | kDocExists;
+        _docRevID = _database->documentFactory().revIDFromVersion(rec.version);
+        _docFlags = (C4DocumentFlags)rec.flags | kDocExists;
         auto optFlags = _options.flags;
         return (optFlags & kC4IncludeNonConflicted ||  (_docFlags & ::kDocConflicted))
-            && (!_filter || _filter(rec, _docFlags));
+            && (!_filter || _filter(_e.record(), _docFlags));
     }
 
     Retained<Database> _database;
@@ -57,6 +57,24 @@ C4Document* c4doc_get(C4Database *database,
 }
 
 
+C4Document* c4doc_getWithContent(C4Database *database,
+                                 C4Slice docID,
+                                 bool mustExist,
+                                 C4DocContentLevel content,
+                                 C4Error *outError) noexcept
+{
+    return tryCatch<C4Document*>(outError, [&]{
+        auto doc = database->documentFactory().newDocumentInstance(docID, content);
+        if (mustExist && !asInternal(doc)->exists()) {
+            delete doc;
+            doc = nullptr;
+            recordError(LiteCoreDomain, kC4ErrorNotFound, outError);
+        }
+        return doc;
+    });
+}
+
+
 C4Document* c4doc_getBySequence(C4Database *database,
                                 C4SequenceNumber sequence,
                                 C4Error *outError) noexcept
@@ -429,30 +447,36 @@ C4Document* c4doc_getForPut(C4Database *database,
 }
 
 
-C4Document* c4doc_put(C4Database *database,
-                      const C4DocPutRequest *rq,
-                      size_t *outCommonAncestorIndex,
-                      C4Error *outError) noexcept
-{
-    if (!database->mustBeInTransaction(outError))
-        return nullptr;
+// Checks the parameters of a put request for consistency.
+static bool checkPutRequest(const C4DocPutRequest *rq, C4Error *outError) {
     if (rq->docID.buf && !Document::isValidDocID(rq->docID)) {
         c4error_return(LiteCoreDomain, kC4ErrorBadDocID, C4STR("Invalid docID"), outError);
-        return nullptr;
+        return false;
     }
     if (rq->existingRevision || rq->historyCount > 0)
         if (!checkParam(rq->docID.buf, "Missing docID", outError))
-            return nullptr;
+            return false;
     if (rq->existingRevision) {
         if (!checkParam(rq->historyCount > 0, "No history", outError))
-            return nullptr;
+            return false;
     } else {
         if (!checkParam(rq->historyCount <= 1, "Too much history", outError))
-            return nullptr;
+            return false;
         if (!checkParam(rq->historyCount > 0 || !(rq->revFlags & kRevDeleted),
                         "Can't create a new already-deleted document", outError))
-            return nullptr;
+            return false;
     }
+    return true;
+}
+
+
+C4Document* c4doc_put(C4Database *database,
+                      const C4DocPutRequest *rq,
+                      size_t *outCommonAncestorIndex,
+                      C4Error *outError) noexcept
+{
+    if (!database->mustBeInTransaction(outError) || !checkPutRequest(rq, outError))
+        return nullptr;
 
     int commonAncestorIndex = 0;
     C4Document *doc = nullptr;
@@ -499,6 +523,127 @@ C4Document* c4doc_put(C4Database *database,
 }
 
 
+// Helper for c4db_putDocuments: new docs whose records haven't been written yet.
+namespace {
+    class PendingInserts {
+    public:
+        explicit PendingInserts(C4Database *db)  :_db(db) { }
+
+        // Puts the request's revision into a new in-memory doc and queues its record to be
+        // written. Returns false if the doc can't take this shortcut.
+        bool add(const C4DocPutRequest &rq, size_t index) {
+            if (!rq.docID.buf || !isNewDocPutRequest(_db, &rq))
+                return false;
+            C4DocPutRequest unsaved = rq;
+            unsaved.save = false;
+            unique_ptr<Document> doc(asInternal(
+                                _db->documentFactory().newDocumentInstance(Record(rq.docID))));
+            bool ok;
+            if (rq.existingRevision)
+                ok = (doc->putExistingRevision(unsaved) >= 0);
+            else
+                ok = doc->putNewRevision(unsaved);
+            if (!ok)
+                return false;
+            _inserts.push_back({move(doc), index, rq.maxRevTreeDepth, nullslice});
+            return true;
+        }
+
+        bool empty() const      {return _inserts.empty();}
+
+        // Writes the queued records with one KeyStore::setMany() call. Requests whose docs turned
+        // out to exist already are left to the caller, via `fallback`.
+        void write(size_t &nSaved, C4Error outErrors[], function_ref<void(size_t)> fallback) {
+            vector<KeyStore::SetRequest> requests;
+            requests.reserve(_inserts.size());
+            for (auto &insert : _inserts)
+                requests.push_back(insert.doc->insertRequest(insert.maxRevTreeDepth,
+                                                             insert.body));
+            vector<sequence_t> sequences;
+            _db->defaultKeyStore().setMany(requests, _db->transaction(), &sequences);
+
+            auto inserts = move(_inserts);
+            _inserts.clear();
+            for (size_t i = 0; i < inserts.size(); ++i) {
+                if (sequences[i]) {
+                    inserts[i].doc->inserted(sequences[i]);
+                    ++nSaved;
+                    if (outErrors)
+                        outErrors[inserts[i].index] = {};
+                } else {
+                    fallback(inserts[i].index);
+                }
+            }
+        }
+
+    private:
+        struct Insert {
+            unique_ptr<Document> doc;
+            size_t index;
+            unsigned maxRevTreeDepth;
+            alloc_slice body;
+        };
+
+        C4Database* const _db;
+        vector<Insert> _inserts;
+    };
+}
+
+
+size_t c4db_putDocuments(C4Database *database,
+                         const C4DocPutRequest requests[],
+                         size_t count,
+                         C4Error outErrors[]) noexcept
+{
+    C4Error error;
+    if (!database->mustBeInTransaction(&error)) {
+        for (size_t i = 0; outErrors && i < count; ++i)
+            outErrors[i] = error;
+        return 0;
+    }
+    size_t nSaved = 0;
+    try {
+        Database::SavingBatch batch(database);
+
+        // Saves one request the regular way, via c4doc_put:
+        auto put = [&](size_t i) {
+            C4DocPutRequest rq = requests[i];
+            rq.save = true;
+            C4Error error;
+            C4Document *doc = c4doc_put(database, &rq, nullptr, &error);
+            if (doc) {
+                c4doc_free(doc);
+                ++nSaved;
+            }
+            if (outErrors)
+                outErrors[i] = doc ? C4Error{} : error;
+        };
+
+        // Runs of new docs are written together by KeyStore::setMany(), which gives them one
+        // contiguous block of sequences. Any other request is saved by c4doc_put, after the
+        // pending new docs so that the requests still take effect in order.
+        PendingInserts inserts(database);
+        for (size_t i = 0; i < count; ++i) {
+            bool queued = false;
+            if (checkPutRequest(&requests[i], nullptr)) {
+                try {
+                    database->validateRevisionBody(requests[i].body);
+                    queued = inserts.add(requests[i], i);
+                } catch (...) { }       // let c4doc_put report the error
+            }
+            if (!queued) {
+                if (!inserts.empty())
+                    inserts.write(nSaved, outErrors, put);
+                put(i);
+            }
+        }
+        if (!inserts.empty())
+            inserts.write(nSaved, outErrors, put);
+    } catchError(nullptr)
+    return nSaved;
+}
+
+
 C4Document* c4doc_create(C4Database *db,
                          C4String docID,
                          C4Slice revBody,
@@ -639,6 +784,13 @@ C4SliceResult c4db_encodeJSON(C4Database *db, C4Slice jsonData, C4Error *outErro
 }
 
 
+C4SliceResult c4db_encodeWithPersistedKeys(C4Database *db, C4Slice fleeceData) noexcept {
+    return tryCatch<C4SliceResult>(nullptr, [&]{
+        return C4SliceResult(db->encodeWithPersistedKeys(fleeceData));
+    });
+}
+
+
 C4SliceResult c4doc_bodyAsJSON(C4Document *doc, bool canonical, C4Error *outError) noexcept {
     return tryCatch<C4SliceResult>(outError, [&]{
         return C4SliceResult(c4Internal::asInternal(doc)->bodyAsJSON(canonical));
@@ -74,6 +74,77 @@ C4Document* c4doc_getForPut(C4Database *database C4NONNULL,
                             bool allowConflict,
                             C4Error *outError) C4API;
 
+/** Specifies how much of a document c4doc_getWithContent should read. */
+typedef C4_ENUM(uint8_t, C4DocContentLevel) {
+    kDocGetMetadata,        ///< Only the docID, revID, sequence and flags
+    kDocGetRevTree,         ///< The revision tree, but none of the revision bodies
+    kDocGetAll,             ///< Everything, like c4doc_get
+};
+
+/** Like c4doc_get, but can skip reading parts of the document the caller doesn't need. This is
+    much cheaper for large documents when all that's wanted is to check which revisions exist.
+    - With kDocGetMetadata, the revisions are read from disk the first time they're accessed.
+    - With kDocGetRevTree, every revision appears to have no body until
+      c4doc_loadRevisionBody is called, which re-reads the whole document. Until then the
+      document can't be saved. */
+C4Document* c4doc_getWithContent(C4Database *database C4NONNULL,
+                                 C4String docID,
+                                 bool mustExist,
+                                 C4DocContentLevel content,
+                                 C4Error *outError) C4API;
+
+/** The result of looking up one revision with c4db_findDocAncestors. */
+typedef struct {
+    bool revExists;             ///< True if the document has the revision
+    bool isRemoteRev;           ///< If revExists: is it the current revision of the remote DB?
+    C4SliceResult ancestors;    ///< If !revExists: a JSON array of revIDs of possible ancestors,
+                                ///<   or null if the document doesn't exist. Caller must free.
+} C4RevAncestors;
+
+/** Looks up many revisions at once, as when the replicator handles a "changes" message.
+    All the documents are read with a single query, and no revision bodies are decoded.
+    The possible ancestors of a missing revision are the existing revisions with lower
+    generations, in the same order c4doc_selectNextPossibleAncestorOf would return them.
+    (Only works with rev-trees.)
+    @param database  The database.
+    @param numRevs  The number of revisions to look up.
+    @param docIDs  The docID of each revision. The same docID may appear more than once.
+    @param revIDs  The revIDs to look up.
+    @param maxAncestors  The maximum number of possible ancestors to return for each revision.
+    @param remoteDBID  If nonzero, each existing revision's `isRemoteRev` is set.
+    @param outResults  An array of `numRevs` results to fill in.
+    @param outError  On failure, the error info will be stored here.
+    @return  True on success, false on failure. */
+bool c4db_findDocAncestors(C4Database *database C4NONNULL,
+                           unsigned numRevs,
+                           const C4String docIDs[] C4NONNULL,
+                           const C4String revIDs[] C4NONNULL,
+                           unsigned maxAncestors,
+                           C4RemoteID remoteDBID,
+                           C4RevAncestors outResults[] C4NONNULL,
+                           C4Error *outError) C4API;
+
+/** Re-encodes Fleece data that doesn't use SharedKeys, such as a revision body received by the
+    replicator, so that it can be stored in the database. Unlike c4db_getSharedFleeceEncoder,
+    this is thread-safe and needs no transaction, so it can be done before handing the revision
+    to the thread that inserts it.
+    Returns a null slice if the data has keys that the database doesn't share yet; it then has
+    to be re-encoded with c4db_getSharedFleeceEncoder within the inserting transaction. */
+C4SliceResult c4db_encodeWithPersistedKeys(C4Database *database C4NONNULL,
+                                           C4Slice fleeceData) C4API;
+
+/** Rebuilds from scratch the index of the blobs referenced by documents, which compaction uses
+    to find the blobs that can be deleted. Compaction keeps the index up to date by itself; this
+    is for recovering from an index that's known to be wrong. */
+bool c4db_rebuildBlobIndex(C4Database *database C4NONNULL,
+                           C4Error *outError) C4API;
+
+/** Scans all documents with blobs and checks that the blob index matches them.
+    Returns false if it doesn't, or if it hasn't been built yet, with the error code set to 0;
+    or returns false with a nonzero error code if the check failed. */
+bool c4db_isBlobIndexValid(C4Database *database C4NONNULL,
+                           C4Error *outError) C4API;
+
 /** Converts C4DocumentFlags to the equivalent C4RevisionFlags. */
 C4RevisionFlags c4rev_flagsFromDocFlags(C4DocumentFlags docFlags);
 
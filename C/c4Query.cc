@@ -23,6 +23,7 @@
 #include "DataFile.hh"
 #include "Query.hh"
 #include "Record.hh"
+#include "SequenceTracker.hh"
 #include "FleeceImpl.hh"
 #include <math.h>
 #include <limits.h>
@@ -36,7 +37,8 @@ using namespace fleece::impl;
 
 
 CBL_CORE_API const C4QueryOptions kC4DefaultQueryOptions = {
-    true
+    true,
+    false
 };
 
 
@@ -56,19 +58,40 @@ private:
 };
 
 
+// Deletes a DatabaseChangeNotifier while holding its tracker's mutex.
+struct ChangeNotifierDeleter {
+    void operator()(DatabaseChangeNotifier *notifier) const {
+        lock_guard<mutex> lock(notifier->tracker.mutex());
+        delete notifier;
+    }
+};
+
+typedef unique_ptr<DatabaseChangeNotifier, ChangeNotifierDeleter> ChangeNotifierRef;
+
+
 // Extension of C4QueryEnumerator
 struct C4QueryEnumeratorImpl : public C4QueryEnumerator, C4InstanceCounted {
-    C4QueryEnumeratorImpl(Database *database, QueryEnumerator *e)
+    C4QueryEnumeratorImpl(Database *database, QueryEnumerator *e, ChangeNotifierRef changes)
     :_database(database)
+    ,_changes(move(changes))
     ,_enum(e)
     ,_hasFullText(_enum->hasFullText())
     {
         clearPublicFields();
+        if (!_enum->canRefreshIncrementally())
+            _changes.reset();
     }
 
     C4QueryEnumeratorImpl(C4Query *query, const Query::Options *options)
-    :C4QueryEnumeratorImpl(query->database(), query->query()->createEnumerator(options))
-    { }
+    :_database(query->database())
+    ,_changes(startTrackingChanges(_database))  // before running the query, so nothing's missed
+    ,_enum(query->query()->createEnumerator(options))
+    ,_hasFullText(_enum->hasFullText())
+    {
+        clearPublicFields();
+        if (!_enum->canRefreshIncrementally())
+            _changes.reset();
+    }
 
     QueryEnumerator& enumerator() const {
         if (!_enum)
@@ -109,21 +132,71 @@ struct C4QueryEnumeratorImpl : public C4QueryEnumerator, C4InstanceCounted {
     }
 
     C4QueryEnumeratorImpl* refresh() {
-        QueryEnumerator* newEnum = enumerator().refresh();
+        QueryEnumerator* newEnum;
+        ChangeNotifierRef newChanges;
+        if (_changes) {
+            // Tell the enumerator which docs changed, so it can skip re-running the query if
+            // they don't affect it:
+            newChanges = startTrackingChanges(_database);
+            vector<alloc_slice> docIDs;
+            sequence_t changesThrough;
+            if (readChanges(docIDs, changesThrough))
+                newEnum = enumerator().refreshWithChanges(docIDs, changesThrough);
+            else
+                newEnum = enumerator().refresh();
+        } else {
+            newEnum = enumerator().refresh();
+        }
         if (newEnum)
-            return new C4QueryEnumeratorImpl(_database, newEnum);
+            return new C4QueryEnumeratorImpl(_database, newEnum, move(newChanges));
         else
             return nullptr;
     }
 
     void close() noexcept {
+        _changes.reset();
         _enum.reset();
     }
 
 private:
+    // Max number of changed docIDs worth passing to QueryEnumerator::refreshWithChanges
+    static constexpr size_t kMaxChangesToCheck = 1000;
+
+    static ChangeNotifierRef startTrackingChanges(Database *db) {
+        if (db->config.flags & kC4DB_NonObservable)
+            return nullptr;
+        lock_guard<mutex> lock(db->sequenceTracker().mutex());
+        return ChangeNotifierRef(new DatabaseChangeNotifier(db->sequenceTracker(), nullptr));
+    }
+
+    // Reads all the changes since the last call. Returns false if there are too many to be
+    // worth checking individually.
+    bool readChanges(vector<alloc_slice> &docIDs, sequence_t &changesThrough) {
+        static constexpr size_t kBatchSize = 100;
+        SequenceTracker::Change changes[kBatchSize];
+        bool external;
+        bool complete = true;
+        changesThrough = 0;
+        lock_guard<mutex> lock(_changes->tracker.mutex());
+        size_t n;
+        while ((n = _changes->readChanges(changes, kBatchSize, external)) > 0) {
+            for (size_t i = 0; i < n; ++i) {
+                changesThrough = max(changesThrough, changes[i].sequence);
+                if (docIDs.size() < kMaxChangesToCheck)
+                    docIDs.push_back(changes[i].docID);
+                else
+                    complete = false;
+            }
+        }
+        return complete;
+    }
+
     Retained<Database> _database;
+    ChangeNotifierRef _changes;         // Tracks changed docs, for refreshWithChanges()
     unique_ptr<QueryEnumerator> _enum;
     bool _hasFullText;
+    //NOTE: _changes must be declared after _database, so it's destructed first while the
+    // Database's SequenceTracker still exists.
 };
 
 
@@ -153,6 +226,29 @@ unsigned c4query_columnCount(C4Query *query) noexcept {
 }
 
 
+void c4query_getStats(C4Query *query, C4QueryStats *outStats) noexcept {
+    Query::Stats stats = query->query()->stats();
+    outStats->runCount = stats.runs;
+    outStats->totalTime = stats.totalTime;
+    outStats->maxTime = stats.maxTime;
+    outStats->rowsReturned = stats.rowsReturned;
+    outStats->vmSteps = stats.vmSteps;
+    outStats->fullScanSteps = stats.fullScanSteps;
+    outStats->sortCount = stats.sorts;
+    outStats->autoIndexRows = stats.autoIndexRows;
+}
+
+
+void c4query_resetStats(C4Query *query) noexcept {
+    query->query()->resetStats();
+}
+
+
+void c4query_setSlowQueryThreshold(double seconds) noexcept {
+    Query::setSlowQueryThreshold(seconds);
+}
+
+
 C4QueryEnumerator* c4query_run(C4Query *query,
                                const C4QueryOptions *c4options,
                                C4Slice encodedParameters,
@@ -161,6 +257,7 @@ C4QueryEnumerator* c4query_run(C4Query *query,
     return tryCatch<C4QueryEnumerator*>(outError, [&]{
         Query::Options options;
         options.paramBindings = encodedParameters;
+        options.streaming = c4options && c4options->streaming;
         return new C4QueryEnumeratorImpl(query, &options);
     });
 }
@@ -281,3 +378,10 @@ C4SliceResult c4db_getIndexes(C4Database* database, C4Error* outError) noexcept
         return C4SliceResult(database->defaultKeyStore().getIndexes());
     });
 }
+
+bool c4db_updateLazyIndexes(C4Database* database, C4Error* outError) noexcept
+{
+    return tryCatch(outError, [&]{
+        database->defaultKeyStore().updateLazyIndexes();
+    });
+}
@@ -278,6 +278,33 @@ int c4_getObjectCount(void) C4API;
 void c4_dumpInstances(void) C4API;
 
 
+//////// METRICS & TRACING:
+
+
+/** Enables or disables recording of LiteCore's runtime metrics: counters and latency histograms
+    of transactions, queries, replicator insertions and socket I/O. They're disabled by default,
+    and cost almost nothing while disabled. This setting is global to the entire process. */
+void c4metrics_setEnabled(bool enabled) C4API;
+
+bool c4metrics_isEnabled(void) C4API;
+
+/** Returns the current values of all metrics, as a JSON object keyed by metric name.
+    Histograms are objects with "count", "sum", "mean", "p50", "p90", "p99" and "max" properties,
+    in the units given by their "unit" property. */
+C4StringResult c4metrics_getSnapshot(void) C4API;
+
+/** Resets all metrics to zero. */
+void c4metrics_reset(void) C4API;
+
+/** Enables or disables tracing. While enabled, timed operations and signposts are recorded as
+    events in memory (up to a limit), which can be retrieved by c4trace_getEvents. */
+void c4trace_setEnabled(bool enabled) C4API;
+
+/** Returns the recorded trace events in Chrome's trace-event JSON format, which can be loaded
+    into chrome://tracing or Perfetto. If `clear` is true, the events are removed afterwards. */
+C4StringResult c4trace_getEvents(bool clear) C4API;
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -71,12 +71,28 @@ extern "C" {
     typedef const char* C4StorageEngine;
     CBL_CORE_API extern C4StorageEngine const kC4SQLiteStorageEngine;
 
+    /** Storage engine tuning, specified in a C4DatabaseConfig. A zero in any field means the
+        default value, so a zeroed struct gives the default behavior. */
+    typedef struct C4StorageTuning {
+        uint64_t cacheSize;         ///< Page cache size per connection, in bytes (default 10MB)
+        int64_t mmapSize;           ///< Max bytes of the file to memory-map (default 50MB, or none
+                                    ///<   on macOS); a negative value disables memory-mapping
+        uint32_t pageSize;          ///< Page size in bytes, for newly created databases (default 4096)
+        uint64_t journalSizeLimit;  ///< Size the WAL file is truncated to after checkpointing (default 5MB)
+        int32_t workerThreads;      ///< Extra threads SQLite may use for large sorts (default 2
+                                    ///<   on macOS, Linux and Windows, else none); a negative
+                                    ///<   value disables them
+        uint32_t checkpointPages;   ///< WAL size in pages that triggers a background checkpoint
+                                    ///<   (default 1000)
+    } C4StorageTuning;
+
     /** Main database configuration struct. */
     typedef struct C4DatabaseConfig {
         C4DatabaseFlags flags;          ///< Create, ReadOnly, AutoCompact, Bundled...
         C4StorageEngine storageEngine;  ///< Which storage to use, or NULL for no preference
         C4DocumentVersioning versioning;///< Type of document versioning
         C4EncryptionKey encryptionKey;  ///< Encryption to use creating/opening the db
+        C4StorageTuning storageTuning;  ///< Storage engine tuning (zero for defaults)
     } C4DatabaseConfig;
 
 
@@ -114,6 +114,7 @@ extern "C" {
 
     /** Stores the metadata of the enumerator's current document into the supplied
         C4DocumentInfo struct. Unlike c4enum_getDocument(), this allocates no memory.
+        The docID and revID it points to are only valid until the next call to c4enum_next().
         @param e  The enumerator.
         @param outInfo  A pointer to a C4DocumentInfo struct that will be filled in if a document
                         is found.
@@ -307,6 +307,22 @@ extern "C" {
                           size_t *outCommonAncestorIndex,
                           C4Error *outError) C4API;
 
+    /** Saves multiple documents at once; must be called within a transaction. This is like
+        calling c4doc_put (with `save` true) on each request and freeing the returned documents,
+        but faster: new documents are written together, with consecutive sequences, without
+        being read first; no C4Document objects are returned; and change notifications are posted
+        once for the whole batch. A request that fails doesn't stop the others from being saved.
+        @param database  The database to save to.
+        @param requests  Array of put requests. Their `save` flags are ignored.
+        @param count  The number of requests.
+        @param outErrors  Either NULL, or an array of `count` errors, which on return will hold
+                    the result of each request (with a zero `code` if it succeeded.)
+        @return  The number of documents successfully saved. */
+    size_t c4db_putDocuments(C4Database *database C4NONNULL,
+                             const C4DocPutRequest requests[] C4NONNULL,
+                             size_t count,
+                             C4Error outErrors[]) C4API;
+
     /** Convenience function to create a new document. This just a wrapper around c4doc_put.
         If the document already exists, it will fail with the error kC4ErrorConflict.
         @param db  The database to create the document in
@@ -64,16 +64,44 @@ extern "C" {
     unsigned c4query_columnCount(C4Query *query) C4API;
 
 
+    /** Statistics about the runs of a query. The last four are counters from SQLite, which
+        indicate whether the query uses indexes effectively. */
+    typedef struct {
+        uint64_t runCount;          ///< Number of times the query has been run
+        double   totalTime;         ///< Total time spent running it, in seconds
+        double   maxTime;           ///< Longest run, in seconds
+        uint64_t rowsReturned;      ///< Total number of rows returned
+        uint64_t vmSteps;           ///< Virtual-machine operations SQLite executed
+        uint64_t fullScanSteps;     ///< Steps through full table scans (nonzero = missing index)
+        uint64_t sortCount;         ///< Sort operations not satisfied by an index
+        uint64_t autoIndexRows;     ///< Rows inserted into temporary automatic indexes
+    } C4QueryStats;
+
+    /** Returns statistics about the runs of a query since it was created (or its stats were
+        reset.) A run of a streaming query is counted when its enumerator reaches the end or is
+        freed. Identical queries may share stats, since the database caches compiled queries. */
+    void c4query_getStats(C4Query *query C4NONNULL, C4QueryStats *outStats C4NONNULL) C4API;
+
+    /** Resets a query's statistics to zero. */
+    void c4query_resetStats(C4Query *query C4NONNULL) C4API;
+
+    /** Sets the duration, in seconds, above which any query run is logged as a warning (to the
+        Query log domain), along with its statistics and the output of c4query_explain.
+        Zero, the default, disables this. This setting is global to the entire process. */
+    void c4query_setSlowQueryThreshold(double seconds) C4API;
+
+
     //////// RUNNING QUERIES:
 
 
     /** Options for running queries. */
     typedef struct {
         bool rankFullText;      ///< Should full-text results be ranked by relevance?
+        bool streaming;         ///< Read rows lazily, instead of collecting them all up front?
     } C4QueryOptions;
 
 
-    /** Default query options. Has skip=0, limit=UINT_MAX, rankFullText=true. */
+    /** Default query options. Has rankFullText=true, streaming=false. */
 	CBL_CORE_API extern const C4QueryOptions kC4DefaultQueryOptions;
 
 
@@ -111,8 +139,13 @@ extern "C" {
     /** Runs a compiled query.
         NOTE: Queries will run much faster if the appropriate properties are indexed.
         Indexes must be created explicitly by calling `c4db_createIndex`.
+        If `options->streaming` is true, rows are read from the database as the enumerator
+        advances, instead of all being collected before this function returns. This uses much
+        less memory and returns the first row much sooner for large result sets, but the
+        enumerator doesn't support `c4queryenum_getRowCount` or `c4queryenum_seek`, and it keeps
+        a read snapshot of the database open until it's freed (or closed.)
         @param query  The compiled query to run.
-        @param options  Query options; only `skip` and `limit` are currently recognized.
+        @param options  Query options; only `streaming` is currently recognized.
         @param encodedParameters  Optional JSON object whose keys correspond to the named
                 parameters in the query expression, and values correspond to the values to
                 bind. Any unbound parameters will be `null`.
@@ -139,15 +172,15 @@ extern "C" {
                           C4Error *outError) C4API;
 
     /** Returns the total number of rows in the query, if known.
-        Not all query enumerators may support this (but the current implementation does.)
+        Not all query enumerators may support this; streaming enumerators don't.
         @param e  The query enumerator
         @param outError  On failure, an error will be stored here (probably kC4ErrorUnsupported.)
         @return  The number of rows, or -1 on failure. */
     int64_t c4queryenum_getRowCount(C4QueryEnumerator *e C4NONNULL,
                                      C4Error *outError) C4API;
 
-    /** Jumps to a specific row. Not all query enumerators may support this (but the current
-        implementation does.)
+    /** Jumps to a specific row. Not all query enumerators may support this; streaming
+        enumerators don't.
         @param e  The query enumerator
         @param rowIndex  The number of the row, starting at 0
         @param outError  On failure, an error will be stored here (probably kC4ErrorUnsupported.)
@@ -157,7 +190,10 @@ extern "C" {
                           C4Error *outError) C4API;
 
     /** Checks whether the query results have changed since this enumerator was created;
-        if so, returns a new enumerator. Otherwise returns NULL. */
+        if so, returns a new enumerator. Otherwise returns NULL.
+        For a simple query (no joins, aggregates, full-text matching, LIMIT or OFFSET) on an
+        observable database, this is cheap when none of the documents changed since the last
+        check matched the query before or after the change: the query isn't re-run. */
     C4QueryEnumerator* c4queryenum_refresh(C4QueryEnumerator *e C4NONNULL,
                                            C4Error *outError) C4API;
 
@@ -184,6 +220,7 @@ extern "C" {
         kC4FullTextIndex,      ///< Full-text index
         kC4ArrayIndex,         ///< Index of array values, for use with UNNEST
         kC4GeoIndex,           ///< Geospatial index of GeoJSON values (NOT YET IMPLEMENTED)
+        kC4FTS5Index,          ///< Full-text index using SQLite's FTS5 engine
     };
 
 
@@ -219,6 +256,23 @@ extern "C" {
             To provide a custom list of words, use a string containing the words in lowercase
             separated by spaces. */
         const char *stopWords;
+
+        /** If true, a full-text or array index isn't updated as documents are saved; instead the
+            changed documents are remembered, and indexed in one batch just before the next query
+            that uses the index, or by `c4db_updateLazyIndexes`. This makes bulk saves (like a
+            pull replication) faster, at the expense of the first query afterwards.
+            Updating the index needs a transaction, so a query won't do it while another thread
+            is in a transaction on the same C4Database; instead it runs without waiting, and may
+            miss documents changed since the index was last updated. (Calling
+            `c4db_updateLazyIndexes` on a background C4Database keeps that window small.) */
+        bool lazy;
+
+        /** If true, a value index stores the binary sort keys of strings its expressions collate
+            with a Unicode-aware `COLLATE`, instead of the strings themselves. Queries whose
+            `ORDER_BY` or `GROUP_BY` use the same collation then compare keys with a simple
+            byte comparison, which is much faster than calling the collator. Ignored on platforms
+            whose collator can't generate sort keys (currently Apple platforms.) */
+        bool unicodeSortKeys;
     } C4IndexOptions;
 
 
@@ -236,7 +290,13 @@ extern "C" {
           by using the `MATCH` operator in a query. A FTS index is **required** for full-text
           search: a query with a `MATCH` operator will fail to compile unless there is already a
           FTS index for the property/expression being matched. Only a single expression is
-          currently allowed, and it must evaluate to a string.
+          currently allowed, and it must evaluate to a string. In a large database a new FTS
+          index is populated by background threads, committing a batch of documents at a time,
+          so other connections can keep saving documents while it's created.
+        * FTS5 indexes are full-text indexes that use SQLite's newer FTS5 engine. They don't store
+          a copy of the indexed text, and `rank()` uses the BM25 algorithm. Their `MATCH`
+          patterns use FTS5 query syntax; for example a column filter whose name contains
+          periods has to be quoted: `"contact.address.street": Santa`. They can't be lazy.
         * Array indexes optimize UNNEST queries, by materializing an unnested array property
           (across all documents) as a table in the SQLite database, and creating a SQL index on it.
 
@@ -289,6 +349,16 @@ extern "C" {
     C4SliceResult c4db_getIndexes(C4Database* database C4NONNULL,
                                   C4Error* outError) C4API;
 
+    /** Brings all lazy indexes (see `C4IndexOptions.lazy`) up to date, by indexing the documents
+        changed since they were last updated. Queries do this automatically, so calling this is
+        optional; but it can be called on a background thread, with its own C4Database instance,
+        to keep that work away from the queries.
+        @param database  The database whose indexes to update.
+        @param outError  On failure, will be set to the error status.
+        @return  True on success, false on failure. */
+    bool c4db_updateLazyIndexes(C4Database* database C4NONNULL,
+                                C4Error* outError) C4API;
+
     /** @} */
 
 #ifdef __cplusplus
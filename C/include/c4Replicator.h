@@ -61,11 +61,25 @@ extern "C" {
         uint64_t    documentCount;      ///< Number of documents transferred so far
     } C4Progress;
 
+    /** The limits the replicator's flow control has currently chosen, and the measurements they
+        are based on. These adapt to the network and database speed as replication runs.
+        Zero means "not measured yet". */
+    typedef struct {
+        unsigned maxRevsInFlight;           ///< Push: # of revisions sent at once
+        unsigned maxRevBytesAwaitingReply;  ///< Push: bytes of revisions sent but not replied to
+        double   revRoundTripTime;          ///< Push: smoothed revision round-trip time (secs)
+        unsigned maxActiveIncomingRevs;     ///< Pull: # of incoming revisions handled at once
+        double   incomingRevTime;           ///< Pull: smoothed time to handle a revision (secs)
+        double   insertionTime;             ///< Pull: smoothed insertion transaction time (secs)
+        unsigned revsPerInsertion;          ///< Pull: # of revisions in last insertion transaction
+    } C4ReplicatorFlowControl;
+
     /** Current status of replication. Passed to `C4ReplicatorStatusChangedCallback`. */
     typedef struct {
         C4ReplicatorActivityLevel level;
         C4Progress progress;
         C4Error error;
+        C4ReplicatorFlowControl flowControl;
     } C4ReplicatorStatus;
 
 
@@ -19,6 +19,7 @@
 #include "c4Test.hh"
 #include "c4BlobStore.h"
 #include "c4Private.h"
+#include "Benchmark.hh"
 
 using namespace std;
 
@@ -321,6 +322,44 @@ N_WAY_TEST_CASE_METHOD(BlobStoreTest, "write blobs of many sizes", "[blob][Encry
 }
 
 
+N_WAY_TEST_CASE_METHOD(BlobStoreTest, "blob stream throughput", "[blob][Encryption][Perf][C][.slow]") {
+    // Compare the MB/sec with and without encryption (the two variants of this test.)
+    static const size_t kBlobSize = 64*1024*1024, kChunkSize = 64*1024;
+    vector<char> chunk(kChunkSize);
+    for (size_t i = 0; i < kChunkSize; ++i)
+        chunk[i] = (char)(i * 7 + i / 4096);
+    const double megabytes = kBlobSize / 1.0e6;
+
+    C4Error error;
+    fleece::Stopwatch st;
+    C4WriteStream *stream = c4blob_openWriteStream(store, &error);
+    REQUIRE(stream);
+    for (size_t pos = 0; pos < kBlobSize; pos += kChunkSize)
+        REQUIRE(c4stream_write(stream, chunk.data(), kChunkSize, &error));
+    C4BlobKey key = c4stream_computeBlobKey(stream);
+    REQUIRE(c4stream_install(stream, nullptr, &error));
+    c4stream_closeWriter(stream);
+    double writeTime = st.elapsed();
+    C4Log("Wrote %.0f MB in %.3f sec: %.1f MB/sec", megabytes, writeTime, megabytes / writeTime);
+
+    for (size_t readSize : {(size_t)4096, kChunkSize}) {
+        st.reset();
+        C4ReadStream *reader = c4blob_openReadStream(store, key, &error);
+        REQUIRE(reader);
+        vector<char> buf(readSize);
+        size_t total = 0, bytesRead;
+        while ((bytesRead = c4stream_read(reader, buf.data(), readSize, &error)) > 0)
+            total += bytesRead;
+        c4stream_close(reader);
+        double readTime = st.elapsed();
+        REQUIRE(error.code == 0);
+        CHECK(total == kBlobSize);
+        C4Log("Read %.0f MB in %zu-byte chunks in %.3f sec: %.1f MB/sec",
+              megabytes, readSize, readTime, megabytes / readTime);
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD(BlobStoreTest, "write blob and cancel", "[blob][Encryption][C]") {
     // Write the blob:
     C4Error error;
@@ -189,6 +189,45 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Transaction", "[Database][C]")
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Metrics", "[Database][C]") {
+    auto getString = [](C4StringResult result) {
+        string str = toString({result.buf, result.size});
+        c4slice_free(result);
+        return str;
+    };
+
+    c4metrics_reset();
+    c4metrics_setEnabled(true);
+    c4trace_setEnabled(true);
+    c4trace_getEvents(true);
+    C4Error error;
+    REQUIRE(c4db_beginTransaction(db, &error));
+    createRev(kDocID, kRevID, kBody);
+    REQUIRE(c4db_endTransaction(db, true, &error));
+    REQUIRE(c4db_beginTransaction(db, &error));
+    REQUIRE(c4db_endTransaction(db, false, &error));
+    c4metrics_setEnabled(false);
+    c4trace_setEnabled(false);
+
+    string snapshot = getString(c4metrics_getSnapshot());
+    C4Log("Metrics: %s", snapshot.c_str());
+    CHECK(snapshot.find("\"commits\":1,") != string::npos);
+    CHECK(snapshot.find("\"aborts\":1,") != string::npos);
+    CHECK(snapshot.find("\"transactionTime\":{\"unit\":\"us\",\"count\":2,") != string::npos);
+
+    string trace = getString(c4trace_getEvents(true));
+    CHECK(trace.find("{\"traceEvents\":[") == 0);
+    CHECK(trace.find("\"name\":\"transaction\"") != string::npos);
+    CHECK(trace.find("\"name\":\"transactionTime\",\"cat\":\"LiteCore\",\"ph\":\"X\"") != string::npos);
+
+    // Nothing is recorded while disabled:
+    REQUIRE(c4db_beginTransaction(db, &error));
+    REQUIRE(c4db_endTransaction(db, true, &error));
+    CHECK(getString(c4metrics_getSnapshot()) == snapshot);
+    CHECK(getString(c4trace_getEvents(true)) == "{\"traceEvents\":[],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":0}}");
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database CreateRawDoc", "[Database][C]") {
     const C4Slice key = c4str("key");
     const C4Slice meta = c4str("meta");
@@ -552,6 +591,90 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Compact", "[Database][C]")
     REQUIRE(c4blob_getSize(store, key3) == -1);
 }
 
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Compact After Purge", "[Database][C]")
+{
+    C4Error err;
+    C4Slice doc1ID = C4STR("doc001");
+    C4Slice doc2ID = C4STR("doc002");
+    vector<string> atts;
+    C4BlobKey key1, key2;
+    {
+        TransactionHelper t(db);
+        atts.emplace_back("This is the first attachment");
+        key1 = addDocWithAttachments(doc1ID, atts, "text/plain")[0];
+        atts.clear();
+        atts.emplace_back("This is the second attachment");
+        key2 = addDocWithAttachments(doc2ID, atts, "text/plain")[0];
+    }
+
+    // The first compaction builds the blob index; it has to persist across reopening:
+    C4BlobStore* store = c4db_getBlobStore(db, &err);
+    REQUIRE(c4db_compact(db, &err));
+    reopenDB();
+    store = c4db_getBlobStore(db, &err);
+    REQUIRE(store);
+    REQUIRE(c4db_compact(db, &err));
+    CHECK(c4blob_getSize(store, key1) > 0);
+    CHECK(c4blob_getSize(store, key2) > 0);
+
+    // Purging a doc removes its references:
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4db_purgeDoc(db, doc1ID, &err));
+    }
+    REQUIRE(c4db_compact(db, &err));
+    CHECK(c4blob_getSize(store, key1) == -1);
+    CHECK(c4blob_getSize(store, key2) > 0);
+}
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Compact With Stale Blob Index", "[Database][C]")
+{
+    C4Error err;
+    C4Slice doc1ID = C4STR("doc001");
+    C4Slice doc2ID = C4STR("doc002");
+    vector<string> atts;
+    C4BlobKey key1, key2;
+    {
+        TransactionHelper t(db);
+        atts.emplace_back("This is the first attachment");
+        key1 = addDocWithAttachments(doc1ID, atts, "text/plain")[0];
+    }
+    C4BlobStore* store = c4db_getBlobStore(db, &err);
+    REQUIRE(store);
+    CHECK(!c4db_isBlobIndexValid(db, &err));         // not built yet
+    CHECK(err.code == 0);
+    REQUIRE(c4db_compact(db, &err));
+    CHECK(c4db_isBlobIndexValid(db, &err));
+
+    // Simulate a doc saved without updating the index, as by an older version of LiteCore:
+    {
+        TransactionHelper t(db);
+        atts.clear();
+        atts.emplace_back("This is the second attachment");
+        key2 = addDocWithAttachments(doc2ID, atts, "text/plain")[0];
+    }
+    REQUIRE(c4raw_put(db, C4STR("blobRefs"), doc2ID, kC4SliceNull, kC4SliceNull, &err));
+    REQUIRE(c4raw_put(db, C4STR("blobCounts"), {key2.bytes, sizeof(key2.bytes)},
+                      kC4SliceNull, kC4SliceNull, &err));
+    CHECK(!c4db_isBlobIndexValid(db, &err));
+    CHECK(err.code == 0);
+
+    // Compaction re-indexes the docs saved since it last ran, so it keeps the blob:
+    REQUIRE(c4db_compact(db, &err));
+    CHECK(c4blob_getSize(store, key1) > 0);
+    CHECK(c4blob_getSize(store, key2) > 0);
+    CHECK(c4db_isBlobIndexValid(db, &err));
+
+    // An explicit rebuild fixes an index that's wrong about older docs too:
+    REQUIRE(c4raw_put(db, C4STR("blobRefs"), doc1ID, kC4SliceNull, kC4SliceNull, &err));
+    CHECK(!c4db_isBlobIndexValid(db, &err));
+    REQUIRE(c4db_rebuildBlobIndex(db, &err));
+    CHECK(c4db_isBlobIndexValid(db, &err));
+    REQUIRE(c4db_compact(db, &err));
+    CHECK(c4blob_getSize(store, key1) > 0);
+    CHECK(c4blob_getSize(store, key2) > 0);
+}
+
 N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database copy", "[Database][C]") {
     C4Slice doc1ID = C4STR("doc001");
     C4Slice doc2ID = C4STR("doc002");
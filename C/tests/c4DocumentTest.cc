@@ -107,6 +107,115 @@ N_WAY_TEST_CASE_METHOD(C4Test, "Document PossibleAncestors", "[Document][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4Test, "Document GetWithContent", "[Document][C]") {
+    if (!isRevTrees()) return;
+
+    createRev(kDocID, kRevID, kBody);
+    createRev(kDocID, kRev2ID, kBody);
+    createRev(kDocID, kRev3ID, kBody);
+
+    // Metadata only; the revisions get loaded on demand:
+    C4Error error;
+    C4Document *doc = c4doc_getWithContent(db, kDocID, true, kDocGetMetadata, &error);
+    REQUIRE(doc);
+    CHECK(doc->revID == kRev3ID);
+    CHECK(doc->flags == kDocExists);
+    CHECK(doc->sequence == 3);
+    CHECK(c4doc_selectRevision(doc, kRevID, false, &error));
+    CHECK(c4doc_selectRevision(doc, kRev3ID, true, &error));
+    CHECK(doc->selectedRev.body == kBody);
+    c4doc_free(doc);
+
+    // Revision tree without bodies:
+    doc = c4doc_getWithContent(db, kDocID, true, kDocGetRevTree, &error);
+    REQUIRE(doc);
+    CHECK(doc->revID == kRev3ID);
+    CHECK(doc->selectedRev.revID == kRev3ID);
+    CHECK(doc->selectedRev.body == kC4SliceNull);
+    CHECK(c4doc_selectRevision(doc, kRev2ID, false, &error));
+    CHECK(!c4doc_selectRevision(doc, C4STR("2-f00f00"), false, &error));
+    C4Slice newRevID = C4STR("3-f00f00");
+    REQUIRE(c4doc_selectFirstPossibleAncestorOf(doc, newRevID));
+    CHECK(doc->selectedRev.revID == kRev2ID);
+
+    // It can't be saved, since that would lose the bodies:
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4doc_setRemoteAncestor(doc, 1, &error));
+        c4log_warnOnErrors(false);
+        CHECK(!c4doc_save(doc, 0, &error));
+        CHECK(error.code == kC4ErrorUnsupported);
+        c4log_warnOnErrors(true);
+    }
+
+    // Loading a body reads the whole document:
+    CHECK(c4doc_selectRevision(doc, kRev3ID, false, &error));
+    CHECK(c4doc_loadRevisionBody(doc, &error));
+    CHECK(doc->selectedRev.revID == kRev3ID);
+    CHECK(doc->selectedRev.body == kBody);
+    c4doc_free(doc);
+
+    // Missing doc:
+    for (C4DocContentLevel content : {kDocGetMetadata, kDocGetRevTree, kDocGetAll}) {
+        CHECK(!c4doc_getWithContent(db, C4STR("nonexistent"), true, content, &error));
+        CHECK(error.domain == LiteCoreDomain);
+        CHECK(error.code == kC4ErrorNotFound);
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4Test, "Document FindDocAncestors", "[Document][C]") {
+    if (!isRevTrees()) return;
+
+    createRev(kDocID, kRevID, kBody);
+    createRev(kDocID, kRev2ID, kBody);
+    createRev(kDocID, kRev3ID, kBody);
+    createRev(C4STR("other"), kRevID, kBody);
+
+    C4String docIDs[5] = {kDocID, C4STR("nonexistent"), kDocID, C4STR("other"), kDocID};
+    C4String revIDs[5] = {kRev2ID, kRevID, C4STR("3-f00f00"), C4STR("2-f00f00"), kRev3ID};
+    C4RevAncestors results[5];
+    C4Error error;
+    REQUIRE(c4db_findDocAncestors(db, 5, docIDs, revIDs, 10, 1, results, &error));
+
+    CHECK(results[0].revExists);
+    CHECK(!results[0].isRemoteRev);
+    CHECK(results[0].ancestors.buf == nullptr);
+
+    CHECK(!results[1].revExists);
+    CHECK(results[1].ancestors.buf == nullptr);
+
+    CHECK(!results[2].revExists);
+    CHECK(toString((C4Slice)results[2].ancestors) == "[\"2-c001d00d\",\"1-abcd\"]");
+
+    CHECK(!results[3].revExists);
+    CHECK(toString((C4Slice)results[3].ancestors) == "[\"1-abcd\"]");
+
+    CHECK(results[4].revExists);
+
+    for (auto &result : results)
+        c4slice_free(result.ancestors);
+
+    // Mark the current revision as the remote's, then look it up again:
+    {
+        TransactionHelper t(db);
+        C4Document *doc = c4doc_get(db, kDocID, true, &error);
+        REQUIRE(doc);
+        REQUIRE(c4doc_setRemoteAncestor(doc, 1, &error));
+        REQUIRE(c4doc_save(doc, 0, &error));
+        c4doc_free(doc);
+    }
+    REQUIRE(c4db_findDocAncestors(db, 1, &docIDs[4], &revIDs[4], 10, 1, results, &error));
+    CHECK(results[0].revExists);
+    CHECK(results[0].isRemoteRev);
+
+    // Limit the number of ancestors:
+    REQUIRE(c4db_findDocAncestors(db, 1, &docIDs[2], &revIDs[2], 1, 0, results, &error));
+    CHECK(toString((C4Slice)results[0].ancestors) == "[\"2-c001d00d\"]");
+    c4slice_free(results[0].ancestors);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4Test, "Document CreateVersionedDoc", "[Database][C]") {
     // Try reading doc with mustExist=true, which should fail:
     C4Error error;
@@ -493,6 +602,45 @@ N_WAY_TEST_CASE_METHOD(C4Test, "Document Put", "[Database][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4Test, "Document PutDocuments", "[Database][C]") {
+    createRev(kDocID, kRevID, kBody);
+    C4SequenceNumber lastSeq = c4db_getLastSequence(db);
+
+    C4String docIDs[4] = {C4STR("a"), C4STR("b"), kDocID, C4STR("c")};
+    C4DocPutRequest requests[4] = {};
+    for (int i = 0; i < 4; ++i) {
+        requests[i].docID = docIDs[i];
+        requests[i].body = kBody;
+    }
+    C4Error errors[4];
+    {
+        TransactionHelper t(db);
+        // The 3rd request conflicts with the existing doc, but the others still get saved:
+        CHECK(c4db_putDocuments(db, requests, 4, errors) == 3);
+    }
+    CHECK(errors[0].code == 0);
+    CHECK(errors[1].code == 0);
+    CHECK(errors[2].domain == LiteCoreDomain);
+    CHECK(errors[2].code == kC4ErrorConflict);
+    CHECK(errors[3].code == 0);
+    CHECK(c4db_getLastSequence(db) == lastSeq + 3);
+    CHECK(c4db_getDocumentCount(db) == 4);
+
+    C4Error error;
+    C4Document *doc = c4doc_get(db, C4STR("c"), true, &error);
+    REQUIRE(doc);
+    CHECK(doc->sequence == lastSeq + 3);
+    CHECK(doc->selectedRev.body == kBody);
+    c4doc_free(doc);
+
+    // Not in a transaction:
+    c4log_warnOnErrors(false);
+    CHECK(c4db_putDocuments(db, requests, 1, errors) == 0);
+    CHECK(errors[0].code == kC4ErrorNotInTransaction);
+    c4log_warnOnErrors(true);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4Test, "Document Update", "[Database][C]") {
     C4Log("Begin test");
     C4Error error;
@@ -152,6 +152,104 @@ public:
         }
         b.printReport(1, "doc");
     }
+
+
+    // Size of the database's SQLite file, after compacting it
+    off_t compactedDBSize() {
+        C4Error error;
+        REQUIRE(c4db_compact(db, &error));
+        alloc_slice path(c4db_getPath(db));
+        std::string dbFile = path.asString() + "db.sqlite3";
+        struct stat st;
+        REQUIRE(stat(dbFile.c_str(), &st) == 0);
+        return st.st_size;
+    }
+
+
+    // Creates a full-text index of the given type on the names dataset's street addresses,
+    // reporting how long that takes, how big it is, and how fast it is to query.
+    void benchmarkFTS(C4IndexType type, const char *typeName, off_t baseSize) {
+        C4Error error;
+        Stopwatch st;
+        REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"),
+                                 type, nullptr, &error));
+        st.printReport((std::string("Creating ") + typeName + " index").c_str(), 1, "index");
+        std::cerr << typeName << " index size: "
+                  << (compactedDBSize() - baseSize) / 1024 << " KB\n";
+
+        const char* const kQueries[] = {
+            "[\"SELECT\", {\"WHAT\": [[\"._id\"]],"
+                          " \"WHERE\": [\"MATCH\", \"byStreet\", \"Kansas\"]}]",
+            "[\"SELECT\", {\"WHAT\": [[\"._id\"]],"
+                          " \"WHERE\": [\"MATCH\", \"byStreet\", \"Kansas Cir\"],"
+                          " \"ORDER_BY\": [[\"DESC\", [\"rank()\", \"byStreet\"]]]}]",
+        };
+        for (auto queryStr : kQueries) {
+            Benchmark b;
+            unsigned n = 0;
+            for (int i = 0; i < 100; ++i) {
+                b.start();
+                n = queryWhere(queryStr);
+                b.stop();
+            }
+            CHECK(n > 0);
+            std::cerr << typeName << " query returning " << n << " docs: ";
+            b.printReport(1, "query");
+        }
+
+        REQUIRE(c4db_deleteIndex(db, C4STR("byStreet"), &error));
+    }
+
+
+    // Creates docs whose "name" property is a random string of mostly non-ASCII syllables.
+    void createRandomNames(unsigned numDocs) {
+        static const char* const kSyllables[] = {
+            "ba", "Bé", "ci", "Dö", "é", "fa", "Gü", "ho", "Ñi", "ja", "Ka", "lø", "Ma",
+            "ne", "ô", "pa", "Qu", "rå", "Sé", "ta", "ü", "Va", "wi", "xa", "Yo", "ză"};
+        const unsigned kNumSyllables = sizeof(kSyllables) / sizeof(kSyllables[0]);
+        TransactionHelper t(db);
+        Encoder enc(c4db_createFleeceEncoder(db));
+        for (unsigned i = 0; i < numDocs; ++i) {
+            std::string name;
+            for (unsigned n = 3 + arc4random() % 3; n > 0; --n)
+                name += kSyllables[arc4random() % kNumSyllables];
+            enc.beginDict();
+            enc.writeKey(FLSTR("name"));
+            enc.writeString(slice(name));
+            enc.endDict();
+            alloc_slice body = enc.finish();
+            enc.reset();
+
+            char docID[20];
+            sprintf(docID, "%07u", i + 1);
+            C4Error c4err;
+            C4DocPutRequest rq = {};
+            rq.docID = c4str(docID);
+            rq.body = (C4Slice)body;
+            rq.save = true;
+            C4Document *doc = c4doc_put(db, &rq, nullptr, &c4err);
+            REQUIRE(doc != nullptr);
+            c4doc_free(doc);
+        }
+    }
+
+
+    // Runs a query sorted by a Unicode collation a few times, reporting how long it takes.
+    void benchmarkCollatedSort(const char *what, unsigned expectedCount) {
+        static const char* const kQuery =
+            "[\"SELECT\", {\"WHAT\": [[\"._id\"]],"
+                         " \"ORDER_BY\": [[\"COLLATE\", {\"unicode\": true, \"case\": false},"
+                                                     " [\".name\"]]]}]";
+        Benchmark b;
+        for (int i = 0; i < 5; ++i) {
+            b.start();
+            unsigned n = queryWhere(kQuery);
+            b.stop();
+            CHECK(n == expectedCount);
+        }
+        std::cerr << "Sorting by collated name, " << what << ": ";
+        b.printReport(1, "query");
+    }
 };
 
 
@@ -162,6 +260,62 @@ N_WAY_TEST_CASE_METHOD(PerfTest, "Performance", "[Perf][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(PerfTest, "Put documents singly vs batched", "[Perf][C][.slow]") {
+    static constexpr size_t kNumDocs = 100000, kBatchSize = 1000;
+    Encoder enc(c4db_createFleeceEncoder(db));
+    enc.beginDict();
+    enc.writeKey("some"_sl);
+    enc.writeString("body"_sl);
+    enc.writeKey("size"_sl);
+    enc.writeInt(12345678);
+    enc.endDict();
+    FLError flErr;
+    alloc_slice body = enc.finish(&flErr);
+    REQUIRE(body.buf);
+
+    std::vector<std::string> docIDs;
+    std::vector<C4DocPutRequest> requests(kNumDocs);
+    for (size_t i = 0; i < kNumDocs; ++i) {
+        char docID[30];
+        sprintf(docID, "doc-%07zu", i);
+        docIDs.push_back(docID);
+    }
+
+    // One c4doc_put call per doc:
+    {
+        Stopwatch st;
+        TransactionHelper t(db);
+        for (size_t i = 0; i < kNumDocs; ++i) {
+            C4DocPutRequest rq = {};
+            rq.docID = c4str(docIDs[i].c_str());
+            rq.body = (C4Slice)body;
+            rq.save = true;
+            C4Error error;
+            C4Document *doc = c4doc_put(db, &rq, nullptr, &error);
+            REQUIRE(doc);
+            c4doc_free(doc);
+        }
+        st.printReport("c4doc_put", kNumDocs, "doc");
+    }
+
+    // c4db_putDocuments, in batches, into a second database:
+    deleteAndRecreateDB();
+    {
+        for (size_t i = 0; i < kNumDocs; ++i) {
+            requests[i] = {};
+            requests[i].docID = c4str(docIDs[i].c_str());
+            requests[i].body = (C4Slice)body;
+        }
+        Stopwatch st;
+        TransactionHelper t(db);
+        for (size_t i = 0; i < kNumDocs; i += kBatchSize)
+            REQUIRE(c4db_putDocuments(db, &requests[i], kBatchSize, nullptr) == kBatchSize);
+        st.printReport("c4db_putDocuments", kNumDocs, "doc");
+    }
+    CHECK(c4db_getDocumentCount(db) == kNumDocs);
+}
+
+
 N_WAY_TEST_CASE_METHOD(PerfTest, "Import names", "[Perf][C][.slow]") {
     // Download https://github.com/arangodb/example-datasets/raw/master/RandomUsers/names_300000.json
     // to C/tests/data/ before running this test.
@@ -191,6 +345,38 @@ N_WAY_TEST_CASE_METHOD(PerfTest, "Import names", "[Perf][C][.slow]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(PerfTest, "Full-text FTS4 vs FTS5", "[Perf][C][FTS][.slow]") {
+    // Download https://github.com/arangodb/example-datasets/raw/master/RandomUsers/names_300000.json
+    // to C/tests/data/ before running this test.
+    importJSONLines(sFixturesDir + "names_300000.json", 30.0, true);
+    off_t baseSize = compactedDBSize();
+    benchmarkFTS(kC4FullTextIndex, "FTS4", baseSize);
+    benchmarkFTS(kC4FTS5Index,     "FTS5", baseSize);
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Unicode sort keys vs collator", "[Perf][C][.slow]") {
+    const unsigned kNumDocs = 1000000;
+    createRandomNames(kNumDocs);
+    benchmarkCollatedSort("no index", kNumDocs);
+
+    const C4Slice kIndexExpr = C4STR("[[\"COLLATE\", {\"unicode\": true, \"case\": false},"
+                                      " [\".name\"]]]");
+    C4Error error;
+    Stopwatch st;
+    REQUIRE(c4db_createIndex(db, C4STR("byName"), kIndexExpr, kC4ValueIndex, nullptr, &error));
+    st.printReport("Creating collated index", 1, "index");
+    benchmarkCollatedSort("collated index", kNumDocs);
+
+    C4IndexOptions options = {};
+    options.unicodeSortKeys = true;
+    st.reset();
+    REQUIRE(c4db_createIndex(db, C4STR("byName"), kIndexExpr, kC4ValueIndex, &options, &error));
+    st.printReport("Creating sort-key index", 1, "index");
+    benchmarkCollatedSort("sort-key index", kNumDocs);
+}
+
+
 N_WAY_TEST_CASE_METHOD(PerfTest, "Import geoblocks", "[Perf][C][.slow]") {
     // Download https://github.com/arangodb/example-datasets/raw/master/IPRanges/geoblocks.json
     // to C/tests/data/ before running this test.
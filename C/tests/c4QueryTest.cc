@@ -127,6 +127,36 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query expression index", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query stats", "[Query][C]") {
+    compile(json5("['=', ['length()', ['.name.first']], 9]"));
+    c4query_resetStats(query);
+    CHECK(run() == (vector<string>{ "0000015", "0000099" }));
+    CHECK(run() == (vector<string>{ "0000015", "0000099" }));
+
+    C4QueryStats stats;
+    c4query_getStats(query, &stats);
+    CHECK(stats.runCount == 2);
+    CHECK(stats.rowsReturned == 4);
+    CHECK(stats.maxTime > 0.0);
+    CHECK(stats.totalTime >= stats.maxTime);
+    CHECK(stats.vmSteps > 0);
+    CHECK(stats.fullScanSteps > 0);         // There's no index, so every doc is scanned
+
+    // With an index, there's no full scan:
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("length"), c4str(json5("[['length()', ['.name.first']]]").c_str()), kC4ValueIndex, nullptr, &err));
+    compile(json5("['=', ['length()', ['.name.first']], 9]"));
+    c4query_resetStats(query);
+    c4query_setSlowQueryThreshold(1e-9);    // Logs every run
+    CHECK(run() == (vector<string>{ "0000015", "0000099" }));
+    c4query_setSlowQueryThreshold(0);
+    c4query_getStats(query, &stats);
+    CHECK(stats.runCount == 1);
+    CHECK(stats.rowsReturned == 2);
+    CHECK(stats.fullScanSteps == 0);
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "Delete indexed doc", "[Query][C]") {
     // Create the same index as the above test:
     C4Error err;
@@ -202,6 +232,75 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "Full-text query", "[Query][C][FTS]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "Lazy full-text index", "[Query][C][FTS]") {
+    C4Error err;
+    C4IndexOptions options = {};
+    options.lazy = true;
+    REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, &options, &err));
+    compile(json5("['MATCH', 'byStreet', 'Hwy']"));
+    CHECK(run() == (vector<string>{"0000013", "0000015", "0000043", "0000044", "0000052"}));
+
+    // Changes since the last query are indexed before the next one runs:
+    createFleeceRev(db, C4STR("0000013"), kRev2ID, C4STR("{\"contact\":{\"address\":{\"street\":\"1 Main St\"}}}"));
+    createFleeceRev(db, C4STR("lazy"), kRevID, C4STR("{\"contact\":{\"address\":{\"street\":\"9 Lazy Hwy\"}}}"));
+    CHECK(run() == (vector<string>{"0000015", "0000043", "0000044", "0000052", "lazy"}));
+
+    // Or they can be indexed ahead of time:
+    createFleeceRev(db, C4STR("0000015"), kRev2ID, C4STR("{\"contact\":{\"address\":{\"street\":\"2 Main St\"}}}"));
+    REQUIRE(c4db_updateLazyIndexes(db, &err));
+    CHECK(run() == (vector<string>{"0000043", "0000044", "0000052", "lazy"}));
+
+    // Recreating the index without the `lazy` option keeps it, but updates it immediately:
+    options.lazy = false;
+    REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, &options, &err));
+    compile(json5("['MATCH', 'byStreet', 'Hwy']"));
+    createFleeceRev(db, C4STR("0000043"), kRev2ID, C4STR("{\"contact\":{\"address\":{\"street\":\"3 Main St\"}}}"));
+    CHECK(run() == (vector<string>{"0000044", "0000052", "lazy"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "FTS5 full-text query", "[Query][C][FTS]") {
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FTS5Index, nullptr, &err));
+    compile(json5("['MATCH', 'byStreet', 'Hwy']"));
+    auto results = runFTS();
+    CHECK(results == (vector<vector<C4FullTextMatch>>{
+        {{13, 0, 0, 10, 3}},
+        {{15, 0, 0, 11, 3}},
+        {{43, 0, 0, 12, 3}},
+        {{44, 0, 0, 12, 3}},
+        {{52, 0, 0, 11, 3}}
+    }));
+
+    C4SliceResult matched = c4query_fullTextMatched(query, &results[0][0], &err);
+    REQUIRE(matched.buf != nullptr);
+    CHECK(toString((C4Slice)matched) == "7 Wyoming Hwy");
+    c4slice_free(matched);
+
+    // Updates and inserts are indexed:
+    createFleeceRev(db, C4STR("0000013"), kRev2ID, C4STR("{\"contact\":{\"address\":{\"street\":\"1 Main St\"}}}"));
+    createFleeceRev(db, C4STR("fts5"), kRevID, C4STR("{\"contact\":{\"address\":{\"street\":\"9 Hwy Hwy\"}}}"));
+    CHECK(run() == (vector<string>{"0000015", "0000043", "0000044", "0000052", "fts5"}));
+
+    // rank() uses BM25, so the doc with two matches comes first:
+    compileSelect(json5("{WHAT: ['._id'], WHERE: ['MATCH', 'byStreet', 'Hwy'],"
+                        " ORDER_BY: [['DESC', ['rank()', 'byStreet']]]}"));
+    auto ranked = run();
+    REQUIRE(ranked.size() == 5);
+    CHECK(ranked[0] == "fts5");
+
+    // FTS5 indexes can't be lazy:
+    C4IndexOptions options = {};
+    options.lazy = true;
+    {
+        ExpectingExceptions x;
+        CHECK(!c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FTS5Index, &options, &err));
+    }
+    CHECK(err.domain == LiteCoreDomain);
+    CHECK(err.code == kC4ErrorInvalidParameter);
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "Full-text multiple properties", "[Query][C][FTS]") {
     C4Error err;
     REQUIRE(c4db_createIndex(db, C4STR("byAddress"),
@@ -470,6 +569,31 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query UNNEST", "[Query][C]") {
     }
 }
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query UNNEST with lazy index", "[Query][C]") {
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("likes"), C4STR("[[\".likes\"]]"), kC4ArrayIndex, nullptr, &err));
+    compileSelect(json5("{WHAT: ['.person._id'],\
+                          FROM: [{as: 'person'}, \
+                                 {as: 'like', unnest: ['.person.likes']}],\
+                         WHERE: ['=', ['.like'], 'climbing'],\
+                      ORDER_BY: [['.person._id']]}"));
+    CHECK(run() == (vector<string>{ "0000017", "0000021", "0000023", "0000045", "0000060" }));
+
+    // Making the index lazy doesn't require recompiling the query; changes since the last run
+    // are indexed before the next one:
+    C4IndexOptions options = {};
+    options.lazy = true;
+    REQUIRE(c4db_createIndex(db, C4STR("likes"), C4STR("[[\".likes\"]]"), kC4ArrayIndex, &options, &err));
+    createFleeceRev(db, C4STR("0000017"), kRev2ID, C4STR("{\"likes\":[\"reading\"]}"));
+    createFleeceRev(db, C4STR("lazy"), kRevID, C4STR("{\"likes\":[\"chess\",\"climbing\"]}"));
+    CHECK(run() == (vector<string>{ "0000021", "0000023", "0000045", "0000060", "lazy" }));
+
+    // Or they can be indexed ahead of time:
+    createFleeceRev(db, C4STR("0000021"), kRev2ID, C4STR("{\"likes\":[]}"));
+    REQUIRE(c4db_updateLazyIndexes(db, &err));
+    CHECK(run() == (vector<string>{ "0000023", "0000045", "0000060", "lazy" }));
+}
+
 N_WAY_TEST_CASE_METHOD(NestedQueryTest, "DB Query UNNEST objects", "[Query][C]") {
     for (int withIndex = 0; withIndex <= 1; ++withIndex) {
         if (withIndex) {
@@ -687,3 +811,41 @@ N_WAY_TEST_CASE_METHOD(CollatedQueryTest, "DB Query aggregate collated", "[Query
     CHECK(artists[2083] == "Zoë Keating");
     CHECK(artists[2084] == "Zola Jesus");
 }
+
+
+N_WAY_TEST_CASE_METHOD(CollatedQueryTest, "DB Query collated with sort-key index", "[Query][C]") {
+    auto queryJSON = json5("{WHAT: [ ['.Artist'] ], \
+                      ORDER_BY: [ ['COLLATE', {'unicode': true}, ['.Artist']], ['.Name'] ]}");
+    compileSelect(queryJSON);
+    vector<string> expected = run();
+    CHECK(expected.size() > 12000);
+
+    C4Error error;
+    C4IndexOptions options = {};
+    options.unicodeSortKeys = true;
+    REQUIRE(c4db_createIndex(db, C4STR("byArtist"),
+                             C4STR("[[\"COLLATE\", {\"unicode\": true}, [\".Artist\"]]]"),
+                             kC4ValueIndex, &options, &error));
+    compileSelect(queryJSON);
+#ifndef __APPLE__
+    // (Apple's collator can't generate sort keys, so there the index uses the collator.)
+    C4SliceResult explanation = c4query_explain(query);
+    string explanationString = toString((C4Slice)explanation);
+    c4slice_free(explanation);
+    CHECK(explanationString.find("collation_key(") != string::npos);
+#endif
+    CHECK(run() == expected);
+
+    // The collator version recorded with the index still matches after reopening:
+    c4query_free(query);
+    query = nullptr;
+    reopenDB();
+    compileSelect(queryJSON);
+#ifndef __APPLE__
+    explanation = c4query_explain(query);
+    explanationString = toString((C4Slice)explanation);
+    c4slice_free(explanation);
+    CHECK(explanationString.find("collation_key(") != string::npos);
+#endif
+    CHECK(run() == expected);
+}
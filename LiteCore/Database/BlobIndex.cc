@@ -0,0 +1,319 @@
+//
+// BlobIndex.cc
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "BlobIndex.hh"
+#include "Database.hh"
+#include "Document.hh"
+#include "c4Document+Fleece.h"
+#include "DataFile.hh"
+#include "Record.hh"
+#include "RecordEnumerator.hh"
+#include "Logging.hh"
+#include "FleeceImpl.hh"
+#include <algorithm>
+#include <unordered_map>
+
+namespace c4Internal {
+    using namespace litecore;
+    using namespace fleece;
+    using namespace fleece::impl;
+
+    static const string kRefsStoreName = "blobRefs";
+    static const string kCountsStoreName = "blobCounts";
+    static const slice kBuiltKey = "blobIndexBuilt"_sl;         // Value is kFormatVersion
+    static const slice kSequenceKey = "blobIndexSequence"_sl;   // Docs up to here are indexed
+
+    // Increment this to make existing indexes be rebuilt, if what gets indexed changes:
+    static constexpr uint64_t kFormatVersion = 2;
+
+    static constexpr size_t kKeySize = sizeof(blobKey::bytes);
+
+
+    // Sorts the keys and removes duplicates, then concatenates them into the form they're
+    // stored in the "blobRefs" KeyStore.
+    static alloc_slice encodeRefs(vector<blobKey> &keys) {
+        auto less = [](const blobKey &a, const blobKey &b) {
+            return memcmp(a.bytes, b.bytes, kKeySize) < 0;
+        };
+        sort(keys.begin(), keys.end(), less);
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+        alloc_slice refs(keys.size() * kKeySize);
+        for (size_t i = 0; i < keys.size(); ++i)
+            memcpy((uint8_t*)refs.buf + i * kKeySize, keys[i].bytes, kKeySize);
+        return refs;
+    }
+
+
+    void BlobIndex::findBlobs(const Dict *body, vector<blobKey> &keys) {
+        Document::findBlobReferences(body, [&](const Dict *blob) {
+            blobKey key;
+            if (Document::getBlobKey(blob, key))
+                keys.push_back(key);
+            return true;
+        });
+
+        // Now look for old-style _attachments:
+        auto attachments = body->get(slice(kC4LegacyAttachmentsProperty));
+        if (attachments) {
+            blobKey key;
+            for (Dict::iterator i(attachments->asDict()); i; ++i) {
+                auto att = i.value()->asDict();
+                if (att && Document::getBlobKey(att, key))
+                    keys.push_back(key);
+            }
+        }
+    }
+
+
+    KeyStore& BlobIndex::refsStore() {
+        return _db->dataFile()->getKeyStore(kRefsStoreName, KeyStore::Capabilities::defaults);
+    }
+
+    KeyStore& BlobIndex::countsStore() {
+        return _db->dataFile()->getKeyStore(kCountsStoreName, KeyStore::Capabilities::defaults);
+    }
+
+
+    void BlobIndex::documentSaved(slice docID, vector<blobKey> &blobs) {
+        update(docID, blobs, _db->transaction());
+    }
+
+
+    void BlobIndex::documentPurged(slice docID) {
+        vector<blobKey> none;
+        update(docID, none, _db->transaction());
+    }
+
+
+    void BlobIndex::update(slice docID, vector<blobKey> &blobs, Transaction &t) {
+        alloc_slice newRefs = encodeRefs(blobs);
+        KeyStore &refs = refsStore();
+        Record oldRec = refs.get(docID);
+        slice oldRefs = oldRec.body();
+        if (oldRefs == newRefs)
+            return;
+
+        // Both lists are sorted, so merge them to find the keys that were added or removed:
+        auto oldKey = (const uint8_t*)oldRefs.buf, oldEnd = oldKey + oldRefs.size;
+        auto newKey = (const uint8_t*)newRefs.buf, newEnd = newKey + newRefs.size;
+        while (oldKey < oldEnd || newKey < newEnd) {
+            int cmp;
+            if (oldKey >= oldEnd)
+                cmp = 1;
+            else if (newKey >= newEnd)
+                cmp = -1;
+            else
+                cmp = memcmp(oldKey, newKey, kKeySize);
+            if (cmp < 0) {
+                adjustCount(blobKey(slice(oldKey, kKeySize)), -1, t);
+                oldKey += kKeySize;
+            } else if (cmp > 0) {
+                adjustCount(blobKey(slice(newKey, kKeySize)), +1, t);
+                newKey += kKeySize;
+            } else {
+                oldKey += kKeySize;
+                newKey += kKeySize;
+            }
+        }
+
+        if (newRefs.size > 0)
+            refs.set(docID, newRefs, t);
+        else
+            refs.del(docID, t);
+    }
+
+
+    void BlobIndex::adjustCount(const blobKey &key, int delta, Transaction &t) {
+        KeyStore &counts = countsStore();
+        Record rec = counts.get(key);
+        uint64_t count = rec.bodyAsUInt();
+        if (delta < 0 && count <= (uint64_t)-delta) {
+            if (rec.exists())
+                counts.del(key, t);
+        } else {
+            rec.setBodyAsUInt(count + delta);
+            counts.write(rec, t);
+        }
+    }
+
+
+    bool BlobIndex::isBuilt() {
+        auto &info = _db->dataFile()->getKeyStore(DataFile::kInfoKeyStoreName);
+        return info.get(kBuiltKey).bodyAsUInt() == kFormatVersion;
+    }
+
+
+    sequence_t BlobIndex::indexedSequence() {
+        auto &info = _db->dataFile()->getKeyStore(DataFile::kInfoKeyStoreName);
+        return info.get(kSequenceKey).bodyAsUInt();
+    }
+
+
+    void BlobIndex::setIndexedSequence(sequence_t seq, Transaction &t) {
+        auto &info = _db->dataFile()->getKeyStore(DataFile::kInfoKeyStoreName);
+        Record rec(kSequenceKey);
+        rec.setBodyAsUInt(seq);
+        info.write(rec, t);
+    }
+
+
+    // Calls `fn` with the blobs referenced by all the stored revisions of each document
+    // with blobs that the enumerator returns.
+    void BlobIndex::scan(RecordEnumerator &e, function_ref<void(slice docID,
+                                                                vector<blobKey>&)> fn) {
+        vector<blobKey> blobs;
+        while (e.next()) {
+            unique_ptr<Document> doc(_db->documentFactory().newDocumentInstance(*e));
+            blobs.clear();
+            doc->selectCurrentRevision();
+            do {
+                if (doc->loadSelectedRevBody()) {
+                    Retained<Doc> fleeceDoc = doc->fleeceDoc();
+                    const Dict *body = fleeceDoc ? fleeceDoc->asDict() : nullptr;
+                    if (body)
+                        findBlobs(body, blobs);
+                }
+            } while (doc->selectNextRevision());
+            fn(doc->docID, blobs);
+        }
+    }
+
+
+    static RecordEnumerator::Options docsWithBlobs() {
+        RecordEnumerator::Options options;
+        options.onlyBlobs = true;
+        options.includeDeleted = true;      // a deleted doc may still have other revisions
+        return options;
+    }
+
+
+    void BlobIndex::rebuild() {
+        LogTo(DBLog, "Building blob index...");
+        DataFile &dataFile = *_db->dataFile();
+        auto &info = dataFile.getKeyStore(DataFile::kInfoKeyStoreName);
+        {
+            Transaction t(dataFile);
+            info.del(kBuiltKey, t);
+            t.commit();
+        }
+        refsStore().erase();
+        countsStore().erase();
+
+        Transaction t(dataFile);
+        KeyStore &refs = refsStore();
+        unordered_map<string, uint64_t> counts;
+        unsigned docCount = 0;
+
+        sequence_t lastSeq = _db->defaultKeyStore().lastSequence();
+        RecordEnumerator e(_db->defaultKeyStore(), docsWithBlobs());
+        scan(e, [&](slice docID, vector<blobKey> &blobs) {
+            alloc_slice docRefs = encodeRefs(blobs);
+            if (docRefs.size == 0)
+                return;
+            refs.set(docID, docRefs, t);
+            for (auto &key : blobs)
+                ++counts[string((const char*)key.bytes, kKeySize)];
+            ++docCount;
+        });
+
+        KeyStore &countsStore = this->countsStore();
+        for (auto &entry : counts) {
+            Record rec(slice(entry.first));
+            rec.setBodyAsUInt(entry.second);
+            countsStore.write(rec, t);
+        }
+
+        setIndexedSequence(lastSeq, t);
+        Record built(kBuiltKey);
+        built.setBodyAsUInt(kFormatVersion);
+        info.write(built, t);
+        t.commit();
+        LogTo(DBLog, "Built blob index: %u docs reference %zu blobs",
+              docCount, counts.size());
+    }
+
+
+    // Re-indexes the docs with blobs that have been saved since the index was last known to be
+    // complete. documentSaved() has already indexed most of them, but not any saved by a write
+    // path that bypasses it, such as an older version of LiteCore.
+    void BlobIndex::catchUp() {
+        sequence_t since = indexedSequence();
+        if (since >= _db->defaultKeyStore().lastSequence())
+            return;
+        Transaction t(*_db->dataFile());
+        sequence_t lastSeq = _db->defaultKeyStore().lastSequence();
+        unsigned docCount = 0;
+        RecordEnumerator e(_db->defaultKeyStore(), since, docsWithBlobs());
+        scan(e, [&](slice docID, vector<blobKey> &blobs) {
+            update(docID, blobs, t);
+            ++docCount;
+        });
+        setIndexedSequence(lastSeq, t);
+        t.commit();
+        LogVerbose(DBLog, "Blob index: checked %u docs saved since sequence %llu",
+                   docCount, (unsigned long long)since);
+    }
+
+
+    bool BlobIndex::isValid() {
+        if (!isBuilt())
+            return false;
+        unordered_map<string, alloc_slice> refs;
+        unordered_map<string, uint64_t> counts;
+        RecordEnumerator docs(_db->defaultKeyStore(), docsWithBlobs());
+        scan(docs, [&](slice docID, vector<blobKey> &blobs) {
+            alloc_slice docRefs = encodeRefs(blobs);
+            if (docRefs.size == 0)
+                return;
+            refs[string(docID)] = docRefs;
+            for (auto &key : blobs)
+                ++counts[string((const char*)key.bytes, kKeySize)];
+        });
+
+        size_t n = 0;
+        for (RecordEnumerator e(refsStore()); e.next(); ++n) {
+            auto i = refs.find(string(e->key()));
+            if (i == refs.end() || i->second != e->body())
+                return false;
+        }
+        if (n != refs.size())
+            return false;
+        n = 0;
+        for (RecordEnumerator e(countsStore()); e.next(); ++n) {
+            auto i = counts.find(string(e->key()));
+            if (i == counts.end() || i->second != e->bodyAsUInt())
+                return false;
+        }
+        return n == counts.size();
+    }
+
+
+    unordered_set<string> BlobIndex::referencedBlobs() {
+        if (isBuilt())
+            catchUp();
+        else
+            rebuild();
+        unordered_set<string> filenames;
+        for (RecordEnumerator e(countsStore()); e.next(); ) {
+            if (e->key().size == kKeySize)
+                filenames.insert(blobKey(e->key()).filename());
+        }
+        return filenames;
+    }
+
+}
@@ -0,0 +1,88 @@
+//
+// BlobIndex.hh
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "c4Internal.hh"
+#include "BlobStore.hh"
+#include "function_ref.hh"
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace fleece { namespace impl {
+    class Dict;
+} }
+namespace litecore {
+    class KeyStore;
+    class RecordEnumerator;
+    class Transaction;
+}
+
+namespace c4Internal {
+    class Database;
+
+
+    /** Persistent index of the blobs referenced by documents, which lets compaction find the
+        unused blobs without reading every revision of every document.
+        It's stored in two KeyStores, updated in the same transaction as the documents:
+        "blobRefs" maps a docID to the keys of the blobs referenced by any of its revisions, and
+        "blobCounts" maps a blob key to the number of documents that reference it.
+        The index of an existing database is built the first time it's needed. */
+    class BlobIndex {
+    public:
+        explicit BlobIndex(Database *db)            :_db(db) { }
+
+        /** Adds the keys of the blobs referenced by a revision body, including the ones in a
+            legacy `_attachments` property, to `keys`. */
+        static void findBlobs(const fleece::impl::Dict *body NONNULL, std::vector<blobKey> &keys);
+
+        /** Updates the index after a document is saved, given the blobs referenced by all of its
+            stored revisions (in any order, and possibly with duplicates.)
+            Must be called inside the database's transaction. */
+        void documentSaved(slice docID, std::vector<blobKey> &blobs);
+
+        /** Removes a purged document from the index. Must be called inside a transaction. */
+        void documentPurged(slice docID);
+
+        /** Returns the filenames of all the blobs that are referenced by documents, in the form
+            BlobStore::deleteAllExcept() wants. Builds the index first if it doesn't exist or is
+            in an older format; otherwise re-indexes the documents with blobs that have been
+            saved since the last call, in case anything saved them without updating the index. */
+        std::unordered_set<std::string> referencedBlobs();
+
+        /** Rebuilds the index from scratch, by scanning all documents that have blobs. */
+        void rebuild();
+
+        /** Scans all documents that have blobs, and returns true if the index matches them. */
+        bool isValid();
+
+    private:
+        bool isBuilt();
+        void catchUp();
+        sequence_t indexedSequence();
+        void setIndexedSequence(sequence_t, Transaction&);
+        void scan(RecordEnumerator&, function_ref<void(slice docID, std::vector<blobKey>&)>);
+        void update(slice docID, std::vector<blobKey> &blobs, Transaction&);
+        void adjustCount(const blobKey&, int delta, Transaction&);
+        KeyStore& refsStore();
+        KeyStore& countsStore();
+
+        Database* const _db;
+    };
+
+}
@@ -22,10 +22,12 @@
 #include "c4Document.h"
 #include "c4Document+Fleece.h"
 #include "DataFile.hh"
+#include "DocumentKeys.hh"
 #include "Record.hh"
 #include "SequenceTracker.hh"
 #include "FleeceImpl.hh"
 #include "BlobStore.hh"
+#include "BlobIndex.hh"
 #include "Upgrader.hh"
 #include "SecureRandomize.hh"
 #include "make_unique.h"
@@ -120,6 +122,13 @@ namespace c4Internal {
 #endif
         }
 
+        options.tuning.cacheSize = config.storageTuning.cacheSize;
+        options.tuning.mmapSize = config.storageTuning.mmapSize;
+        options.tuning.pageSize = config.storageTuning.pageSize;
+        options.tuning.journalSizeLimit = config.storageTuning.journalSizeLimit;
+        options.tuning.workerThreads = config.storageTuning.workerThreads;
+        options.tuning.checkpointPages = config.storageTuning.checkpointPages;
+
         switch (config.versioning) {
             case kC4RevisionTrees:
                 options.fleeceAccessor = TreeDocumentFactory::fleeceAccessor();
@@ -252,57 +261,20 @@ namespace c4Internal {
         return factory->deleteFile(path);
     }
 
-    unordered_set<string> Database::collectBlobs() {
-        RecordEnumerator::Options options;
-        options.onlyBlobs = true;
-        RecordEnumerator e(defaultKeyStore(), options);
-        unordered_set<string> usedDigests;
-        while (e.next()) {
-            auto doc = documentFactory().newDocumentInstance(*e);
-            doc->selectCurrentRevision();
-            do {
-                if(!doc->loadSelectedRevBody()) {
-                    continue;
-                }
-
-                Retained<Doc> fleeceDoc = doc->fleeceDoc();
-                const Dict* body = fleeceDoc->asDict();
-
-                // Iterate over blobs:
-                Document::findBlobReferences(body, [&](const Dict *blob) {
-                    blobKey key;
-                    if (Document::dictIsBlob(blob, key))    // get the key
-                        usedDigests.insert(key.filename());
-                    return true;
-                });
+    void Database::compact() {
+        mustNotBeInTransaction();
+        dataFile()->compact();
+        blobStore()->deleteAllExcept(blobIndex().referencedBlobs());
+    }
 
-                // Now look for old-style _attachments:
-                auto attachments = body->get(slice(kC4LegacyAttachmentsProperty));
-                if (attachments) {
-                    blobKey key;
-                    for (Dict::iterator i(attachments->asDict()); i; ++i) {
-                        auto att = i.value()->asDict();
-                        if (att) {
-                            const Value* digest = att->get("digest"_sl);
-                            if (digest && key.readFromBase64(digest->asString())) {
-                                usedDigests.insert(key.filename());
-                            }
-                        }
-                    }
-                }
-            } while(doc->selectNextRevision());
-            
-            delete doc;
-        }
-        
-        return usedDigests;
+    void Database::rebuildBlobIndex() {
+        mustNotBeInTransaction();
+        blobIndex().rebuild();
     }
 
-    void Database::compact() {
+    bool Database::isBlobIndexValid() {
         mustNotBeInTransaction();
-        dataFile()->compact();
-        unordered_set<string> digestsInUse = collectBlobs();
-        blobStore()->deleteAllExcept(digestsInUse);
+        return blobIndex().isValid();
     }
 
 
@@ -386,6 +358,13 @@ namespace c4Internal {
     }
 
 
+    BlobIndex& Database::blobIndex() {
+        if (!_blobIndex)
+            _blobIndex.reset(new BlobIndex(this));
+        return *_blobIndex;
+    }
+
+
     unique_ptr<BlobStore> Database::createBlobStore(const string &dirname,
                                                     C4EncryptionKey encryptionKey)
     {
@@ -548,7 +527,10 @@ namespace c4Internal {
 
     
     bool Database::purgeDocument(slice docID) {
-        return defaultKeyStore().del(docID, transaction());
+        if (!defaultKeyStore().del(docID, transaction()))
+            return false;
+        blobIndex().documentPurged(docID);
+        return true;
     }
 
 
@@ -573,6 +555,47 @@ namespace c4Internal {
     }
 
 
+    alloc_slice Database::encodeWithPersistedKeys(slice fleeceData) {
+        auto keys = static_cast<DocumentKeys*>(documentKeys());
+        alloc_slice state = keys ? keys->persistedState() : alloc_slice();
+        if (!state)
+            return {};
+
+        // SharedKeys aren't thread-safe, so each caller borrows its own copy:
+        Retained<SharedKeys> copy;
+        {
+            lock_guard<mutex> lock(_keysCopiesMutex);
+            if (state != _keysCopiesState) {
+                _keysCopiesState = state;
+                _spareKeysCopies.clear();
+            } else if (!_spareKeysCopies.empty()) {
+                copy = _spareKeysCopies.back();
+                _spareKeysCopies.pop_back();
+            }
+        }
+        if (!copy) {
+            copy = new SharedKeys();
+            copy->loadFrom(state);
+        }
+
+        auto count = copy->count();
+        Encoder enc;
+        enc.setSharedKeys(copy);
+        enc.writeValue(Value::fromTrustedData(fleeceData));
+        alloc_slice result = enc.finish();
+        if (copy->count() != count) {
+            // Encoding added keys that the database doesn't have, so the result is unusable,
+            // and so is this copy of the keys:
+            return {};
+        }
+
+        lock_guard<mutex> lock(_keysCopiesMutex);
+        if (state == _keysCopiesState)
+            _spareKeysCopies.push_back(copy);
+        return result;
+    }
+
+
 #if DEBUG
     // Validate that all dictionary keys in this value behave correctly, i.e. the keys found
     // through iteration also work for element lookup. (This tests the fix for issue #156.)
@@ -621,8 +644,13 @@ namespace c4Internal {
 
     void Database::saved(Document* doc) {
         if (_sequenceTracker) {
-            lock_guard<mutex> lock(_sequenceTracker->mutex());
             Assert(doc->selectedRev.sequence == doc->sequence); // The new revision must be selected
+            if (_batchingSaves) {
+                _savedBatch.push_back({doc->_docIDBuf, doc->_selectedRevIDBuf,
+                                       doc->selectedRev.sequence, doc->selectedRev.body.size});
+                return;
+            }
+            lock_guard<mutex> lock(_sequenceTracker->mutex());
             _sequenceTracker->documentChanged(doc->_docIDBuf,
                                               doc->_selectedRevIDBuf,
                                               doc->selectedRev.sequence,
@@ -630,4 +658,23 @@ namespace c4Internal {
         }
     }
 
+
+    void Database::beginSavingBatch() {
+        Assert(!_batchingSaves);
+        _batchingSaves = true;
+    }
+
+
+    void Database::endSavingBatch() {
+        Assert(_batchingSaves);
+        _batchingSaves = false;
+        if (_sequenceTracker && !_savedBatch.empty()) {
+            lock_guard<mutex> lock(_sequenceTracker->mutex());
+            for (auto &change : _savedBatch)
+                _sequenceTracker->documentChanged(change.docID, change.revID,
+                                                  change.sequence, change.bodySize);
+        }
+        _savedBatch.clear();
+    }
+
 }
@@ -27,6 +27,7 @@
 #include <memory>
 #include <mutex>
 #include <unordered_set>
+#include <vector>
 
 namespace fleece { namespace impl {
     class Encoder;
@@ -39,6 +40,7 @@ namespace litecore {
 
 
 namespace c4Internal {
+    class BlobIndex;
     class Document;
     class DocumentFactory;
 
@@ -72,6 +74,8 @@ namespace c4Internal {
         void rekey(const C4EncryptionKey *newKey);
 
         void compact();
+        void rebuildBlobIndex();
+        bool isBlobIndexValid();
 
         const C4DatabaseConfig config;
 
@@ -104,13 +108,35 @@ namespace c4Internal {
 
         fleece::impl::SharedKeys* documentKeys()                  {return _db->documentKeys();}
 
+        /** Re-encodes Fleece data that doesn't use SharedKeys (like a revision received from a
+            peer) so it can be stored in this database. Unlike sharedEncoder() this is
+            thread-safe and needs no transaction, because it uses a private copy of the keys
+            as last saved. Returns a null slice if the data has keys that aren't shared yet;
+            it then has to be re-encoded with sharedEncoder() inside a transaction. */
+        alloc_slice encodeWithPersistedKeys(slice fleeceData);
+
         SequenceTracker& sequenceTracker();
 
         BlobStore* blobStore();
 
+        /** Index of the blobs referenced by documents, kept up to date as they're saved. */
+        BlobIndex& blobIndex();
+
         void lockClientMutex()                              {_clientMutex.lock();}
         void unlockClientMutex()                            {_clientMutex.unlock();}
 
+        /** While one of these exists, saved() queues up document changes and then posts them
+            to the SequenceTracker all at once, instead of locking it once per document. */
+        class SavingBatch {
+        public:
+            explicit SavingBatch(Database *db)  :_db(db)    {_db->beginSavingBatch();}
+            ~SavingBatch()                                  {_db->endSavingBatch();}
+        private:
+            SavingBatch(const SavingBatch&) =delete;
+            SavingBatch& operator=(const SavingBatch&) =delete;
+            Database* const _db;
+        };
+
     public:
         // should be private, but called from Document
         void saved(Document* NONNULL);
@@ -133,8 +159,8 @@ namespace c4Internal {
         UUID generateUUID(slice key, Transaction&, bool overwrite =false);
 
         std::unique_ptr<BlobStore> createBlobStore(const std::string &dirname, C4EncryptionKey);
-        std::unordered_set<std::string> collectBlobs();
-        void removeUnusedBlobs(const std::unordered_set<std::string> &used);
+        void beginSavingBatch();
+        void endSavingBatch();
 
         unique_ptr<DataFile>        _db;                    // Underlying DataFile
         Transaction*                _transaction {nullptr}; // Current Transaction, or null
@@ -143,8 +169,21 @@ namespace c4Internal {
         unique_ptr<fleece::impl::Encoder> _encoder;
         unique_ptr<SequenceTracker> _sequenceTracker;       // Doc change tracker/notifier
         unique_ptr<BlobStore>       _blobStore;
+        unique_ptr<BlobIndex>       _blobIndex;
         uint32_t                    _maxRevTreeDepth {0};
         recursive_mutex             _clientMutex;
+
+        struct SavedChange {
+            alloc_slice docID, revID;
+            sequence_t sequence;
+            uint64_t bodySize;
+        };
+        std::vector<SavedChange>    _savedBatch;            // Changes queued by saved()
+        bool                        _batchingSaves {false}; // Inside beginSavingBatch()?
+
+        std::mutex                  _keysCopiesMutex;
+        alloc_slice                 _keysCopiesState;       // Persisted state of _spareKeysCopies
+        std::vector<Retained<fleece::impl::SharedKeys>> _spareKeysCopies;   // encodeWithPersistedKeys
     };
 
 
@@ -159,6 +198,7 @@ namespace c4Internal {
 
         virtual ~DocumentFactory() { }
         virtual Document* newDocumentInstance(C4Slice docID) =0;
+        virtual Document* newDocumentInstance(C4Slice docID, C4DocContentLevel) =0;
         virtual Document* newDocumentInstance(const Record&) =0;
         virtual alloc_slice revIDFromVersion(slice version) =0;
         virtual bool isFirstGenRevID(slice revID)               {return false;}
@@ -173,6 +213,7 @@ namespace c4Internal {
     public:
         TreeDocumentFactory(Database *db)   :DocumentFactory(db) { }
         Document* newDocumentInstance(C4Slice docID) override;
+        Document* newDocumentInstance(C4Slice docID, C4DocContentLevel) override;
         Document* newDocumentInstance(const Record&) override;
         alloc_slice revIDFromVersion(slice version) override;
         bool isFirstGenRevID(slice revID) override;
@@ -130,6 +130,16 @@ namespace c4Internal {
         virtual int32_t putExistingRevision(const C4DocPutRequest&) =0;
         virtual bool putNewRevision(const C4DocPutRequest&) =0;
 
+        // Batched saving of new docs, for c4db_putDocuments: after putting a revision into a doc
+        // that doesn't exist yet, without saving, insertRequest() returns the record to write
+        // with KeyStore::setMany(); if it's written, call inserted() with its new sequence.
+        virtual KeyStore::SetRequest insertRequest(unsigned maxRevTreeDepth, alloc_slice &body) {
+            error::_throw(error::UnsupportedOperation);
+        }
+        virtual void inserted(sequence_t) {
+            error::_throw(error::UnsupportedOperation);
+        }
+
         virtual void resolveConflict(C4String winningRevID,
                                      C4String losingRevID,
                                      C4Slice mergedBody,
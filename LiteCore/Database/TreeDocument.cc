@@ -21,6 +21,7 @@
 #include "c4Private.h"
 
 #include "Database.hh"
+#include "BlobIndex.hh"
 #include "Record.hh"
 #include "RawRevTree.hh"
 #include "VersionedDocument.hh"
@@ -28,6 +29,7 @@
 #include "SecureRandomize.hh"
 #include "SecureDigest.hh"
 #include "FleeceImpl.hh"
+#include "JSONEncoder.hh"
 #include "varint.hh"
 #include <ctime>
 #include <algorithm>
@@ -37,9 +39,9 @@ namespace c4Internal {
 
     class TreeDocument : public Document {
     public:
-        TreeDocument(Database* database, C4Slice docID)
+        TreeDocument(Database* database, C4Slice docID, bool withBodies =true)
         :Document(database),
-         _versionedDoc(database->defaultKeyStore(), docID),
+         _versionedDoc(database->defaultKeyStore(), docID, withBodies),
          _selectedRev(nullptr)
         {
             init();
@@ -59,6 +61,7 @@ namespace c4Internal {
         :Document(other)
         ,_versionedDoc(other._versionedDoc)
         ,_selectedRev(nullptr)
+        ,_hadBlobs(other._hadBlobs)
         {
             if (other._selectedRev)
                 _selectedRev = _versionedDoc[other._selectedRev->revID];
@@ -75,6 +78,7 @@ namespace c4Internal {
             flags = (C4DocumentFlags)_versionedDoc.flags();
             if (_versionedDoc.exists())
                 flags = (C4DocumentFlags)(flags | kDocExists);
+            _hadBlobs = _versionedDoc.hasAttachments();
 
             initRevID();
             selectCurrentRevision();
@@ -113,6 +117,12 @@ namespace c4Internal {
 
         bool loadSelectedRevBody() override {
             loadRevisions();
+            if (!_versionedDoc.bodiesAvailable() && _selectedRev) {
+                // The tree was read without bodies, so read it again and reselect the revision:
+                revidBuffer revID(_selectedRev->revID);
+                _versionedDoc.read();
+                selectRevision(_versionedDoc[revID]);
+            }
             return selectedRev.body.buf != nullptr;
         }
 
@@ -236,19 +246,58 @@ namespace c4Internal {
                 case litecore::VersionedDocument::kConflict:
                     return false;
                 case litecore::VersionedDocument::kNoNewSequence:
+                    updateBlobIndex();
                     return true;
                 case litecore::VersionedDocument::kNewSequence:
-                    selectedRev.flags &= ~kRevNew;
-                    if (_versionedDoc.sequence() > sequence) {
-                        sequence = _versionedDoc.sequence();
-                        if (selectedRev.sequence == 0)
-                            selectedRev.sequence = sequence;
-                        _db->saved(this);
-                    }
+                    savedNewSequence();
                     return true;
             }
         }
 
+        KeyStore::SetRequest insertRequest(unsigned maxRevTreeDepth, alloc_slice &body) override {
+            requireValidDocID();
+            if (maxRevTreeDepth == 0)
+                maxRevTreeDepth = _db->maxRevTreeDepth();
+            _versionedDoc.prune(maxRevTreeDepth);
+            return _versionedDoc.insertRequest(body);
+        }
+
+        void inserted(sequence_t seq) override {
+            _versionedDoc.inserted(seq);
+            savedNewSequence();
+        }
+
+        void savedNewSequence() {
+            updateBlobIndex();
+            selectedRev.flags &= ~kRevNew;
+            if (_versionedDoc.sequence() > sequence) {
+                sequence = _versionedDoc.sequence();
+                if (selectedRev.sequence == 0)
+                    selectedRev.sequence = sequence;
+                _db->saved(this);
+            }
+        }
+
+        // Tells the database's BlobIndex which blobs the stored revisions now reference.
+        // (Only docs that have, or had, revisions with blobs need to be looked at.)
+        void updateBlobIndex() {
+            bool hasBlobs = _versionedDoc.hasAttachments();
+            if (hasBlobs || _hadBlobs) {
+                vector<blobKey> blobs;
+                if (hasBlobs) {
+                    for (auto rev : _versionedDoc.allRevisions()) {
+                        slice body = rev->body();
+                        auto root = body.buf ? fleece::impl::Value::fromTrustedData(body)->asDict()
+                                             : nullptr;
+                        if (root)
+                            BlobIndex::findBlobs(root, blobs);
+                    }
+                }
+                _db->blobIndex().documentSaved(_versionedDoc.docID(), blobs);
+            }
+            _hadBlobs = hasBlobs;
+        }
+
         int32_t purgeRevision(C4Slice revID) override {
             int32_t total;
             if (revID.buf)
@@ -440,6 +489,7 @@ namespace c4Internal {
     private:
         VersionedDocument _versionedDoc;
         const Rev *_selectedRev;
+        bool _hadBlobs {false};             // Did the stored doc have revisions with blobs?
     };
 
 
@@ -450,6 +500,18 @@ namespace c4Internal {
         return new TreeDocument(database(), docID);
     }
 
+    Document* TreeDocumentFactory::newDocumentInstance(C4Slice docID, C4DocContentLevel content) {
+        switch (content) {
+            case kDocGetMetadata:
+                return new TreeDocument(database(),
+                                        database()->defaultKeyStore().get(docID, kMetaOnly));
+            case kDocGetRevTree:
+                return new TreeDocument(database(), docID, false);
+            default:
+                return new TreeDocument(database(), docID);
+        }
+    }
+
     Document* TreeDocumentFactory::newDocumentInstance(const Record &doc) {
         return new TreeDocument(database(), doc);
     }
@@ -491,6 +553,83 @@ bool c4doc_save(C4Document *doc,
 }
 
 
+// Looks up one revision for c4db_findDocAncestors.
+static void findAncestors(RevTree &tree, C4Slice revIDStr, unsigned maxAncestors,
+                          C4RemoteID remoteDBID, C4RevAncestors &result)
+{
+    revidBuffer revID;
+    bool validRevID = revID.tryParse(revIDStr);
+    const Rev *rev = validRevID ? tree[revID] : nullptr;
+    if (rev) {
+        result.revExists = true;
+        if (remoteDBID)
+            result.isRemoteRev = (tree.latestRevisionOnRemote(remoteDBID) == rev);
+        return;
+    }
+
+    // A possible ancestor is one with a lower generation number:
+    unsigned generation = validRevID ? revID.generation() : 0;
+    fleece::impl::JSONEncoder enc;
+    enc.beginArray();
+    unsigned count = 0;
+    for (const Rev *ancestor : tree.allRevisions()) {
+        if (count >= maxAncestors)
+            break;
+        if (ancestor->revID.generation() < generation) {
+            enc.writeString(ancestor->revID.expanded());
+            ++count;
+        }
+    }
+    enc.endArray();
+    result.ancestors = C4SliceResult(enc.finish());
+}
+
+
+bool c4db_findDocAncestors(C4Database *database,
+                           unsigned numRevs,
+                           const C4String docIDs[],
+                           const C4String revIDs[],
+                           unsigned maxAncestors,
+                           C4RemoteID remoteDBID,
+                           C4RevAncestors outResults[],
+                           C4Error *outError) noexcept
+{
+    if (!database->mustUseVersioning(kC4RevisionTrees, outError))
+        return false;
+    return tryCatch<bool>(outError, [&]{
+        vector<slice> keys(docIDs, docIDs + numRevs);
+        for (unsigned i = 0; i < numRevs; ++i)
+            outResults[i] = {};
+
+        // Records arrive in docID order, so walk through the requests sorted the same way:
+        vector<unsigned> order(numRevs);
+        for (unsigned i = 0; i < numRevs; ++i)
+            order[i] = i;
+        sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+            return keys[a] < keys[b];
+        });
+        auto next = order.begin();
+
+        database->defaultKeyStore().getManyBorrowed(keys, kDefaultContent,
+                                                    [&](const RecordLite &rec) {
+            while (next != order.end() && keys[*next] < rec.key)
+                ++next;
+            RevTree tree;
+            if (rec.body.buf) {
+                tree.decode(rec.body, rec.sequence);
+                // See VersionedDocument::decode:
+                if (rec.flags & DocumentFlags::kSynced)
+                    tree.setLatestRevisionOnRemote(RevTree::kDefaultRemoteID,
+                                                   tree.currentRevision());
+            }
+            for (; next != order.end() && keys[*next] == rec.key; ++next)
+                findAncestors(tree, revIDs[*next], maxAncestors, remoteDBID, outResults[*next]);
+        });
+        return true;
+    });
+}
+
+
 unsigned c4rev_getGeneration(C4Slice revID) noexcept {
     try {
         return revidBuffer(revID).generation();
@@ -25,4 +25,6 @@ namespace litecore {
 
     LogDomain QueryLog("Query");
 
+    std::atomic<double> Query::sSlowQueryThreshold {0.0};
+
 }
@@ -21,6 +21,7 @@
 #include "KeyStore.hh"
 #include "FleeceImpl.hh"
 #include "Error.hh"
+#include <atomic>
 
 namespace litecore {
     class QueryEnumerator;
@@ -48,8 +49,29 @@ namespace litecore {
 
         virtual std::string explain() =0;
 
+        /** Statistics about the runs of a query. */
+        struct Stats {
+            uint64_t runs;                  ///< Number of times it's been run
+            double   totalTime;             ///< Total time spent running it (secs)
+            double   maxTime;               ///< Longest run (secs)
+            uint64_t rowsReturned;          ///< Total number of rows returned
+            uint64_t vmSteps;               ///< Virtual-machine operations executed
+            uint64_t fullScanSteps;         ///< Steps taken through full table scans
+            uint64_t sorts;                 ///< Sort operations (not satisfied by an index)
+            uint64_t autoIndexRows;         ///< Rows inserted into temporary automatic indexes
+        };
+
+        virtual Stats stats() const =0;
+        virtual void resetStats() =0;
+
+        /** Runs that take at least this many seconds are logged as warnings, along with the
+            query plan from explain(). Zero (the default) disables this. Applies to all queries. */
+        static void setSlowQueryThreshold(double seconds)   {sSlowQueryThreshold = seconds;}
+        static double slowQueryThreshold()                  {return sSlowQueryThreshold;}
+
         struct Options {
             alloc_slice paramBindings;
+            bool streaming {false};     ///< Read rows directly from the live statement
         };
 
         virtual QueryEnumerator* createEnumerator(const Options* =nullptr) =0;
@@ -62,6 +84,8 @@ namespace litecore {
         virtual ~Query() =default;
 
     private:
+        static std::atomic<double> sSlowQueryThreshold;
+
         KeyStore &_keyStore;
     };
 
@@ -78,8 +102,8 @@ namespace litecore {
         virtual fleece::impl::Array::iterator columns() const noexcept =0;
         virtual uint64_t missingColumns() const noexcept =0;
         
-        /** Random access to rows. May not be supported by all implementations, but does work with
-            the current SQLite query implementation. */
+        /** Random access to rows. May not be supported by all implementations; it works with
+            the default SQLite query enumerator, but not with a streaming one. */
         virtual int64_t getRowCount() const         {return -1;}
         virtual void seek(uint64_t rowIndex)        {error::_throw(error::UnsupportedOperation);}
 
@@ -90,6 +114,18 @@ namespace litecore {
             that will return the new results. Otherwise returns null. */
         virtual QueryEnumerator* refresh() =0;
 
+        /** True if refreshWithChanges() can do better than refresh(). */
+        virtual bool canRefreshIncrementally() const            {return false;}
+
+        /** Like refresh(), but is also given the IDs of all documents changed since this
+            enumerator was created (or last refreshed), which are known to cover all changes
+            through sequence `changesThrough`. If none of those documents matched the query
+            before or after the change, the query doesn't need to be re-run. */
+        virtual QueryEnumerator* refreshWithChanges(const std::vector<alloc_slice> &changedDocIDs,
+                                                    sequence_t changesThrough) {
+            return refresh();
+        }
+
     protected:
         // The implementation of fullTextTerms() should populate this and return a reference:
         FullTextTerms _fullTextTerms;
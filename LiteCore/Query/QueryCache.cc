@@ -0,0 +1,92 @@
+//
+// QueryCache.cc
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "QueryCache.hh"
+#include "Query.hh"
+#include "KeyStore.hh"
+#include "Logging.hh"
+#include "FleeceImpl.hh"
+
+using namespace std;
+using namespace fleece::impl;
+
+namespace litecore {
+
+    QueryCache::~QueryCache() =default;
+
+
+    string QueryCache::keyFor(const KeyStore &keyStore, slice expressionJSON) {
+        Retained<Doc> doc;
+        try {
+            doc = Doc::fromJSON(expressionJSON);
+        } catch (const FleeceException&) {
+            return "";      // Let the QueryParser report the error
+        }
+        // Canonical JSON sorts dict keys, so equivalent expressions get the same key:
+        alloc_slice canonical = doc->root()->toJSON(false, true);
+        string key = keyStore.name();
+        key += '\0';
+        key.append((const char*)canonical.buf, canonical.size);
+        return key;
+    }
+
+
+    Retained<Query> QueryCache::get(const string &key) {
+        lock_guard<mutex> lock(_mutex);
+        auto i = _index.find(key);
+        if (i == _index.end()) {
+            ++_misses;
+            return nullptr;
+        }
+        ++_hits;
+        _entries.splice(_entries.begin(), _entries, i->second);     // Move to front
+        return i->second->second;
+    }
+
+
+    void QueryCache::put(const string &key, Query *query) {
+        lock_guard<mutex> lock(_mutex);
+        auto i = _index.find(key);
+        if (i != _index.end()) {
+            i->second->second = query;
+            _entries.splice(_entries.begin(), _entries, i->second);
+            return;
+        }
+        _entries.emplace_front(key, query);
+        _index[key] = _entries.begin();
+        if (_entries.size() > _capacity) {
+            LogVerbose(QueryLog, "QueryCache: evicting least recently used query");
+            _index.erase(_entries.back().first);
+            _entries.pop_back();
+        }
+    }
+
+
+    void QueryCache::clear() {
+        lock_guard<mutex> lock(_mutex);
+        _index.clear();
+        _entries.clear();
+    }
+
+
+    size_t QueryCache::count() const {
+        lock_guard<mutex> lock(_mutex);
+        return _entries.size();
+    }
+
+}
@@ -0,0 +1,76 @@
+//
+// QueryCache.hh
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Base.hh"
+#include "RefCounted.hh"
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace litecore {
+    class KeyStore;
+    class Query;
+
+
+    /** A least-recently-used cache of compiled Queries, owned by a DataFile. Queries are keyed
+        by KeyStore name plus the canonical JSON form of their expression, so the same query
+        written with different whitespace or property order shares an entry.
+        The cache must be cleared whenever the schema changes in a way that affects how queries
+        are compiled, e.g. when an index is created or deleted. */
+    class QueryCache {
+    public:
+        static constexpr size_t kDefaultCapacity = 64;
+
+        explicit QueryCache(size_t capacity =kDefaultCapacity)
+        :_capacity(capacity)
+        { }
+
+        ~QueryCache();
+
+        /** Returns the cache key for a query expression, or an empty string if it can't be
+            cached (i.e. it isn't valid JSON.) */
+        static std::string keyFor(const KeyStore&, slice expressionJSON);
+
+        /** Returns the cached query with this key, or null, and updates the hit/miss counts. */
+        Retained<Query> get(const std::string &key);
+
+        /** Adds a query, evicting the least recently used one if the cache is full. */
+        void put(const std::string &key, Query*);
+
+        /** Removes all queries. */
+        void clear();
+
+        size_t count() const;
+        size_t capacity() const                 {return _capacity;}
+        uint64_t hits() const                   {return _hits;}
+        uint64_t misses() const                 {return _misses;}
+
+    private:
+        using Entry = std::pair<std::string, Retained<Query>>;
+
+        mutable std::mutex _mutex;
+        size_t const _capacity;
+        std::list<Entry> _entries;                          // Most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+        std::atomic<uint64_t> _hits {0}, _misses {0};
+    };
+
+}
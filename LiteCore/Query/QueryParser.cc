@@ -167,10 +167,13 @@ namespace litecore {
         _parameters.clear();
         _variables.clear();
         _ftsTables.clear();
+        _unnestTables.clear();
         _aliases.clear();
         _dbAlias.clear();
         _1stCustomResultCol = 0;
         _isAggregateQuery = _aggregatesOK = _propertiesUseAliases = false;
+        _docKeyColumn = -1;
+        _docMatchSQL.clear();
 
         _aliases.insert({_dbAlias, kDBAlias});
     }
@@ -258,6 +261,17 @@ namespace litecore {
         for (auto ftsTable : _ftsTables) {
             _sql << (nCol++ ? ", " : "") << "offsets(\"" << ftsTable << "\")";
         }
+
+        // Doc key column, for queries whose rows each come from a single matching doc:
+        bool trackDocKeys = _trackDocKeys && !distinctVal && _ftsTables.empty()
+                                && _aliases.size() == 1
+                                && !getCaseInsensitive(operands, "GROUP_BY"_sl)
+                                && !getCaseInsensitive(operands, "LIMIT"_sl)
+                                && !getCaseInsensitive(operands, "OFFSET"_sl);
+        if (trackDocKeys) {
+            _docKeyColumn = nCol;
+            _sql << (nCol++ ? ", " : "") << defaultTablePrefix << "key";
+        }
         _1stCustomResultCol = nCol;
 
         auto nCustomCol = writeSelectListClause(operands, "WHAT"_sl, (nCol ? ", " : ""), true);
@@ -275,6 +289,9 @@ namespace litecore {
         // WHERE clause:
         writeWhereClause(where);
 
+        if (trackDocKeys)
+            writeDocMatchSQL(from, where, defaultTablePrefix);
+
         // GROUP_BY clause:
         bool grouped = (writeSelectListClause(operands, "GROUP_BY"_sl, " GROUP BY ") > 0);
         if (grouped)
@@ -296,6 +313,10 @@ namespace litecore {
         // LIMIT, OFFSET clauses:
         writeOrderOrLimitClause(operands, "LIMIT"_sl,  "LIMIT");
         writeOrderOrLimitClause(operands, "OFFSET"_sl, "OFFSET");
+
+        // Aggregate functions in the WHAT clause only show up while it's being parsed:
+        if (_isAggregateQuery)
+            _docMatchSQL.clear();
     }
 
 
@@ -325,6 +346,25 @@ namespace litecore {
     }
 
 
+    // Generates _docMatchSQL, a statement with the same FROM and WHERE clauses as the query that
+    // returns a row iff the doc whose key is bound to `$docKey` matches. It's written into its
+    // own stream, leaving the query's SQL as it was.
+    void QueryParser::writeDocMatchSQL(const Value *from, const Value *where,
+                                       const string &tablePrefix)
+    {
+        string querySQL = _sql.str();
+        _sql.str("");
+        _sql << "SELECT 1";
+        writeFromClause(from);
+        writeWhereClause(where);
+        _sql << ((_includeDeleted && !where) ? " WHERE " : " AND ") << tablePrefix
+             << "key=$docKey";
+        _docMatchSQL = _sql.str();
+        _sql.str("");
+        _sql << querySQL;
+    }
+
+
     void QueryParser::writeWhereClause(const Value *where) {
         if (_includeDeleted) {
             if (where) {
@@ -413,10 +453,12 @@ namespace litecore {
                 } else {
                     require (!on, "cannot use ON and UNNEST together");
                     string unnestTable = unnestedTableName(unnest);
-                    if (_delegate.tableExists(unnestTable))
+                    if (_delegate.tableExists(unnestTable)) {
                         type = kUnnestTableAlias;
-                    else
+                        _unnestTables.push_back(unnestTable);
+                    } else {
                         type = kUnnestVirtualTableAlias;
+                    }
                 }
                 _aliases.insert({alias, type});
                 first = false;
@@ -505,8 +547,10 @@ namespace litecore {
         unsigned ftsTableNo = 0;
         for (auto ftsTable : _ftsTables) {
             ++ftsTableNo;
+            const char *idColumn = _delegate.isFTS5Table(ftsTable) ? "rowid" : "docid";
             _sql << " JOIN \"" << ftsTable << "\" AS FTS" << ftsTableNo
-                 << " ON FTS" << ftsTableNo << ".docid = " << quoteTableName(_dbAlias) << ".rowid";
+                 << " ON FTS" << ftsTableNo << "." << idColumn << " = "
+                 << quoteTableName(_dbAlias) << ".rowid";
         }
     }
 
@@ -735,8 +779,19 @@ namespace litecore {
         auto curContext = _context.back();
         _context.pop_back();
 
-        // Parse the expression:
-        parseNode(operands[1]);
+        if (_collation.unicodeAware && isColumnListItem()
+                && (_useCollationKeys || _delegate.hasCollationKeyIndex(_collation.sqliteName()))) {
+            // Sort by the strings' binary sort keys, so comparisons are just memcmp:
+            _collationUsed = true;
+            _sql << "collation_key(";
+            parseNode(operands[1]);
+            _sql << ", ";
+            writeSQLString(slice(_collation.sqliteName()));
+            _sql << ")";
+        } else {
+            // Parse the expression:
+            parseNode(operands[1]);
+        }
 
         // If nothing in the expression (like a comparison operator) used the collation to generate
         // a SQL 'COLLATE', generate one now for the entire expression:
@@ -751,6 +806,17 @@ namespace litecore {
     }
 
 
+    // Is the current node an item of an ORDER BY / GROUP BY / CREATE INDEX column list, optionally
+    // followed by DESC? Only there are the values just compared to one another, not to other
+    // expressions, so they can be replaced by collation keys.
+    bool QueryParser::isColumnListItem() const {
+        auto n = _context.size();
+        if (n >= 2 && _context[n-1]->op == "DESC"_sl)
+            --n;
+        return n >= 1 && _context[n-1] == &kColumnListOperation;
+    }
+
+
     // Handles "x BETWEEN y AND z" expressions
     void QueryParser::betweenOp(slice op, Array::iterator& operands) {
         parseCollatableNode(operands[0]);
@@ -1021,12 +1087,16 @@ namespace litecore {
         if (op.caseEquivalent(kArrayCountFnName) && writeNestedPropertyOpIfAny(kCountFnName, operands))
             return;
 
-        // Special case: in "rank(ftsName)" the param has to be a matchinfo() call:
+        // Special case: in "rank(ftsName)" the param has to be a matchinfo() call,
+        // or for an FTS5 index, rank() is BM25 (negated, since bm25() is lower for better matches):
         if (op.caseEquivalent(kRankFnName)) {
             string fts = FTSTableName(operands[0]);
             if (find(_ftsTables.begin(), _ftsTables.end(), fts) == _ftsTables.end())
                 fail("rank() can only be called on FTS indexes");
-            _sql << "rank(matchinfo(\"" << fts << "\"))";
+            if (_delegate.isFTS5Table(fts))
+                _sql << "(-bm25(\"" << fts << "\"))";
+            else
+                _sql << "rank(matchinfo(\"" << fts << "\"))";
             return;
         }
 
@@ -46,6 +46,8 @@ namespace litecore {
             virtual std::string FTSTableName(const std::string &property) const =0;
             virtual std::string unnestedTableName(const std::string &property) const =0;
             virtual bool tableExists(const std::string &tableName) const =0;
+            virtual bool isFTS5Table(const std::string &tableName) const {return false;}
+            virtual bool hasCollationKeyIndex(const std::string &collationName) const {return false;}
         };
 
         QueryParser(const delegate &delegate)
@@ -56,6 +58,18 @@ namespace litecore {
         void setBodyColumnName(const std::string &name)             {_bodyColumnName = name;}
         void setBaseResultColumns(const std::vector<std::string>& c){_baseResultColumns = c;}
 
+        /** If enabled, a top-level SELECT whose results depend only on the individual documents
+            matching its WHERE clause (no joins, UNNEST, MATCH, DISTINCT, grouping, aggregates,
+            LIMIT or OFFSET) gets the doc key as an extra leading result column, and
+            `docMatchSQL` returns a statement that tests whether the doc whose key is bound to
+            `$docKey` matches the WHERE clause. */
+        void setTrackDocKeys(bool track)                            {_trackDocKeys = track;}
+
+        /** If enabled, a Unicode-aware `COLLATE` of an ORDER BY, GROUP BY or index expression
+            generates the strings' sort keys with `collation_key()`, instead of a SQL `COLLATE`.
+            (This also happens if the delegate says an index uses sort keys for that collation.) */
+        void setUseCollationKeys(bool use)                          {_useCollationKeys = use;}
+
         void parse(const fleece::impl::Value*);
         void parseJSON(slice);
 
@@ -71,10 +85,14 @@ namespace litecore {
 
         const std::set<std::string>& parameters()                   {return _parameters;}
         const std::vector<std::string>& ftsTablesUsed() const       {return _ftsTables;}
+        const std::vector<std::string>& unnestTablesUsed() const    {return _unnestTables;}
         unsigned firstCustomResultColumn() const                    {return _1stCustomResultCol;}
 
         bool isAggregateQuery() const                               {return _isAggregateQuery;}
 
+        int docKeyColumn() const                                    {return _docKeyColumn;}
+        const std::string& docMatchSQL() const                      {return _docMatchSQL;}
+
         std::string expressionSQL(const fleece::impl::Value*);
         std::string eachExpressionSQL(const fleece::impl::Value*);
         static std::string FTSColumnName(const fleece::impl::Value *expression);
@@ -121,6 +139,8 @@ namespace litecore {
         unsigned writeSelectListClause(const fleece::impl::Dict *operands, slice key, const char *sql, bool aggregatesOK =false);
 
         void writeWhereClause(const fleece::impl::Value *where);
+        void writeDocMatchSQL(const fleece::impl::Value *from, const fleece::impl::Value *where,
+                              const std::string &tablePrefix);
         void writeNotDeletedTest(const std::string &alias);
 
         void parseFromClause(const fleece::impl::Value *from);
@@ -163,6 +183,7 @@ namespace litecore {
         void writeColumnList(fleece::impl::Array::iterator& operands);
         void writeResultColumn(const fleece::impl::Value*);
         void writeCollation();
+        bool isColumnListItem() const;
         void parseCollatableNode(const fleece::impl::Value*);
 
         void parseJoin(const fleece::impl::Dict*);
@@ -183,12 +204,17 @@ namespace litecore {
         std::set<std::string> _parameters;          // Plug-in "$" parameters found in parsing
         std::set<std::string> _variables;           // Active variables, inside ANY/EVERY exprs
         std::vector<std::string> _ftsTables;        // FTS virtual tables being used
+        std::vector<std::string> _unnestTables;     // Unnest tables being used
         unsigned _1stCustomResultCol {0};           // Index of 1st result after _baseResultColumns
         bool _aggregatesOK {false};                 // Are aggregate fns OK to call?
         bool _isAggregateQuery {false};             // Is this an aggregate query?
+        bool _trackDocKeys {false};                 // Emit doc key column & docMatchSQL?
+        int _docKeyColumn {-1};                     // Index of doc key result column, or -1
+        std::string _docMatchSQL;                   // Tests whether one doc matches WHERE
         static constexpr bool _includeDeleted {false};  // In future add an accessor to set this
         Collation _collation;                       // Collation in use during parse
         bool _collationUsed {true};                 // Emitted SQL "COLLATION" yet?
+        bool _useCollationKeys {false};             // Use collation_key() instead of COLLATE?
     };
 
 }
@@ -0,0 +1,272 @@
+//
+// SQLiteFTS5.cc
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//  FTS5 API documentation: https://www.sqlite.org/fts5.html#extending_fts5
+
+#include "SQLite_Internal.hh"
+#include <sqlite3.h>
+#include <sstream>
+#include <string>
+#include <string.h>
+#include <vector>
+
+extern "C" {
+#include "fts3_tokenizer.h"
+}
+
+using namespace std;
+
+
+#pragma mark - FTS5 API:
+
+
+// These are the parts of SQLite's fts5.h that we use. That header isn't part of the
+// amalgamation's public API, and the structs are append-only, so it's safe to declare only the
+// leading members of Fts5ExtensionApi.
+extern "C" {
+    typedef struct Fts5Context Fts5Context;
+    typedef struct Fts5Tokenizer Fts5Tokenizer;
+
+    struct Fts5ExtensionApi {
+        int iVersion;
+        void *(*xUserData)(Fts5Context*);
+        int (*xColumnCount)(Fts5Context*);
+        int (*xRowCount)(Fts5Context*, sqlite3_int64 *pnRow);
+        int (*xColumnTotalSize)(Fts5Context*, int iCol, sqlite3_int64 *pnToken);
+        int (*xTokenize)(Fts5Context*, const char *pText, int nText, void *pCtx,
+                         int (*xToken)(void*, int, const char*, int, int, int));
+        int (*xPhraseCount)(Fts5Context*);
+        int (*xPhraseSize)(Fts5Context*, int iPhrase);
+        int (*xInstCount)(Fts5Context*, int *pnInst);
+        int (*xInst)(Fts5Context*, int iIdx, int *piPhrase, int *piCol, int *piOff);
+        sqlite3_int64 (*xRowid)(Fts5Context*);
+        int (*xColumnText)(Fts5Context*, int iCol, const char **pz, int *pn);
+        // ...more members follow
+    };
+
+    typedef void (*fts5_extension_function)(const Fts5ExtensionApi *pApi,
+                                            Fts5Context *pFts,
+                                            sqlite3_context *pCtx,
+                                            int nVal,
+                                            sqlite3_value **apVal);
+
+    struct fts5_tokenizer {
+        int (*xCreate)(void*, const char **azArg, int nArg, Fts5Tokenizer **ppOut);
+        void (*xDelete)(Fts5Tokenizer*);
+        int (*xTokenize)(Fts5Tokenizer*, void *pCtx, int flags, const char *pText, int nText,
+                         int (*xToken)(void *pCtx, int tflags, const char *pToken, int nToken,
+                                       int iStart, int iEnd));
+    };
+
+    struct fts5_api {
+        int iVersion;
+        int (*xCreateTokenizer)(fts5_api *pApi, const char *zName, void *pContext,
+                                fts5_tokenizer *pTokenizer, void (*xDestroy)(void*));
+        int (*xFindTokenizer)(fts5_api *pApi, const char *zName, void **ppContext,
+                              fts5_tokenizer *pTokenizer);
+        int (*xCreateFunction)(fts5_api *pApi, const char *zName, void *pContext,
+                               fts5_extension_function xFunction, void (*xDestroy)(void*));
+    };
+}
+
+#define FTS5_TOKEN_COLOCATED 0x0001
+
+
+namespace litecore {
+
+    // Returns the connection's FTS5 API, or nullptr if SQLite was built without FTS5.
+    static fts5_api* getFTS5API(sqlite3 *db) {
+        fts5_api *api = nullptr;
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, "SELECT fts5(?1)", -1, &stmt, nullptr) != SQLITE_OK)
+            return nullptr;
+        sqlite3_bind_pointer(stmt, 1, &api, "fts5_api_ptr", nullptr);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        return api;
+    }
+
+
+    // Returns the FTS3 tokenizer module registered under a name, or nullptr.
+    static const sqlite3_tokenizer_module* getFTS3Tokenizer(sqlite3 *db, const char *name) {
+        const sqlite3_tokenizer_module *module = nullptr;
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, "SELECT fts3_tokenizer(?1)", -1, &stmt, nullptr) != SQLITE_OK)
+            return nullptr;
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_bytes(stmt, 0) == sizeof(module))
+            memcpy(&module, sqlite3_column_blob(stmt, 0), sizeof(module));
+        sqlite3_finalize(stmt);
+        return module;
+    }
+
+
+#pragma mark - TOKENIZER:
+
+
+    /*  FTS5 has its own tokenizer API, so this adapts an FTS3 tokenizer module (i.e. unicodesn)
+        to it. The tokenizer's arguments are the same as with FTS3/4, e.g.
+            tokenize='unicodesn "stemmer=en" "remove_diacritics=1"'
+     */
+
+    static int fts5TokenizerCreate(void *context, const char **argv, int argc,
+                                   Fts5Tokenizer **outTokenizer)
+    {
+        auto module = (const sqlite3_tokenizer_module*)context;
+        sqlite3_tokenizer *tokenizer = nullptr;
+        int rc = module->xCreate(argc, argv, &tokenizer);
+        if (rc == SQLITE_OK) {
+            tokenizer->pModule = module;
+            *outTokenizer = (Fts5Tokenizer*)tokenizer;
+        }
+        return rc;
+    }
+
+
+    static void fts5TokenizerDelete(Fts5Tokenizer *fts5Tokenizer) {
+        auto tokenizer = (sqlite3_tokenizer*)fts5Tokenizer;
+        tokenizer->pModule->xDestroy(tokenizer);
+    }
+
+
+    static int fts5Tokenize(Fts5Tokenizer *fts5Tokenizer, void *context, int /*flags*/,
+                            const char *text, int textLen,
+                            int (*callback)(void*, int, const char*, int, int, int))
+    {
+        auto tokenizer = (sqlite3_tokenizer*)fts5Tokenizer;
+        auto module = tokenizer->pModule;
+        sqlite3_tokenizer_cursor *cursor;
+        int rc = module->xOpen(tokenizer, text, textLen, &cursor);
+        if (rc != SQLITE_OK)
+            return rc;
+        cursor->pTokenizer = tokenizer;
+        const char *token;
+        int tokenLen, start, end, position;
+        while (SQLITE_OK == (rc = module->xNext(cursor, &token, &tokenLen,
+                                                &start, &end, &position))) {
+            rc = callback(context, 0, token, tokenLen, start, end);
+            if (rc != SQLITE_OK)
+                break;
+        }
+        module->xClose(cursor);
+        return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+    }
+
+
+#pragma mark - OFFSETS FUNCTION:
+
+
+    /*  FTS5 auxiliary function "offsets(fts)", which works like FTS4's offsets(): it returns a
+        string of space-separated integers in groups of four, one group per match, giving the
+        column number, the query phrase number, and the byte offset and length of the match.
+        (FTS5 only knows the token offsets of matches, so this re-tokenizes the matching
+        columns to find their byte offsets.) */
+
+    namespace {
+        struct Match {
+            int phrase, column, tokenOffset;
+        };
+
+        struct OffsetsContext {
+            const vector<Match> *matches;
+            int column;
+            int tokenOffset;
+            stringstream *out;
+            bool first;
+        };
+    }
+
+
+    static int offsetsTokenCallback(void *ctx, int tflags, const char*, int, int start, int end) {
+        auto &context = *(OffsetsContext*)ctx;
+        if (tflags & FTS5_TOKEN_COLOCATED)
+            return SQLITE_OK;
+        for (auto &match : *context.matches) {
+            if (match.column == context.column && match.tokenOffset == context.tokenOffset) {
+                if (!context.first)
+                    *context.out << ' ';
+                context.first = false;
+                *context.out << match.column << ' ' << match.phrase << ' '
+                             << start << ' ' << (end - start);
+            }
+        }
+        ++context.tokenOffset;
+        return SQLITE_OK;
+    }
+
+
+    static void fts5Offsets(const Fts5ExtensionApi *api, Fts5Context *fts,
+                            sqlite3_context *ctx, int /*argc*/, sqlite3_value** /*argv*/)
+    {
+        int nInst = 0;
+        int rc = api->xInstCount(fts, &nInst);
+        if (rc != SQLITE_OK) {
+            sqlite3_result_error_code(ctx, rc);
+            return;
+        }
+        vector<Match> matches(nInst);
+        for (int i = 0; i < nInst && rc == SQLITE_OK; ++i) {
+            auto &m = matches[i];
+            rc = api->xInst(fts, i, &m.phrase, &m.column, &m.tokenOffset);
+        }
+
+        stringstream out;
+        OffsetsContext context {&matches, 0, 0, &out, true};
+        int nCols = api->xColumnCount(fts);
+        for (int col = 0; col < nCols && rc == SQLITE_OK; ++col) {
+            bool colMatches = false;
+            for (auto &match : matches)
+                colMatches = colMatches || (match.column == col);
+            if (!colMatches)
+                continue;
+            const char *text;
+            int textLen;
+            rc = api->xColumnText(fts, col, &text, &textLen);
+            if (rc == SQLITE_OK && text) {
+                context.column = col;
+                context.tokenOffset = 0;
+                rc = api->xTokenize(fts, text, textLen, &context, &offsetsTokenCallback);
+            }
+        }
+
+        if (rc != SQLITE_OK) {
+            sqlite3_result_error_code(ctx, rc);
+            return;
+        }
+        string result = out.str();
+        sqlite3_result_text(ctx, result.data(), (int)result.size(), SQLITE_TRANSIENT);
+    }
+
+
+#pragma mark - REGISTRATION:
+
+
+    int RegisterSQLiteFTS5(sqlite3 *db) {
+        fts5_api *api = getFTS5API(db);
+        if (!api)
+            return SQLITE_ERROR;
+        auto module = getFTS3Tokenizer(db, "unicodesn");
+        if (!module)
+            return SQLITE_ERROR;
+        fts5_tokenizer tokenizer = {&fts5TokenizerCreate, &fts5TokenizerDelete, &fts5Tokenize};
+        int rc = api->xCreateTokenizer(api, "unicodesn", (void*)module, &tokenizer, nullptr);
+        if (rc == SQLITE_OK)
+            rc = api->xCreateFunction(api, "offsets", nullptr, &fts5Offsets, nullptr);
+        return rc;
+    }
+
+}
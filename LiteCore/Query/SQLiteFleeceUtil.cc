@@ -208,6 +208,7 @@ namespace litecore {
     static void registerFunctionSpecs(sqlite3 *db,
                                       DataFile::FleeceAccessor accessor,
                                       fleece::impl::SharedKeys *sharedKeys,
+                                      const shared_ptr<RegexCache> &regexCache,
                                       const SQLiteFunctionSpec functions[])
     {
         if (!accessor)
@@ -217,7 +218,7 @@ namespace litecore {
                                                 fn->name,
                                                 fn->argCount,
                                                 SQLITE_UTF8 | SQLITE_DETERMINISTIC,
-                                                new fleeceFuncContext{accessor, sharedKeys},
+                                                new fleeceFuncContext{accessor, sharedKeys, regexCache},
                                                 fn->function, fn->stepCallback, fn->finalCallback,
                                                 [](void *param) {delete (fleeceFuncContext*)param;});
             if (rc != SQLITE_OK)
@@ -230,10 +231,11 @@ namespace litecore {
                                  DataFile::FleeceAccessor accessor,
                                  fleece::impl::SharedKeys *sharedKeys)
     {
-        registerFunctionSpecs(db, accessor, sharedKeys, kFleeceFunctionsSpec);
-        registerFunctionSpecs(db, nullptr,  sharedKeys, kFleeceNullAccessorFunctionsSpec);
-        registerFunctionSpecs(db, accessor, sharedKeys, kRankFunctionsSpec);
-        registerFunctionSpecs(db, accessor, sharedKeys, kN1QLFunctionsSpec);
+        auto regexCache = NewRegexCache();
+        registerFunctionSpecs(db, accessor, sharedKeys, nullptr, kFleeceFunctionsSpec);
+        registerFunctionSpecs(db, nullptr,  sharedKeys, nullptr, kFleeceNullAccessorFunctionsSpec);
+        registerFunctionSpecs(db, accessor, sharedKeys, nullptr, kRankFunctionsSpec);
+        registerFunctionSpecs(db, accessor, sharedKeys, regexCache, kN1QLFunctionsSpec);
         RegisterFleeceEachFunctions(db, accessor, sharedKeys);
     }
 
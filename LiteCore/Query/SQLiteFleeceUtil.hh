@@ -20,6 +20,7 @@
 #include "Base.hh"
 #include "FleeceImpl.hh"
 #include <sqlite3.h>
+#include <memory>
 
 
 namespace litecore {
@@ -38,10 +39,13 @@ namespace litecore {
         return (const fleece::impl::Value*) sqlite3_value_pointer(value, kFleeceValuePointerType);
     }
 
+    class RegexCache;
+
     // What the user_data of a registered function points to
     struct fleeceFuncContext {
         DataFile::FleeceAccessor accessor;
         fleece::impl::SharedKeys *sharedKeys;
+        std::shared_ptr<RegexCache> regexCache;     // Shared by all functions on a connection
     };
 
 
@@ -115,6 +119,9 @@ namespace litecore {
     extern const SQLiteFunctionSpec kRankFunctionsSpec[];
     extern const SQLiteFunctionSpec kN1QLFunctionsSpec[];
 
+    // Creates the cache of compiled regular expressions used by the regexp_ functions
+    std::shared_ptr<RegexCache> NewRegexCache();
+
     int RegisterFleeceEachFunctions(sqlite3 *db, DataFile::FleeceAccessor,
                                     fleece::impl::SharedKeys*);
 
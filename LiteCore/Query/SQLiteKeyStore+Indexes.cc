@@ -22,13 +22,22 @@
 #include "SQLite_Internal.hh"
 #include "Query.hh"
 #include "QueryParser.hh"
+#include "QueryCache.hh"
 #include "Record.hh"
 #include "Error.hh"
 #include "StringUtil.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include "FleeceImpl.hh"
 #include "Stopwatch.hh"
+#include "UnicodeCollator.hh"
+#include "RefCounted.hh"
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 extern "C" {
 #include "sqlite3_unicodesn_tokenizer.h"
@@ -43,6 +52,7 @@ namespace litecore {
     /*
      A value index is a SQL index named 'NAME'.
      A FTS index is a SQL virtual table named 'kv_default::NAME'
+         (An FTS5 index also has a view named 'kv_default::NAME:content' that it reads text from)
      An array index has two parts:
          * A SQL table named `kv_default:unnest:PATH`
          * An index on that table named `NAME`
@@ -51,6 +61,11 @@ namespace litecore {
     static void validateIndexName(slice name);
     static pair<alloc_slice, const Array*> parseIndexExpr(slice expression, KeyStore::IndexType);
     static void writeTokenizerOptions(stringstream &sql, const KeyStore::IndexOptions*);
+    static string collationKeyVersion(const string &collationName);
+    static uint64_t claimIndexTableBuild(DataFile&, const string &indexTableName);
+    static bool releaseIndexTableBuild(DataFile&, const string &indexTableName,
+                                       uint64_t buildID =0);
+    static bool isIndexTableBuildActive(DataFile&, const string &indexTableName);
 
 
     bool SQLiteKeyStore::createIndex(slice indexName,
@@ -64,27 +79,60 @@ namespace litecore {
         tie(expressionFleece, params) = parseIndexExpr(expression, type);
 
         Stopwatch st;
-        Transaction t(db());
-        bool created;
-        switch (type) {
-            case kValueIndex: {
-                Array::iterator iParams(params);
-                created = createValueIndex(kValueIndex, tableName(), indexNameStr, iParams, options);
-                break;
+        IndexTableBuild build;
+        try {
+            Transaction t(db());
+            bool created;
+            switch (type) {
+                case kValueIndex: {
+                    Array::iterator iParams(params);
+                    created = createValueIndex(kValueIndex, tableName(), indexNameStr, iParams,
+                                               options);
+                    break;
+                }
+                case kFullTextIndex:
+                    created = createFTSIndex(indexNameStr, params, options, &build);
+                    break;
+                case kFTS5Index:     created = createFTS5Index(indexNameStr, params, options); break;
+                case kArrayIndex:    created = createArrayIndex(indexNameStr, params, options); break;
+                default:             error::_throw(error::Unimplemented);
             }
-            case kFullTextIndex: created = createFTSIndex(indexNameStr, params, options); break;
-            case kArrayIndex:    created = createArrayIndex(indexNameStr, params, options); break;
-            default:             error::_throw(error::Unimplemented);
-        }
-
-        if (created) {
+            if (!created)
+                return false;
             garbageCollectArrayIndexes();
             t.commit();
-            double time = st.elapsed();
-            QueryLog.log((time < 3.0 ? LogLevel::Info : LogLevel::Warning),
-                         "Created index '%.*s' in %.3f sec", SPLAT(indexName), time);
+        } catch (...) {
+            if (!build.tableName.empty())
+                releaseIndexTableBuild(db(), build.tableName, build.buildID);
+            throw;
+        }
+        db().queryCache().clear();      // Cached queries may compile differently now
+
+        if (!build.tableName.empty()) {
+            // The index table was left empty, to be populated outside the Transaction:
+            try {
+                buildIndexTable(build);
+                Transaction t(db());
+                registerLazyIndexTable(build.tableName, build.updateSQL);
+                unregisterIndexTableBuild(db(), build.tableName);
+                if (!(options && options->lazy))
+                    createFTSIndex(indexNameStr, params, options);  // Catches up & makes it immediate
+                t.commit();
+                releaseIndexTableBuild(db(), build.tableName, build.buildID);
+            } catch (...) {
+                // Delete the half-built index, unless it's since been deleted or replaced:
+                Transaction t(db());
+                if (releaseIndexTableBuild(db(), build.tableName, build.buildID))
+                    _sqlDeleteIndex(indexNameStr);
+                t.commit();
+                throw;
+            }
         }
-        return created;
+
+        double time = st.elapsed();
+        QueryLog.log((time < 3.0 ? LogLevel::Info : LogLevel::Warning),
+                     "Created index '%.*s' in %.3f sec", SPLAT(indexName), time);
+        return true;
     }
 
 
@@ -95,6 +143,7 @@ namespace litecore {
         _sqlDeleteIndex(string(name));
         garbageCollectArrayIndexes();
         t.commit();
+        db().queryCache().clear();
     }
 
 
@@ -147,9 +196,8 @@ namespace litecore {
         // Delete any FTS index:
         auto ftsTableName = FTSTableName(indexName);
         db().exec(CONCAT("DROP TABLE IF EXISTS \"" << ftsTableName << "\""));
-        dropTrigger(ftsTableName, "ins");
-        dropTrigger(ftsTableName, "upd");
-        dropTrigger(ftsTableName, "del");
+        db().exec(CONCAT("DROP VIEW IF EXISTS \"" << FTS5ContentViewName(ftsTableName) << "\""));
+        dropIndexTableTriggers(ftsTableName);
     }
 
 
@@ -165,6 +213,13 @@ namespace litecore {
     {
         QueryParser qp(*this);
         qp.setTableName(CONCAT('"' << sourceTableName << '"'));
+        if (options && options->unicodeSortKeys) {
+            if (UnicodeSortKeysSupported())
+                qp.setUseCollationKeys(true);
+            else
+                Warn("Unicode sort keys aren't supported on this platform; index '%s' will "
+                     "use the collator instead", indexName.c_str());
+        }
         qp.writeCreateIndex(indexName, expressions, (type == kArrayIndex));
         string sql = qp.SQL();
         if (_schemaExistsWithSQL(indexName, "index", sourceTableName, sql))
@@ -173,17 +228,138 @@ namespace litecore {
         LogTo(QueryLog, "Creating %sindex '%s'",
               (type == kArrayIndex ? "array " : ""), indexName.c_str());
         db().exec(sql);
+        recordCollationKeyVersions(sql);
         return true;
     }
 
 
+    // Does a value index on this KeyStore store sort keys for the given Unicode collation?
+    // If so, QueryParser sorts by the same sort keys so the index can be used. An index whose
+    // keys came from a different collator version (which can only be the case in a read-only
+    // file; see checkCollationKeyVersions) doesn't count.
+    bool SQLiteKeyStore::hasCollationKeyIndex(const string &collationName) const {
+        if (!UnicodeSortKeysSupported() || !db().tableExists("collationkeys"))
+            return false;
+        SQLite::Statement version(db(), "SELECT version FROM collationkeys WHERE collation=?");
+        version.bind(1, collationName);
+        if (!version.executeStep()
+                || version.getColumn(0).getString() != collationKeyVersion(collationName))
+            return false;
+        SQLite::Statement check(db(), "SELECT 1 FROM sqlite_master "
+                                      "WHERE type = 'index' AND tbl_name = ? "
+                                      "AND instr(sql, 'collation_key(') > 0 AND instr(sql, ?) > 0");
+        check.bind(1, tableName());
+        check.bind(2, CONCAT("'" << collationName << "')"));
+        LogStatement(check);
+        return check.executeStep();
+    }
+
+
+    // The names of the collations whose sort keys an index's SQL uses. (QueryParser writes
+    // them as string literals, while COLLATE clauses quote the name with double quotes.)
+    static vector<string> collationKeyNames(const string &indexSQL) {
+        vector<string> names;
+        for (auto pos = indexSQL.find("'LCUnicode_"); pos != string::npos;
+                  pos = indexSQL.find("'LCUnicode_", pos)) {
+            auto end = indexSQL.find('\'', pos + 1);
+            if (end == string::npos)
+                break;
+            string name = indexSQL.substr(pos + 1, end - pos - 1);
+            if (find(names.begin(), names.end(), name) == names.end())
+                names.push_back(name);
+            pos = end + 1;
+        }
+        return names;
+    }
+
+
+    static string collationKeyVersion(const string &collationName) {
+        Collation coll;
+        if (!coll.readSQLiteName(collationName.c_str()))
+            return "";
+        return UnicodeSortKeyVersion(coll);
+    }
+
+
+    // Sort keys depend on the collator's version, which can change with an OS or ICU update.
+    // So the version that generated each collation's keys is stored in the `collationkeys` table.
+    void SQLiteKeyStore::recordCollationKeyVersions(const string &indexSQL) {
+        auto names = collationKeyNames(indexSQL);
+        if (names.empty())
+            return;
+        db().exec("CREATE TABLE IF NOT EXISTS collationkeys "
+                  "(collation TEXT PRIMARY KEY, version TEXT NOT NULL)");
+        SQLite::Statement st(db(), "INSERT OR REPLACE INTO collationkeys (collation, version) "
+                                   "VALUES (?, ?)");
+        for (auto &name : names) {
+            st.bind(1, name);
+            st.bind(2, collationKeyVersion(name));
+            st.exec();
+            st.reset();
+        }
+    }
+
+
+    // Called when a file is opened. Rebuilds the indexes whose sort keys came from a different
+    // version of the collator (or from a platform that doesn't support sort keys), since they'd
+    // be ordered inconsistently with the keys generated now.
+    void SQLiteKeyStore::checkCollationKeyVersions(SQLiteDataFile &db) {
+        if (!db.options().writeable || !db.tableExists("collationkeys"))
+            return;
+        vector<pair<string, string>> changed;
+        SQLite::Statement versions(db, "SELECT collation, version FROM collationkeys");
+        while (versions.executeStep()) {
+            string name = versions.getColumn(0).getString();
+            string version = collationKeyVersion(name);
+            if (version != versions.getColumn(1).getString())
+                changed.emplace_back(name, version);
+        }
+        versions.reset();
+        if (changed.empty())
+            return;
+
+        Transaction t(db);
+        for (auto &entry : changed) {
+            const string &name = entry.first;
+            SQLite::Statement indexes(db, "SELECT name FROM sqlite_master "
+                                          "WHERE type = 'index' "
+                                          "AND instr(sql, 'collation_key(') > 0 "
+                                          "AND instr(sql, ?) > 0");
+            indexes.bind(1, CONCAT("'" << name << "')"));
+            vector<string> indexNames;
+            while (indexes.executeStep())
+                indexNames.push_back(indexes.getColumn(0).getString());
+            indexes.reset();
+            for (auto &indexName : indexNames) {
+                Warn("Rebuilding index '%s', since the sort keys of collation %s have changed",
+                     indexName.c_str(), name.c_str());
+                db.exec(CONCAT("REINDEX \"" << indexName << "\""));
+            }
+            if (indexNames.empty()) {
+                SQLite::Statement del(db, "DELETE FROM collationkeys WHERE collation=?");
+                del.bind(1, name);
+                del.exec();
+            } else {
+                SQLite::Statement update(db, "UPDATE collationkeys SET version=? "
+                                             "WHERE collation=?");
+                update.bind(1, entry.second);
+                update.bind(2, name);
+                update.exec();
+            }
+        }
+        t.commit();
+    }
+
+
 #pragma mark - FTS INDEX:
 
 
-    // Creates a FTS index.
+    // Creates a FTS index. If `deferredBuild` is given and the KeyStore is large, a new FTS table
+    // is left empty, and `deferredBuild` is filled in so the caller can populate it.
     bool SQLiteKeyStore::createFTSIndex(string indexName,
                                         const Array *params,
-                                        const IndexOptions *options)
+                                        const IndexOptions *options,
+                                        IndexTableBuild *deferredBuild)
     {
         auto ftsTableName = FTSTableName(indexName);
         // Collect the name of each FTS column and the SQL expression that populates it:
@@ -202,21 +378,86 @@ namespace litecore {
         {
             stringstream sql;
             sql << "CREATE VIRTUAL TABLE \"" << ftsTableName << "\" USING fts4(" << columns << ", ";
+            sql << "tokenize=";
             writeTokenizerOptions(sql, options);
             sql << ")";
             sqlStr = sql.str();
         }
 
-        // Create the FTS table, but if an identical one already exists, return:
-        if (_schemaExistsWithSQL(ftsTableName, "table", ftsTableName, sqlStr))
-            return false;
-        _sqlDeleteIndex(indexName);
-        LogTo(QueryLog, "Creating full-text search index '%s'", indexName.c_str());
-        db().exec(sqlStr);
+        // The SQL that re-indexes the records in the pending table, if it's lazy:
+        string pending = pendingTableName(ftsTableName);
+        string updateSQL = CONCAT("DELETE FROM \"" << ftsTableName << "\" WHERE docid IN "
+                                      "(SELECT docid FROM \"" << pending << "\"); "
+                                  "INSERT INTO \"" << ftsTableName << "\" (docid, " << columns << ") "
+                                      "SELECT rowid, " << exprs << " FROM kv_" << name() << " AS new "
+                                      "WHERE rowid IN (SELECT docid FROM \"" << pending << "\")");
+
+        // Create the FTS table, but if an identical one already exists, return.
+        // (One whose build was interrupted doesn't count.)
+        bool lazy = options && options->lazy;
+        bool exists = _schemaExistsWithSQL(ftsTableName, "table", ftsTableName, sqlStr)
+                          && !isIndexTableBuilding(ftsTableName);
+        if (exists) {
+            if (isLazyIndexTable(ftsTableName) == lazy)
+                return false;
+            // Only the update mode is changing, so keep the table but replace its triggers:
+            LogTo(QueryLog, "Making full-text search index '%s' %s",
+                  indexName.c_str(), (lazy ? "lazy" : "immediate"));
+            updateLazyIndexTables({ftsTableName});
+            dropIndexTableTriggers(ftsTableName);
+        } else {
+            if (isIndexTableBuilding(ftsTableName) && isIndexTableBuildActive(db(), ftsTableName)) {
+                // Another connection is populating the table right now; don't pull it out from
+                // under that build. If it's building this same index, the index already exists.
+                if (_schemaExistsWithSQL(ftsTableName, "table", ftsTableName, sqlStr))
+                    return false;
+                error::_throw(error::Busy, "Full-text index '%s' is still being built",
+                              indexName.c_str());
+            }
+            _sqlDeleteIndex(indexName);
+            LogTo(QueryLog, "Creating %sfull-text search index '%s'",
+                  (lazy ? "lazy " : ""), indexName.c_str());
+            db().exec(sqlStr);
+
+            if (deferredBuild && shouldBuildIndexTableInParallel()) {
+                // Leave the table empty, for the caller to populate with buildIndexTable() after
+                // this Transaction commits. Meanwhile, records that change go in the pending table:
+                createLazyIndexTriggers(ftsTableName);
+                deferredBuild->tableName = ftsTableName;
+                deferredBuild->selectSQL = CONCAT("SELECT rowid, " << exprs << " "
+                                                  "FROM kv_" << name() << " AS new "
+                                                  "WHERE rowid BETWEEN ?1 AND ?2 ORDER BY rowid");
+                stringstream insert;
+                insert << "INSERT INTO \"" << ftsTableName << "\" (docid, " << columns << ") "
+                          "VALUES (?";
+                for (size_t i = 0; i < colNames.size(); ++i)
+                    insert << ", ?";
+                insert << ")";
+                deferredBuild->insertSQL = insert.str();
+                deferredBuild->updateSQL = updateSQL;
+                deferredBuild->buildID = claimIndexTableBuild(db(), ftsTableName);
+                // In case the build is interrupted, record how to finish it in one go:
+                registerIndexTableBuild(ftsTableName,
+                                        CONCAT("DELETE FROM \"" << ftsTableName << "\"; "
+                                               "INSERT INTO \"" << ftsTableName << "\" (docid, "
+                                                   << columns << ") "
+                                               "SELECT rowid, " << exprs << " FROM kv_" << name()
+                                                   << " AS new"),
+                                        updateSQL);
+                return true;
+            }
 
-        // Index the existing records:
-        db().exec(CONCAT("INSERT INTO \"" << ftsTableName << "\" (docid, " << columns << ") "
-                         "SELECT rowid, " << exprs << " FROM kv_" << name() << " AS new"));
+            // Index the existing records:
+            db().exec(CONCAT("INSERT INTO \"" << ftsTableName << "\" (docid, " << columns << ") "
+                             "SELECT rowid, " << exprs << " FROM kv_" << name() << " AS new"));
+        }
+
+        if (lazy) {
+            // Set up triggers to record changed records, and the SQL to re-index them later:
+            createLazyIndexTriggers(ftsTableName);
+            registerLazyIndexTable(ftsTableName, updateSQL);
+            return true;
+        }
 
         // Set up triggers to keep the FTS table up to date
         // ...on insertion:
@@ -247,10 +488,10 @@ namespace litecore {
     }
 
 
-    // subroutine that generates the option string passed to the FTS tokenizer
+    // subroutine that generates the tokenizer name & options of the FTS 'tokenize' option
     static void writeTokenizerOptions(stringstream &sql, const KeyStore::IndexOptions *options) {
         // See https://www.sqlite.org/fts3.html#tokenizer . 'unicodesn' is our custom tokenizer.
-        sql << "tokenize=unicodesn";
+        sql << "unicodesn";
         if (options) {
             // Get the language code (options->language might have a country too, like "en_US")
             string languageCode;
@@ -283,6 +524,99 @@ namespace litecore {
     }
 
 
+#pragma mark - FTS5 INDEX:
+
+
+    // FTS5 merges its index segments as documents are added. A higher 'automerge' level
+    // (default 4) merges less often, which makes bulk inserts cheaper, and 'crisismerge' (default
+    // 16) is the number of segments at which a merge is forced regardless.
+    static constexpr int kFTS5AutoMerge = 8, kFTS5CrisisMerge = 32;
+
+
+    // Creates a FTS index using FTS5. Unlike the FTS4 one, its table has no copy of the indexed
+    // text ("external content"); instead it reads the text from a view on the KeyStore's table.
+    bool SQLiteKeyStore::createFTS5Index(string indexName,
+                                         const Array *params,
+                                         const IndexOptions *options)
+    {
+        if (options && options->lazy)
+            error::_throw(error::InvalidParameter, "FTS5 indexes can't be lazy");
+        auto ftsTableName = FTSTableName(indexName);
+        auto contentViewName = FTS5ContentViewName(ftsTableName);
+
+        // Collect the name of each FTS column and the SQL expressions that populate it from the
+        // new and old versions of a record:
+        QueryParser newQP(*this), oldQP(*this);
+        newQP.setBodyColumnName("new.body");
+        oldQP.setBodyColumnName("old.body");
+        vector<string> colNames, newExprs, oldExprs, viewCols;
+        for (Array::iterator i(params); i; ++i) {
+            colNames.push_back(CONCAT('"' << QueryParser::FTSColumnName(i.value()) << '"'));
+            newExprs.push_back(newQP.expressionSQL(i.value()));
+            oldExprs.push_back(oldQP.expressionSQL(i.value()));
+            viewCols.push_back(newExprs.back() + " AS " + colNames.back());
+        }
+        string columns = join(colNames, ", ");
+
+        // Build the SQL that creates the FTS table. The tokenizer options have to be a single
+        // string argument:
+        string sqlStr;
+        {
+            stringstream tokenizer;
+            writeTokenizerOptions(tokenizer, options);
+            string tokenize = tokenizer.str();
+            for (auto q = tokenize.find('\''); q != string::npos; q = tokenize.find('\'', q + 2))
+                tokenize.insert(q, 1, '\'');
+            sqlStr = CONCAT("CREATE VIRTUAL TABLE \"" << ftsTableName << "\" USING fts5("
+                            << columns << ", content=\"" << contentViewName << "\", "
+                            << "tokenize='" << tokenize << "')");
+        }
+
+        // Create the FTS table and its view, but if an identical one already exists, return:
+        if (_schemaExistsWithSQL(ftsTableName, "table", ftsTableName, sqlStr))
+            return false;
+        _sqlDeleteIndex(indexName);
+        LogTo(QueryLog, "Creating FTS5 full-text search index '%s'", indexName.c_str());
+        db().exec(CONCAT("CREATE VIEW \"" << contentViewName << "\" AS "
+                         "SELECT new.rowid AS rowid, " << join(viewCols, ", ") << " "
+                         "FROM kv_" << name() << " AS new"));
+        db().exec(sqlStr);
+
+        // Configure incremental merging, then index the existing records:
+        string command = CONCAT("INSERT INTO \"" << ftsTableName << "\" "
+                                "(\"" << ftsTableName << "\", rank) VALUES ");
+        db().exec(CONCAT(command << "('automerge', " << kFTS5AutoMerge << ")"));
+        db().exec(CONCAT(command << "('crisismerge', " << kFTS5CrisisMerge << ")"));
+        db().exec(CONCAT("INSERT INTO \"" << ftsTableName << "\" (\"" << ftsTableName << "\") "
+                         "VALUES ('rebuild')"));
+
+        // Set up triggers to keep the FTS table up to date. Since it doesn't store the text,
+        // removing a record's old text from the index requires passing in that text:
+        string insertNew = CONCAT("INSERT INTO \"" << ftsTableName << "\" "
+                                  "(rowid, " << columns << ") "
+                                  "VALUES (new.rowid, " << join(newExprs, ", ") << ")");
+        string deleteOld = CONCAT("INSERT INTO \"" << ftsTableName << "\" "
+                                  "(\"" << ftsTableName << "\", rowid, " << columns << ") "
+                                  "VALUES ('delete', old.rowid, " << join(oldExprs, ", ") << ")");
+        createTrigger(ftsTableName, "ins", "AFTER INSERT", "", insertNew);
+        createTrigger(ftsTableName, "del", "AFTER DELETE", "", deleteOld);
+        createTrigger(ftsTableName, "upd", "AFTER UPDATE OF body", "", deleteOld + "; " + insertNew);
+        return true;
+    }
+
+
+    string SQLiteKeyStore::FTS5ContentViewName(const string &ftsTableName) {
+        return ftsTableName + ":content";
+    }
+
+
+    bool SQLiteKeyStore::isFTS5Table(const string &tableName) const {
+        string sql;
+        return db().getSchema(tableName, "table", tableName, sql)
+            && sql.find("USING fts5(") != string::npos;
+    }
+
+
 #pragma mark - ARRAY INDEX:
 
 
@@ -308,49 +642,75 @@ namespace litecore {
                             " body BLOB NOT NULL, "
                             " CONSTRAINT pk PRIMARY KEY (docid, i)) "
                             "WITHOUT ROWID");
-        if (!_schemaExistsWithSQL(unnestTableName, "table", unnestTableName, sql)) {
-            LogTo(QueryLog, "Creating UNNEST table '%s'", unnestTableName.c_str());
+        bool lazy = options && options->lazy;
+        QueryParser qp(*this);
+        qp.setBodyColumnName("new.body");
+        string eachExpr = qp.eachExpressionSQL(path);
+
+        if (_schemaExistsWithSQL(unnestTableName, "table", unnestTableName, sql)) {
+            // The table may be shared by several array indexes; the last one created decides
+            // whether it's updated lazily.
+            if (isLazyIndexTable(unnestTableName) == lazy)
+                return unnestTableName;
+            LogTo(QueryLog, "Making UNNEST table '%s' %s",
+                  unnestTableName.c_str(), (lazy ? "lazy" : "immediate"));
+            updateLazyIndexTables({unnestTableName});
+            dropIndexTableTriggers(unnestTableName);
+        } else {
+            LogTo(QueryLog, "Creating %sUNNEST table '%s'",
+                  (lazy ? "lazy " : ""), unnestTableName.c_str());
             db().exec(sql);
 
-            QueryParser qp(*this);
-            qp.setBodyColumnName("new.body");
-            string eachExpr = qp.eachExpressionSQL(path);
-
             // Populate the index-table with data from existing documents:
             db().exec(CONCAT("INSERT INTO \"" << unnestTableName << "\" (docid, i, body) "
                              "SELECT new.rowid, _each.rowid, _each.value " <<
                              "FROM " << kvTableName << " as new, " << eachExpr << " AS _each "
                              "WHERE (new.flags & 1) = 0"));
+        }
 
-            // Set up triggers to keep the index-table up to date
-            // ...on insertion:
-            string insertTriggerExpr = CONCAT("INSERT INTO \"" << unnestTableName <<
-                                              "\" (docid, i, body) "
-                                              "SELECT new.rowid, _each.rowid, _each.value " <<
-                                              "FROM " << eachExpr << " AS _each ");
-            createTrigger(unnestTableName, "ins",
-                          "AFTER INSERT",
-                          "WHEN (new.flags & 1) = 0",
-                          insertTriggerExpr);
-
-            // ...on delete:
-            string deleteTriggerExpr = CONCAT("DELETE FROM \"" << unnestTableName << "\" "
-                                              "WHERE docid = old.rowid");
-            createTrigger(unnestTableName, "del",
-                          "BEFORE DELETE",
-                          "WHEN (old.flags & 1) = 0",
-                          deleteTriggerExpr);
-
-            // ...on update:
-            createTrigger(unnestTableName, "preupdate",
-                          "BEFORE UPDATE OF body, flags",
-                          "WHEN (old.flags & 1) = 0",
-                          deleteTriggerExpr);
-            createTrigger(unnestTableName, "postupdate",
-                          "AFTER UPDATE OF body, flags",
-                          "WHEN (new.flags & 1 = 0)",
-                          insertTriggerExpr);
+        if (lazy) {
+            // Set up triggers to record changed records, and the SQL to re-index them later:
+            string pending = pendingTableName(unnestTableName);
+            createLazyIndexTriggers(unnestTableName);
+            registerLazyIndexTable(unnestTableName,
+                CONCAT("DELETE FROM \"" << unnestTableName << "\" WHERE docid IN "
+                           "(SELECT docid FROM \"" << pending << "\"); "
+                       "INSERT INTO \"" << unnestTableName << "\" (docid, i, body) "
+                           "SELECT new.rowid, _each.rowid, _each.value " <<
+                           "FROM " << kvTableName << " as new, " << eachExpr << " AS _each "
+                           "WHERE (new.flags & 1) = 0 "
+                             "AND new.rowid IN (SELECT docid FROM \"" << pending << "\")"));
+            return unnestTableName;
         }
+
+        // Set up triggers to keep the index-table up to date
+        // ...on insertion:
+        string insertTriggerExpr = CONCAT("INSERT INTO \"" << unnestTableName <<
+                                          "\" (docid, i, body) "
+                                          "SELECT new.rowid, _each.rowid, _each.value " <<
+                                          "FROM " << eachExpr << " AS _each ");
+        createTrigger(unnestTableName, "ins",
+                      "AFTER INSERT",
+                      "WHEN (new.flags & 1) = 0",
+                      insertTriggerExpr);
+
+        // ...on delete:
+        string deleteTriggerExpr = CONCAT("DELETE FROM \"" << unnestTableName << "\" "
+                                          "WHERE docid = old.rowid");
+        createTrigger(unnestTableName, "del",
+                      "BEFORE DELETE",
+                      "WHEN (old.flags & 1) = 0",
+                      deleteTriggerExpr);
+
+        // ...on update:
+        createTrigger(unnestTableName, "preupdate",
+                      "BEFORE UPDATE OF body, flags",
+                      "WHEN (old.flags & 1) = 0",
+                      deleteTriggerExpr);
+        createTrigger(unnestTableName, "postupdate",
+                      "AFTER UPDATE OF body, flags",
+                      "WHEN (new.flags & 1 = 0)",
+                      insertTriggerExpr);
         return unnestTableName;
     }
 
@@ -367,6 +727,7 @@ namespace litecore {
             SQLite::Statement st(db(),
                  "SELECT unnestTbl.name FROM sqlite_master as unnestTbl "
                   "WHERE unnestTbl.type='table' and unnestTbl.name like (?1 || ':unnest:%') "
+                        "and unnestTbl.name not like '%:pending' "
                         "and not exists (SELECT * FROM sqlite_master "
                                          "WHERE type='index' and tbl_name=unnestTbl.name "
                                                "and sql not null)");
@@ -377,20 +738,510 @@ namespace litecore {
         for (string &tableName : garbageTableNames) {
             LogTo(QueryLog, "Dropping unused UNNEST table '%s'", tableName.c_str());
             db().exec(CONCAT("DROP TABLE \"" << tableName << "\""));
-            dropTrigger(tableName, "ins");
-            dropTrigger(tableName, "del");
-            dropTrigger(tableName, "preupdate");
-            dropTrigger(tableName, "postupdate");
+            dropIndexTableTriggers(tableName);
         }
     }
 
 
+#pragma mark - LAZY INDEXES:
+
+
+    /*
+     A lazy FTS or unnest table isn't updated by its triggers. Instead they just add the rowid of
+     each changed record to a table named `INDEXTABLE:pending`. Before a query uses the index
+     table, updateLazyIndexTables() re-indexes those records all at once and empties the pending
+     table. The SQL that does the re-indexing is stored in the `lazyindexes` table.
+     */
+
+
+    string SQLiteKeyStore::pendingTableName(const string &indexTableName) {
+        return indexTableName + ":pending";
+    }
+
+
+    bool SQLiteKeyStore::isLazyIndexTable(const string &indexTableName) const {
+        return db().tableExists(pendingTableName(indexTableName));
+    }
+
+
+    // Creates the pending table of a lazy index table, and the triggers that add to it.
+    void SQLiteKeyStore::createLazyIndexTriggers(const string &indexTableName) {
+        string pending = pendingTableName(indexTableName);
+        db().exec(CONCAT("CREATE TABLE IF NOT EXISTS \"" << pending << "\" "
+                         "(docid INTEGER PRIMARY KEY)"));
+        string addNew = CONCAT("INSERT OR IGNORE INTO \"" << pending << "\" VALUES (new.rowid)");
+        createTrigger(indexTableName, "pending_ins", "AFTER INSERT", "", addNew);
+        createTrigger(indexTableName, "pending_upd", "AFTER UPDATE OF body, flags", "", addNew);
+        createTrigger(indexTableName, "pending_del", "AFTER DELETE", "",
+                      CONCAT("INSERT OR IGNORE INTO \"" << pending << "\" VALUES (old.rowid)"));
+        db().exec("CREATE TABLE IF NOT EXISTS lazyindexes "
+                  "(indexTable TEXT PRIMARY KEY, updateSQL TEXT NOT NULL)");
+    }
+
+
+    // Records the SQL that re-indexes the records in a lazy index table's pending table. Until
+    // this is called, updateLazyIndexTables() leaves the table alone.
+    void SQLiteKeyStore::registerLazyIndexTable(const string &indexTableName,
+                                                const string &updateSQL)
+    {
+        SQLite::Statement st(db(), "INSERT OR REPLACE INTO lazyindexes (indexTable, updateSQL) "
+                                   "VALUES (?, ?)");
+        st.bind(1, indexTableName);
+        st.bind(2, updateSQL);
+        st.exec();
+    }
+
+
+    // Drops the triggers that keep an FTS or unnest table up to date, whether it's lazy or not,
+    // and its pending table if any. (Doesn't apply pending changes; see updateLazyIndexTables.)
+    void SQLiteKeyStore::dropIndexTableTriggers(const string &indexTableName) {
+        if (isLazyIndexTable(indexTableName)) {
+            db().exec(CONCAT("DROP TABLE \"" << pendingTableName(indexTableName) << "\""));
+            SQLite::Statement st(db(), "DELETE FROM lazyindexes WHERE indexTable=?");
+            st.bind(1, indexTableName);
+            st.exec();
+            unregisterIndexTableBuild(db(), indexTableName);
+            releaseIndexTableBuild(db(), indexTableName);
+        }
+        for (auto suffix : {"ins", "upd", "del", "preupdate", "postupdate",
+                            "pending_ins", "pending_upd", "pending_del"})
+            dropTrigger(indexTableName, suffix);
+    }
+
+
+    // Returns the names of this KeyStore's lazy FTS and unnest tables.
+    vector<string> SQLiteKeyStore::lazyIndexTables() const {
+        vector<string> tables;
+        if (db().tableExists("lazyindexes")) {
+            SQLite::Statement st(db(), "SELECT indexTable FROM lazyindexes "
+                                       "WHERE substr(indexTable, 1, length(?1) + 1) = (?1 || ':')");
+            st.bind(1, tableName());
+            while (st.executeStep())
+                tables.push_back(st.getColumn(0));
+        }
+        return tables;
+    }
+
+
+    void SQLiteKeyStore::updateLazyIndexes() {
+        updateLazyIndexTables(lazyIndexTables());
+    }
+
+
+    // Re-indexes the records in the pending tables of the given lazy index tables.
+    // Tables that aren't (or are no longer) lazy are ignored.
+    void SQLiteKeyStore::updateLazyIndexTables(const vector<string> &indexTableNames) {
+        if (!db().options().writeable)
+            return;     // Can't update; queries will see the tables as of their last update
+        if (indexTableNames.empty() || !db().tableExists("lazyindexes"))
+            return;
+
+        // Finds the tables with pending changes, so a Transaction is only needed if any do:
+        auto findUpdates = [&] {
+            vector<pair<string, string>> updates;       // (index table name, update SQL)
+            for (auto &indexTableName : indexTableNames) {
+                SQLite::Statement getSQL(db(), "SELECT updateSQL FROM lazyindexes "
+                                               "WHERE indexTable=?");
+                getSQL.bind(1, indexTableName);
+                if (getSQL.executeStep()) {
+                    string pending = pendingTableName(indexTableName);
+                    if (db().intQuery(CONCAT("SELECT EXISTS (SELECT 1 FROM \"" << pending
+                                             << "\")").c_str()))
+                        updates.emplace_back(indexTableName, getSQL.getColumn(0).getString());
+                }
+            }
+            return updates;
+        };
+        auto updates = findUpdates();
+        if (updates.empty())
+            return;
+
+        // Use this thread's Transaction if there is one, else make one. (Another thread's
+        // Transaction on the same connection can't be joined; making one waits for it to end,
+        // after which the pending tables have to be checked again.)
+        unique_ptr<Transaction> t;
+        if (!db().inThisThreadsTransaction()) {
+            t.reset(new Transaction(db()));
+            updates = findUpdates();
+        }
+        for (auto &update : updates) {
+            Stopwatch st;
+            db().exec(update.second);
+            int changes = db().exec(CONCAT("DELETE FROM \"" << pendingTableName(update.first)
+                                           << "\""));
+            LogTo(QueryLog, "Updated lazy index table '%s' with %d changed records in %.3f sec",
+                  update.first.c_str(), changes, st.elapsed());
+        }
+        if (t)
+            t->commit();
+    }
+
+
+    // True if an index table is still being populated by buildIndexTable(), or was left
+    // incomplete by a build that was interrupted: it has a pending table but isn't registered.
+    // Queries treat such a table as missing, rather than returning partial results.
+    bool SQLiteKeyStore::isIndexTableBuilding(const string &indexTableName) const {
+        if (!isLazyIndexTable(indexTableName))
+            return false;
+        SQLite::Statement st(db(), "SELECT 1 FROM lazyindexes WHERE indexTable=?");
+        st.bind(1, indexTableName);
+        return !st.executeStep();
+    }
+
+
+#pragma mark - PARALLEL INDEX BUILD:
+
+
+    /*
+     Populating a big FTS table in the Transaction that creates it would block other writers
+     until every record had been indexed. Instead, createFTSIndex() can leave the new table empty,
+     with lazy-index triggers that add changed records to its pending table, and then
+     buildIndexTable() populates it one chunk of rowids at a time:
+         * Worker threads evaluate the index expressions of each chunk's records, reading a
+           recent snapshot through a connection borrowed from the reader pool.
+         * The calling thread inserts the chunks' rows, in rowid order, one Transaction per chunk,
+           so other writers only ever wait for one chunk.
+     Finally createIndex() re-indexes the records in the pending table -- those that changed
+     after the table was created -- and replaces the lazy triggers, in one short Transaction.
+     The indexbuilds table records how to finish a build all at once, in case the process exits
+     before it's done; the ActiveIndexBuilds of the file tells a build that's still running, on
+     some other connection, from one that was interrupted.
+     */
+
+
+    atomic<unsigned> SQLiteKeyStore::sIndexBuildChunkSize {5000};
+    function<void(unsigned)> SQLiteKeyStore::sIndexBuildChunkCallback;
+
+    // An index table is built in parallel if its KeyStore has at least this many chunks of records
+    static const unsigned kParallelIndexBuildMinChunks = 4;
+
+    // Maximum number of worker threads used by buildIndexTable
+    static const unsigned kMaxIndexBuildThreads = 4;
+
+    // How many chunks, per worker thread, may be read ahead of the one being inserted
+    static const unsigned kIndexBuildChunksPerThread = 2;
+
+
+    namespace {
+        // The index tables being populated by buildIndexTable(), by all connections to a file
+        // in this process. Each build is identified by the ID claimIndexTableBuild() gave it.
+        class ActiveIndexBuilds : public RefCounted {
+        public:
+            static Retained<ActiveIndexBuilds> forDataFile(DataFile &dataFile) {
+                static const char* const kSharedObjectKey = "ActiveIndexBuilds";
+                Retained<RefCounted> builds = dataFile.sharedObject(kSharedObjectKey);
+                if (!builds) {
+                    Retained<RefCounted> newBuilds = new ActiveIndexBuilds;
+                    builds = dataFile.addSharedObject(kSharedObjectKey, newBuilds);
+                }
+                return (ActiveIndexBuilds*)builds.get();
+            }
+
+            uint64_t claim(const string &indexTableName) {
+                lock_guard<mutex> lock(_mutex);
+                return _builds[indexTableName] = ++_lastBuildID;
+            }
+
+            // Returns false if the table isn't being built, or if `buildID` is given and the
+            // table is being built by a different build.
+            bool release(const string &indexTableName, uint64_t buildID) {
+                lock_guard<mutex> lock(_mutex);
+                auto i = _builds.find(indexTableName);
+                if (i == _builds.end() || (buildID != 0 && i->second != buildID))
+                    return false;
+                _builds.erase(i);
+                return true;
+            }
+
+            bool isActive(const string &indexTableName) {
+                lock_guard<mutex> lock(_mutex);
+                return _builds.find(indexTableName) != _builds.end();
+            }
+
+        private:
+            mutex _mutex;
+            map<string, uint64_t> _builds;
+            uint64_t _lastBuildID {0};
+        };
+
+
+        // One row to be inserted into an index table
+        struct IndexRow {
+            int64_t docid;
+            vector<pair<bool, string>> values;      // (isNull, text) of each column
+        };
+
+        // The rows of a chunk of records. `unread` means no reader connection was available.
+        struct IndexChunk {
+            vector<IndexRow> rows;
+            bool unread {false};
+        };
+
+
+        // Runs an IndexTableBuild's selectSQL for the rowids [minRowid...maxRowid].
+        void readIndexChunk(SQLite::Statement &select, int64_t minRowid, int64_t maxRowid,
+                            IndexChunk &chunk)
+        {
+            UsingStatement u(select);
+            select.bind(1, (long long)minRowid);
+            select.bind(2, (long long)maxRowid);
+            int nCols = select.getColumnCount();
+            while (select.executeStep()) {
+                IndexRow row;
+                row.docid = select.getColumn(0).getInt64();
+                for (int i = 1; i < nCols; ++i) {
+                    SQLite::Column col = select.getColumn(i);
+                    if (col.isNull())
+                        row.values.emplace_back(true, string());
+                    else
+                        row.values.emplace_back(false, col.getString());
+                }
+                chunk.rows.push_back(move(row));
+            }
+        }
+
+
+        // Worker threads that read the chunks of an index table's rows, staying a limited
+        // number of chunks ahead of the one the caller is inserting.
+        class IndexChunkReader {
+        public:
+            IndexChunkReader(SQLiteDataFile &db, const string &selectSQL,
+                             unsigned chunkSize, unsigned nChunks, unsigned nThreads)
+            :_db(db)
+            ,_selectSQL(selectSQL)
+            ,_chunkSize(chunkSize)
+            ,_nChunks(nChunks)
+            ,_maxReadAhead(nThreads * kIndexBuildChunksPerThread)
+            {
+                for (unsigned i = 0; i < nThreads; ++i)
+                    _threads.emplace_back(&IndexChunkReader::run, this);
+            }
+
+            ~IndexChunkReader() {
+                {
+                    lock_guard<mutex> lock(_mutex);
+                    _stopped = true;
+                }
+                _cond.notify_all();
+                for (auto &thread : _threads)
+                    thread.join();
+            }
+
+            int64_t minRowid(unsigned n) const     {return int64_t(n) * _chunkSize + 1;}
+            int64_t maxRowid(unsigned n) const     {return int64_t(n + 1) * _chunkSize;}
+
+            // Waits for chunk `n` to be read, and returns it. Chunks must be taken in order.
+            unique_ptr<IndexChunk> take(unsigned n) {
+                unique_lock<mutex> lock(_mutex);
+                _cond.wait(lock, [&]{return _error || _chunks.find(n) != _chunks.end();});
+                if (_error)
+                    rethrow_exception(_error);
+                auto chunk = move(_chunks[n]);
+                _chunks.erase(n);
+                _taken = n + 1;
+                lock.unlock();
+                _cond.notify_all();
+                return chunk;
+            }
+
+        private:
+            void run() {
+                try {
+                    unsigned n;
+                    while (claim(n)) {
+                        unique_ptr<IndexChunk> chunk(new IndexChunk);
+                        {
+                            // A reader is borrowed per chunk, so that its snapshot is never old
+                            // enough to keep the WAL from being checkpointed for long:
+                            auto reader = _db.borrowWorkerReader();
+                            auto select = reader ? reader->compile(_selectSQL) : nullptr;
+                            if (select)
+                                readIndexChunk(*select, minRowid(n), maxRowid(n), *chunk);
+                            else
+                                chunk->unread = true;
+                        }
+                        lock_guard<mutex> lock(_mutex);
+                        _chunks[n] = move(chunk);
+                        _cond.notify_all();
+                    }
+                } catch (...) {
+                    lock_guard<mutex> lock(_mutex);
+                    if (!_error)
+                        _error = current_exception();
+                    _cond.notify_all();
+                }
+            }
+
+            // Claims the next chunk to read, after waiting till it's close enough to the caller.
+            bool claim(unsigned &n) {
+                unique_lock<mutex> lock(_mutex);
+                _cond.wait(lock, [&]{return _stopped || _error || _next >= _nChunks
+                                         || _next < _taken + _maxReadAhead;});
+                if (_stopped || _error || _next >= _nChunks)
+                    return false;
+                n = _next++;
+                return true;
+            }
+
+            SQLiteDataFile &_db;
+            string const _selectSQL;
+            unsigned const _chunkSize, _nChunks, _maxReadAhead;
+            vector<thread> _threads;
+            mutex _mutex;
+            condition_variable _cond;
+            map<unsigned, unique_ptr<IndexChunk>> _chunks;  // Chunks read but not yet taken
+            unsigned _next {0};                             // Next chunk to be claimed
+            unsigned _taken {0};                            // Number of chunks taken
+            bool _stopped {false};
+            exception_ptr _error;
+        };
+    }
+
+
+    bool SQLiteKeyStore::shouldBuildIndexTableInParallel() const {
+        auto maxRowid = db().intQuery(CONCAT("SELECT max(rowid) FROM kv_" << name()).c_str());
+        return maxRowid >= int64_t(kParallelIndexBuildMinChunks) * sIndexBuildChunkSize;
+    }
+
+
+    // Populates an index table left empty by createFTSIndex(). Must not be in a Transaction.
+    void SQLiteKeyStore::buildIndexTable(const IndexTableBuild &build) {
+        unsigned chunkSize = sIndexBuildChunkSize;
+        auto maxRowid = db().intQuery(CONCAT("SELECT max(rowid) FROM kv_" << name()).c_str());
+        auto nChunks = unsigned((maxRowid + chunkSize - 1) / chunkSize);
+        unsigned nThreads = min(max(thread::hardware_concurrency(), 2u) - 1,
+                                kMaxIndexBuildThreads);
+        LogTo(QueryLog, "Building index table '%s' in %u chunks, with %u threads",
+              build.tableName.c_str(), nChunks, nThreads);
+
+        SQLite::Statement insert(db(), build.insertSQL);
+        unique_ptr<SQLite::Statement> select;
+        IndexChunkReader reader(db(), build.selectSQL, chunkSize, nChunks, nThreads);
+        for (unsigned n = 0; n < nChunks; ++n) {
+            auto chunk = reader.take(n);
+            Transaction t(db());
+            if (chunk->unread) {
+                // No reader connection was available, so read it on this connection:
+                if (!select)
+                    select.reset(new SQLite::Statement(db(), build.selectSQL));
+                readIndexChunk(*select, reader.minRowid(n), reader.maxRowid(n), *chunk);
+            }
+            UsingStatement u(insert);
+            for (auto &row : chunk->rows) {
+                insert.bind(1, (long long)row.docid);
+                int param = 2;
+                for (auto &value : row.values) {
+                    if (value.first)
+                        insert.bind(param++); // null
+                    else
+                        insert.bindNoCopy(param++, value.second);
+                }
+                insert.exec();
+                insert.reset();
+            }
+            t.commit();
+            if (sIndexBuildChunkCallback)
+                sIndexBuildChunkCallback(n);
+        }
+    }
+
+
+    // Marks an index table as being built by this process. Call inside the Transaction that
+    // registers the build, so no other connection sees it registered but unclaimed.
+    static uint64_t claimIndexTableBuild(DataFile &db, const string &indexTableName) {
+        return ActiveIndexBuilds::forDataFile(db)->claim(indexTableName);
+    }
+
+
+    // Ends the claim on an index table. With a `buildID`, only if it's still that build's claim;
+    // returns false if it isn't, i.e. the index has since been deleted or re-created.
+    static bool releaseIndexTableBuild(DataFile &db, const string &indexTableName,
+                                       uint64_t buildID)
+    {
+        return ActiveIndexBuilds::forDataFile(db)->release(indexTableName, buildID);
+    }
+
+
+    static bool isIndexTableBuildActive(DataFile &db, const string &indexTableName) {
+        return ActiveIndexBuilds::forDataFile(db)->isActive(indexTableName);
+    }
+
+
+    // Records the SQL that populates an index table all at once, while buildIndexTable() is
+    // populating it in chunks. If the process exits before the build finishes, the table is
+    // rebuilt with it the next time the file is opened.
+    void SQLiteKeyStore::registerIndexTableBuild(const string &indexTableName,
+                                                 const string &rebuildSQL,
+                                                 const string &updateSQL)
+    {
+        db().exec("CREATE TABLE IF NOT EXISTS indexbuilds "
+                  "(indexTable TEXT PRIMARY KEY, rebuildSQL TEXT NOT NULL, "
+                  "updateSQL TEXT NOT NULL)");
+        SQLite::Statement st(db(), "INSERT OR REPLACE INTO indexbuilds "
+                                   "(indexTable, rebuildSQL, updateSQL) VALUES (?, ?, ?)");
+        st.bind(1, indexTableName);
+        st.bind(2, rebuildSQL);
+        st.bind(3, updateSQL);
+        st.exec();
+    }
+
+
+    void SQLiteKeyStore::unregisterIndexTableBuild(SQLiteDataFile &db,
+                                                   const string &indexTableName)
+    {
+        if (db.tableExists("indexbuilds")) {
+            SQLite::Statement st(db, "DELETE FROM indexbuilds WHERE indexTable=?");
+            st.bind(1, indexTableName);
+            st.exec();
+        }
+    }
+
+
+    // Called when a file is opened. Rebuilds the index tables whose builds were interrupted,
+    // leaving them lazy. (Re-creating the index makes it immediate again, if it was.)
+    // Builds that another connection in this process is still running are left alone; they're
+    // claimed in the same Transaction that registers them, so checking under the file lock is
+    // enough to tell them apart.
+    void SQLiteKeyStore::finishInterruptedIndexBuilds(SQLiteDataFile &db) {
+        if (!db.options().writeable || !db.tableExists("indexbuilds"))
+            return;
+        Transaction t(db);
+        SQLite::Statement builds(db, "SELECT indexTable, rebuildSQL, updateSQL FROM indexbuilds");
+        vector<array<string, 3>> rows;
+        while (builds.executeStep())
+            rows.push_back({builds.getColumn(0).getString(), builds.getColumn(1).getString(),
+                            builds.getColumn(2).getString()});
+        builds.reset();
+        for (auto &row : rows) {
+            const string &indexTableName = row[0];
+            if (isIndexTableBuildActive(db, indexTableName))
+                continue;
+            if (!db.tableExists(indexTableName)) {
+                unregisterIndexTableBuild(db, indexTableName);
+                continue;
+            }
+            Warn("Rebuilding index table '%s', whose build was interrupted",
+                 indexTableName.c_str());
+            db.exec(row[1]);
+            db.exec(CONCAT("DELETE FROM \"" << pendingTableName(indexTableName) << "\""));
+            SQLite::Statement reg(db, "INSERT OR REPLACE INTO lazyindexes (indexTable, updateSQL) "
+                                      "VALUES (?, ?)");
+            reg.bind(1, indexTableName);
+            reg.bind(2, row[2]);
+            reg.exec();
+            unregisterIndexTableBuild(db, indexTableName);
+        }
+        t.commit();
+    }
+
+
 #pragma mark - UTILITIES:
 
 
-    // Part of the QueryParser delegate API
+    // Part of the QueryParser delegate API. An index table that's still being built doesn't
+    // count, since it would give partial results.
     bool SQLiteKeyStore::tableExists(const std::string &tableName) const {
-        return db().tableExists(tableName);
+        return db().tableExists(tableName) && !isIndexTableBuilding(tableName);
     }
 
 
@@ -27,6 +27,8 @@
 #include "FleeceImpl.hh"
 #include <regex>
 #include <cmath>
+#include <list>
+#include <mutex>
 #include <string>
 
 #ifdef _MSC_VER
@@ -506,7 +508,7 @@ namespace litecore {
     static void contains(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
         auto arg0 = stringArgument(argv[0]);
         auto arg1 = stringArgument(argv[1]);
-        sqlite3_result_int(ctx, arg0.find(arg1).buf != nullptr);
+        sqlite3_result_int(ctx, arg1.buf && findBytes(arg0, arg1) != nullptr);
     }
 
     // length() returns the length in characters of a string.
@@ -518,7 +520,14 @@ namespace litecore {
     static void changeCase(sqlite3_context* ctx, sqlite3_value **argv, bool isUpper) noexcept {
         try {
             auto arg = stringArgument(argv[0]);
-            result_alloc_slice(ctx, UTF8ChangeCase(arg, isUpper));
+            if (ASCIIPrefixLength(arg) == arg.size) {
+                // Pure ASCII, so there's no need to call the platform's Unicode case mapping:
+                alloc_slice result(arg.size);
+                ASCIIChangeCase((const uint8_t*)arg.buf, (uint8_t*)result.buf, arg.size, isUpper);
+                result_alloc_slice(ctx, result);
+            } else {
+                result_alloc_slice(ctx, UTF8ChangeCase(arg, isUpper));
+            }
         } catch (const std::exception &) {
             sqlite3_result_error(ctx, "upper() or lower() caught an exception!", -1);
         }
@@ -643,20 +652,97 @@ namespace litecore {
 #pragma mark - REGULAR EXPRESSIONS:
 
 
+    // A small LRU cache of compiled regular expressions, shared by the functions registered on
+    // one SQLite connection. Compiling a std::regex costs far more than matching with it, so this
+    // keeps a pattern from being recompiled for every row when it isn't a constant expression.
+    // (Constant patterns are cached more cheaply with sqlite3_set_auxdata; see compiledRegex.)
+    class RegexCache {
+    public:
+        static constexpr size_t kCapacity = 16;
+
+        // Returns the compiled form of a pattern. Throws std::regex_error if it's invalid.
+        shared_ptr<const regex> get(slice pattern) {
+            lock_guard<mutex> lock(_mutex);
+            for (auto i = _entries.begin(); i != _entries.end(); ++i) {
+                if (slice(i->first) == pattern) {
+                    _entries.splice(_entries.begin(), _entries, i);     // Move to front
+                    return i->second;
+                }
+            }
+            // The `optimize` flag makes matching faster at the expense of compiling, which is
+            // now a good trade-off since a compiled regex is reused for many rows:
+            auto r = make_shared<const regex>((const char*)pattern.buf, pattern.size,
+                                              regex::ECMAScript | regex::optimize);
+            _entries.emplace_front(pattern.asString(), r);
+            if (_entries.size() > kCapacity)
+                _entries.pop_back();
+            return r;
+        }
+
+    private:
+        mutex _mutex;
+        list<pair<string, shared_ptr<const regex>>> _entries;   // Most recently used first
+    };
+
+
+    shared_ptr<RegexCache> NewRegexCache() {
+        return make_shared<RegexCache>();
+    }
+
+
+    // Returns the compiled regex for the pattern in argv[argNo], or null after setting an error
+    // result if the pattern is missing or invalid.
+    static shared_ptr<const regex> compiledRegex(sqlite3_context *ctx, sqlite3_value **argv,
+                                                 int argNo) noexcept
+    {
+        // If the pattern is a constant, SQLite keeps the auxdata for the life of the statement:
+        auto cached = (shared_ptr<const regex>*)sqlite3_get_auxdata(ctx, argNo);
+        if (cached)
+            return *cached;
+
+        slice pattern = stringArgument(argv[argNo]);
+        if (!pattern) {
+            sqlite3_result_null(ctx);
+            return nullptr;
+        }
+        shared_ptr<const regex> r;
+        try {
+            auto cache = ((fleeceFuncContext*)sqlite3_user_data(ctx))->regexCache;
+            if (cache)
+                r = cache->get(pattern);
+            else
+                r = make_shared<const regex>((const char*)pattern.buf, pattern.size);
+        } catch (const regex_error &x) {
+            Warn("Invalid regular expression `%.*s` in query: %s", SPLAT(pattern), x.what());
+            sqlite3_result_error(ctx, "Invalid regular expression", -1);
+            return nullptr;
+        } catch (const bad_alloc&) {
+            sqlite3_result_error_nomem(ctx);
+            return nullptr;
+        }
+        sqlite3_set_auxdata(ctx, argNo, new shared_ptr<const regex>(r), [](void *auxdata) {
+            delete (shared_ptr<const regex>*)auxdata;
+        });
+        return r;
+    }
+
+
     static void regexp_like(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        auto r = compiledRegex(ctx, argv, 1);
+        if (!r)
+            return;
         auto arg0 = stringArgument(argv[0]);
-        auto arg1 = stringArgument(argv[1]);
-        regex r((char *)arg1.buf);
-        int result = regex_search((char *)arg0.buf, r) ? 1 : 0;
+        int result = regex_search((const char*)arg0.buf, (const char*)arg0.end(), *r) ? 1 : 0;
         sqlite3_result_int(ctx, result);
     }
 
     static void regexp_position(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        auto r = compiledRegex(ctx, argv, 1);
+        if (!r)
+            return;
         auto arg0 = stringArgument(argv[0]);
-        auto arg1 = stringArgument(argv[1]);
-        regex r((char *)arg1.buf);
         cmatch pattern_match;
-        if(!regex_search((char *)arg0.buf, pattern_match, r)) {
+        if(!regex_search((const char*)arg0.buf, (const char*)arg0.end(), pattern_match, *r)) {
             sqlite3_result_int64(ctx, -1);
             return;
         }
@@ -665,8 +751,10 @@ namespace litecore {
     }
 
     static void regexp_replace(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        auto r = compiledRegex(ctx, argv, 1);
+        if (!r)
+            return;
         auto expression = stringArgument(argv[0]).asString();
-        auto pattern = stringArgument(argv[1]);
         auto repl = stringArgument(argv[2]).asString();
         string result;
         auto out = back_inserter(result);
@@ -675,8 +763,7 @@ namespace litecore {
             n = sqlite3_value_int(argv[3]);
         }
 
-        regex r((char *)pattern.buf);
-        auto iter = sregex_iterator(expression.begin(), expression.end(), r);
+        auto iter = sregex_iterator(expression.begin(), expression.end(), *r);
         auto last_iter = iter;
         auto stop = sregex_iterator();
         if(iter == stop) {
@@ -22,15 +22,21 @@
 #include "Logging.hh"
 #include "Query.hh"
 #include "QueryParser.hh"
+#include "QueryCache.hh"
 #include "Error.hh"
 #include "StringUtil.hh"
 #include "FleeceImpl.hh"
 #include "Path.hh"
+#include "Instrumentation.hh"
 #include "Stopwatch.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <sstream>
 #include <iostream>
+#include <unordered_set>
 
 using namespace std;
 using namespace fleece;
@@ -39,6 +45,7 @@ using namespace fleece::impl;
 namespace litecore {
 
     class SQLiteQueryEnumerator;
+    class SQLiteQueryStreamingEnumerator;
 
 
     // Implicit columns in full-text query result:
@@ -47,6 +54,10 @@ namespace litecore {
         kFTSOffsetsCol
     };
 
+    // Above this many changed docs, an incremental refresh just re-runs the query, since checking
+    // each doc against the WHERE clause would likely take longer.
+    static const size_t kMaxIncrementalChanges = 1000;
+
 
     class SQLiteQuery : public Query, Logging {
     public:
@@ -54,8 +65,10 @@ namespace litecore {
         :Query(keyStore)
         ,Logging(QueryLog)
         {
+            LatencyTimer timer(metric::queryCompileTime);
             log("Compiling JSON query: %.*s", SPLAT(selectorExpression));
             QueryParser qp(keyStore);
+            qp.setTrackDocKeys(true);
             qp.parseJSON(selectorExpression);
 
             _parameters = qp.parameters();
@@ -68,17 +81,27 @@ namespace litecore {
 
             _ftsTables = qp.ftsTablesUsed();
             for (auto ftsTable : _ftsTables) {
-                if (!keyStore.db().tableExists(ftsTable))
+                if (!keyStore.tableExists(ftsTable))       // (false if it's still being built)
                     error::_throw(error::NoSuchIndex, "'match' test requires a full-text index");
             }
 
+            // Note the FTS and unnest tables it uses; any that are lazy when it runs have to be
+            // updated first. (That's checked at run time, since an index can be made lazy
+            // while the query is alive.)
+            _indexTables = _ftsTables;
+            auto &unnestTables = qp.unnestTablesUsed();
+            _indexTables.insert(_indexTables.end(), unnestTables.begin(), unnestTables.end());
+
             string sql = qp.SQL();
             log("Compiled as %s", sql.c_str());
             LogTo(SQL, "Compiled {Query#%u}: %s", _objectRef, sql.c_str());
-            _statement.reset(keyStore.compile(sql));
+            _sql = sql;
+            _statement.reset(keyStore.compile(sql, _statementHandle));
             
             _1stCustomResultColumn = qp.firstCustomResultColumn();
             _isAggregate = qp.isAggregateQuery();
+            _docKeyColumn = qp.docKeyColumn();
+            _docMatchSQL = qp.docMatchSQL();
         }
 
 
@@ -86,6 +109,21 @@ namespace litecore {
             return keyStore().lastSequence();
         }
 
+        // Brings the lazy index tables the query uses up to date. This needs a Transaction; if
+        // another thread is in one, the update is skipped instead of waiting for it, and the
+        // query runs on a reader (see createRecordingEnumerator), seeing the lazy tables as of
+        // their last update.
+        void updateLazyIndexes() {
+            if (_indexTables.empty())
+                return;
+            auto &keyStore = (SQLiteKeyStore&)this->keyStore();
+            if (keyStore.db().inOtherThreadsTransaction()) {
+                logVerbose("Another thread is in a transaction; not updating lazy indexes");
+                return;
+            }
+            keyStore.updateLazyIndexTables(_indexTables);
+        }
+
 
         alloc_slice getMatchedText(const FullTextTerm &term) override {
             // Get the expression that generated the text
@@ -93,9 +131,10 @@ namespace litecore {
                 error::_throw(error::NoSuchIndex);
             string expr = _ftsTables[0];    // TODO: Support for multiple matches in a query
 
+            lock_guard<mutex> lock(_matchedTextMutex);  // the Query may be shared by many users
             if (!_matchedTextStatement) {
                 auto &df = (SQLiteDataFile&) keyStore().dataFile();
-                string sql = "SELECT * FROM \"" + expr + "\" WHERE docid=?";
+                string sql = "SELECT * FROM \"" + expr + "\" WHERE rowid=?";
                 _matchedTextStatement.reset(new SQLite::Statement(df, sql));
             }
 
@@ -116,14 +155,18 @@ namespace litecore {
 
 
         string explain() override {
+            return explain((SQLiteDataFile&) keyStore().dataFile());
+        }
+
+        // Explains the query plan on a specific connection, i.e. a reader's.
+        string explain(SQLite::Database &db) {
             stringstream result;
             // https://www.sqlite.org/eqp.html
-            string query = _statement->getQuery();
+            const string &query = _sql;
             result << query << "\n";
 
             string sql = "EXPLAIN QUERY PLAN " + query;
-            auto &df = (SQLiteDataFile&) keyStore().dataFile();
-            SQLite::Statement x(df, sql);
+            SQLite::Statement x(db, sql);
             while (x.executeStep()) {
                 for (int i = 0; i < 3; ++i)
                     result << x.getColumn(i).getInt() << "|";
@@ -132,25 +175,115 @@ namespace litecore {
             return result.str();
         }
 
+        Stats stats() const override {
+            lock_guard<mutex> lock(_statsMutex);
+            return _stats;
+        }
+
+        void resetStats() override {
+            lock_guard<mutex> lock(_statsMutex);
+            _stats = { };
+        }
+
+        // Called by a runner when it's done; `db` is the connection the statement ran on, and
+        // `handle` is the statement's sqlite3_stmt if known.
+        void recordRun(SQLite::Database &db, sqlite3_stmt *handle,
+                       double elapsed, uint64_t rowCount) {
+            StatementStatus status = handle ? TakeStatementStatus(handle) : StatementStatus{ };
+            {
+                lock_guard<mutex> lock(_statsMutex);
+                ++_stats.runs;
+                _stats.totalTime += elapsed;
+                _stats.maxTime = max(_stats.maxTime, elapsed);
+                _stats.rowsReturned += rowCount;
+                _stats.vmSteps += status.vmSteps;
+                _stats.fullScanSteps += status.fullScanSteps;
+                _stats.sorts += status.sorts;
+                _stats.autoIndexRows += status.autoIndexRows;
+            }
+
+            double threshold = slowQueryThreshold();
+            if (threshold > 0 && elapsed >= threshold) {
+                string plan;
+                try {
+                    plan = explain(db);
+                } catch (const exception &x) {
+                    plan = string("(couldn't explain: ") + x.what() + ")";
+                }
+                warn("Slow query took %.3fms, returning %llu rows (%llu VM steps, "
+                     "%llu full-scan steps, %llu sorts, %llu auto-index rows); plan:\n%s",
+                     elapsed * 1000, (unsigned long long)rowCount,
+                     (unsigned long long)status.vmSteps,
+                     (unsigned long long)status.fullScanSteps,
+                     (unsigned long long)status.sorts,
+                     (unsigned long long)status.autoIndexRows, plan.c_str());
+            }
+        }
+
         virtual QueryEnumerator* createEnumerator(const Options *options) override;
-        SQLiteQueryEnumerator* createEnumerator(const Options *options, sequence_t lastSeq);
+        QueryEnumerator* createEnumerator(const Options *options, sequence_t lastSeq);
+        SQLiteQueryEnumerator* createRecordingEnumerator(const Options *options,
+                                                         sequence_t lastSeq);
+        SQLiteQueryStreamingEnumerator* createStreamingEnumerator(const Options *options,
+                                                                  sequence_t lastSeq);
 
         unsigned objectRef() const                  {return _objectRef;}
 
+        // True if a change to a doc that matches the WHERE clause neither before nor after can't
+        // affect the results, so a refresh can skip docs that don't.
+        bool canRefreshIncrementally() const {
+            lock_guard<mutex> lock(_docMatchMutex);
+            return !_docMatchSQL.empty();
+        }
+
+        bool anyDocMatches(const vector<alloc_slice> &docIDs, const Options &options);
+
         set<string> _parameters;
         vector<string> _ftsTables;
+        vector<string> _indexTables;        // FTS and unnest tables the query uses
         unsigned _1stCustomResultColumn;
         bool _isAggregate;
+        int _docKeyColumn;                  // Result column containing doc key, or -1
+
+        // Returns the query's statement for a runner to use, or if another runner is already
+        // using it (the Query may be shared via the QueryCache), a newly compiled private copy.
+        // Either way the runner must call releaseStatement() when done.
+        shared_ptr<SQLite::Statement> acquireStatement(sqlite3_stmt* &outHandle) {
+            if (_statementBusy.exchange(true))
+                return newStatement(outHandle);
+            outHandle = _statementHandle;
+            return _statement;
+        }
 
-        shared_ptr<SQLite::Statement> statement() {return _statement;}
+        void releaseStatement(const shared_ptr<SQLite::Statement> &statement) {
+            if (statement == _statement)
+                _statementBusy = false;
+        }
+
+        // Compiles a private copy of the statement.
+        shared_ptr<SQLite::Statement> newStatement(sqlite3_stmt* &outHandle) {
+            logVerbose("Shared statement is busy; compiling a private copy");
+            auto &keyStore = (SQLiteKeyStore&)this->keyStore();
+            return shared_ptr<SQLite::Statement>(keyStore.compile(_sql, outHandle));
+        }
 
     protected:
         ~SQLiteQuery() =default;
         string loggingClassName() const override    {return "Query";}
 
     private:
+        string _sql;                                    // _statement's SQL, without marker
         shared_ptr<SQLite::Statement> _statement;
+        sqlite3_stmt* _statementHandle {nullptr};       // _statement's sqlite3_stmt
+        atomic<bool> _statementBusy {false};            // Is a runner using _statement?
+        mutex _matchedTextMutex;                        // Guards _matchedTextStatement
         unique_ptr<SQLite::Statement> _matchedTextStatement;
+        mutable mutex _docMatchMutex;                   // Guards _docMatchSQL & _docMatchStatement
+        string _docMatchSQL;
+        shared_ptr<SQLite::Statement> _docMatchStatement;
+        sqlite3_stmt* _docMatchHandle {nullptr};
+        mutable mutex _statsMutex;
+        Stats _stats { };
     };
 
 
@@ -170,6 +303,10 @@ namespace litecore {
                 _options = *options;
         }
 
+        SQLiteQuery* query() const                  {return _query;}
+        const Query::Options& options() const       {return _options;}
+        sequence_t lastSequence() const             {return _lastSequence;}
+
     protected:
         Retained<SQLiteQuery> _query;
         Query::Options _options;
@@ -178,6 +315,27 @@ namespace litecore {
 
 
 
+    // Parses the FTS columns of a result row into `terms`.
+    static void parseFullTextTerms(const Array *row, QueryEnumerator::FullTextTerms &terms) {
+        terms.clear();
+        uint64_t dataSource = row->get(kFTSRowidCol)->asInt();
+        // The offsets() function returns a string of space-separated numbers in groups of 4.
+        string offsets = row->get(kFTSOffsetsCol)->asString().asString();
+        const char *termStr = offsets.c_str();
+        while (*termStr) {
+            uint32_t n[4];
+            for (int i = 0; i < 4; ++i) {
+                char *next;
+                n[i] = (uint32_t)strtol(termStr, &next, 10);
+                termStr = next;
+            }
+            terms.push_back({dataSource, n[0], n[1], n[2], n[3]});
+            // {rowid, key #, term #, byte offset, byte length}
+        }
+    }
+
+
+
     // Query enumerator that reads from prerecorded Fleece data (generated by fastForward(), below)
     // Each array item is a row, which is itself an array of column values.
     class SQLiteQueryEnumerator : public QueryEnumerator, SQLiteQueryEnumBase, Logging {
@@ -246,9 +404,30 @@ namespace litecore {
         }
 
 
+        bool canRefreshIncrementally() const override {
+            return _query->canRefreshIncrementally();
+        }
+
+        QueryEnumerator* refreshWithChanges(const vector<alloc_slice> &changedDocIDs,
+                                            sequence_t changesThrough) override
+        {
+            if (!canRefreshIncrementally() || changedDocIDs.size() > kMaxIncrementalChanges)
+                return refresh();
+            sequence_t curSeq = _query->lastSequence();
+            if (curSeq == _lastSequence)
+                return nullptr;
+            if (changesThrough < curSeq || isAffectedBy(changedDocIDs))
+                return refresh();
+            // None of the changed docs match the query, or did before, so the results are the same:
+            logVerbose("Skipped refresh; none of %zu changed docs affect the results",
+                       changedDocIDs.size());
+            _lastSequence = curSeq;
+            return nullptr;
+        }
+
         QueryEnumerator* refresh() override {
             unique_ptr<SQLiteQueryEnumerator> newEnum(
-                                            _query->createEnumerator(&_options, _lastSequence) );
+                                    _query->createRecordingEnumerator(&_options, _lastSequence) );
             if (newEnum) {
                 if (!hasEqualContents(newEnum.get())) {
                     // Results have changed, so return new enumerator:
@@ -265,21 +444,7 @@ namespace litecore {
         }
 
         const FullTextTerms& fullTextTerms() override {
-            _fullTextTerms.clear();
-            uint64_t dataSource = _iter->asArray()->get(kFTSRowidCol)->asInt();
-            // The offsets() function returns a string of space-separated numbers in groups of 4.
-            string offsets = _iter->asArray()->get(kFTSOffsetsCol)->asString().asString();
-            const char *termStr = offsets.c_str();
-            while (*termStr) {
-                uint32_t n[4];
-                for (int i = 0; i < 4; ++i) {
-                    char *next;
-                    n[i] = (uint32_t)strtol(termStr, &next, 10);
-                    termStr = next;
-                }
-                _fullTextTerms.push_back({dataSource, n[0], n[1], n[2], n[3]});
-                // {rowid, key #, term #, byte offset, byte length}
-            }
+            parseFullTextTerms(_iter->asArray(), _fullTextTerms);
             return _fullTextTerms;
         }
 
@@ -287,28 +452,55 @@ namespace litecore {
         string loggingClassName() const override    {return "QueryEnum";}
 
     private:
+        // Returns true if any of the docs is in my results, or currently matches the query.
+        bool isAffectedBy(const vector<alloc_slice> &docIDs) {
+            if (!_resultKeysLoaded) {
+                for (Array::iterator i(_rows); i; i += 2)
+                    _resultKeys.insert(i->asArray()->get(_query->_docKeyColumn)->asString());
+                _resultKeysLoaded = true;
+            }
+            for (auto &docID : docIDs) {
+                if (_resultKeys.find(docID) != _resultKeys.end())
+                    return true;
+            }
+            return _query->anyDocMatches(docIDs, _options);
+        }
+
         Retained<Doc> _recording;
         const Array* _rows;
         Array::iterator _iter;
         bool _first {true};
+        unordered_set<slice, fleece::sliceHash> _resultKeys;   // Doc keys of all rows
+        bool _resultKeysLoaded {false};
     };
 
 
 
     // Reads from 'live' SQLite statement and records the results into a Fleece array,
     // which is then used as the data source of a SQLiteQueryEnum.
+    // By default it uses the query's own statement, or a private copy if that one's busy.
+    // A statement on a reader connection must come with that reader's SharedKeys and connection.
+    // A given statement should come with its sqlite3_stmt, if known, for recording stats.
     class SQLiteQueryRunner : public SQLiteQueryEnumBase {
     public:
-        SQLiteQueryRunner(SQLiteQuery *query, const Query::Options *options, sequence_t lastSequence)
+        SQLiteQueryRunner(SQLiteQuery *query, const Query::Options *options, sequence_t lastSequence,
+                          shared_ptr<SQLite::Statement> statement =nullptr,
+                          sqlite3_stmt *handle =nullptr,
+                          SharedKeys *sk =nullptr,
+                          SQLite::Database *db =nullptr,
+                          bool partialStatement =false)
         :SQLiteQueryEnumBase(query, options, lastSequence)
-        ,_statement(query->statement())
-        ,_sk(query->keyStore().dataFile().documentKeys())
+        ,_statement(statement ? statement : query->acquireStatement(handle))
+        ,_handle(handle)        // (initialized after _statement, which may have set `handle`)
+        ,_sk(sk ? sk : query->keyStore().dataFile().documentKeys())
+        ,_db(db ? *db : mainConnection(query))
+        ,_partialStatement(partialStatement)
         {
             _statement->clearBindings();
             _unboundParameters = _query->_parameters;
             if (options && options->paramBindings.buf)
                 bindParameters(options->paramBindings);
-            if (!_unboundParameters.empty()) {
+            if (!_unboundParameters.empty() && !_partialStatement) {
                 stringstream msg;
                 for (const string &param : _unboundParameters)
                     msg << " $" << param;
@@ -323,6 +515,7 @@ namespace litecore {
             try {
                 _statement->reset();
             } catch (...) { }
+            _query->releaseStatement(_statement);
         }
 
         void bindParameters(slice json) {
@@ -359,11 +552,13 @@ namespace litecore {
                             error::_throw(error::InvalidParameter);
                     }
                 } catch (const SQLite::Exception &x) {
-                    if (x.getErrorCode() == SQLITE_RANGE)
+                    if (x.getErrorCode() != SQLITE_RANGE)
+                        throw;
+                    else if (_partialStatement)
+                        continue;       // parameter isn't used by this statement; that's OK
+                    else
                         error::_throw(error::InvalidQueryParam,
                                       "Unknown query property '%s'", key.c_str());
-                    else
-                        throw;
                 }
             }
         }
@@ -399,54 +594,249 @@ namespace litecore {
             return true;
         }
 
+        // Advances the statement to the next row; returns false at the end.
+        bool step() {
+            return _statement->executeStep();
+        }
+
+        // Writes the current row as an array of column values,
+        // returning a bit-map of which columns are missing/undefined.
+        uint64_t encodeRow(Encoder &enc) {
+            int nCols = _statement->getColumnCount();
+            uint64_t missingCols = 0;
+            enc.beginArray(nCols);
+            int firstCol = _query->_1stCustomResultColumn;
+            for (int i = 0; i < nCols; ++i) {
+                if (!encodeColumn(enc, i) && i >= firstCol && i - firstCol < 64)
+                    missingCols |= (1ull << (i - firstCol));
+            }
+            enc.endArray();
+            return missingCols;
+        }
+
+        SharedKeys* sharedKeys() const              {return _sk;}
+
+        static SQLite::Database& mainConnection(SQLiteQuery *query) {
+            return (SQLiteDataFile&)query->keyStore().dataFile();
+        }
+
+        // Adds this run to the query's stats; only the first call has any effect.
+        void recordStats(uint64_t rowCount) {
+            if (!_statsRecorded) {
+                _statsRecorded = true;
+                _query->recordRun(_db, _handle, _stopwatch.elapsed(), rowCount);
+            }
+        }
+
+        // Using the query's docMatchSQL statement, tests whether a doc matches the query.
+        bool matchesDoc(slice docID) {
+            _statement->bind("$docKey", (string)docID);
+            bool matches = _statement->executeStep();
+            _statement->reset();
+            return matches;
+        }
+
         // Collects all the (remaining) rows into a Fleece array of arrays,
         // and returns an enumerator impl that will replay them.
         SQLiteQueryEnumerator* fastForward() {
             Stopwatch st;
-            int nCols = _statement->getColumnCount();
             uint64_t rowCount = 0;
             Encoder enc;
             enc.setSharedKeys(_sk);
             enc.beginArray();
-            while (_statement->executeStep()) {
-                uint64_t missingCols = 0;
-                enc.beginArray(nCols);
-                for (int i = 0; i < nCols; ++i) {
-                    if (!encodeColumn(enc, i) && i < 64)
-                        missingCols |= (1 << i);
-                }
-                enc.endArray();
+            while (step()) {
+                uint64_t missingCols = encodeRow(enc);
                 // Add an integer containing a bit-map of which columns are missing/undefined:
                 enc.writeUInt(missingCols);
                 ++rowCount;
             }
             enc.endArray();
             Retained<Doc> recording = enc.finishDoc();
+            recordStats(rowCount);
             return new SQLiteQueryEnumerator(_query, &_options, _lastSequence, recording,
                                              rowCount, st.elapsed());
         }
 
     private:
         shared_ptr<SQLite::Statement> _statement;
+        sqlite3_stmt* _handle;              // _statement's sqlite3_stmt, or null if unknown
         set<string> _unboundParameters;
         SharedKeys* _sk;
+        SQLite::Database &_db;              // Connection the statement belongs to
+        bool _partialStatement;             // Statement may not use all the query's parameters
+        Stopwatch _stopwatch;
+        bool _statsRecorded {false};
+    };
+
+
+
+    // Query enumerator that reads rows directly from a 'live' SQLite statement as it's iterated,
+    // instead of recording them all first. Memory use is bounded and the first row is available
+    // right away, but getRowCount() and seek() aren't supported. The enumerator keeps the
+    // statement (and thus a read snapshot of the database) open until it's deleted.
+    class SQLiteQueryStreamingEnumerator : public QueryEnumerator, Logging {
+    public:
+        SQLiteQueryStreamingEnumerator(SQLiteQuery *query,
+                                       const Query::Options *options,
+                                       sequence_t lastSequence)
+        :Logging(QueryLog)
+        ,_runner(query, options, lastSequence)
+        {
+            // Step to the first row now, while the caller's read-only transaction is open, so
+            // that the statement's snapshot is consistent with `lastSequence`:
+            Stopwatch st;
+            _hasRow = _runner.step();
+            log("Created on {Query#%u}, streaming (first row in %.3fms)",
+                query->objectRef(), st.elapsed()*1000);
+        }
+
+        ~SQLiteQueryStreamingEnumerator() {
+            log("Deleted after %llu rows", (unsigned long long)_rowCount);
+            try {
+                _runner.recordStats(_rowCount);
+            } catch (...) { }
+        }
+
+        // The row count isn't known until the statement has been stepped to the end:
+        int64_t getRowCount() const override {
+            error::_throw(error::UnsupportedOperation);
+        }
+
+        bool next() override {
+            if (_first)
+                _first = false;
+            else if (_hasRow)
+                _hasRow = _runner.step();
+            if (!_hasRow) {
+                _row = nullptr;
+                _runner.recordStats(_rowCount);
+                logVerbose("END");
+                return false;
+            }
+            _enc.reset();
+            _enc.setSharedKeys(_runner.sharedKeys());
+            _missingColumns = _runner.encodeRow(_enc);
+            _row = _enc.finishDoc();
+            ++_rowCount;
+            if (willLog(LogLevel::Verbose)) {
+                alloc_slice json = _row->asArray()->toJSON();
+                logVerbose("--> %.*s", SPLAT(json));
+            }
+            return true;
+        }
+
+        Array::iterator columns() const noexcept override {
+            Array::iterator i(_row->asArray());
+            i += _runner.query()->_1stCustomResultColumn;
+            return i;
+        }
+
+        uint64_t missingColumns() const noexcept override {
+            return _missingColumns;
+        }
+
+        QueryEnumerator* refresh() override {
+            // The rows aren't kept, so there's nothing to compare against; just return a new
+            // enumerator if the database has changed at all.
+            return _runner.query()->createStreamingEnumerator(&_runner.options(),
+                                                              _runner.lastSequence());
+        }
+
+        bool hasFullText() const override {
+            return !_runner.query()->_ftsTables.empty();
+        }
+
+        const FullTextTerms& fullTextTerms() override {
+            parseFullTextTerms(_row->asArray(), _fullTextTerms);
+            return _fullTextTerms;
+        }
+
+    protected:
+        string loggingClassName() const override    {return "QueryEnum";}
+
+    private:
+        SQLiteQueryRunner _runner;
+        Encoder _enc;
+        Retained<Doc> _row;                 // Current row, as a Fleece array
+        uint64_t _missingColumns {0};
+        uint64_t _rowCount {0};
+        bool _hasRow;                       // Is the statement positioned on a row?
+        bool _first {true};
     };
 
 
 
-    // The factory method that creates a SQLite Query.
+    bool SQLiteQuery::anyDocMatches(const vector<alloc_slice> &docIDs, const Options &options) {
+        // Cached Queries are shared, so enumerators on other threads may be here at once:
+        lock_guard<mutex> lock(_docMatchMutex);
+        if (_docMatchSQL.empty())
+            return true;
+        if (!_docMatchStatement) {
+            try {
+                _docMatchStatement.reset(((SQLiteKeyStore&)keyStore()).compile(_docMatchSQL,
+                                                                               _docMatchHandle));
+            } catch (const SQLite::Exception &x) {
+                // e.g. the WHERE clause refers to a result column; give up on incremental refresh
+                _docMatchSQL.clear();
+                return true;
+            }
+        }
+        // The docMatch statement lacks the WHAT and ORDER_BY clauses, so it may not use every
+        // parameter the query does:
+        SQLiteQueryRunner matcher(this, &options, 0, _docMatchStatement, _docMatchHandle,
+                                  nullptr, nullptr, true);
+        for (auto &docID : docIDs) {
+            if (matcher.matchesDoc(docID))
+                return true;
+        }
+        return false;
+    }
+
+
+    // The factory method that creates a SQLite Query, or reuses an identical one from the cache.
     Retained<Query> SQLiteKeyStore::compileQuery(slice selectorExpression) {
-        return new SQLiteQuery(*this, selectorExpression);
+        QueryCache &cache = db().queryCache();
+        string key = QueryCache::keyFor(*this, selectorExpression);
+        Retained<Query> query;
+        if (!key.empty())
+            query = cache.get(key);
+        if (query) {
+            LogVerbose(QueryLog, "Reusing cached {Query#%u} for %.*s",
+                       ((SQLiteQuery*)query.get())->objectRef(), SPLAT(selectorExpression));
+        } else {
+            query = new SQLiteQuery(*this, selectorExpression);
+            if (!key.empty())
+                cache.put(key, query);
+        }
+        return query;
     }
 
 
     // The factory method that creates a SQLite QueryEnumerator, but only if the database has
     // changed since lastSeq.
-    SQLiteQueryEnumerator* SQLiteQuery::createEnumerator(const Options *options,
-                                                         sequence_t lastSeq)
+    SQLiteQueryEnumerator* SQLiteQuery::createRecordingEnumerator(const Options *options,
+                                                                  sequence_t lastSeq)
     {
+        LatencyTimer timer(metric::queryRunTime);
+        updateLazyIndexes();
         // Start a read-only transaction, to ensure that the result of lastSequence() will be
         // consistent with the query results.
+        // If another thread is in a Transaction, run the query on a reader connection instead,
+        // which sees the last committed state without having to wait for that Transaction:
+        auto reader = ((SQLiteKeyStore&)keyStore()).db().borrowReader();
+        if (reader) {
+            sqlite3_stmt *handle;
+            auto statement = reader->compile(_sql, &handle);
+            if (statement) {
+                sequence_t curSeq = reader->lastSequence(keyStore().name());
+                if (lastSeq > 0 && lastSeq == curSeq)
+                    return nullptr;
+                SQLiteQueryRunner recorder(this, options, curSeq, statement, handle,
+                                           reader->documentKeys(), &reader->database());
+                return recorder.fastForward();
+            }
+        }
+
         ReadOnlyTransaction t(keyStore().dataFile());
 
         sequence_t curSeq = lastSequence();
@@ -456,6 +846,27 @@ namespace litecore {
         return recorder.fastForward();
     }
 
+    // Same as above, but creates a streaming enumerator.
+    SQLiteQueryStreamingEnumerator* SQLiteQuery::createStreamingEnumerator(const Options *options,
+                                                                           sequence_t lastSeq)
+    {
+        LatencyTimer timer(metric::queryRunTime);
+        updateLazyIndexes();
+        ReadOnlyTransaction t(keyStore().dataFile());
+
+        sequence_t curSeq = lastSequence();
+        if (lastSeq > 0 && lastSeq == curSeq)
+            return nullptr;
+        return new SQLiteQueryStreamingEnumerator(this, options, curSeq);
+    }
+
+    QueryEnumerator* SQLiteQuery::createEnumerator(const Options *options, sequence_t lastSeq) {
+        if (options && options->streaming)
+            return createStreamingEnumerator(options, lastSeq);
+        else
+            return createRecordingEnumerator(options, lastSeq);
+    }
+
     QueryEnumerator* SQLiteQuery::createEnumerator(const Options *options) {
         return createEnumerator(options, 0);
     }
@@ -101,6 +101,30 @@ namespace litecore {
     }
 
 
+    alloc_slice RawRevision::stripBodies(slice raw_tree) {
+        // First pass computes the size, second pass copies everything but the bodies:
+        const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
+        size_t totalSize = raw_tree.size;
+        for (; rawRev->isValid(); rawRev = rawRev->next())
+            totalSize -= _dec32(rawRev->size_BE) - rawRev->headerSize();
+        if ((const uint8_t*)rawRev + sizeof(uint32_t) > (const uint8_t*)raw_tree.end())
+            error::_throw(error::CorruptRevisionData);
+
+        alloc_slice result(totalSize);
+        RawRevision *dst = (RawRevision*)result.buf;
+        for (rawRev = (const RawRevision*)raw_tree.buf; rawRev->isValid(); rawRev = rawRev->next()) {
+            size_t size = rawRev->headerSize();
+            memcpy(dst, rawRev, size);
+            dst->size_BE = _enc32((uint32_t)size);
+            dst->flags &= ~RawRevision::kHasData;
+            dst = (RawRevision*)offsetby(dst, size);
+        }
+        // Copy the trailing 0 size marker and the remote entries as-is:
+        memcpy(dst, rawRev, (uint8_t*)raw_tree.end() - (uint8_t*)rawRev);
+        return result;
+    }
+
+
     size_t RawRevision::sizeToWrite(const Rev &rev) {
         return offsetof(RawRevision, revID)
              + rev.revID.size
@@ -146,6 +170,14 @@ namespace litecore {
     }
 
 
+    size_t RawRevision::headerSize() const {
+        // Size of everything but the body, i.e. the fixed fields, revID and sequence:
+        const void *data = offsetby(&this->revID, this->revIDLen);
+        data = SkipVarInt(data);
+        return (uint8_t*)data - (uint8_t*)this;
+    }
+
+
     slice RawRevision::body() const {
         if (_usuallyTrue(this->flags & RawRevision::kHasData)) {
             const void* end = this->next();
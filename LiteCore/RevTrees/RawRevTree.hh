@@ -44,6 +44,11 @@ namespace litecore {
         static alloc_slice encodeTree(const std::vector<Rev*> &revs,
                                       const RevTree::RemoteRevMap &remoteMap);
 
+        /** Returns a copy of an encoded tree with all revision bodies removed, leaving only
+            the revIDs, flags, sequences and remote markers. The bodies are skipped over, not
+            read, so the cost depends only on the number of revisions. */
+        static alloc_slice stripBodies(slice raw_tree);
+
         static inline slice getCurrentRevBody(slice raw_tree) noexcept {
             const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
             return rawRev->body();
@@ -74,6 +79,7 @@ namespace litecore {
         }
 
         slice body() const;
+        size_t headerSize() const;
 
         const RawRevision *next() const {
             return (const RawRevision*)fleece::offsetby(this, _dec32(size_BE));
@@ -67,6 +67,7 @@ namespace litecore {
     }
 
     void RevTree::decode(litecore::slice raw_tree, sequence_t seq) {
+        _remoteRevs.clear();
         _revsStorage = RawRevision::decodeTree(raw_tree, _remoteRevs, this, seq);
         initRevs();
     }
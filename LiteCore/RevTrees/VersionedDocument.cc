@@ -17,6 +17,7 @@
 //
 
 #include "VersionedDocument.hh"
+#include "RawRevTree.hh"
 #include "Record.hh"
 #include "KeyStore.hh"
 #include "DataFile.hh"
@@ -29,10 +30,10 @@ namespace litecore {
     using namespace fleece;
     using namespace fleece::impl;
 
-    VersionedDocument::VersionedDocument(KeyStore& store, slice docID)
+    VersionedDocument::VersionedDocument(KeyStore& store, slice docID, bool withBodies)
     :_store(store), _rec(docID)
     {
-        read();
+        read(withBodies);
     }
 
     VersionedDocument::VersionedDocument(KeyStore& store, const Record& rec)
@@ -45,21 +46,38 @@ namespace litecore {
     :RevTree(other)
     ,_store(other._store)
     ,_rec(other._rec)
+    ,_bodiesSkipped(other._bodiesSkipped)
     {
-        updateScope();
+        if (!_bodiesSkipped)
+            updateScope();
     }
 
     VersionedDocument::~VersionedDocument() {
     }
 
-    void VersionedDocument::read() {
-        _store.read(_rec);
+    void VersionedDocument::read(bool withBodies) {
+        while (!_fleeceScopes.empty())
+            _fleeceScopes.pop();
+        if (withBodies) {
+            _store.read(_rec);
+        } else {
+            // Copy only the tree structure out of the stored record, without its bodies:
+            _store.getBorrowed(_rec.key(), kDefaultContent, [&](const RecordLite &rec) {
+                _rec.setVersion(alloc_slice(rec.version));
+                _rec.setFlags(rec.flags);
+                _rec.updateSequence(rec.sequence);
+                _rec.setBody(rec.body.buf ? RawRevision::stripBodies(rec.body) : alloc_slice());
+                _rec.setExists();
+            });
+        }
+        _bodiesSkipped = !withBodies && _rec.body().buf != nullptr;
         decode();
     }
 
     void VersionedDocument::decode() {
         _unknown = false;
-        updateScope();
+        if (!_bodiesSkipped)
+            updateScope();
         if (_rec.body().buf) {
             RevTree::decode(_rec.body(), _rec.sequence());
             // The kSynced flag is set when the document's current revision is pushed to a server.
@@ -130,6 +148,8 @@ namespace litecore {
     VersionedDocument::SaveResult VersionedDocument::save(Transaction& transaction) {
         if (!_changed)
             return kNoNewSequence;
+        if (_bodiesSkipped)
+            error::_throw(error::UnsupportedOperation);     // would lose the revision bodies
         updateMeta();
         sequence_t seq = _rec.sequence();
         bool createSequence;
@@ -156,6 +176,23 @@ namespace litecore {
         return createSequence ? kNewSequence : kNoNewSequence;
     }
 
+    KeyStore::SetRequest VersionedDocument::insertRequest(alloc_slice &body) {
+        Assert(!_rec.exists() && _rec.sequence() == 0 && currentRevision());
+        if (_bodiesSkipped)
+            error::_throw(error::UnsupportedOperation);     // would lose the revision bodies
+        updateMeta();
+        removeNonLeafBodies();
+        body = encode();
+        return KeyStore::SetRequest(_rec.key(), _rec.version(), body, _rec.flags(), true);
+    }
+
+    void VersionedDocument::inserted(sequence_t seq) {
+        _rec.updateSequence(seq);
+        _rec.setExists();
+        saved(seq);
+        _changed = false;
+    }
+
 #if DEBUG
     void VersionedDocument::dump(std::ostream& out) {
         out << "\"" << (std::string)docID() << "\" / " << (std::string)revID();
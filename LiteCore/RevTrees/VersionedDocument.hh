@@ -19,6 +19,7 @@
 #pragma once
 #include "RevTree.hh"
 #include "Record.hh"
+#include "KeyStore.hh"
 #include "Doc.hh"
 #include <memory>
 #include <queue>
@@ -35,18 +36,24 @@ namespace litecore {
     class VersionedDocument : public RevTree {
     public:
 
-        VersionedDocument(KeyStore&, slice docID);
+        VersionedDocument(KeyStore&, slice docID, bool withBodies =true);
         VersionedDocument(KeyStore&, const Record&);
 
         VersionedDocument(const VersionedDocument&);
         ~VersionedDocument();
 
-        /** Reads and parses the body of the record. Useful if doc was read as meta-only. */
-        void read();
+        /** Reads and parses the body of the record. Useful if doc was read as meta-only.
+            If `withBodies` is false, only the structure of the tree is kept and every revision
+            will appear to have no body; such a document can't be saved until it's re-read
+            with bodies. */
+        void read(bool withBodies =true);
 
         /** Returns false if the record was loaded metadata-only. Revision accessors will fail. */
         bool revsAvailable() const {return !_unknown;}
 
+        /** Returns false if the revision tree was read without bodies. */
+        bool bodiesAvailable() const {return !_bodiesSkipped;}
+
         const alloc_slice& docID() const {return _rec.key();}
         revid revID() const         {return revid(_rec.version());}
         DocumentFlags flags() const {return _rec.flags();}
@@ -64,6 +71,13 @@ namespace litecore {
         enum SaveResult {kConflict, kNoNewSequence, kNewSequence};
         SaveResult save(Transaction& transaction);
 
+        /** Alternative to save() for a document that's never been saved, to batch it with
+            others in KeyStore::setMany(). Encodes the record into `body` and returns the request
+            to write it, which points into this object and `body`. If it's written, call
+            inserted() with its new sequence. */
+        KeyStore::SetRequest insertRequest(alloc_slice &body);
+        void inserted(sequence_t);
+
         bool updateMeta();
 
 #if DEBUG
@@ -83,6 +97,7 @@ namespace litecore {
 
         KeyStore&       _store;
         Record          _rec;
+        bool            _bodiesSkipped {false};
         std::queue<fleece::impl::Scope> _fleeceScopes;
     };
 }
@@ -9,6 +9,7 @@
 #pragma once
 #include "Error.hh"
 #include "c4Private.h"        // C4InstanceCounted
+#include "Instrumentation.hh"
 #include <mutex>              // std::mutex, std::unique_lock
 #include <condition_variable> // std::condition_variable
 #include <unordered_map>
@@ -108,9 +109,14 @@ namespace litecore {
 
         void setTransaction(Transaction* t) {
             Assert(t);
+            LatencyTimer timer(metric::transactionWait);
             unique_lock<mutex> lock(_transactionMutex);
-            while (_transaction != nullptr)
-                _transactionCond.wait(lock);
+            if (_transaction != nullptr) {
+                metric::transactionWaiters.add(1);
+                while (_transaction != nullptr)
+                    _transactionCond.wait(lock);
+                metric::transactionWaiters.add(-1);
+            }
             _transaction = t;
         }
 
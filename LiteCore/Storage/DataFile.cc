@@ -304,11 +304,18 @@ namespace litecore {
         }
     }
     
+    void DataFile::transactionCommitted(Transaction*) {
+        if (_documentKeys)
+            static_cast<DocumentKeys*>(_documentKeys.get())->transactionCommitted();
+    }
+
     void DataFile::endTransactionScope(Transaction* t) {
         _shared->unsetTransaction(t);
         _inTransaction = false;
-        if (_documentKeys)
+        if (_documentKeys) {
             _documentKeys->transactionEnded();
+            static_cast<DocumentKeys*>(_documentKeys.get())->discardPendingState();
+        }
     }
 
 
@@ -334,12 +341,14 @@ namespace litecore {
 
     Transaction::Transaction(DataFile* db, bool active)
     :_db(*db),
-     _active(false)
+     _active(false),
+     _startTime(0)
     {
         _db.beginTransactionScope(this);
         if (active) {
             LogToAt(DBLog, Verbose, "DataFile: begin transaction");
             Signpost::begin(Signpost::transaction, uint32_t(size_t(this)));
+            _startTime = Metric::startTime();
             _db._beginTransaction(this);
             _active = true;
             _db.transactionBegan(this);
@@ -353,7 +362,10 @@ namespace litecore {
         _active = false;
         LogToAt(DBLog, Verbose, "DataFile: commit transaction");
         _db._endTransaction(this, true);
+        _db.transactionCommitted(this);
         Signpost::end(Signpost::transaction, uint32_t(size_t(this)));
+        metric::transactionTime.recordSince(_startTime);
+        metric::commits.add();
     }
 
 
@@ -364,6 +376,8 @@ namespace litecore {
         LogTo(DBLog, "DataFile: abort transaction");
         _db._endTransaction(this, false);
         Signpost::end(Signpost::transaction, uint32_t(size_t(this)));
+        metric::transactionTime.recordSince(_startTime);
+        metric::aborts.add();
     }
 
 
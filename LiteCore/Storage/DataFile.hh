@@ -47,6 +47,16 @@ namespace litecore {
         // Callback that takes a record body and returns the portion of it containing Fleece data
         typedef slice (*FleeceAccessor)(slice recordBody);
 
+        /** Storage engine tuning parameters. Zero in any field means the engine's default. */
+        struct Tuning {
+            uint64_t            cacheSize;              ///< Page cache size per connection, in bytes
+            int64_t             mmapSize;               ///< Bytes of file to memory-map; <0 disables
+            uint32_t            pageSize;               ///< Page size (only when creating a file)
+            uint64_t            journalSizeLimit;       ///< Max size of the WAL after a checkpoint
+            int32_t             workerThreads;          ///< Extra threads for large sorts; <0 for none
+            uint32_t            checkpointPages;        ///< WAL pages that trigger a checkpoint
+        };
+
         struct Options {
             KeyStore::Capabilities keyStores;
             bool                create         :1;      ///< Should the db be created if it doesn't exist?
@@ -55,6 +65,7 @@ namespace litecore {
             EncryptionAlgorithm encryptionAlgorithm;    ///< What encryption (if any)
             alloc_slice         encryptionKey;          ///< Encryption key, if encrypting
             FleeceAccessor      fleeceAccessor;         ///< Fn to get Fleece from Record body
+            Tuning              tuning;                 ///< Storage engine tuning
 
             static const Options defaults;
         };
@@ -205,6 +216,7 @@ namespace litecore {
         void beginTransactionScope(Transaction*);
         void transactionBegan(Transaction*);
         void transactionEnding(Transaction*, bool committing);
+        void transactionCommitted(Transaction*);
         void endTransactionScope(Transaction*);
         Transaction& transaction();
 
@@ -246,6 +258,7 @@ namespace litecore {
 
         DataFile&   _db;        // The DataFile
         bool _active;           // Is there an open transaction at the db level?
+        uint64_t _startTime;    // Metric::startTime() when it began
     };
 
 
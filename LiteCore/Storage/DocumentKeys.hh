@@ -21,6 +21,7 @@
 #include "DataFile.hh"
 #include "Record.hh"
 #include "SharedKeys.hh"
+#include <mutex>
 
 namespace litecore {
     using namespace fleece;
@@ -34,18 +35,51 @@ namespace litecore {
         _keyStore(_db.getKeyStore(DataFile::kInfoKeyStoreName))
         { }
 
+        /** The encoded keys as last read from or saved to the DataFile. Unlike the keys
+            themselves this is safe to access from any thread, so it can be used to make
+            private copies of the keys for encoding. */
+        alloc_slice persistedState() const {
+            std::lock_guard<std::mutex> lock(_stateMutex);
+            return _persistedState;
+        }
+
     protected:
         virtual bool read() override {
             Record r = _keyStore.get("SharedKeys"_sl);
+            setPersistedState(r.body());
             return loadFrom(r.body());
         }
         virtual void write(slice encodedData) override {
             _keyStore.set("SharedKeys"_sl, encodedData, _db.transaction());
+            // Other threads mustn't see this state until the transaction commits:
+            _pendingState = alloc_slice(encodedData);
         }
 
     private:
+        friend class DataFile;
+
+        // Called by DataFile after the transaction that wrote the keys has committed.
+        void transactionCommitted() {
+            if (_pendingState)
+                setPersistedState(_pendingState);
+            _pendingState = nullslice;
+        }
+
+        // Called by DataFile when a transaction ends; if it didn't commit, its state is dropped.
+        void discardPendingState() {
+            _pendingState = nullslice;
+        }
+
+        void setPersistedState(const alloc_slice &state) {
+            std::lock_guard<std::mutex> lock(_stateMutex);
+            _persistedState = state;
+        }
+
         DataFile &_db;
         KeyStore &_keyStore;
+        mutable std::mutex _stateMutex;
+        alloc_slice _persistedState;        // Committed state; guarded by _stateMutex
+        alloc_slice _pendingState;          // Written in the current transaction; not shared
     };
 
 }
@@ -22,6 +22,7 @@
 #include "Error.hh"
 #include "StringUtil.hh"
 #include "Logging.hh"
+#include <algorithm>
 
 using namespace std;
 
@@ -47,6 +48,29 @@ namespace litecore {
         fn(get(seq));
     }
 
+    bool KeyStore::getBorrowed(slice key, ContentOptions options,
+                               function_ref<void(const RecordLite&)> fn) const
+    {
+        // Subclasses should override this to avoid copying the record.
+        Record rec = get(key, options);
+        if (!rec.exists())
+            return false;
+        fn({rec.key(), rec.version(), rec.body(), rec.bodySize(), rec.sequence(), rec.flags(),
+            true});
+        return true;
+    }
+
+    void KeyStore::getManyBorrowed(const vector<slice> &keys, ContentOptions options,
+                                   function_ref<void(const RecordLite&)> fn) const
+    {
+        // Subclasses should override this to read all the records in one query.
+        vector<slice> sortedKeys(keys);
+        sort(sortedKeys.begin(), sortedKeys.end());
+        sortedKeys.erase(unique(sortedKeys.begin(), sortedKeys.end()), sortedKeys.end());
+        for (slice key : sortedKeys)
+            getBorrowed(key, options, fn);
+    }
+
     void KeyStore::readBody(Record &rec) const {
         if (!rec.body()) {
             Record fullDoc = rec.sequence() ? get(rec.sequence())
@@ -67,6 +91,24 @@ namespace litecore {
         rec.updateSequence(seq);
     }
 
+    sequence_t KeyStore::setMany(const vector<SetRequest> &requests, Transaction &t,
+                                 vector<sequence_t> *outSequences)
+    {
+        static const sequence_t kNoSequence = 0;
+        sequence_t firstSeq = 0;
+        if (outSequences)
+            outSequences->clear();
+        for (auto &rq : requests) {
+            auto seq = set(rq.key, rq.version, rq.value, rq.flags, t,
+                           (rq.insertOnly ? &kNoSequence : nullptr));
+            if (firstSeq == 0)
+                firstSeq = seq;
+            if (outSequences)
+                outSequences->push_back(seq);
+        }
+        return firstSeq;
+    }
+
     bool KeyStore::setDocumentFlag(slice key, sequence_t sequence, DocumentFlags, Transaction&) {
         error::_throw(error::Unimplemented);
     }
@@ -83,6 +125,9 @@ namespace litecore {
         error::_throw(error::Unimplemented);
     }
 
+    void KeyStore::updateLazyIndexes() {
+    }
+
     Retained<Query> KeyStore::compileQuery(slice expressionJSON) {
         error::_throw(error::Unimplemented);
     }
@@ -21,6 +21,7 @@
 #include "RefCounted.hh"
 #include "RecordEnumerator.hh"
 #include "function_ref.hh"
+#include <vector>
 
 namespace litecore {
 
@@ -70,6 +71,19 @@ namespace litecore {
         virtual void get(slice key, ContentOptions, function_ref<void(const Record&)>);
         virtual void get(sequence_t, function_ref<void(const Record&)>);
 
+        /** Reads a record and passes `fn` a RecordLite that points directly into storage,
+            avoiding copying the data. The RecordLite is only valid during the callback, which
+            must not read from this KeyStore. Returns false (without calling `fn`) if there's
+            no such record. */
+        virtual bool getBorrowed(slice key, ContentOptions,
+                                 function_ref<void(const RecordLite&)> fn) const;
+
+        /** Like getBorrowed, but reads many records at once, calling `fn` for each one that
+            exists, in ascending key order. Much faster than calling getBorrowed for each key,
+            since the records are fetched with as few queries as possible. */
+        virtual void getManyBorrowed(const std::vector<slice> &keys, ContentOptions,
+                                     function_ref<void(const RecordLite&)> fn) const;
+
         /** Reads a record whose key() is already set. */
         virtual bool read(Record &rec, ContentOptions options = kDefaultContent) const =0;
 
@@ -96,6 +110,27 @@ namespace litecore {
             return set(key, nullslice, value, DocumentFlags::kNone, t, replacingSequence);
         }
 
+        /** Parameters of one record to be written by setMany(). */
+        struct SetRequest {
+            SetRequest(slice key_, slice version_, slice value_,
+                       DocumentFlags flags_ =DocumentFlags::kNone, bool insertOnly_ =false)
+            :key(key_), version(version_), value(value_), flags(flags_), insertOnly(insertOnly_)
+            { }
+
+            slice key, version, value;
+            DocumentFlags flags;
+            bool insertOnly;    ///< If true, skip it if a record with this key exists
+                                ///< (like set() with *replacingSequence == 0)
+        };
+
+        /** Writes many records (unconditionally, unless `insertOnly`), giving the ones written
+            consecutive new sequences in the order given. Much faster than calling set() in a
+            loop. Returns the sequence assigned to the first record written, or 0 if none were.
+            If `outSequences` is given, it's filled with each request's new sequence, or 0 if
+            the record wasn't written. */
+        virtual sequence_t setMany(const std::vector<SetRequest>&, Transaction&,
+                                   std::vector<sequence_t> *outSequences =nullptr);
+
         void write(Record&, Transaction&, const sequence_t *replacingSequence =nullptr);
 
         virtual bool del(slice key, Transaction&, sequence_t replacingSequence =0) =0;
@@ -111,6 +146,7 @@ namespace litecore {
             kFullTextIndex,      ///< Full-text index, for MATCH queries
             kArrayIndex,         ///< Index of array values, for UNNEST queries
             kGeoIndex,           ///< Geo index of GeoJSON values [unimplemented]
+            kFTS5Index,          ///< Full-text index using SQLite FTS5, ranked by BM25
         };
 
         struct IndexOptions {
@@ -118,6 +154,8 @@ namespace litecore {
             bool ignoreDiacritics;  ///< True to strip diacritical marks/accents from letters
             bool disableStemming;   ///< Disables stemming
             const char *stopWords;  ///< NULL for default, or comma-delimited string, or empty
+            bool lazy;              ///< FTS/array index is updated just before it's queried
+            bool unicodeSortKeys;   ///< Value index stores sort keys of Unicode-collated strings
         };
 
         virtual bool supportsIndexes(IndexType) const                   {return false;}
@@ -128,6 +166,10 @@ namespace litecore {
         virtual void deleteIndex(slice name);
         virtual alloc_slice getIndexes() const;
 
+        /** Brings lazy indexes up to date with the records changed since they were last used.
+            (Queries do this automatically; calling it ahead of time makes them faster.) */
+        virtual void updateLazyIndexes();
+
         // public for complicated reasons; clients should never call it
         virtual ~KeyStore()                             { }
 
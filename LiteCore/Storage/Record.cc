@@ -35,6 +35,16 @@ namespace litecore {
         setKey(key);
     }
 
+    Record::Record(const RecordLite &r)
+    :_key(r.key),
+     _version(r.version),
+     _body(r.body),
+     _bodySize(r.bodySize),
+     _sequence(r.sequence),
+     _flags(r.flags),
+     _exists(r.exists)
+    { }
+
     Record::Record(const Record &d)
     :_key(d._key),
      _version(d._version),
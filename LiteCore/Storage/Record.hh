@@ -38,6 +38,18 @@ namespace litecore {
         return (DocumentFlags)((uint8_t)a | (uint8_t)b);
     }
 
+    /** A lightweight read-only view of a Record, whose key, version and body point directly
+        into the storage engine's memory instead of being copied. It's only valid for a short
+        time, as defined by whatever API returned it; use it to construct a Record to keep it. */
+    struct RecordLite {
+        slice           key, version, body;
+        size_t          bodySize;               // Size of body, even if body wasn't loaded
+        sequence_t      sequence;
+        DocumentFlags   flags;
+        bool            exists;
+    };
+
+
     /** The unit of storage in a DataFile: a key, version and body (all opaque blobs);
         and some extra metadata like flags and a sequence number. */
     class Record {
@@ -45,6 +57,7 @@ namespace litecore {
         Record()                              { }
         explicit Record(slice key);
         explicit Record(alloc_slice key);
+        explicit Record(const RecordLite&);     // copies the data
         Record(const Record&);
         Record(Record&&) noexcept;
 
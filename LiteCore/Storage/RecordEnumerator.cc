@@ -37,7 +37,12 @@ namespace litecore {
     :descending(false),
      includeDeleted(false),
      onlyBlobs(false),
-     contentOptions(kDefaultContent)
+     onlyConflicts(false),
+     inclusiveStart(true),
+     inclusiveEnd(true),
+     contentOptions(kDefaultContent),
+     skip(0),
+     limit(UINT64_MAX)
     { }
 
 
@@ -65,7 +70,9 @@ namespace litecore {
 
 
     void RecordEnumerator::close() noexcept {
+        _recordLite = RecordLite();
         _record.clear();
+        _recordCopied = false;
         _impl.reset();
     }
 
@@ -77,14 +84,34 @@ namespace litecore {
             close();
             return false;
         } else {
-            _record.clear();
-            if (!_impl->read(_record)) {
+            _recordLite = RecordLite();
+            _recordCopied = false;
+            if (!_impl->read(_recordLite)) {
                 close();
                 return false;
             }
-            LogToAt(EnumLog, Debug, "enum:     --> [%s]", _record.key().hexCString());
+            LogToAt(EnumLog, Debug, "enum:     --> [%s]", _recordLite.key.hexCString());
             return true;
         }
     }
 
+
+    const Record& RecordEnumerator::record() const {
+        if (!_recordCopied) {
+            _record.clear();
+            _record.setKey(_recordLite.key);
+            _record.setVersion(_recordLite.version);
+            if (_recordLite.body.buf)
+                _record.setBody(_recordLite.body);
+            else
+                _record.setUnloadedBodySize(_recordLite.bodySize);
+            _record.updateSequence(_recordLite.sequence);
+            _record.setFlags(_recordLite.flags);
+            if (_recordLite.exists)
+                _record.setExists();
+            _recordCopied = true;
+        }
+        return _record;
+    }
+
 }
@@ -43,12 +43,20 @@ namespace litecore {
     class RecordEnumerator {
     public:
         struct Options {
-            bool           descending     :1;   ///< Reverse order? (Start must be
+            bool           descending     :1;   ///< Reverse order? (Start must be >= end)
             bool           includeDeleted :1;   ///< Include deleted records?
             bool           onlyBlobs      :1;   ///< Only include records which contain linked binary data
+            bool           onlyConflicts  :1;   ///< Only include records with conflicts
+            bool           inclusiveStart :1;   ///< Include the record whose key is startKey?
+            bool           inclusiveEnd   :1;   ///< Include the record whose key is endKey?
             ContentOptions contentOptions :4;   ///< Load record bodies?
+            slice          startKey;            ///< Key to start at (by-key only); null for none
+            slice          endKey;              ///< Key to stop at (by-key only); null for none
+            uint64_t       skip;                ///< Number of records to skip at the start
+            uint64_t       limit;               ///< Max number of records to return
 
-            /** Default options have all flags false, and kDefaultContent */
+            /** Default options have all flags false except inclusiveStart and inclusiveEnd,
+                kDefaultContent, no key range, no skip, and no limit. */
             Options();
         };
 
@@ -74,19 +82,24 @@ namespace litecore {
             destructor might not be called soon enough.) */
         void close() noexcept;
 
-        /** The current record. */
-        const Record& record() const      {return _record;}
+        /** The current record. Its data is copied from storage the first time this is called
+            after next(). */
+        const Record& record() const;
+
+        /** The current record, as a RecordLite pointing directly into storage, which avoids
+            copying its data. It's only valid until the next call to next() or close(). */
+        const RecordLite& recordLite() const    {return _recordLite;}
 
         // Can treat an enumerator as a record pointer:
-        operator const Record*() const    {return _record.key().buf ? &_record : nullptr;}
-        const Record* operator->() const  {return _record.key().buf ? &_record : nullptr;}
+        operator const Record*() const    {return _recordLite.key.buf ? &record() : nullptr;}
+        const Record* operator->() const  {return _recordLite.key.buf ? &record() : nullptr;}
 
         /** Internal implementation of enumerator; each storage type must subclass it. */
         class Impl {
         public:
             virtual ~Impl()                         { }
             virtual bool next() =0;
-            virtual bool read(Record&) =0;
+            virtual bool read(RecordLite&) =0;
         };
 
     private:
@@ -96,7 +109,9 @@ namespace litecore {
         RecordEnumerator& operator=(const RecordEnumerator&) = delete;    // no assignment allowed
 
         KeyStore *      _store;             // The KeyStore I'm enumerating
-        Record          _record;            // Current record
+        RecordLite      _recordLite {};     // Current record, pointing into storage
+        mutable Record  _record;            // Copy of current record, made by record()
+        mutable bool    _recordCopied {false};
         std::unique_ptr<Impl> _impl;        // The storage-specific implementation
     };
 
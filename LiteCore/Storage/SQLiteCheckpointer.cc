@@ -0,0 +1,222 @@
+//
+// SQLiteCheckpointer.cc
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "SQLiteCheckpointer.hh"
+#include "SQLite_Internal.hh"
+#include "Error.hh"
+#include "Logging.hh"
+#include "Stopwatch.hh"
+#include "SQLiteCpp/SQLiteCpp.h"
+#include <algorithm>
+#include <sqlite3.h>
+
+using namespace std;
+
+namespace litecore {
+
+    // The PASSIVE threshold matches SQLite's default auto-checkpoint size (4MB of 4KB pages).
+    const SQLiteCheckpointer::Thresholds SQLiteCheckpointer::Thresholds::defaults = {
+        1000, 4000, 16000
+    };
+
+    // Busy timeout of the checkpointer's connection. A RESTART or TRUNCATE checkpoint blocks
+    // writers while it waits for readers, so this bounds the delay it can add to a commit;
+    // if it times out, the checkpoint is retried after a later commit.
+    static const int kBusyTimeoutMS = 250;
+
+    static const string kSharedObjectKey = "SQLiteCheckpointer";
+
+
+    Retained<SQLiteCheckpointer> SQLiteCheckpointer::forDataFile(DataFile &dataFile) {
+        Retained<RefCounted> obj = dataFile.sharedObject(kSharedObjectKey);
+        if (!obj) {
+            Retained<RefCounted> checkpointer = new SQLiteCheckpointer(dataFile.filePath().path());
+            obj = dataFile.addSharedObject(kSharedObjectKey, checkpointer);
+        }
+        return (SQLiteCheckpointer*)obj.get();
+    }
+
+
+    SQLiteCheckpointer::SQLiteCheckpointer(const string &path)
+    :_path(path)
+    ,_thresholds(Thresholds::defaults)
+    ,_stats()
+    ,_options()
+    { }
+
+
+    SQLiteCheckpointer::~SQLiteCheckpointer() {
+        Assert(!_thread.joinable());
+    }
+
+
+    void SQLiteCheckpointer::addDataFile(const DataFile::Options &options) {
+        lock_guard<mutex> threadLock(_threadMutex);
+        lock_guard<mutex> lock(_mutex);
+        _options = options;
+        if (_dataFileCount++ == 0) {
+            _stopping = false;
+            _thread = thread([this]{run();});
+        }
+    }
+
+
+    void SQLiteCheckpointer::removeDataFile() {
+        lock_guard<mutex> threadLock(_threadMutex);
+        thread t;
+        {
+            lock_guard<mutex> lock(_mutex);
+            Assert(_dataFileCount > 0);
+            if (--_dataFileCount > 0)
+                return;
+            _stopping = true;
+            _pending = false;
+            _cond.notify_one();
+            t = move(_thread);
+        }
+        t.join();
+        lock_guard<mutex> ckLock(_checkpointMutex);
+        _db.reset();
+    }
+
+
+    void SQLiteCheckpointer::setOptions(const DataFile::Options &options) {
+        lock_guard<mutex> lock(_mutex);
+        _options = options;
+    }
+
+
+    SQLiteCheckpointer::Thresholds SQLiteCheckpointer::thresholds() const {
+        lock_guard<mutex> lock(_mutex);
+        return _thresholds;
+    }
+
+    void SQLiteCheckpointer::setThresholds(const Thresholds &thresholds) {
+        lock_guard<mutex> lock(_mutex);
+        _thresholds = thresholds;
+    }
+
+
+    SQLiteCheckpointer::Stats SQLiteCheckpointer::stats() const {
+        lock_guard<mutex> lock(_mutex);
+        return _stats;
+    }
+
+
+    int SQLiteCheckpointer::walHook(void *context, sqlite3*, const char *dbName, int walPages) {
+        ((SQLiteCheckpointer*)context)->walCommitted(walPages);
+        return SQLITE_OK;
+    }
+
+
+    // Called on the committing thread, so it just signals the background thread.
+    void SQLiteCheckpointer::walCommitted(unsigned walPages) {
+        lock_guard<mutex> lock(_mutex);
+        _stats.walPages = walPages;
+        _stats.maxWALPages = max(_stats.maxWALPages, walPages);
+        if (walPages >= _thresholds.passivePages && !_pending && !_stopping) {
+            _pending = true;
+            _cond.notify_one();
+        }
+    }
+
+
+    void SQLiteCheckpointer::run() {
+        unique_lock<mutex> lock(_mutex);
+        while (true) {
+            _cond.wait(lock, [this]{return _pending || _stopping;});
+            if (_stopping)
+                break;
+            _pending = false;
+            lock.unlock();
+            checkpoint(false);
+            lock.lock();
+        }
+    }
+
+
+    bool SQLiteCheckpointer::checkpointNow(bool truncate) {
+        return checkpoint(truncate);
+    }
+
+
+    bool SQLiteCheckpointer::checkpoint(bool truncate) {
+        lock_guard<mutex> ckLock(_checkpointMutex);
+        DataFile::Options options;
+        int mode;
+        {
+            lock_guard<mutex> lock(_mutex);
+            options = _options;
+            if (truncate || _stats.walPages >= _thresholds.truncatePages)
+                mode = SQLITE_CHECKPOINT_TRUNCATE;
+            else if (_stats.walPages >= _thresholds.restartPages)
+                mode = SQLITE_CHECKPOINT_RESTART;
+            else
+                mode = SQLITE_CHECKPOINT_PASSIVE;
+        }
+        static const char* const kModeNames[] = {"PASSIVE", "FULL", "RESTART", "TRUNCATE"};
+
+        Stopwatch st;
+        int walPages = 0, checkpointedPages = 0, rc;
+        try {
+            if (_db && _dbKey != options.encryptionKey)
+                _db.reset();                    // Database has been rekeyed
+            if (!_db) {
+                _db = OpenSQLiteConnection(_path, options, SQLite::OPEN_READWRITE,
+                                           kBusyTimeoutMS);
+                // Closing this connection must not checkpoint, in case it's the last one open
+                // and the file has been deleted (see SQLiteDataFile::close):
+                sqlite3_db_config(_db->getHandle(), SQLITE_DBCONFIG_NO_CKPT_ON_CLOSE, 1, nullptr);
+                _dbKey = options.encryptionKey;
+            }
+            rc = sqlite3_wal_checkpoint_v2(_db->getHandle(), nullptr, mode,
+                                           &walPages, &checkpointedPages);
+        } catch (const exception &x) {
+            Warn("SQLiteCheckpointer: couldn't open %s: %s", _path.c_str(), x.what());
+            return false;
+        }
+        double elapsed = st.elapsed();
+
+        bool busy = (rc == SQLITE_BUSY);
+        if (rc != SQLITE_OK && !busy) {
+            Warn("SQLiteCheckpointer: %s checkpoint of %s failed: SQLite err %d",
+                 kModeNames[mode], _path.c_str(), rc);
+            return false;
+        }
+        LogVerbose(DBLog, "%s checkpoint copied %d of %d WAL pages in %.3f ms%s",
+                   kModeNames[mode], checkpointedPages, walPages, elapsed * 1000.0,
+                   (busy ? " (busy)" : ""));
+
+        lock_guard<mutex> lock(_mutex);
+        ++_stats.checkpoints;
+        if (mode == SQLITE_CHECKPOINT_RESTART)
+            ++_stats.restarts;
+        else if (mode == SQLITE_CHECKPOINT_TRUNCATE)
+            ++_stats.truncates;
+        if (busy)
+            ++_stats.busy;
+        else if (mode == SQLITE_CHECKPOINT_TRUNCATE)
+            _stats.walPages = 0;
+        _stats.pagesCheckpointed += max(checkpointedPages, 0);
+        _stats.lastTime = elapsed;
+        _stats.maxTime = max(_stats.maxTime, elapsed);
+        _stats.totalTime += elapsed;
+        return !busy;
+    }
+
+}
@@ -0,0 +1,121 @@
+//
+// SQLiteCheckpointer.hh
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "DataFile.hh"
+#include "RefCounted.hh"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct sqlite3;
+
+namespace SQLite {
+    class Database;
+}
+
+namespace litecore {
+
+    /** Runs WAL checkpoints on a background thread, instead of letting SQLite run them
+        synchronously inside whichever COMMIT pushes the WAL past its auto-checkpoint size.
+        There is one instance per database file, shared by all its SQLiteDataFiles. Each of them
+        installs walHook() on its connection, which replaces SQLite's auto-checkpointing and
+        reports the size of the WAL after every commit.
+        Checkpoints are normally PASSIVE, which never blocks readers or writers. If the WAL keeps
+        growing anyway (because readers keep old snapshots alive) they escalate to RESTART, and
+        then to TRUNCATE, which wait for readers to finish so the WAL can be reset. */
+    class SQLiteCheckpointer : public RefCounted {
+    public:
+        /** WAL sizes, in pages, that trigger each type of checkpoint. */
+        struct Thresholds {
+            unsigned passivePages;              // Start a PASSIVE checkpoint
+            unsigned restartPages;              // Escalate to RESTART
+            unsigned truncatePages;             // Escalate to TRUNCATE
+
+            static const Thresholds defaults;
+        };
+
+        struct Stats {
+            unsigned walPages;                  // WAL size as of the latest commit
+            unsigned maxWALPages;               // Largest WAL size seen
+            uint64_t checkpoints;               // Number of checkpoints run
+            uint64_t restarts;                  // ...of which were RESTART
+            uint64_t truncates;                 // ...of which were TRUNCATE
+            uint64_t busy;                      // Number that couldn't complete (SQLITE_BUSY)
+            uint64_t pagesCheckpointed;         // Total pages copied back to the database
+            double   lastTime;                  // Duration of the latest checkpoint (secs)
+            double   maxTime;                   // Longest checkpoint (secs)
+            double   totalTime;                 // Total time spent checkpointing (secs)
+        };
+
+        /** Returns the checkpointer of a DataFile's file, creating it if necessary. */
+        static Retained<SQLiteCheckpointer> forDataFile(DataFile&);
+
+        /** Registers an open DataFile; the background thread runs while there are any.
+            The options supply the encryption key for the checkpointer's own connection. */
+        void addDataFile(const DataFile::Options&);
+
+        /** Unregisters a DataFile. When the last one is removed, waits for any checkpoint in
+            progress, then stops the thread and closes the checkpointer's connection. */
+        void removeDataFile();
+
+        /** Updates the encryption key, after the database has been rekeyed. */
+        void setOptions(const DataFile::Options&);
+
+        Thresholds thresholds() const;
+        void setThresholds(const Thresholds&);
+
+        Stats stats() const;
+
+        /** Runs a checkpoint right away on the calling thread, at least as strong as the
+            WAL size calls for; if `truncate` is true, a TRUNCATE checkpoint.
+            Returns false if it couldn't complete because the database was busy. */
+        bool checkpointNow(bool truncate =false);
+
+        /** Callback to pass to sqlite3_wal_hook, with this object as the context. */
+        static int walHook(void *context, sqlite3*, const char *dbName, int walPages);
+
+    protected:
+        SQLiteCheckpointer(const std::string &path);
+        ~SQLiteCheckpointer();
+
+    private:
+        void walCommitted(unsigned walPages);
+        void run();
+        bool checkpoint(bool truncate);
+
+        std::string const _path;
+        std::mutex _threadMutex;                    // Serializes addDataFile/removeDataFile
+        mutable std::mutex _mutex;                  // Guards the variables below
+        std::condition_variable _cond;
+        std::thread _thread;
+        unsigned _dataFileCount {0};
+        bool _pending {false};                      // A checkpoint has been requested
+        bool _stopping {false};
+        Thresholds _thresholds;
+        Stats _stats;
+        DataFile::Options _options;
+
+        std::mutex _checkpointMutex;                // Serializes checkpoints; guards _db
+        std::unique_ptr<SQLite::Database> _db;      // Connection used for checkpoints
+        alloc_slice _dbKey;                         // Encryption key _db was opened with
+    };
+
+}
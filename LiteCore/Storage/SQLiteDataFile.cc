@@ -17,8 +17,11 @@
 //
 
 #include "SQLiteDataFile.hh"
+#include "SQLiteCheckpointer.hh"
 #include "SQLiteKeyStore.hh"
 #include "SQLite_Internal.hh"
+#include "DocumentKeys.hh"
+#include "QueryCache.hh"
 #include "Record.hh"
 #include "UnicodeCollator.hh"
 #include "Error.hh"
@@ -29,11 +32,14 @@
 #include "SQLiteCpp/SQLiteCpp.h"
 #include "PlatformCompat.hh"
 #include "fleece/Fleece.hh"
+#include <algorithm>
 #include <mutex>
 #include <sqlite3.h>
 #include <sstream>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 extern "C" {
     #include "sqlite3_unicodesn_tokenizer.h"
@@ -58,7 +64,11 @@ namespace litecore {
     static const int kMinUserVersion = 201;
     static const int kMaxUserVersion = 299;
 
-    // SQLite page size
+    // user_version of files whose indexes were built knowing that some locales collate ASCII
+    // differently than CompareASCII does (see reindexCustomASCIICollations)
+    static const int kCustomASCIIRulesUserVersion = 202;
+
+    // SQLite page size (default; see DataFile::Tuning)
     static const int64_t kPageSize = 4096;
 
     // SQLite cache size (per connection)
@@ -74,11 +84,25 @@ namespace litecore {
     static const int kMMapSize = 50 * MB;
 #endif
 
+    // Number of extra threads SQLite may use for sorting. Only desktop/server platforms get any;
+    // on mobile devices the extra cores are better left to the app (and the battery.)
+#if TARGET_OS_OSX || (defined(__linux__) && !defined(__ANDROID__)) || defined(_WIN32)
+    static const int32_t kWorkerThreads = 2;
+#else
+    static const int32_t kWorkerThreads = 0;
+#endif
+
     // If this fraction of the database is composed of free pages, vacuum it
     static const float kVacuumFractionThreshold = 0.25;
     // If the database has many bytes of free space, vacuum it
     static const int64_t kVacuumSizeThreshold = 50 * MB;
 
+    // Maximum number of read-only connections in the reader pool
+    static const unsigned kMaxReaders = 8;
+
+    // SQLite cache size of each reader connection; smaller since they're short-lived users
+    static const size_t kReaderCacheSize = 2 * MB;
+
     // Database busy timeout; generally not needed since we have other arbitration that keeps
     // multiple threads from trying to start transactions at once, but another process might
     // open the database and grab the write lock.
@@ -86,10 +110,66 @@ namespace litecore {
 
     LogDomain SQL("SQL", LogLevel::Warning);
 
+    // Returns the tuning parameters in the options, with the defaults filled in.
+    static DataFile::Tuning effectiveTuning(const DataFile::Options &options) {
+        DataFile::Tuning tuning = options.tuning;
+        if (tuning.cacheSize == 0)
+            tuning.cacheSize = kCacheSize;
+        if (tuning.mmapSize == 0)
+            tuning.mmapSize = kMMapSize;
+        else if (tuning.mmapSize < 0)
+            tuning.mmapSize = 0;            // i.e. don't memory-map
+        if (tuning.pageSize == 0)
+            tuning.pageSize = kPageSize;
+        if (tuning.journalSizeLimit == 0)
+            tuning.journalSizeLimit = kJournalSize;
+        if (tuning.workerThreads == 0)
+            tuning.workerThreads = kWorkerThreads;
+        else if (tuning.workerThreads < 0)
+            tuning.workerThreads = 0;       // i.e. no worker threads
+        return tuning;
+    }
+
     void LogStatement(const SQLite::Statement &st) {
         LogTo(SQL, "... %s", st.getQuery().c_str());
     }
 
+
+    unique_ptr<SQLite::Statement> CompileStatement(SQLite::Database &db, const string &sql,
+                                                   sqlite3_stmt* &outHandle)
+    {
+        static atomic<uint64_t> sStatementCount {0};
+        string markedSQL = format("%s /*#%llu*/",
+                                  sql.c_str(), (unsigned long long)++sStatementCount);
+        unique_ptr<SQLite::Statement> statement(new SQLite::Statement(db, markedSQL));
+        // Holding the connection's mutex keeps other threads from finalizing statements while
+        // the list is walked:
+        outHandle = nullptr;
+        sqlite3 *handle = db.getHandle();
+        sqlite3_mutex *mutex = sqlite3_db_mutex(handle);
+        sqlite3_mutex_enter(mutex);
+        for (auto stmt = sqlite3_next_stmt(handle, nullptr); stmt;
+                  stmt = sqlite3_next_stmt(handle, stmt)) {
+            const char *stmtSQL = sqlite3_sql(stmt);
+            if (stmtSQL && markedSQL == stmtSQL) {
+                outHandle = stmt;
+                break;
+            }
+        }
+        sqlite3_mutex_leave(mutex);
+        return statement;
+    }
+
+
+    StatementStatus TakeStatementStatus(sqlite3_stmt *stmt) {
+        StatementStatus status = { };
+        status.vmSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, true);
+        status.fullScanSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, true);
+        status.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, true);
+        status.autoIndexRows = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, true);
+        return status;
+    }
+
     static void sqlite3_log_callback(void *pArg, int errCode, const char *msg) {
         if (errCode == SQLITE_NOTICE_RECOVER_WAL)
             return;     // harmless "recovered __ frames from WAL file" message
@@ -160,6 +240,7 @@ namespace litecore {
 
     SQLiteDataFile::SQLiteDataFile(const FilePath &path, const Options *options)
     :DataFile(path, options)
+    ,_queryCache(new QueryCache)
     {
         reopen();
     }
@@ -182,12 +263,12 @@ namespace litecore {
         if (!decrypt())
             error::_throw(error::UnsupportedEncryption);
 
-        if (sqlite3_libversion_number() < 003012) {
+        DataFile::Tuning tuning = effectiveTuning(options());
+        if (options().tuning.pageSize || sqlite3_libversion_number() < 003012) {
             // Prior to 3.12, the default page size was 1024, which is less than optimal.
             // Note that setting the page size has to be done before any other command that touches
-            // the database file.
-            // The cache_size value is negative to tell SQLite it's in KB (hence the /1024.)
-            _exec(format("PRAGMA page_size=%lld", (long long)kPageSize));
+            // the database file. It has no effect on an existing database.
+            _exec(format("PRAGMA page_size=%u", tuning.pageSize));
         }
 
         withFileLock([this]{
@@ -203,8 +284,8 @@ namespace litecore {
                      );
                 // Create the default KeyStore's table:
                 (void)defaultKeyStore();
-                _exec("PRAGMA user_version=201; "
-                      "END;");
+                _exec(format("PRAGMA user_version=%d; "
+                             "END;", kCustomASCIIRulesUserVersion));
             } else if (userVersion < kMinUserVersion) {
                 error::_throw(error::DatabaseTooOld);
             } else if (userVersion > kMaxUserVersion) {
@@ -212,12 +293,14 @@ namespace litecore {
             }
         });
 
-        _exec(format("PRAGMA cache_size=%d; "            // Memory cache
-                     "PRAGMA mmap_size=%d; "             // Memory-mapped reads
+        // The cache_size value is negative to tell SQLite it's in KB (hence the /1024.)
+        _exec(format("PRAGMA cache_size=%lld; "          // Memory cache
+                     "PRAGMA mmap_size=%lld; "           // Memory-mapped reads
                      "PRAGMA synchronous=normal; "       // Speeds up commits
-                     "PRAGMA journal_size_limit=%lld; "  // Limit WAL disk usage
+                     "PRAGMA journal_size_limit=%llu; "  // Limit WAL disk usage
                      "PRAGMA case_sensitive_like=true",  // Case sensitive LIKE, for N1QL compat
-                     -(int)kCacheSize/1024, kMMapSize, (long long)kJournalSize));
+                     -(long long)(tuning.cacheSize / 1024), (long long)tuning.mmapSize,
+                     (unsigned long long)tuning.journalSizeLimit));
 
 #if DEBUG
         // Deliberately make unordered queries unpredictable, to expose any LiteCore code that
@@ -227,14 +310,26 @@ namespace litecore {
 #endif
 
         // Configure number of extra threads to be used by SQLite:
-        int maxThreads = 0;
-#if TARGET_OS_OSX
-        maxThreads = 2;
-        // TODO: Configure for other platforms
-#endif
         auto sqlite = _sqlDb->getHandle();
-        if (maxThreads > 0)
-            sqlite3_limit(sqlite, SQLITE_LIMIT_WORKER_THREADS, maxThreads);
+        sqlite3_limit(sqlite, SQLITE_LIMIT_WORKER_THREADS, (int)tuning.workerThreads);
+
+        // Take over WAL checkpointing from SQLite, so commits don't have to wait for it.
+        // (Installing a WAL hook disables SQLite's auto-checkpoint.)
+        if (options().writeable) {
+            if (!_checkpointer) {
+                _checkpointer = SQLiteCheckpointer::forDataFile(*this);
+                _checkpointer->addDataFile(options());
+            } else {
+                _checkpointer->setOptions(options());
+            }
+            // The thresholds belong to the file's shared checkpointer, so the latest connection
+            // to open sets them; one opened without tuning restores the defaults.
+            unsigned pages = options().tuning.checkpointPages;
+            _checkpointer->setThresholds(pages ? SQLiteCheckpointer::Thresholds{pages, 4 * pages,
+                                                                                16 * pages}
+                                               : SQLiteCheckpointer::Thresholds::defaults);
+            sqlite3_wal_hook(sqlite, &SQLiteCheckpointer::walHook, _checkpointer.get());
+        }
 
         // Register collators, custom functions, and the FTS tokenizer:
         RegisterSQLiteUnicodeCollations(sqlite, _collationContexts);
@@ -242,6 +337,57 @@ namespace litecore {
         int rc = register_unicodesn_tokenizer(sqlite);
         if (rc != SQLITE_OK)
             Warn("Unable to register FTS tokenizer: SQLite err %d", rc);
+        rc = RegisterSQLiteFTS5(sqlite);
+        if (rc != SQLITE_OK)
+            Warn("Unable to register FTS5 tokenizer: SQLite err %d", rc);
+
+        if (_readerPool)
+            _readerPool->close();
+        _readerPool = make_shared<SQLiteReaderPool>(filePath().path(), options(), fleeceAccessor(),
+                                                    dynamic_cast<DocumentKeys*>(documentKeys()));
+
+        reindexCustomASCIICollations();
+        SQLiteKeyStore::finishInterruptedIndexBuilds(*this);
+        SQLiteKeyStore::checkCollationKeyVersions(*this);
+    }
+
+
+    // Earlier versions compared all-ASCII strings with CompareASCII in every locale, so indexes
+    // using a Unicode collation whose locale has its own ASCII rules (LocaleHasCustomASCIIRules)
+    // may be out of order. This rebuilds them, once per file.
+    void SQLiteDataFile::reindexCustomASCIICollations() {
+        if (!options().writeable || intQuery("PRAGMA user_version") >= kCustomASCIIRulesUserVersion)
+            return;
+        withFileLock([this]{
+            vector<string> collations;
+            SQLite::Statement indexes(*_sqlDb, "SELECT sql FROM sqlite_master "
+                                               "WHERE type = 'index' AND sql IS NOT NULL");
+            while (indexes.executeStep()) {
+                string sql = indexes.getColumn(0).getString();
+                for (auto pos = sql.find("COLLATE \"LCUnicode_"); pos != string::npos;
+                          pos = sql.find("COLLATE \"LCUnicode_", pos)) {
+                    pos += strlen("COLLATE \"");
+                    auto end = sql.find('"', pos);
+                    if (end == string::npos)
+                        break;
+                    string name = sql.substr(pos, end - pos);
+                    Collation coll;
+                    if (coll.readSQLiteName(name.c_str())
+                            && LocaleHasCustomASCIIRules(coll.localeName)
+                            && find(collations.begin(), collations.end(), name) == collations.end())
+                        collations.push_back(name);
+                }
+            }
+            indexes.reset();
+
+            _exec("BEGIN");
+            for (auto &name : collations) {
+                Log("Rebuilding indexes that use collation %s", name.c_str());
+                _exec(CONCAT("REINDEX \"" << name << "\""));
+            }
+            _exec(format("PRAGMA user_version=%d; "
+                         "END;", kCustomASCIIRulesUserVersion));
+        });
     }
 
 
@@ -251,11 +397,21 @@ namespace litecore {
 
 
     void SQLiteDataFile::close() {
+        _queryCache->clear();   // frees the cached queries' statements
+        if (_readerPool) {
+            _readerPool->close();
+            _readerPool.reset();
+        }
         DataFile::close(); // closes all the KeyStores
         _getLastSeqStmt.reset();
         _setLastSeqStmt.reset();
         if (_sqlDb) {
             optimizeAndVacuum();
+            if (_checkpointer) {
+                sqlite3_wal_hook(_sqlDb->getHandle(), nullptr, nullptr);
+                _checkpointer->removeDataFile();
+                _checkpointer = nullptr;
+            }
             // Close the SQLite database:
             if (!_sqlDb->closeUnlessStatementsOpen()) {
                 // There are still SQLite statements (queries) open, probably in QueryEnumerators
@@ -366,10 +522,13 @@ namespace litecore {
     void SQLiteDataFile::_beginTransaction(Transaction*) {
         checkOpen();
         _exec("BEGIN");
+        _transactionThread = this_thread::get_id();
     }
 
 
     void SQLiteDataFile::_endTransaction(Transaction *t, bool commit) {
+        _transactionThread = thread::id();
+
         // Notify key-stores so they can save state:
         forOpenKeyStores([commit](KeyStore &ks) {
             ((SQLiteKeyStore&)ks).transactionWillEnd(commit);
@@ -483,13 +642,14 @@ namespace litecore {
         try {
             int64_t pageCount = intQuery("PRAGMA page_count");
             int64_t freePages = intQuery("PRAGMA freelist_count");
+            int64_t pageSize = intQuery("PRAGMA page_size");
             LogVerbose(DBLog, "Pre-close housekeeping: %lld of %lld pages free (%.0f%%)",
                        (long long)freePages, (long long)pageCount, (float)freePages / pageCount);
 
             _exec("PRAGMA optimize");
 
             if ((pageCount > 0 && (float)freePages / pageCount >= kVacuumFractionThreshold)
-                    || (freePages * kPageSize >= kVacuumSizeThreshold)) {
+                    || (freePages * pageSize >= kVacuumSizeThreshold)) {
                 Log("Vacuuming database '%s'...", filePath().dirName().c_str());
                 _exec("PRAGMA incremental_vacuum");
             }
@@ -501,7 +661,32 @@ namespace litecore {
 
     void SQLiteDataFile::compact() {
         checkOpen();
+        optimizeFTS5Indexes();
         optimizeAndVacuum();
+        if (_checkpointer)
+            _checkpointer->checkpointNow(true);     // Shrink the WAL file too
+    }
+
+
+    // Merges the segments of each FTS5 index into one, which makes it smaller and faster to
+    // query. (Between compactions, FTS5 merges incrementally as its 'automerge' setting allows.)
+    void SQLiteDataFile::optimizeFTS5Indexes() {
+        vector<string> tables;
+        {
+            SQLite::Statement st(*_sqlDb, "SELECT name FROM sqlite_master WHERE type='table' "
+                                          "AND sql LIKE 'CREATE VIRTUAL TABLE % USING fts5(%'");
+            while (st.executeStep())
+                tables.push_back(st.getColumn(0));
+        }
+        if (tables.empty())
+            return;
+        Transaction t(this);
+        for (auto &table : tables) {
+            LogVerbose(DBLog, "Optimizing FTS5 index '%s'", table.c_str());
+            exec(format("INSERT INTO \"%s\" (\"%s\") VALUES ('optimize')",
+                        table.c_str(), table.c_str()));
+        }
+        t.commit();
     }
 
 
@@ -533,4 +718,249 @@ namespace litecore {
         return enc.finish();
     }
 
+
+
+#pragma mark - READER POOL:
+
+
+    unique_ptr<SQLite::Database> OpenSQLiteConnection(const string &path,
+                                                      const DataFile::Options &options,
+                                                      int flags, int busyTimeoutMS)
+    {
+        auto db = make_unique<SQLite::Database>(path.c_str(), flags, busyTimeoutMS);
+#ifdef COUCHBASE_ENTERPRISE
+        slice key;
+        if (options.encryptionAlgorithm != kNoEncryption)
+            key = options.encryptionKey;
+        int rc = sqlite3_key_v2(db->getHandle(), nullptr, key.buf, (int)key.size);
+        if (rc != SQLITE_OK)
+            error::_throw(error::SQLite, rc);
+#endif
+        return db;
+    }
+
+
+    struct SQLiteReader::Connection {
+        CollationContextVector collationContexts;
+        Retained<fleece::impl::SharedKeys> keys;
+        alloc_slice keysState;                      // Encoded state `keys` was loaded from
+        unique_ptr<SQLite::Database> db;
+        struct CachedStatement {
+            shared_ptr<SQLite::Statement> statement;
+            sqlite3_stmt *handle;
+        };
+        unordered_map<string, CachedStatement> statements;
+    };
+
+
+    /** Pool of read-only connections to a SQLiteDataFile's file, which let other threads read
+        the last committed state while the DataFile's own connection is in a Transaction.
+        (SQLite's WAL mode allows any number of readers to run alongside one writer.) */
+    class SQLiteReaderPool : public enable_shared_from_this<SQLiteReaderPool> {
+    public:
+        SQLiteReaderPool(const string &path,
+                         const DataFile::Options &options,
+                         DataFile::FleeceAccessor accessor,
+                         DocumentKeys *documentKeys)
+        :_path(path)
+        ,_options(options)
+        ,_accessor(accessor)
+        ,_documentKeys(documentKeys)
+        { }
+
+        unique_ptr<SQLiteReader> borrow() {
+            unique_ptr<SQLiteReader::Connection> conn;
+            {
+                lock_guard<mutex> lock(_mutex);
+                if (_closed)
+                    return nullptr;
+                if (!_idle.empty()) {
+                    conn = move(_idle.back());
+                    _idle.pop_back();
+                } else if (_count >= kMaxReaders) {
+                    return nullptr;
+                } else {
+                    ++_count;
+                }
+            }
+            try {
+                if (!conn)
+                    conn = openConnection();
+                conn->db->exec("BEGIN");
+                refreshKeys(*conn);
+            } catch (const exception &x) {
+                Warn("SQLiteReaderPool: couldn't start reading %s: %s", _path.c_str(), x.what());
+                lock_guard<mutex> lock(_mutex);
+                --_count;
+                return nullptr;
+            }
+            return unique_ptr<SQLiteReader>(new SQLiteReader(shared_from_this(), move(conn)));
+        }
+
+        void giveBack(unique_ptr<SQLiteReader::Connection> conn) noexcept {
+            try {
+                for (auto &entry : conn->statements)
+                    entry.second.statement->reset();
+                conn->db->exec("COMMIT");
+            } catch (const exception &x) {
+                Warn("SQLiteReaderPool: error ending read of %s: %s", _path.c_str(), x.what());
+                conn.reset();
+            }
+            lock_guard<mutex> lock(_mutex);
+            if (conn && !_closed) {
+                _idle.push_back(move(conn));
+            } else {
+                conn.reset();
+                --_count;
+            }
+        }
+
+        void close() {
+            lock_guard<mutex> lock(_mutex);
+            _closed = true;
+            _count -= (unsigned)_idle.size();
+            _idle.clear();
+        }
+
+        DataFile::FleeceAccessor accessor() const       {return _accessor;}
+
+    private:
+        unique_ptr<SQLiteReader::Connection> openConnection() {
+            LogVerbose(DBLog, "SQLiteReaderPool: opening reader #%u on %s", _count, _path.c_str());
+            unique_ptr<SQLiteReader::Connection> conn(new SQLiteReader::Connection);
+            conn->db = OpenSQLiteConnection(_path, _options, SQLite::OPEN_READONLY,
+                                            kBusyTimeoutSecs * 1000);
+            DataFile::Tuning tuning = effectiveTuning(_options);
+            conn->db->exec(format("PRAGMA cache_size=%lld; "
+                                  "PRAGMA mmap_size=%lld; "
+                                  "PRAGMA case_sensitive_like=true; "
+                                  "PRAGMA query_only=true",
+                                  -(long long)(min<uint64_t>(tuning.cacheSize, kReaderCacheSize) / 1024),
+                                  (long long)tuning.mmapSize));
+            auto sqlite = conn->db->getHandle();
+            RegisterSQLiteUnicodeCollations(sqlite, conn->collationContexts);
+            int rc = register_unicodesn_tokenizer(sqlite);
+            if (rc != SQLITE_OK)
+                Warn("Unable to register FTS tokenizer: SQLite err %d", rc);
+            rc = RegisterSQLiteFTS5(sqlite);
+            if (rc != SQLITE_OK)
+                Warn("Unable to register FTS5 tokenizer: SQLite err %d", rc);
+            return conn;
+        }
+
+        // Gives the connection a copy of the document SharedKeys, and registers the SQLite
+        // functions with it. The keys are read from the database, not taken from the DataFile,
+        // and that read also fixes the snapshot of the read transaction (a deferred BEGIN doesn't
+        // pick it until the first read.) So the keys always match the documents the connection
+        // can see, even if a commit adding keys lands right after the BEGIN.
+        void refreshKeys(SQLiteReader::Connection &conn) {
+            alloc_slice state;
+            int hasInfo = conn.db->execAndGet("SELECT count(*) FROM sqlite_master "
+                                              "WHERE type='table' AND name='kv_info'");
+            if (_documentKeys && hasInfo) {
+                SQLite::Statement st(*conn.db, "SELECT body FROM kv_info WHERE key='SharedKeys'");
+                if (st.executeStep()) {
+                    SQLite::Column col = st.getColumn(0);
+                    state = alloc_slice(col.getBlob(), col.getBytes());
+                }
+            }
+            // (If a query recording from an earlier borrower still retains the keys, they get
+            // replaced anyway, so that recording's keys can't be changed by a later encoder.)
+            if (conn.keys && state == conn.keysState && conn.keys->refCount() == 1)
+                return;
+            Retained<fleece::impl::SharedKeys> keys;
+            if (_documentKeys) {
+                keys = new fleece::impl::SharedKeys();
+                if (state)
+                    keys->loadFrom(state);
+            }
+            // No statements are active at this point, so SQLite allows replacing the functions:
+            RegisterSQLiteFunctions(conn.db->getHandle(), _accessor, keys);
+            conn.keys = keys;
+            conn.keysState = state;
+        }
+
+        string const _path;
+        DataFile::Options const _options;
+        DataFile::FleeceAccessor const _accessor;
+        DocumentKeys* const _documentKeys;
+        mutex _mutex;
+        vector<unique_ptr<SQLiteReader::Connection>> _idle;
+        unsigned _count {0};                        // Total connections, idle or borrowed
+        bool _closed {false};
+    };
+
+
+    unique_ptr<SQLiteReader> SQLiteDataFile::borrowReader() const {
+        if (!inOtherThreadsTransaction() || !_readerPool)
+            return nullptr;
+        return _readerPool->borrow();
+    }
+
+
+    bool SQLiteDataFile::inOtherThreadsTransaction() const {
+        auto owner = _transactionThread.load();
+        return owner != thread::id() && owner != this_thread::get_id();
+    }
+
+
+    bool SQLiteDataFile::inThisThreadsTransaction() const {
+        return _transactionThread.load() == this_thread::get_id();
+    }
+
+
+    unique_ptr<SQLiteReader> SQLiteDataFile::borrowWorkerReader() const {
+        return _readerPool ? _readerPool->borrow() : nullptr;
+    }
+
+
+    SQLiteReader::SQLiteReader(shared_ptr<SQLiteReaderPool> pool, unique_ptr<Connection> conn)
+    :_pool(move(pool))
+    ,_connection(move(conn))
+    { }
+
+
+    SQLiteReader::~SQLiteReader() {
+        _pool->giveBack(move(_connection));
+    }
+
+
+    fleece::impl::SharedKeys* SQLiteReader::documentKeys() const {
+        return _connection->keys;
+    }
+
+
+    SQLite::Database& SQLiteReader::database() const {
+        return *_connection->db;
+    }
+
+
+    shared_ptr<SQLite::Statement> SQLiteReader::compile(const string &sql,
+                                                        sqlite3_stmt* *outHandle)
+    {
+        auto &cached = _connection->statements[sql];
+        if (!cached.statement) {
+            try {
+                cached.statement = CompileStatement(*_connection->db, sql, cached.handle);
+            } catch (const SQLite::Exception &x) {
+                LogVerbose(SQL, "Reader couldn't compile \"%s\": %s", sql.c_str(), x.what());
+                _connection->statements.erase(sql);
+                return nullptr;
+            }
+        }
+        if (outHandle)
+            *outHandle = cached.handle;
+        return cached.statement;
+    }
+
+
+    sequence_t SQLiteReader::lastSequence(const string &keyStoreName) {
+        auto stmt = compile("SELECT lastSeq FROM kvmeta WHERE name=?");
+        if (!stmt)
+            return 0;
+        UsingStatement u(*stmt);
+        stmt->bindNoCopy(1, keyStoreName);
+        return stmt->executeStep() ? (int64_t)stmt->getColumn(0) : 0;
+    }
+
 }
@@ -20,6 +20,9 @@
 
 #include "DataFile.hh"
 #include "UnicodeCollator.hh"
+#include <atomic>
+#include <memory>
+#include <thread>
 
 namespace SQLite {
     class Database;
@@ -30,7 +33,11 @@ namespace SQLite {
 
 namespace litecore {
 
+    class SQLiteCheckpointer;
     class SQLiteKeyStore;
+    class SQLiteReader;
+    class SQLiteReaderPool;
+    class QueryCache;
 
 
     /** SQLite implementation of Database. */
@@ -58,6 +65,29 @@ namespace litecore {
 
         fleece::alloc_slice rawQuery(const std::string &query) override;
 
+        /** Cache of compiled queries, shared by all KeyStores. */
+        QueryCache& queryCache() const                      {return *_queryCache;}
+
+        /** If a Transaction is open on another thread, borrows a read-only connection from the
+            pool of readers, so the caller can read the last committed state of the file in
+            parallel with that Transaction. Otherwise, or if all the readers are busy, returns
+            null, meaning that the main connection should be used as usual. */
+        std::unique_ptr<SQLiteReader> borrowReader() const;
+
+        /** Borrows a read-only connection from the pool whether or not a Transaction is open,
+            for use by a worker thread. Returns null if all the readers are busy. */
+        std::unique_ptr<SQLiteReader> borrowWorkerReader() const;
+
+        /** True if a Transaction is open on a thread other than the current one. Anything the
+            current thread runs on the main connection would then be part of that Transaction. */
+        bool inOtherThreadsTransaction() const;
+
+        /** True if the current thread is in a Transaction. */
+        bool inThisThreadsTransaction() const;
+
+        /** Runs WAL checkpoints in the background; null if the file is read-only. */
+        SQLiteCheckpointer* checkpointer() const            {return _checkpointer;}
+
         class Factory : public DataFile::Factory {
         public:
             Factory();
@@ -93,16 +123,22 @@ namespace litecore {
         int execWithLock(const std::string &sql);
         int64_t intQuery(const char *query);
         void optimizeAndVacuum();
+        void optimizeFTS5Indexes();
 
     private:
         friend class SQLiteKeyStore;
 
         bool decrypt();
+        void reindexCustomASCIICollations();
         int _exec(const std::string &sql);
 
         std::unique_ptr<SQLite::Database>    _sqlDb;         // SQLite database object
         std::unique_ptr<SQLite::Statement>   _getLastSeqStmt, _setLastSeqStmt;
         CollationContextVector _collationContexts;
+        std::unique_ptr<QueryCache>          _queryCache;    // Compiled queries, for reuse
+        std::shared_ptr<SQLiteReaderPool>    _readerPool;    // Read-only snapshot connections
+        Retained<SQLiteCheckpointer>         _checkpointer;  // Background WAL checkpoints
+        std::atomic<std::thread::id>         _transactionThread {std::thread::id()};
     };
 
 }
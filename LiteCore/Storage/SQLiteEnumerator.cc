@@ -25,6 +25,8 @@
 #include "FleeceImpl.hh"
 #include "Path.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
+#include <algorithm>
+#include <mutex>
 #include <sstream>
 #include <iostream>
 
@@ -36,27 +38,37 @@ namespace litecore {
 
    class SQLiteEnumerator : public RecordEnumerator::Impl {
     public:
-        SQLiteEnumerator(SQLite::Statement *stmt, bool descending, ContentOptions content)
-        :_stmt(stmt),
+        SQLiteEnumerator(unique_ptr<SQLiteReader> reader, shared_ptr<SQLite::Statement> stmt,
+                         bool descending, ContentOptions content)
+        :_reader(move(reader)),
+         _stmt(move(stmt)),
          _content(content)
         {
             LogTo(SQL, "Enumerator: %s", _stmt->getQuery().c_str());
         }
 
+        ~SQLiteEnumerator() {
+            // The statement may be cached by the KeyStore, so reset it for the next enumerator:
+            try {
+                _stmt->reset();
+            } catch (...) { }
+        }
+
         virtual bool next() override {
             return _stmt->executeStep();
         }
 
-        virtual bool read(Record &rec) override {
-            rec.updateSequence((int64_t)_stmt->getColumn(0));
-            rec.setFlags((DocumentFlags)(int)_stmt->getColumn(1));
-            rec.setKey(SQLiteKeyStore::columnAsSlice(_stmt->getColumn(2)));
+        virtual bool read(RecordLite &rec) override {
+            // The slices point into the current row, so they're valid until the next step:
+            rec.sequence = (int64_t)_stmt->getColumn(0);
+            rec.key = SQLiteKeyStore::columnAsSlice(_stmt->getColumn(2));
             SQLiteKeyStore::setRecordMetaAndBody(rec, *_stmt.get(), _content);
             return true;
         }
 
     private:
-        unique_ptr<SQLite::Statement> _stmt;
+        unique_ptr<SQLiteReader> _reader;       // Reader connection _stmt belongs to, if any
+        shared_ptr<SQLite::Statement> _stmt;
         ContentOptions _content;
     };
 
@@ -73,6 +85,59 @@ namespace litecore {
     void SQLiteKeyStore::writeSQLOptions(stringstream &sql, RecordEnumerator::Options options) {
         if (options.descending)
             sql << " DESC";
+        if (options.skip > 0 || options.limit < UINT64_MAX)
+            sql << " LIMIT $limit OFFSET $skip";
+    }
+
+
+    // Returns a number identifying the SQL that newEnumeratorImpl generates for the options.
+    // The values of `since`, the key range, skip and limit are bound as parameters.
+    static unsigned enumeratorKey(bool bySequence, const RecordEnumerator::Options &options) {
+        bool startKey = !bySequence && options.startKey.buf;
+        bool endKey = !bySequence && options.endKey.buf;
+        return    (bySequence                                       ? 0x001 : 0)
+                | (options.descending                               ? 0x002 : 0)
+                | (options.includeDeleted                           ? 0x004 : 0)
+                | (options.onlyBlobs                                ? 0x008 : 0)
+                | (options.onlyConflicts                            ? 0x010 : 0)
+                | ((options.contentOptions & kMetaOnly)             ? 0x020 : 0)
+                | (startKey                                         ? 0x040 : 0)
+                | (startKey && options.inclusiveStart               ? 0x080 : 0)
+                | (endKey                                           ? 0x100 : 0)
+                | (endKey && options.inclusiveEnd                   ? 0x200 : 0)
+                | (options.skip > 0 || options.limit < UINT64_MAX   ? 0x400 : 0);
+    }
+
+
+    string SQLiteKeyStore::enumeratorSQL(bool bySequence, RecordEnumerator::Options options) {
+        stringstream sql;
+        selectFrom(sql, options);
+        const char *conjunction = " WHERE ";
+        auto where = [&]() -> stringstream& {
+            sql << conjunction;
+            conjunction = " AND ";
+            return sql;
+        };
+        if (bySequence)
+            where() << "sequence > $since";
+        if (!options.includeDeleted)
+            where() << "(flags & 1) != 1";
+        if (options.onlyBlobs)
+            where() << "(flags & 4) != 0";
+        if (options.onlyConflicts)
+            where() << "(flags & 2) != 0";
+        if (!bySequence) {
+            // When descending, the start key is the upper bound:
+            if (options.startKey.buf)
+                where() << "key " << (options.descending ? '<' : '>')
+                        << (options.inclusiveStart ? "= " : " ") << "$startKey";
+            if (options.endKey.buf)
+                where() << "key " << (options.descending ? '>' : '<')
+                        << (options.inclusiveEnd ? "= " : " ") << "$endKey";
+        }
+        sql << (bySequence ? " ORDER BY sequence" : " ORDER BY key");
+        writeSQLOptions(sql, options);
+        return sql.str();
     }
 
 
@@ -80,34 +145,55 @@ namespace litecore {
                                                               sequence_t since,
                                                               RecordEnumerator::Options options)
     {
-        if (bySequence && _db.options().writeable)
+        // (Creating the index on the main connection while another thread is in a Transaction
+        // would make it part of that Transaction, so leave it for later.)
+        if (bySequence && _db.options().writeable && !db().inOtherThreadsTransaction())
             createSequenceIndex();
 
-        stringstream sql;
-        selectFrom(sql, options);
-        bool writeAnd = false;
+        unsigned key = enumeratorKey(bySequence, options);
+        string sql;
+        {
+            lock_guard<mutex> lock(_enumStatementsMutex);
+            EnumeratorStatement &cached = _enumStatements[key];
+            if (cached.sql.empty())
+                cached.sql = enumeratorSQL(bySequence, options);
+            sql = cached.sql;
+        }
+
+        // If another thread is in a Transaction, enumerate a committed snapshot on a reader:
+        shared_ptr<SQLite::Statement> stmt;
+        auto reader = db().borrowReader();
+        if (reader)
+            stmt = reader->compile(sql);
+        if (!stmt) {
+            reader.reset();
+            lock_guard<mutex> lock(_enumStatementsMutex);
+            EnumeratorStatement &cached = _enumStatements[key];
+            if (!cached.statement) {
+                cached.statement = make_shared<SQLite::Statement>(db(), sql);
+                stmt = cached.statement;
+            } else if (cached.statement.use_count() == 1) {
+                stmt = cached.statement;
+            } else {
+                // An earlier enumerator is still using the cached statement, so make a new one:
+                stmt = make_shared<SQLite::Statement>(db(), sql);
+            }
+        }
+
         if (bySequence) {
-            sql << " WHERE sequence > ?";
-            writeAnd = true;
+            stmt->bind("$since", (long long)since);
         } else {
-            if (!options.includeDeleted || options.onlyBlobs)
-                sql << " WHERE ";
-        }
-        if (!options.includeDeleted) {
-            if (writeAnd) sql << " AND "; else writeAnd = true;
-            sql << "(flags & 1) != 1";
+            if (options.startKey.buf)
+                stmt->bind("$startKey", options.startKey.asString());
+            if (options.endKey.buf)
+                stmt->bind("$endKey", options.endKey.asString());
         }
-        if (options.onlyBlobs) {
-            if(writeAnd) sql << " AND "; // else writeAnd = true;
-            sql << "(flags & 4) != 0";
+        if (options.skip > 0 || options.limit < UINT64_MAX) {
+            stmt->bind("$limit", (long long)min(options.limit, (uint64_t)INT64_MAX));
+            stmt->bind("$skip", (long long)min(options.skip, (uint64_t)INT64_MAX));
         }
-        sql << (bySequence ? " ORDER BY sequence" : " ORDER BY key");
-        writeSQLOptions(sql, options);
-
-        auto stmt = new SQLite::Statement(db(), sql.str());        // TODO: Cache a statement
-        if (bySequence)
-            stmt->bind(1, (long long)since);
-        return new SQLiteEnumerator(stmt, options.descending, options.contentOptions);
+        return new SQLiteEnumerator(move(reader), stmt,
+                                    options.descending, options.contentOptions);
     }
 
 }
@@ -24,6 +24,7 @@
 #include "StringUtil.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include "FleeceImpl.hh"
+#include <algorithm>
 #include <sstream>
 
 using namespace std;
@@ -80,6 +81,8 @@ namespace litecore {
         _getBySeqStmt.reset();
         _getByOffStmt.reset();
         _getMetaBySeqStmt.reset();
+        _getManyByKeyStmt.reset();
+        _getManyMetaByKeyStmt.reset();
         _setStmt.reset();
         _insertStmt.reset();
         _replaceStmt.reset();
@@ -88,6 +91,10 @@ namespace litecore {
         _delByBothStmt.reset();
         _backupStmt.reset();
         _setFlagStmt.reset();
+        {
+            lock_guard<mutex> lock(_enumStatementsMutex);
+            _enumStatements.clear();
+        }
         KeyStore::close();
     }
 
@@ -111,6 +118,17 @@ namespace litecore {
     }
 
 
+    // Variant that also returns the statement's sqlite3_stmt, for recording its status counters.
+    SQLite::Statement* SQLiteKeyStore::compile(const string &sql, sqlite3_stmt* &outHandle) const {
+        try {
+            return CompileStatement(db(), sql, outHandle).release();
+        } catch (const SQLite::Exception &x) {
+            Warn("SQLite error compiling statement \"%s\": %s", sql.c_str(), x.what());
+            throw;
+        }
+    }
+
+
     SQLite::Statement& SQLiteKeyStore::compile(const unique_ptr<SQLite::Statement>& ref,
                                                const char *sqlTemplate) const
     {
@@ -123,6 +141,22 @@ namespace litecore {
     }
 
 
+    // Variant that compiles the statement on a borrowed reader connection, if there is one,
+    // so the read doesn't see (or wait for) another thread's uncommitted Transaction. The
+    // reader caches the statement, so the reference stays valid while the reader is alive.
+    SQLite::Statement& SQLiteKeyStore::compile(const unique_ptr<SQLite::Statement>& ref,
+                                               const char *sqlTemplate,
+                                               SQLiteReader *reader) const
+    {
+        if (reader) {
+            auto stmt = reader->compile(subst(sqlTemplate));
+            if (stmt)
+                return *stmt;
+        }
+        return compile(ref, sqlTemplate);
+    }
+
+
     uint64_t SQLiteKeyStore::recordCount() const {
         if (!_recCountStmt) {
             stringstream sql;
@@ -171,9 +205,8 @@ namespace litecore {
     }
 
 
-    // OPT: Would be nice to avoid copying key/vers/body here; this would require Record to
-    // know that the pointers are ephemeral, and create copies if they're accessed as
-    // alloc_slice (not just slice).
+    // Note: This copies the version and body into the Record. Callers that don't need to keep
+    // the data can avoid that by using a RecordLite (see getBorrowed and SQLiteEnumerator.)
 
 
     // Gets flags from col 1, version from col 3, and body (or its length) from col 4
@@ -191,12 +224,34 @@ namespace litecore {
     }
     
 
+    // Same as above, but points the RecordLite's slices directly at the column data, which stays
+    // valid until the statement is stepped or reset.
+    /*static*/ void SQLiteKeyStore::setRecordMetaAndBody(RecordLite &rec,
+                                                         SQLite::Statement &stmt,
+                                                         ContentOptions options)
+    {
+        rec.exists = true;
+        rec.flags = (DocumentFlags)(int)stmt.getColumn(1);
+        rec.version = columnAsSlice(stmt.getColumn(3));
+        if (options & kMetaOnly) {
+            rec.body = nullslice;
+            rec.bodySize = (ssize_t)stmt.getColumn(4);
+        } else {
+            rec.body = columnAsSlice(stmt.getColumn(4));
+            rec.bodySize = rec.body.size;
+        }
+    }
+
+
     bool SQLiteKeyStore::read(Record &rec, ContentOptions options) const {
+        auto reader = db().borrowReader();
         auto &stmt = (options & kMetaOnly)
             ? compile(_getMetaByKeyStmt,
-                      "SELECT sequence, flags, 0, version, length(body) FROM kv_@ WHERE key=?")
+                      "SELECT sequence, flags, 0, version, length(body) FROM kv_@ WHERE key=?",
+                      reader.get())
             : compile(_getByKeyStmt,
-                      "SELECT sequence, flags, 0, version, body FROM kv_@ WHERE key=?");
+                      "SELECT sequence, flags, 0, version, body FROM kv_@ WHERE key=?",
+                      reader.get());
         stmt.bindNoCopy(1, (const char*)rec.key().buf, (int)rec.key().size);
         UsingStatement u(stmt);
         if (!stmt.executeStep())
@@ -209,15 +264,92 @@ namespace litecore {
     }
 
 
+    bool SQLiteKeyStore::getBorrowed(slice key, ContentOptions options,
+                                     function_ref<void(const RecordLite&)> fn) const
+    {
+        auto reader = db().borrowReader();
+        auto &stmt = (options & kMetaOnly)
+            ? compile(_getMetaByKeyStmt,
+                      "SELECT sequence, flags, 0, version, length(body) FROM kv_@ WHERE key=?",
+                      reader.get())
+            : compile(_getByKeyStmt,
+                      "SELECT sequence, flags, 0, version, body FROM kv_@ WHERE key=?",
+                      reader.get());
+        stmt.bindNoCopy(1, (const char*)key.buf, (int)key.size);
+        UsingStatement u(stmt);
+        if (!stmt.executeStep())
+            return false;
+
+        RecordLite rec = {};
+        rec.key = key;
+        rec.sequence = (int64_t)stmt.getColumn(0);
+        setRecordMetaAndBody(rec, stmt, options);
+        fn(rec);
+        return true;
+    }
+
+
+    // Number of keys getManyBorrowed looks up per query. (SQLite allows up to 999 parameters.)
+    static constexpr size_t kKeysPerGetMany = 256;
+
+
+    void SQLiteKeyStore::getManyBorrowed(const vector<slice> &keys, ContentOptions options,
+                                         function_ref<void(const RecordLite&)> fn) const
+    {
+        // The statement always has kKeysPerGetMany parameters; any that aren't bound are NULL,
+        // which never matches a key. That lets a single compiled statement handle any batch.
+        auto sqlFor = [](const char *bodyColumn) {
+            stringstream sql;
+            sql << "SELECT sequence, flags, key, version, " << bodyColumn
+                << " FROM kv_@ WHERE key IN (?";
+            for (size_t i = 1; i < kKeysPerGetMany; ++i)
+                sql << ",?";
+            sql << ") ORDER BY key";
+            return sql.str();
+        };
+        static const string kGetManyByKeySQL = sqlFor("body");
+        static const string kGetManyMetaByKeySQL = sqlFor("length(body)");
+
+        auto reader = db().borrowReader();
+        auto &stmt = (options & kMetaOnly)
+            ? compile(_getManyMetaByKeyStmt, kGetManyMetaByKeySQL.c_str(), reader.get())
+            : compile(_getManyByKeyStmt, kGetManyByKeySQL.c_str(), reader.get());
+
+        // Sorting the keys up front keeps the results in order across multiple queries, and
+        // removing duplicates keeps a key in two queries from producing the record twice:
+        vector<slice> sortedKeys(keys);
+        sort(sortedKeys.begin(), sortedKeys.end());
+        sortedKeys.erase(unique(sortedKeys.begin(), sortedKeys.end()), sortedKeys.end());
+        for (size_t start = 0; start < sortedKeys.size(); start += kKeysPerGetMany) {
+            size_t end = min(start + kKeysPerGetMany, sortedKeys.size());
+            stmt.clearBindings();
+            for (size_t i = start; i < end; ++i)
+                stmt.bindNoCopy((int)(i - start + 1),
+                                (const char*)sortedKeys[i].buf, (int)sortedKeys[i].size);
+            UsingStatement u(stmt);
+            while (stmt.executeStep()) {
+                RecordLite rec = {};
+                rec.key = columnAsSlice(stmt.getColumn(2));
+                rec.sequence = (int64_t)stmt.getColumn(0);
+                setRecordMetaAndBody(rec, stmt, options);
+                fn(rec);
+            }
+        }
+    }
+
+
     Record SQLiteKeyStore::get(sequence_t seq /*, ContentOptions options*/) const {
         constexpr ContentOptions options = kDefaultContent;  // this used to be a param but not used
         Assert(_capabilities.sequences);
         Record rec;
+        auto reader = db().borrowReader();
         auto &stmt = (options & kMetaOnly)
             ? compile(_getMetaBySeqStmt,
-                      "SELECT 0, flags, key, version, length(body) FROM kv_@ WHERE sequence=?")
+                      "SELECT 0, flags, key, version, length(body) FROM kv_@ WHERE sequence=?",
+                      reader.get())
             : compile(_getBySeqStmt,
-                      "SELECT 0, flags, key, version, body FROM kv_@ WHERE sequence=?");
+                      "SELECT 0, flags, key, version, body FROM kv_@ WHERE sequence=?",
+                      reader.get());
         UsingStatement u(stmt);
         stmt.bind(1, (long long)seq);
         if (stmt.executeStep()) {
@@ -288,6 +420,55 @@ namespace litecore {
     }
 
 
+    sequence_t SQLiteKeyStore::setMany(const vector<SetRequest> &requests, Transaction&,
+                                       vector<sequence_t> *outSequences)
+    {
+        if (outSequences)
+            outSequences->clear();
+        if (requests.empty())
+            return 0;
+        LogVerbose(DBLog, "KeyStore(%s) set %zu records", name().c_str(), requests.size());
+        // Allocate all the sequences up front, and only update lastSequence once at the end.
+        // A skipped insert doesn't use up its sequence, so the block stays contiguous:
+        sequence_t firstSeq = _capabilities.sequences ? lastSequence() + 1 : 1;
+        sequence_t seq = firstSeq;
+        bool wroteAny = false;
+        for (auto &rq : requests) {
+            SQLite::Statement *stmt;
+            if (rq.insertOnly)
+                stmt = &compile(_insertStmt,
+                                "INSERT OR IGNORE INTO kv_@ (version, body, flags, sequence, key)"
+                                " VALUES (?, ?, ?, ?, ?)");
+            else
+                stmt = &compile(_setStmt,
+                                "INSERT OR REPLACE INTO kv_@ (version, body, flags, sequence, key)"
+                                " VALUES (?, ?, ?, ?, ?)");
+            UsingStatement u(*stmt);
+            stmt->bindNoCopy(1, rq.version.buf, (int)rq.version.size);
+            stmt->bindNoCopy(2, rq.value.buf, (int)rq.value.size);
+            stmt->bind(3, (int)rq.flags);
+            if (_capabilities.sequences)
+                stmt->bind(4, (long long)seq);
+            else
+                stmt->bind(4); // null
+            stmt->bindNoCopy(5, (const char*)rq.key.buf, (int)rq.key.size);
+            bool wrote = stmt->exec() > 0;
+            if (outSequences)
+                outSequences->push_back(wrote ? seq : 0);
+            if (wrote) {
+                wroteAny = true;
+                if (_capabilities.sequences)
+                    ++seq;
+            }
+        }
+        if (!wroteAny)
+            return 0;
+        if (_capabilities.sequences)
+            setLastSequence(seq - 1);
+        return firstSeq;
+    }
+
+
     bool SQLiteKeyStore::del(slice key, Transaction&, sequence_t seq) {
         Assert(key);
         SQLite::Statement *stmt;
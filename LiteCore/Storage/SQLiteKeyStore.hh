@@ -20,6 +20,13 @@
 #include "KeyStore.hh"
 #include "QueryParser.hh"
 #include "FleeceImpl.hh"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+struct sqlite3_stmt;
 
 namespace SQLite {
     class Column;
@@ -30,6 +37,7 @@ namespace SQLite {
 namespace litecore {
 
     class SQLiteDataFile;
+    class SQLiteReader;
     
 
     /** SQLite implementation of KeyStore; corresponds to a SQL table. */
@@ -40,12 +48,19 @@ namespace litecore {
 
         Record get(sequence_t) const override;
         bool read(Record &rec, ContentOptions options) const override;
+        bool getBorrowed(slice key, ContentOptions,
+                         function_ref<void(const RecordLite&)>) const override;
+        void getManyBorrowed(const std::vector<slice> &keys, ContentOptions,
+                             function_ref<void(const RecordLite&)>) const override;
 
         sequence_t set(slice key, slice meta, slice value, DocumentFlags,
                        Transaction&,
                        const sequence_t *replacingSequence =nullptr,
                        bool newSequence =true) override;
 
+        sequence_t setMany(const std::vector<SetRequest>&, Transaction&,
+                           std::vector<sequence_t> *outSequences =nullptr) override;
+
         bool del(slice key, Transaction&, sequence_t s) override;
 
         bool setDocumentFlag(slice key, sequence_t, DocumentFlags, Transaction&) override;
@@ -60,14 +75,27 @@ namespace litecore {
 
         void deleteIndex(slice name) override;
         alloc_slice getIndexes() const override;
+        void updateLazyIndexes() override;
 
         void createSequenceIndex();
 
+        /** Full-text indexes of KeyStores with more than a few times this many records are
+            populated by worker threads, this many records per Transaction, so that creating
+            them doesn't block other writers for long. */
+        static void setIndexBuildChunkSize(unsigned records)   {sIndexBuildChunkSize = records;}
+        static unsigned indexBuildChunkSize()                   {return sIndexBuildChunkSize;}
+        /** For testing: a function to call after each chunk of an index table is built. */
+        static void setIndexBuildChunkCallback(std::function<void(unsigned chunk)> fn) {
+            sIndexBuildChunkCallback = fn;
+        }
+
         // QueryParser::delegate:
         virtual std::string tableName() const override  {return std::string("kv_") + name();}
         virtual std::string FTSTableName(const std::string &property) const override;
         virtual std::string unnestedTableName(const std::string &property) const override;
         virtual bool tableExists(const std::string &tableName) const override;
+        virtual bool isFTS5Table(const std::string &tableName) const override;
+        virtual bool hasCollationKeyIndex(const std::string &collationName) const override;
 
 
     protected:
@@ -77,8 +105,12 @@ namespace litecore {
         Retained<Query> compileQuery(slice expression) override;
 
         SQLite::Statement* compile(const std::string &sql) const;
+        SQLite::Statement* compile(const std::string &sql, sqlite3_stmt* &outHandle) const;
         SQLite::Statement& compile(const std::unique_ptr<SQLite::Statement>& ref,
                                    const char *sqlTemplate) const;
+        SQLite::Statement& compile(const std::unique_ptr<SQLite::Statement>& ref,
+                                   const char *sqlTemplate,
+                                   SQLiteReader *reader) const;
 
         void transactionWillEnd(bool commit);
 
@@ -88,6 +120,9 @@ namespace litecore {
         static void setRecordMetaAndBody(Record &rec,
                                          SQLite::Statement &stmt,
                                          ContentOptions options);
+        static void setRecordMetaAndBody(RecordLite &rec,
+                                         SQLite::Statement &stmt,
+                                         ContentOptions options);
 
     private:
         friend class SQLiteDataFile;
@@ -99,6 +134,7 @@ namespace litecore {
         std::string subst(const char *sqlTemplate) const;
         void selectFrom(std::stringstream& in, const RecordEnumerator::Options options);
         void writeSQLOptions(std::stringstream &sql, RecordEnumerator::Options options);
+        std::string enumeratorSQL(bool bySequence, RecordEnumerator::Options);
         void setLastSequence(sequence_t seq);
         void createTrigger(const std::string &triggerName,
                            const char *triggerSuffix,
@@ -110,21 +146,65 @@ namespace litecore {
                               const std::string &indexName,
                               fleece::impl::Array::iterator &expressions,
                               const IndexOptions *options);
-        bool createFTSIndex(std::string, const fleece::impl::Array *params, const IndexOptions*);
+        // Describes how buildIndexTable() should populate an index table
+        struct IndexTableBuild {
+            std::string tableName;          // The index table
+            std::string selectSQL;          // Selects its rows for the record rowids ?1...?2
+            std::string insertSQL;          // Inserts one of those rows into it
+            std::string updateSQL;          // Re-indexes the records in its pending table
+            uint64_t buildID {0};           // Identifies this build while it runs
+        };
+
+        bool createFTSIndex(std::string, const fleece::impl::Array *params, const IndexOptions*,
+                            IndexTableBuild *deferredBuild =nullptr);
+        bool createFTS5Index(std::string, const fleece::impl::Array *params, const IndexOptions*);
+        static std::string FTS5ContentViewName(const std::string &ftsTableName);
         bool createArrayIndex(std::string, const fleece::impl::Array *params, const IndexOptions*);
         std::string createUnnestedTable(const fleece::impl::Value *arrayPath, const IndexOptions*);
         bool _schemaExistsWithSQL(const std::string &name, const std::string &type,
                                   const std::string &tableName, const std::string &sql);
         void _sqlDeleteIndex(const std::string &name);
         void garbageCollectArrayIndexes();
+        static std::string pendingTableName(const std::string &indexTableName);
+        bool isLazyIndexTable(const std::string &indexTableName) const;
+        void createLazyIndexTriggers(const std::string &indexTableName);
+        void registerLazyIndexTable(const std::string &indexTableName,
+                                    const std::string &updateSQL);
+        bool isIndexTableBuilding(const std::string &indexTableName) const;
+        bool shouldBuildIndexTableInParallel() const;
+        void buildIndexTable(const IndexTableBuild&);
+        void registerIndexTableBuild(const std::string &indexTableName,
+                                     const std::string &rebuildSQL,
+                                     const std::string &updateSQL);
+        static void unregisterIndexTableBuild(SQLiteDataFile&, const std::string &indexTableName);
+        static void finishInterruptedIndexBuilds(SQLiteDataFile&);
+        void recordCollationKeyVersions(const std::string &indexSQL);
+        static void checkCollationKeyVersions(SQLiteDataFile&);
+        void dropIndexTableTriggers(const std::string &indexTableName);
+        std::vector<std::string> lazyIndexTables() const;
+        void updateLazyIndexTables(const std::vector<std::string> &indexTableNames);
 
         std::unique_ptr<SQLite::Statement> _recCountStmt;
         std::unique_ptr<SQLite::Statement> _getByKeyStmt, _getMetaByKeyStmt, _getByOffStmt;
         std::unique_ptr<SQLite::Statement> _getBySeqStmt, _getMetaBySeqStmt;
+        std::unique_ptr<SQLite::Statement> _getManyByKeyStmt, _getManyMetaByKeyStmt;
         std::unique_ptr<SQLite::Statement> _setStmt, _insertStmt, _replaceStmt, _updateBodyStmt;
         std::unique_ptr<SQLite::Statement> _backupStmt, _delByKeyStmt, _delBySeqStmt, _delByBothStmt;
         std::unique_ptr<SQLite::Statement> _setFlagStmt;
-        bool _createdSeqIndex {false};     // Created by-seq index yet?
+
+        // Statements used by enumerators, keyed by the options that determine their SQL.
+        // Enumerators may be created on several threads at once, so it's guarded by a mutex.
+        struct EnumeratorStatement {
+            std::string sql;
+            std::shared_ptr<SQLite::Statement> statement;
+        };
+        std::unordered_map<unsigned, EnumeratorStatement> _enumStatements;
+        std::mutex _enumStatementsMutex;
+
+        static std::atomic<unsigned> sIndexBuildChunkSize;
+        static std::function<void(unsigned)> sIndexBuildChunkCallback;
+
+        std::atomic<bool> _createdSeqIndex {false};     // Created by-seq index yet?
         bool _lastSequenceChanged {false};
         int64_t _lastSequence {-1};
     };
@@ -20,8 +20,10 @@
 #include "DataFile.hh"
 #include "Logging.hh"
 #include <memory>
+#include <string>
 
 struct sqlite3;
+struct sqlite3_stmt;
 
 namespace SQLite {
     class Database;
@@ -40,6 +42,26 @@ namespace litecore {
     void LogStatement(const SQLite::Statement &st);
 
 
+    /** Counters from sqlite3_stmt_status. */
+    struct StatementStatus {
+        uint64_t vmSteps;
+        uint64_t fullScanSteps;
+        uint64_t sorts;
+        uint64_t autoIndexRows;
+    };
+
+    /** Compiles a statement, and also returns its sqlite3_stmt, which SQLite::Statement doesn't
+        expose. (The SQL gets a unique trailing comment, by which the statement is found in the
+        connection's list of statements.) Throws SQLite::Exception like the Statement
+        constructor; `outHandle` is set to nullptr if the statement couldn't be found. */
+    std::unique_ptr<SQLite::Statement> CompileStatement(SQLite::Database&,
+                                                        const std::string &sql,
+                                                        sqlite3_stmt* &outHandle);
+
+    /** Returns a statement's sqlite3_stmt_status counters, and resets them. */
+    StatementStatus TakeStatementStatus(sqlite3_stmt*);
+
+
     // Little helper class that makes sure Statement objects get reset on exit
     class UsingStatement {
     public:
@@ -56,7 +78,58 @@ namespace litecore {
     };
 
 
+    /** Opens an additional connection to a SQLiteDataFile's file, e.g. for use by a background
+        thread, and gives it the file's encryption key. */
+    std::unique_ptr<SQLite::Database> OpenSQLiteConnection(const std::string &path,
+                                                           const DataFile::Options&,
+                                                           int flags, int busyTimeoutMS);
+
+
+    class SQLiteReaderPool;
+
+    /** A read-only connection to a SQLiteDataFile's file, borrowed from its pool of readers by
+        SQLiteDataFile::borrowReader(). It holds a read transaction open while it's borrowed, so
+        everything read through it comes from one committed snapshot of the file, isolated from
+        (and running in parallel with) any Transaction on the main connection.
+        The connection goes back to the pool when this object is destroyed. */
+    class SQLiteReader {
+    public:
+        ~SQLiteReader();
+
+        /** This connection's private copy of the document SharedKeys. It's only safe to use on
+            the thread that borrowed the reader, unlike the DataFile's own documentKeys(). */
+        fleece::impl::SharedKeys* documentKeys() const;
+
+        /** Returns a statement compiled on this connection and cached for reuse, or null if it
+            can't be compiled against the snapshot's schema -- e.g. if it uses a table created
+            by a Transaction that hasn't committed yet. */
+        std::shared_ptr<SQLite::Statement> compile(const std::string &sql,
+                                                   sqlite3_stmt* *outHandle =nullptr);
+
+        /** The last sequence of a KeyStore, as of the snapshot. */
+        sequence_t lastSequence(const std::string &keyStoreName);
+
+        /** The reader's connection. */
+        SQLite::Database& database() const;
+
+        struct Connection;
+
+    private:
+        friend class SQLiteReaderPool;
+
+        SQLiteReader(std::shared_ptr<SQLiteReaderPool>, std::unique_ptr<Connection>);
+        SQLiteReader(const SQLiteReader&) =delete;
+
+        std::shared_ptr<SQLiteReaderPool> _pool;
+        std::unique_ptr<Connection> _connection;
+    };
+
+
     void RegisterSQLiteFunctions(sqlite3 *db,
                                  DataFile::FleeceAccessor accessor,
                                  fleece::impl::SharedKeys *sharedKeys);
+
+    /** Registers the FTS5 version of the unicodesn tokenizer, and an FTS5 offsets() function.
+        Must be called after the FTS3 unicodesn tokenizer has been registered. */
+    int RegisterSQLiteFTS5(sqlite3 *db);
 }
@@ -20,6 +20,7 @@
 #include "Logging.hh"
 #include "PlatformCompat.hh"
 #include "StringUtil.hh"
+#include "SQLiteCpp/Exception.h"
 #include <sqlite3.h>
 #include <algorithm>
 
@@ -29,8 +30,80 @@ namespace litecore {
     using namespace fleece;
     
 
+    // Prefixes of the blobs returned by collation_key(). Strings' sort keys are prefixed with
+    // a lower byte than other blobs (encoded Fleece arrays and dicts), so they still sort before
+    // them as the strings themselves would; blobs keep their order among themselves.
+    static constexpr uint8_t kSortKeyPrefix = 0x00, kBlobPrefix = 0x01;
+
+
+    static void resultBlobWithPrefix(sqlite3_context *ctx, uint8_t prefix, slice blob) noexcept {
+        auto buf = (uint8_t*)sqlite3_malloc64(blob.size + 1);
+        if (!buf) {
+            sqlite3_result_error_nomem(ctx);
+            return;
+        }
+        buf[0] = prefix;
+        if (blob.size > 0)
+            memcpy(buf + 1, blob.buf, blob.size);
+        sqlite3_result_blob64(ctx, buf, blob.size + 1, sqlite3_free);
+    }
+
+
+    // SQL function `collation_key(value, collationName)`. Returns the sort key of a string value
+    // in the named Unicode collation, as a blob; blobs are returned with a different prefix byte
+    // (see above) and other values are returned unchanged. Where sort keys aren't supported, all
+    // values are returned unchanged, so writes to a sort-key index still work; QueryParser
+    // doesn't use such an index for sorting (see SQLiteKeyStore::hasCollationKeyIndex.)
+    // The CollationContext is cached as auxiliary data of the collation-name argument, which is
+    // normally a constant.
+    static void collationKeyFunc(sqlite3_context *ctx, int argc, sqlite3_value **argv) noexcept {
+        int type = sqlite3_value_type(argv[0]);
+        if ((type != SQLITE_TEXT && type != SQLITE_BLOB) || !UnicodeSortKeysSupported()) {
+            sqlite3_result_value(ctx, argv[0]);
+            return;
+        }
+        if (type == SQLITE_BLOB) {
+            resultBlobWithPrefix(ctx, kBlobPrefix, slice(sqlite3_value_blob(argv[0]),
+                                                         sqlite3_value_bytes(argv[0])));
+            return;
+        }
+        try {
+            auto context = (CollationContext*)sqlite3_get_auxdata(ctx, 1);
+            if (!context) {
+                Collation coll;
+                auto name = (const char*)sqlite3_value_text(argv[1]);
+                if (!name || !coll.readSQLiteName(name)) {
+                    sqlite3_result_error(ctx, "collation_key: invalid collation name", -1);
+                    return;
+                }
+                context = NewUnicodeCollationContext(coll).release();
+                sqlite3_set_auxdata(ctx, 1, context,
+                                    [](void *c) {delete (CollationContext*)c;});
+                context = (CollationContext*)sqlite3_get_auxdata(ctx, 1);
+                if (!context) {
+                    sqlite3_result_error_nomem(ctx);
+                    return;
+                }
+            }
+            slice str(sqlite3_value_text(argv[0]), sqlite3_value_bytes(argv[0]));
+            alloc_slice key = UnicodeSortKey(str, *context);
+            resultBlobWithPrefix(ctx, kSortKeyPrefix, key);
+        } catch (const std::exception &x) {
+            sqlite3_result_error(ctx, x.what(), -1);
+        }
+    }
+
+
     void RegisterSQLiteUnicodeCollations(sqlite3* dbHandle,
                                          CollationContextVector &contexts) {
+        // collation_key is only deterministic for a given collator version, but it has to be
+        // flagged as such to be used in an index; SQLiteKeyStore::checkCollationKeyVersions
+        // rebuilds the indexes when the version changes.
+        int rc = sqlite3_create_function_v2(dbHandle, "collation_key", 2,
+                                            SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr,
+                                            collationKeyFunc, nullptr, nullptr, nullptr);
+        if (rc != SQLITE_OK)
+            throw SQLite::Exception(dbHandle, rc);
         sqlite3_collation_needed(dbHandle, &contexts,
                                  [](void *pContexts, sqlite3 *db, int textRep, const char *name)
         {
@@ -81,13 +154,34 @@ namespace litecore {
     }
 
 
-    // This source file does not implement CompareUTF8() or RegisterSQLiteUnicodeCollation(),
-    // which are platform-dependent. Those appear in platform-specific source files.
+    // This source file does not implement CompareUTF8(), RegisterSQLiteUnicodeCollation() or the
+    // sort-key functions, which are platform-dependent. Those appear in platform-specific source
+    // files.
 
 
 #pragma mark - ASCII COLLATOR:
 
 
+    bool LocaleHasCustomASCIIRules(slice localeName) {
+        // Languages whose collation reorders ASCII letters, treats ASCII digraphs like "ch" or
+        // "aa" as single letters, or (Turkish, Azeri) doesn't case-fold "i" to "I":
+        static const char* const kLanguages[] = {
+            "az", "bs", "cs", "cy", "da", "et", "haw", "hr", "hu", "lt", "nb", "nn", "no",
+            "sk", "sq", "tr", nullptr};
+        slice language = localeName;
+        for (size_t i = 0; i < localeName.size; ++i) {
+            if (localeName[i] == '_' || localeName[i] == '-') {
+                language = slice(localeName.buf, i);
+                break;
+            }
+        }
+        for (auto lang = kLanguages; *lang; ++lang)
+            if (language.caseEquivalent(slice(*lang)))
+                return true;
+        return false;
+    }
+
+
     // Maps an ASCII character to its relative priority in the Unicode collation sequence.
     static const uint8_t kCharPriority[128] = {
          99,100,101,102,103,104,105,106,107,  1,  2,108,109,  3,110,111,
@@ -139,7 +233,20 @@ namespace litecore {
     {
         int tieBreaker = 0;
         auto cp1 = chars1, cp2 = chars2;
-        for (size_t n = std::min(len1, len2); n > 0; --n) {
+        size_t n = std::min(len1, len2);
+        if (sizeof(CHAR) == 1) {
+            // Skip the common prefix (ignoring case) in big steps, then finish byte by byte:
+            size_t caseDiff;
+            size_t skip = ASCIIMatchLengthIgnoringCase((const uint8_t*)chars1,
+                                                       (const uint8_t*)chars2, n, caseDiff);
+            if (caseSensitive && caseDiff < skip)
+                tieBreaker = cmp(kCharPriority[chars1[caseDiff]],
+                                 kCharPriority[chars2[caseDiff]]);
+            cp1 += skip;
+            cp2 += skip;
+            n -= skip;
+        }
+        for (; n > 0; --n) {
             auto c1 = *cp1, c2 = *cp2;
             if (_usuallyFalse((c1 >= 0x80) || (c2 >= 0x80)))
                 return kCompareASCIIGaveUp;
@@ -54,15 +54,18 @@ namespace litecore {
     };
 
 
+    /** Returns true if the locale's collation orders ASCII strings differently than CompareASCII
+        does, e.g. by treating "ch" as one letter (Czech) or sorting "y" after "i" (Lithuanian). */
+    bool LocaleHasCustomASCIIRules(fleece::slice localeName);
+
+
     /** Base class of context info managed by collation implementations. */
     class CollationContext {
     public:
         CollationContext(const Collation &collation)
-        :caseSensitive(collation.caseSensitive)
-        ,canCompareASCII(true)
-        {
-            //TODO: Some locales have unusual rules for ASCII; for these, clear canCompareASCII.
-        }
+        :canCompareASCII(!LocaleHasCustomASCIIRules(collation.localeName))
+        ,caseSensitive(collation.caseSensitive)
+        { }
 
         virtual ~CollationContext() =default;
 
@@ -81,12 +84,33 @@ namespace litecore {
 
     /** Registers all collation functions; actually it registers a callback that lets SQLite ask
         for a specific collation, and then calls RegisterSQLiteUnicodeCollation.
-        The contexts created by the collations will be added to the vector. */
+        The contexts created by the collations will be added to the vector.
+        Also registers the SQL function `collation_key(value, collationName)`, which returns the
+        sort key of a string value (see UnicodeSortKey), or any other value unchanged. Where
+        sort keys aren't supported it returns strings unchanged too. */
     void RegisterSQLiteUnicodeCollations(sqlite3*, CollationContextVector&);
 
 
+    /** Returns true if this platform's collator can generate sort keys. */
+    bool UnicodeSortKeysSupported();
+
+    /** Returns a string identifying the version of the sort keys generated for a collation.
+        If it changes (e.g. after an OS or ICU update) any stored sort keys are invalid.
+        Returns an empty string if sort keys aren't supported on this platform. */
+    std::string UnicodeSortKeyVersion(const Collation&);
+
+    /** Creates a context for use with UnicodeSortKey. */
+    std::unique_ptr<CollationContext> NewUnicodeCollationContext(const Collation&);
+
+    /** Returns the binary sort key of a UTF8-encoded string: comparing the sort keys of two
+        strings with memcmp gives the same ordering as comparing the strings with the collation.
+        Must only be called if UnicodeSortKeysSupported() returns true. */
+    fleece::alloc_slice UnicodeSortKey(fleece::slice str, CollationContext&);
+
+
     /** Simple comparison of two UTF8- or UTF16-encoded strings. Uses Unicode ordering, but gives
-        up and returns kCompareASCIIGaveUp if it finds any non-ASCII characters. */
+        up and returns kCompareASCIIGaveUp if it finds any non-ASCII characters.
+        UTF-8 strings are compared 16 bytes at a time where the CPU supports it. */
     template <class CHAR>       // uint8_t or uchar16_t
     int CompareASCII(int len1, const CHAR *chars1,
                      int len2, const CHAR *chars2,
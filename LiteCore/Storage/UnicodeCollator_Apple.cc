@@ -122,6 +122,28 @@ namespace litecore {
     }
 
 
+    // CoreFoundation has no API for generating sort keys (and UCGetCollationKey isn't available
+    // on iOS), so Unicode sort-key indexes fall back to the collation function.
+    bool UnicodeSortKeysSupported() {
+        return false;
+    }
+
+
+    string UnicodeSortKeyVersion(const Collation&) {
+        return "";
+    }
+
+
+    unique_ptr<CollationContext> NewUnicodeCollationContext(const Collation &coll) {
+        return unique_ptr<CollationContext>(new CFCollationContext(coll));
+    }
+
+
+    alloc_slice UnicodeSortKey(slice str, CollationContext&) {
+        return nullslice;
+    }
+
+
     unique_ptr<CollationContext> RegisterSQLiteUnicodeCollation(sqlite3* dbHandle,
                                                                 const Collation &coll) {
         unique_ptr<CollationContext> context(new CFCollationContext(coll));
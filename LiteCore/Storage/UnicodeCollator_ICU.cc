@@ -21,6 +21,7 @@
 #include "Logging.hh"
 #include "PlatformCompat.hh"
 #include "StringUtil.hh"
+#include "TempArray.hh"
 #include "SQLiteCpp/Exception.h"
 #include <sqlite3.h>
 
@@ -47,6 +48,7 @@
 #pragma clang diagnostic ignored "-Wdocumentation"
 #include <unicode/uloc.h>
 #include <unicode/ucol.h>
+#include <unicode/ustring.h>
 #pragma clang diagnostic pop
 
 // http://userguide.icu-project.org/collation
@@ -137,6 +139,50 @@ namespace litecore {
     }
 
 
+    bool UnicodeSortKeysSupported() {
+        return true;
+    }
+
+
+    // The collator's version covers the ICU runtime, the UCA data and the locale's tailoring.
+    string UnicodeSortKeyVersion(const Collation &coll) {
+        ICUCollationContext ctx(coll);
+        UVersionInfo version;
+        ucol_getVersion(ctx.ucoll, version);
+        char str[U_MAX_VERSION_STRING_LENGTH];
+        u_versionToString(version, str);
+        return string("icu-") + str;
+    }
+
+
+    unique_ptr<CollationContext> NewUnicodeCollationContext(const Collation &coll) {
+        return unique_ptr<CollationContext>(new ICUCollationContext(coll));
+    }
+
+
+    alloc_slice UnicodeSortKey(slice str, CollationContext &context) {
+        auto &coll = (ICUCollationContext&)context;
+        // ucol_getSortKey needs UTF-16; that's never more code units than UTF-8 has bytes.
+        UErrorCode status = U_ZERO_ERROR;
+        TempArray(uchars, UChar, str.size + 1);
+        int32_t ulen;
+        u_strFromUTF8(uchars, (int32_t)str.size + 1, &ulen,
+                      (const char*)str.buf, (int32_t)str.size, &status);
+        if (U_FAILURE(status))
+            error::_throw(error::UnexpectedError,
+                          "Failed to convert string for collation (ICU error %d)", (int)status);
+
+        uint8_t buf[256];
+        int32_t keyLen = ucol_getSortKey(coll.ucoll, uchars, ulen, buf, sizeof(buf));
+        if (keyLen <= (int32_t)sizeof(buf))
+            return alloc_slice(buf, keyLen - 1);        // (drop the trailing NUL)
+        alloc_slice key(keyLen);
+        ucol_getSortKey(coll.ucoll, uchars, ulen, (uint8_t*)key.buf, keyLen);
+        key.shorten(keyLen - 1);
+        return key;
+    }
+
+
     unique_ptr<CollationContext> RegisterSQLiteUnicodeCollation(sqlite3* dbHandle,
                                                                 const Collation &coll) {
         unique_ptr<CollationContext> context(new ICUCollationContext(coll));
@@ -24,6 +24,7 @@
 namespace litecore {
 
     using namespace std;
+    using namespace fleece;
 
     int CompareUTF8(slice str1, slice str2, const Collation &coll) {
         error::_throw(error::Unimplemented);
@@ -33,6 +34,22 @@ namespace litecore {
                                                                 const Collation &coll) {
         return nullptr;
     }
+
+    bool UnicodeSortKeysSupported() {
+        return false;
+    }
+
+    string UnicodeSortKeyVersion(const Collation&) {
+        return "";
+    }
+
+    unique_ptr<CollationContext> NewUnicodeCollationContext(const Collation &coll) {
+        return unique_ptr<CollationContext>(new CollationContext(coll));
+    }
+
+    alloc_slice UnicodeSortKey(slice str, CollationContext&) {
+        return nullslice;
+    }
 }
 
 #endif
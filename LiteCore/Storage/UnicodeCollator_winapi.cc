@@ -139,6 +139,54 @@ namespace litecore {
     }
 
 
+    bool UnicodeSortKeysSupported() {
+        return true;
+    }
+
+
+    string UnicodeSortKeyVersion(const Collation &coll) {
+        WinApiCollationContext ctx(coll);
+        NLSVERSIONINFOEX info = {};
+        info.dwNLSVersionInfoSize = sizeof(info);
+        if (!GetNLSVersionEx(COMPARE_STRING, ctx.localeName, &info)) {
+            DWORD err = GetLastError();
+            error::_throw(error::UnexpectedError, "Failed to get NLS version (Error %d)", err);
+        }
+        char str[32];
+        sprintf(str, "nls-%08lx-%08lx", (unsigned long)info.dwNLSVersion,
+                                        (unsigned long)info.dwDefinedVersion);
+        return str;
+    }
+
+
+    unique_ptr<CollationContext> NewUnicodeCollationContext(const Collation &coll) {
+        return unique_ptr<CollationContext>(new WinApiCollationContext(coll));
+    }
+
+
+    alloc_slice UnicodeSortKey(slice str, CollationContext &context) {
+        auto &ctx = (WinApiCollationContext&)context;
+        if (str.size == 0)
+            return alloc_slice(size_t(0));  // (the APIs below fail when given zero length)
+        int len = (int)str.size;
+        TempArray(wchars, WCHAR, len + 1);
+        int wlen = MultiByteToWideChar(CP_UTF8, 0, (const char*)str.buf, len, wchars, len + 1);
+        DWORD flags = ctx.flags | LCMAP_SORTKEY;
+        int keyLen = LCMapStringEx(ctx.localeName, flags, wchars, wlen, nullptr, 0,
+                                   nullptr, nullptr, 0);
+        if (keyLen == 0) {
+            DWORD err = GetLastError();
+            error::_throw(error::UnexpectedError, "Failed to get sort key (Error %d)", err);
+        }
+        // With LCMAP_SORTKEY the destination is a byte array, and its size is in bytes:
+        alloc_slice key(keyLen);
+        LCMapStringEx(ctx.localeName, flags, wchars, wlen, (LPWSTR)key.buf, keyLen,
+                      nullptr, nullptr, 0);
+        key.shorten(keyLen - 1);        // (drop the trailing NUL)
+        return key;
+    }
+
+
     unique_ptr<CollationContext> RegisterSQLiteUnicodeCollation(sqlite3* dbHandle,
         const Collation &coll) {
         unique_ptr<CollationContext> context(new WinApiCollationContext(coll));
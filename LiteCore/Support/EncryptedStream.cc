@@ -50,6 +50,9 @@
     the PKCS7 padding would increase its length, making it overflow.
  
     Finally, the nonce is appended to the end of the stream.
+
+    For efficiency, runs of consecutive whole blocks are read or written with a single I/O call
+    (up to kMaxBlocksPerIO of them), and the AES key schedule is set up only once per stream.
  */
 
 
@@ -58,10 +61,15 @@ namespace litecore {
 
     extern LogDomain BlobLog;
 
+    // Capacity of _ioBuffer: the ciphertext of kMaxBlocksPerIO blocks, plus padding.
+    static const size_t kIOBufferSize = EncryptedStream::kMaxBlocksPerIO
+                                            * EncryptedStream::kFileBlockSize + kAESBlockSize;
+
 
     void EncryptedStream::initEncryptor(EncryptionAlgorithm alg,
                                         slice encryptionKey,
-                                        slice nonce)
+                                        slice nonce,
+                                        bool encrypting)
     {
         bool available = false;
         if (alg == kAES256) {
@@ -74,6 +82,9 @@ namespace litecore {
 
         memcpy(&_key, encryptionKey.buf, kAES256KeySize);
         memcpy(&_nonce, nonce.buf, kAES256KeySize);
+#if AES256_AVAILABLE
+        _cipher.reset(new AES256Context(encrypting, slice(_key, sizeof(_key))));
+#endif
     }
 
 
@@ -93,7 +104,7 @@ namespace litecore {
         uint8_t buf[kAES256KeySize];
         slice nonce(buf, sizeof(buf));
         SecureRandomize(nonce);
-        initEncryptor(alg, encryptionKey, nonce);
+        initEncryptor(alg, encryptionKey, nonce, true);
     }
 
 
@@ -104,27 +115,39 @@ namespace litecore {
     }
 
 
-    void EncryptedWriteStream::writeBlock(slice plaintext, bool finalBlock) {
+    // Encrypts a block into `ciphertext`, returning the size of the ciphertext.
+    size_t EncryptedWriteStream::encryptBlock(slice plaintext, bool finalBlock, slice ciphertext) {
 #if AES256_AVAILABLE
         DebugAssert(plaintext.size <= kFileBlockSize, "Block is too large");
         uint64_t iv[2] = {0, _endian_encode(_blockID)};
         ++_blockID;
-        uint8_t cipherBuf[kFileBlockSize + kAESBlockSize];
-        slice ciphertext(cipherBuf, sizeof(cipherBuf));
-        ciphertext.shorten(AES256(true,
-                                  slice(&_key, sizeof(_key)), slice(iv, sizeof(iv)),
-                                  finalBlock,
-                                  ciphertext,
-                                  plaintext));
-        _output->write(ciphertext);
+        size_t cipherSize = _cipher->crypt(slice(iv, sizeof(iv)), finalBlock,
+                                           ciphertext, plaintext);
         LogVerbose(BlobLog, "WRITE #%2llu: %llu bytes, final=%d --> %llu bytes ciphertext",
-            (unsigned long long)(_blockID-1), (unsigned long long)plaintext.size, finalBlock, (unsigned long long)ciphertext.size);
+            (unsigned long long)(_blockID-1), (unsigned long long)plaintext.size, finalBlock, (unsigned long long)cipherSize);
+        return cipherSize;
 #else
         error::_throw(error::Unimplemented);
 #endif
     }
 
 
+    // Encrypts up to kMaxBlocksPerIO blocks and writes them to the output in one call.
+    // If `finalBlock` is true, `plaintext` is the final (partial or empty) block.
+    void EncryptedWriteStream::writeBlocks(slice plaintext, bool finalBlock) {
+        DebugAssert(plaintext.size <= kMaxBlocksPerIO * kFileBlockSize, "Too many blocks");
+        if (!_ioBuffer)
+            _ioBuffer.reset(new uint8_t[kIOBufferSize]);
+        uint8_t *cipherStart = _ioBuffer.get();
+        slice ciphertext(cipherStart, kIOBufferSize);       // (the unused part of the buffer)
+        do {
+            slice block = plaintext.read(min(plaintext.size, (size_t)kFileBlockSize));
+            ciphertext.moveStart(encryptBlock(block, finalBlock, ciphertext));
+        } while (plaintext.size > 0);
+        _output->write(slice(cipherStart, ciphertext.buf));
+    }
+
+
     void EncryptedWriteStream::write(slice plaintext) {
         // Fill the current partial block buffer:
         auto capacity = min((size_t)kFileBlockSize - _bufferPos, plaintext.size);
@@ -135,11 +158,13 @@ namespace litecore {
             return; // done; didn't fill buffer
 
         // Write the completed buffer:
-        writeBlock(slice(_buffer, kFileBlockSize), false);
+        writeBlocks(slice(_buffer, kFileBlockSize), false);
 
-        // Write entire blocks:
-        while (plaintext.size >= kFileBlockSize)
-            writeBlock(plaintext.read(kFileBlockSize), false);
+        // Write entire blocks, several at a time:
+        while (plaintext.size >= kFileBlockSize) {
+            size_t nBlocks = min(plaintext.size / kFileBlockSize, (size_t)kMaxBlocksPerIO);
+            writeBlocks(plaintext.read(nBlocks * kFileBlockSize), false);
+        }
 
         // Save remainder (if any) in the buffer.
         memcpy(_buffer, plaintext.buf, plaintext.size);
@@ -150,7 +175,7 @@ namespace litecore {
     void EncryptedWriteStream::close() {
         if (_output) {
             // Write the final (partial or empty) block with PKCS7 padding:
-            writeBlock(slice(_buffer, _bufferPos), true);
+            writeBlocks(slice(_buffer, _bufferPos), true);
             // End with the nonce:
             _output->write(slice(_nonce, kAES256KeySize));
             _output->close();
@@ -176,7 +201,7 @@ namespace litecore {
             error::_throw(error::CorruptData);
         _input->seek(0);
 
-        initEncryptor(alg, encryptionKey, slice(buf, sizeof(buf)));
+        initEncryptor(alg, encryptionKey, slice(buf, sizeof(buf)), false);
     }
 
 
@@ -202,11 +227,9 @@ namespace litecore {
 
         uint64_t iv[2] = {0, _endian_encode(_blockID)};
         ++_blockID;
-        size_t outputSize = AES256(false,
-                      slice(_key, sizeof(_key)),
-                      slice(iv, sizeof(iv)),
-                      finalBlock,
-                      output, slice(blockBuf, bytesRead));
+        size_t outputSize = _cipher->crypt(slice(iv, sizeof(iv)),
+                                           finalBlock,
+                                           output, slice(blockBuf, bytesRead));
         LogVerbose(BlobLog, "READ  #%2llu: %llu bytes, final=%d --> %llu bytes ciphertext",
             (unsigned long long)(_blockID-1), (unsigned long long)bytesRead, finalBlock, (unsigned long long)outputSize);
         return outputSize;
@@ -216,6 +239,42 @@ namespace litecore {
     }
 
 
+    // Reads & decrypts as many whole blocks as will fit in `output`, up to kMaxBlocksPerIO,
+    // with a single read from the file. Returns the number of bytes decrypted.
+    size_t EncryptedReadStream::readBlocksFromFile(slice output) {
+#if AES256_AVAILABLE
+        // (The final block is padded, so it's left to readBlockFromFile.)
+        uint64_t nBlocks = min(min(uint64_t(output.size / kFileBlockSize),
+                                   uint64_t(kMaxBlocksPerIO)),
+                               _finalBlockID - _blockID);
+        if (nBlocks <= 1)
+            return readBlockFromFile(output);
+
+        if (!_ioBuffer)
+            _ioBuffer.reset(new uint8_t[kIOBufferSize]);
+        size_t readSize = (size_t)nBlocks * kFileBlockSize;
+        if (_input->read(_ioBuffer.get(), readSize) < readSize)
+            error::_throw(error::CorruptData);
+
+        slice ciphertext(_ioBuffer.get(), readSize);
+        size_t outputSize = 0;
+        while (ciphertext.size > 0) {
+            uint64_t iv[2] = {0, _endian_encode(_blockID)};
+            ++_blockID;
+            outputSize += _cipher->crypt(slice(iv, sizeof(iv)), false,
+                                         slice((uint8_t*)output.buf + outputSize, kFileBlockSize),
+                                         ciphertext.read(kFileBlockSize));
+        }
+        LogVerbose(BlobLog, "READ  #%2llu-%llu: %llu bytes --> %llu bytes ciphertext",
+            (unsigned long long)(_blockID-nBlocks), (unsigned long long)(_blockID-1),
+            (unsigned long long)readSize, (unsigned long long)outputSize);
+        return outputSize;
+#else
+        error::_throw(error::Unimplemented);
+#endif
+    }
+
+
     // Reads the next block from the file into _buffer
     void EncryptedReadStream::fillBuffer() {
         _bufferBlockID = _blockID;
@@ -241,7 +300,7 @@ namespace litecore {
         if (remaining.size > 0 && _blockID <= _finalBlockID) {
             // Read & decrypt as many blocks as possible from the file to the output:
             while (remaining.size >= kFileBlockSize && _blockID <= _finalBlockID) {
-                remaining.moveStart(readBlockFromFile(remaining));
+                remaining.moveStart(readBlocksFromFile(remaining));
             }
 
             if (remaining.size > 0) {
@@ -18,9 +18,11 @@
 
 #pragma once
 #include "Stream.hh"
+#include <memory>
 
 
 namespace litecore {
+    class AES256Context;
 
     /** Abstract base class of EncryptedReadStream and EncryptedWriteStream. */
     class EncryptedStream {
@@ -29,16 +31,22 @@ namespace litecore {
         static const unsigned kFileSizeOverhead = kKeySize;
         static const unsigned kFileBlockSize = 4096;
 
+        /** Max number of consecutive blocks read or written with a single I/O call. */
+        static const unsigned kMaxBlocksPerIO = 16;
+
     protected:
         EncryptedStream() { }
         void initEncryptor(EncryptionAlgorithm alg,
                            slice encryptionKey,
-                           slice nonce);
+                           slice nonce,
+                           bool encrypting);
         virtual ~EncryptedStream();
 
         EncryptionAlgorithm _alg;
         uint8_t _key[kKeySize];
         uint8_t _nonce[kKeySize];
+        std::unique_ptr<AES256Context> _cipher; // Encrypts or decrypts blocks using _key
+        std::unique_ptr<uint8_t[]> _ioBuffer;   // Ciphertext of up to kMaxBlocksPerIO blocks
         uint8_t _buffer[kFileBlockSize];    // stores partially read/written blocks across calls
         size_t _bufferPos {0};        // Indicates how much of buffer is used
         uint64_t _blockID   {0};        // Next block ID to be encrypted/decrypted (counter)
@@ -57,7 +65,8 @@ namespace litecore {
         void close() override;
 
     private:
-        void writeBlock(slice plaintext, bool finalBlock);
+        size_t encryptBlock(slice plaintext, bool finalBlock, slice ciphertext);
+        void writeBlocks(slice plaintext, bool finalBlock);
 
         std::shared_ptr<WriteStream> _output;    // Wrapped stream that will write the ciphertext
     };
@@ -77,6 +86,7 @@ namespace litecore {
 
     private:
         size_t readBlockFromFile(slice output);
+        size_t readBlocksFromFile(slice output);
         void readFromBuffer(slice &dst);
         void fillBuffer();
         void findLength();
@@ -17,28 +17,322 @@
 //
 
 #include "Instrumentation.hh"
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <string.h>
+#include <vector>
 
 #ifdef __APPLE__
 #include <sys/kdebug_signpost.h>
 #endif
 
+using namespace std;
+
 namespace litecore {
 
-#if defined(__APPLE__) && LITECORE_SIGNPOSTS
+#pragma mark - METRICS:
+
+
+    atomic<bool> Metric::sEnabled {false};
+    Metric* Metric::sFirst = nullptr;
+
+
+    namespace metric {
+        Histogram transactionTime       ("transactionTime",    "us");
+        Histogram transactionWait       ("transactionWait",    "us");
+        Gauge     transactionWaiters    ("transactionWaiters");
+        Counter   commits               ("commits");
+        Counter   aborts                ("aborts");
+        Histogram queryCompileTime      ("queryCompileTime",   "us");
+        Histogram queryRunTime          ("queryRunTime",       "us");
+        Histogram revInsertBatchSize    ("revInsertBatchSize", "revs");
+        Histogram revInsertTime         ("revInsertTime",      "us");
+        Counter   bytesSent             ("bytesSent");
+        Counter   bytesReceived         ("bytesReceived");
+    }
+
+
+    // Metrics are only constructed during static initialization, so the list needs no lock.
+    Metric::Metric(const char *name)
+    :_name(name)
+    ,_next(sFirst)
+    {
+        sFirst = this;
+    }
+
+
+    void Metric::setEnabled(bool enabled) {
+        sEnabled = enabled;
+    }
+
+
+    Metric* Metric::named(const char *name) {
+        for (auto m = sFirst; m; m = m->_next)
+            if (strcmp(m->_name, name) == 0)
+                return m;
+        return nullptr;
+    }
+
+
+    void Metric::resetAll() {
+        for (auto m = sFirst; m; m = m->_next)
+            m->reset();
+    }
+
+
+    string Metric::snapshotJSON() {
+        stringstream out;
+        out << '{';
+        for (auto m = sFirst; m; m = m->_next) {
+            if (m != sFirst)
+                out << ',';
+            out << '"' << m->_name << "\":";
+            m->writeJSON(out);
+        }
+        out << '}';
+        return out.str();
+    }
+
+
+    uint64_t Metric::now() {
+        using namespace chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+
+    uint64_t Metric::startTime() {
+        return (enabled() || Tracer::enabled()) ? now() : 0;
+    }
+
+
+    void Counter::writeJSON(ostream &out) const {
+        out << value();
+    }
+
+
+    void Gauge::add(int64_t delta) {
+        int64_t value = _value.fetch_add(delta, memory_order_relaxed) + delta;
+        int64_t max = _max.load(memory_order_relaxed);
+        while (value > max && !_max.compare_exchange_weak(max, value, memory_order_relaxed))
+            ;
+    }
+
+
+    void Gauge::writeJSON(ostream &out) const {
+        out << "{\"value\":" << value() << ",\"max\":" << maxValue() << '}';
+    }
+
+
+    Histogram::Histogram(const char *name, const char *unit)
+    :Metric(name)
+    ,_unit(unit)
+    {
+        reset();
+    }
+
+
+    void Histogram::reset() {
+        _count = 0;
+        _sum = 0;
+        _max = 0;
+        for (auto &bucket : _buckets)
+            bucket = 0;
+    }
+
+
+    void Histogram::_record(uint64_t value) {
+        unsigned bucket = 0;
+        for (uint64_t v = value; v > 0 && bucket < kNumBuckets - 1; v >>= 1)
+            ++bucket;
+        _buckets[bucket].fetch_add(1, memory_order_relaxed);
+        _count.fetch_add(1, memory_order_relaxed);
+        _sum.fetch_add(value, memory_order_relaxed);
+        uint64_t max = _max.load(memory_order_relaxed);
+        while (value > max && !_max.compare_exchange_weak(max, value, memory_order_relaxed))
+            ;
+    }
+
+
+    void Histogram::_recordSince(uint64_t start) {
+        uint64_t end = now();
+        record(end - start);
+        if (Tracer::enabled())
+            Tracer::complete(name(), start, end);
+    }
+
+
+    uint64_t Histogram::percentile(double pct) const {
+        uint64_t count = this->count();
+        if (count == 0)
+            return 0;
+        auto target = uint64_t(count * pct / 100.0 + 0.5);
+        uint64_t seen = 0;
+        unsigned bucket;
+        for (bucket = 0; bucket < kNumBuckets - 1; ++bucket) {
+            seen += _buckets[bucket].load(memory_order_relaxed);
+            if (seen >= target && seen > 0)
+                break;
+        }
+        uint64_t upper = (bucket == 0) ? 0 : (uint64_t(1) << bucket) - 1;
+        uint64_t max = maxValue();
+        return upper < max ? upper : max;
+    }
+
+
+    void Histogram::writeJSON(ostream &out) const {
+        uint64_t count = this->count();
+        out << "{\"unit\":\"" << _unit << "\",\"count\":" << count
+            << ",\"sum\":" << sum()
+            << ",\"mean\":" << (count ? sum() / count : 0)
+            << ",\"p50\":" << percentile(50)
+            << ",\"p90\":" << percentile(90)
+            << ",\"p99\":" << percentile(99)
+            << ",\"max\":" << maxValue() << '}';
+    }
+
+
+#pragma mark - TRACING:
+
+
+    atomic<bool> Tracer::sEnabled {false};
+
+    static const size_t kMaxTraceEvents = 100000;
+
+    namespace {
+        struct TraceEvent {
+            const char* name;
+            char        phase;          // Chrome trace-event phase: 'X', 'i', 'b' or 'e'
+            uint32_t    thread;
+            uint64_t    time;
+            uint64_t    durationOrID;   // Duration for 'X' events, else the ID
+        };
+    }
+
+    static mutex sTraceMutex;
+    static vector<TraceEvent> sTraceEvents;
+    static uint64_t sDroppedTraceEvents = 0;
+
+
+    // Small sequential thread IDs make the trace easier to read than hashed std::thread::ids.
+    static uint32_t currentThreadNumber() {
+        static atomic<uint32_t> sNextThread {1};
+        static thread_local uint32_t tThread = 0;
+        if (tThread == 0)
+            tThread = sNextThread++;
+        return tThread;
+    }
+
+
+    static void addTraceEvent(const char *name, char phase, uint64_t time, uint64_t durationOrID) {
+        TraceEvent event = {name, phase, currentThreadNumber(), time, durationOrID};
+        lock_guard<mutex> lock(sTraceMutex);
+        if (sTraceEvents.size() < kMaxTraceEvents)
+            sTraceEvents.push_back(event);
+        else
+            ++sDroppedTraceEvents;
+    }
+
+
+    void Tracer::setEnabled(bool enabled) {
+        sEnabled = enabled;
+    }
+
+
+    void Tracer::complete(const char *name, uint64_t start, uint64_t end) {
+        addTraceEvent(name, 'X', start, end - start);
+    }
+
+    void Tracer::instant(const char *name, uint64_t id) {
+        addTraceEvent(name, 'i', Metric::now(), id);
+    }
+
+    void Tracer::asyncBegin(const char *name, uint64_t id) {
+        addTraceEvent(name, 'b', Metric::now(), id);
+    }
+
+    void Tracer::asyncEnd(const char *name, uint64_t id) {
+        addTraceEvent(name, 'e', Metric::now(), id);
+    }
+
+
+    void Tracer::clear() {
+        lock_guard<mutex> lock(sTraceMutex);
+        sTraceEvents.clear();
+        sDroppedTraceEvents = 0;
+    }
+
+
+    string Tracer::eventsJSON(bool clear) {
+        vector<TraceEvent> events;
+        uint64_t dropped;
+        {
+            lock_guard<mutex> lock(sTraceMutex);
+            dropped = sDroppedTraceEvents;
+            if (clear) {
+                events.swap(sTraceEvents);
+                sDroppedTraceEvents = 0;
+            } else {
+                events = sTraceEvents;
+            }
+        }
+
+        stringstream out;
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for (auto &e : events) {
+            if (!first)
+                out << ",\n";
+            first = false;
+            out << "{\"name\":\"" << e.name << "\",\"cat\":\"LiteCore\",\"ph\":\"" << e.phase
+                << "\",\"pid\":1,\"tid\":" << e.thread << ",\"ts\":" << e.time;
+            if (e.phase == 'X')
+                out << ",\"dur\":" << e.durationOrID;
+            else if (e.phase == 'i')
+                out << ",\"s\":\"t\",\"args\":{\"id\":" << e.durationOrID << '}';
+            else
+                out << ",\"id\":" << e.durationOrID;
+            out << '}';
+        }
+        out << "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << dropped << "}}";
+        return out.str();
+    }
+
+
+#pragma mark - SIGNPOSTS:
+
+
+    static const char* const kSignpostNames[] = {
+        nullptr, "transaction", "get", "replicatorStart", "replicatorConnect",
+        "replicatorDisconnect"
+    };
+
+
     void Signpost::mark(Type t, uint32_t param) {
+#if LITECORE_SIGNPOSTS
         if (__builtin_available(macOS 10.12, iOS 10, tvOS 10, *))
             kdebug_signpost(uint32_t(t), param, 0, 0, uint32_t(t));
+#endif
+        if (Tracer::enabled())
+            Tracer::instant(kSignpostNames[t], param);
     }
 
     void Signpost::begin(Type t, uint32_t param) {
+#if LITECORE_SIGNPOSTS
         if (__builtin_available(macOS 10.12, iOS 10, tvOS 10, *))
             kdebug_signpost_start(uint32_t(t), param, 0, 0, uint32_t(t));
+#endif
+        if (Tracer::enabled())
+            Tracer::asyncBegin(kSignpostNames[t], param);
     }
 
     void Signpost::end(Type t, uint32_t param) {
+#if LITECORE_SIGNPOSTS
         if (__builtin_available(macOS 10.12, iOS 10, tvOS 10, *))
             kdebug_signpost_end(uint32_t(t), param, 0, 0, uint32_t(t));
-    }
 #endif
+        if (Tracer::enabled())
+            Tracer::asyncEnd(kSignpostNames[t], param);
+    }
 
 }
@@ -17,6 +17,9 @@
 //
 
 #pragma once
+#include <atomic>
+#include <iosfwd>
+#include <string>
 #include <stdint.h>
 
 namespace litecore {
@@ -25,7 +28,183 @@ namespace litecore {
 #define LITECORE_SIGNPOSTS 1
 #endif
 
-    /** A utility for logging chronological points and regions of interest, for profiling. */
+
+    /** A named runtime metric: a Counter, Gauge or Histogram.
+        Metrics are static objects, which register themselves in a process-wide list that can be
+        dumped as JSON. Counters and Histograms are only updated while metrics are enabled; when
+        they're not, an update costs one relaxed atomic load. */
+    class Metric {
+    public:
+        static bool enabled()                   {return sEnabled.load(std::memory_order_relaxed);}
+        static void setEnabled(bool);
+
+        /** Returns the current values of all metrics, as a JSON object keyed by metric name. */
+        static std::string snapshotJSON();
+
+        /** Resets all metrics to zero. */
+        static void resetAll();
+
+        /** Returns the metric with the given name, or nullptr. */
+        static Metric* named(const char *name);
+
+        /** The current monotonic time in microseconds, for measuring durations. */
+        static uint64_t now();
+
+        /** Returns now(), or 0 if neither metrics nor tracing are enabled. Pass the result to
+            Histogram::recordSince() when the operation finishes. */
+        static uint64_t startTime();
+
+        const char* name() const                {return _name;}
+
+        virtual void reset() =0;
+
+    protected:
+        explicit Metric(const char *name);
+        virtual ~Metric() =default;
+        virtual void writeJSON(std::ostream&) const =0;
+
+    private:
+        static std::atomic<bool> sEnabled;
+        static Metric* sFirst;
+
+        const char* const _name;
+        Metric* const _next;
+    };
+
+
+    /** A metric that counts events, or bytes. */
+    class Counter : public Metric {
+    public:
+        explicit Counter(const char *name)      :Metric(name) { }
+
+        void add(uint64_t n =1) {
+            if (enabled())
+                _value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t value() const                  {return _value.load(std::memory_order_relaxed);}
+        void reset() override                   {_value = 0;}
+
+    protected:
+        void writeJSON(std::ostream&) const override;
+
+    private:
+        std::atomic<uint64_t> _value {0};
+    };
+
+
+    /** A metric that tracks a current level, like the number of threads waiting for something.
+        Unlike the other metrics it's updated even while metrics are disabled, so that it stays
+        balanced; so use it only in places that are already slow, like blocking waits. */
+    class Gauge : public Metric {
+    public:
+        explicit Gauge(const char *name)        :Metric(name) { }
+
+        void add(int64_t delta);
+
+        int64_t value() const                   {return _value.load(std::memory_order_relaxed);}
+        int64_t maxValue() const                {return _max.load(std::memory_order_relaxed);}
+        void reset() override                   {_max = _value.load();}
+
+    protected:
+        void writeJSON(std::ostream&) const override;
+
+    private:
+        std::atomic<int64_t> _value {0}, _max {0};
+    };
+
+
+    /** A metric that records the distribution of a value, such as a latency in microseconds.
+        Samples are counted in power-of-two buckets, so percentiles are approximate (within 2x)
+        but recording is lock-free and cheap. */
+    class Histogram : public Metric {
+    public:
+        Histogram(const char *name, const char *unit);
+
+        void record(uint64_t value) {
+            if (enabled())
+                _record(value);
+        }
+
+        /** Records the time elapsed since `start`, a value returned by Metric::startTime(), and
+            adds it to the trace if tracing is enabled. Does nothing if `start` is 0. */
+        void recordSince(uint64_t start) {
+            if (start)
+                _recordSince(start);
+        }
+
+        const char* unit() const                {return _unit;}
+        uint64_t count() const                  {return _count.load(std::memory_order_relaxed);}
+        uint64_t sum() const                    {return _sum.load(std::memory_order_relaxed);}
+        uint64_t maxValue() const               {return _max.load(std::memory_order_relaxed);}
+
+        /** The approximate value at the given percentile (0..100): the upper bound of the bucket
+            it falls in, but no more than the largest value recorded. */
+        uint64_t percentile(double pct) const;
+
+        void reset() override;
+
+    protected:
+        void writeJSON(std::ostream&) const override;
+
+    private:
+        static constexpr unsigned kNumBuckets = 48;
+
+        void _record(uint64_t value);
+        void _recordSince(uint64_t start);
+
+        const char* const _unit;
+        std::atomic<uint64_t> _count {0}, _sum {0}, _max {0};
+        std::atomic<uint64_t> _buckets[kNumBuckets];    // Bucket n counts values < 2^n
+    };
+
+
+    /** Records the lifetime of a scope in a Histogram, in microseconds. */
+    class LatencyTimer {
+    public:
+        explicit LatencyTimer(Histogram &h)     :_histogram(h), _start(Metric::startTime()) { }
+        ~LatencyTimer()                         {stop();}
+
+        /** Records the time now, instead of when the scope exits. */
+        void stop()                             {_histogram.recordSince(_start); _start = 0;}
+
+    private:
+        LatencyTimer(const LatencyTimer&) =delete;
+
+        Histogram &_histogram;
+        uint64_t _start;
+    };
+
+
+    /** Records trace events in memory, and exports them in the Chrome trace-event JSON format,
+        which can be viewed in chrome://tracing or Perfetto. Histogram::recordSince() and
+        Signpost feed it while it's enabled. The number of buffered events is limited; once the
+        limit is reached, later events are dropped until the trace is cleared. */
+    class Tracer {
+    public:
+        static bool enabled()                   {return sEnabled.load(std::memory_order_relaxed);}
+        static void setEnabled(bool);
+
+        /** A span of time, from `start` to `end` (in Metric::now() units.) */
+        static void complete(const char *name, uint64_t start, uint64_t end);
+        /** A point in time. */
+        static void instant(const char *name, uint64_t id);
+        /** Beginning and end of a span that may cross threads; `id` pairs them up. */
+        static void asyncBegin(const char *name, uint64_t id);
+        static void asyncEnd(const char *name, uint64_t id);
+
+        /** Returns the buffered events as a JSON trace, optionally clearing the buffer. */
+        static std::string eventsJSON(bool clear);
+        static void clear();
+
+    private:
+        static std::atomic<bool> sEnabled;
+    };
+
+
+    /** A utility for logging chronological points and regions of interest, for profiling.
+        On Apple platforms these are reported to Instruments as kdebug signposts; on all
+        platforms they're added to the Tracer's events while tracing is enabled. */
     class Signpost {
     public:
         enum Type {
@@ -36,25 +215,33 @@ namespace litecore {
             replicatorDisconnect,
         };
 
-#if LITECORE_SIGNPOSTS
         static void mark(Type, uint32_t param =0);
         static void begin(Type, uint32_t param =0);
         static void end(Type, uint32_t param =0);
 
-        Signpost(Type t)            :_type(t) {begin(_type);}
-        ~Signpost()                 {end(_type);}
+        Signpost(Type t)            :_type(t) {begin(_type, param());}
+        ~Signpost()                 {end(_type, param());}
 
     private:
+        uint32_t param() const      {return uint32_t(size_t(this));}
+
         Type const _type;
+    };
 
-#else
-        static inline void mark(Type, uint32_t param =0)    { }
-        static inline void begin(Type, uint32_t param =0)   { }
-        static inline void end(Type, uint32_t param =0)     { }
 
-        Signpost(Type t)                                    { }
-        ~Signpost()                                         { }
-#endif
-    };
+    /** The metrics LiteCore records. */
+    namespace metric {
+        extern Histogram transactionTime;       // Duration of write transactions
+        extern Histogram transactionWait;       // Time spent waiting to begin a transaction
+        extern Gauge     transactionWaiters;    // Number of threads waiting to begin one
+        extern Counter   commits;               // Number of transactions committed
+        extern Counter   aborts;                // Number of transactions aborted
+        extern Histogram queryCompileTime;      // Time to compile a Query
+        extern Histogram queryRunTime;          // Time to run a query (up to its 1st row if streaming)
+        extern Histogram revInsertBatchSize;    // Number of revs the replicator inserts at once
+        extern Histogram revInsertTime;         // Time to insert a batch of revs
+        extern Counter   bytesSent;             // Bytes written to replicator sockets
+        extern Counter   bytesReceived;         // Bytes read from replicator sockets
+    }
 
 }
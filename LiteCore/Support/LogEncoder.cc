@@ -21,6 +21,7 @@
 #include "Endian.hh"
 #include "StringUtil.hh"
 #include "varint.hh"
+#include <algorithm>
 #include <exception>
 #include <iostream>
 #include <time.h>
@@ -46,9 +47,195 @@ namespace litecore {
     // ...or when this many seconds have elapsed since the previous save:
     static const uint64_t kSaveInterval = 1 * kTicksPerSec;
 
+    // Capacity of each thread's buffer (must be a power of 2):
+    static constexpr size_t kThreadBufferSize = 16 * 1024;
+
+    static atomic<uint64_t> sLastEncoderID {0};
+
+
+#pragma mark - THREAD BUFFERS:
+
+
+    // A string that's written to the file as a token: the domain, the format, or a "%-s"
+    // argument. Tokens are written at merge time, since their IDs are shared by all threads.
+    // The caller's string may be gone by then, so its bytes are copied into the entry; its
+    // address is only used to recognize it, as in _formats.
+    struct LogEncoder::TokenRef {
+        size_t      offset;             // Position in the encoded arguments (for arguments)
+        const char* key;                // The caller's pointer to the string
+        uint32_t    strOffset;          // Position of the copied string in the entry's strings
+    };
+
+    // A log call as stored in a ThreadBuffer. It's followed by `numTokens` TokenRefs, then by
+    // `argsSize` bytes of arguments, encoded as in the file except for tokenized strings, then
+    // by `stringsSize` bytes of the tokens' NUL-terminated strings.
+    struct LogEncoder::EntryHeader {
+        uint32_t    size;               // Total size of the entry, padded to a multiple of 8
+        uint32_t    argsSize;           // Size of the encoded arguments
+        uint32_t    stringsSize;        // Size of the copied strings
+        int64_t     elapsed;            // Ticks since the encoder started
+        TokenRef    domain;
+        TokenRef    format;
+        unsigned    object;
+        uint16_t    numTokens;
+        int8_t      level;
+    };
+
+
+    // Encodes a log call into an entry. Each thread reuses one, to avoid allocating memory.
+    class LogEncoder::EntryBuilder {
+    public:
+        void begin(int8_t level, const char *domain, unsigned object, const char *format,
+                   int64_t elapsed)
+        {
+            _tokens.clear();
+            _args.clear();
+            _strings.clear();
+            _header = {0, 0, 0, elapsed, addString(0, domain ? domain : ""),
+                       addString(0, format), object, 0, level};
+        }
+
+        void write(const void *data, size_t size) {
+            _args.insert(_args.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+        }
+
+        void write(slice s)                     {write(s.buf, s.size);}
+
+        void writeUVarInt(uint64_t n) {
+            uint8_t buf[kMaxVarintLen64];
+            write(buf, PutUVarInt(buf, n));
+        }
+
+        void writeToken(const char *token) {
+            _tokens.push_back(addString(_args.size(), token));
+        }
+
+        const EntryHeader& finish() {
+            _header.numTokens = (uint16_t)_tokens.size();
+            _header.argsSize = (uint32_t)_args.size();
+            _header.stringsSize = (uint32_t)_strings.size();
+            size_t size = sizeof(EntryHeader) + _tokens.size() * sizeof(TokenRef)
+                        + _args.size() + _strings.size();
+            _header.size = (uint32_t)((size + 7) & ~7);
+            return _header;
+        }
+
+        const EntryHeader& header() const       {return _header;}
+        const TokenRef* tokens() const          {return _tokens.data();}
+        const uint8_t* args() const             {return _args.data();}
+        const char* strings() const             {return _strings.data();}
+
+    private:
+        TokenRef addString(size_t offset, const char *str) {
+            auto strOffset = (uint32_t)_strings.size();
+            _strings.insert(_strings.end(), str, str + strlen(str) + 1);
+            return {offset, str, strOffset};
+        }
+
+        EntryHeader _header;
+        vector<TokenRef> _tokens;
+        vector<uint8_t> _args;
+        vector<char> _strings;
+    };
+
+
+    // A ring buffer that entries are written to by one thread, and read by whichever thread is
+    // flushing the log. Neither side needs a lock.
+    class LogEncoder::ThreadBuffer {
+    public:
+        // Called by the owning thread. Returns false if there's no room.
+        bool push(const EntryBuilder &entry) {
+            auto &header = entry.header();
+            uint64_t head = _head.load(memory_order_relaxed);
+            if (header.size > kThreadBufferSize - (head - _tail.load(memory_order_acquire)))
+                return false;
+            uint64_t pos = head;
+            copyIn(pos, &header, sizeof(header));
+            copyIn(pos, entry.tokens(), header.numTokens * sizeof(TokenRef));
+            copyIn(pos, entry.args(), header.argsSize);
+            copyIn(pos, entry.strings(), header.stringsSize);
+            _head.store(head + header.size, memory_order_release);
+            return true;
+        }
+
+        size_t used() const {
+            return (size_t)(_head.load(memory_order_relaxed) - _tail.load(memory_order_relaxed));
+        }
+
+        // Called by the flushing thread. Moves all the entries to the end of `out`.
+        void drain(vector<uint8_t> &out) {
+            uint64_t tail = _tail.load(memory_order_relaxed);
+            uint64_t head = _head.load(memory_order_acquire);
+            if (tail == head)
+                return;
+            size_t start = out.size();
+            out.resize(start + (size_t)(head - tail));
+            copyOut(tail, &out[start], (size_t)(head - tail));
+            _tail.store(head, memory_order_release);
+        }
+
+        atomic<bool> abandoned {false};    // Set when the thread stops using this buffer
+
+    private:
+        void copyIn(uint64_t &pos, const void *src, size_t size) {
+            if (size == 0)
+                return;
+            size_t offset = pos & (kThreadBufferSize - 1);
+            size_t n = min(size, kThreadBufferSize - offset);
+            memcpy(&_data[offset], src, n);
+            memcpy(&_data[0], (const uint8_t*)src + n, size - n);
+            pos += size;
+        }
+
+        void copyOut(uint64_t pos, void *dst, size_t size) const {
+            size_t offset = pos & (kThreadBufferSize - 1);
+            size_t n = min(size, kThreadBufferSize - offset);
+            memcpy(dst, &_data[offset], n);
+            memcpy((uint8_t*)dst + n, &_data[0], size - n);
+        }
+
+        atomic<uint64_t> _head {0};         // Total bytes ever written
+        atomic<uint64_t> _tail {0};         // Total bytes ever read
+        uint8_t _data[kThreadBufferSize];
+    };
+
+
+    // The calling thread's buffer, for the LogEncoder it last logged to.
+    struct LogEncoder::ThreadState {
+        uint64_t encoderID {0};
+        shared_ptr<ThreadBuffer> buffer;
+        EntryBuilder entry;
+
+        ~ThreadState() {
+            if (buffer)
+                buffer->abandoned = true;
+        }
+    };
+
+    thread_local LogEncoder::ThreadState LogEncoder::sThreadState;
+
+
+    LogEncoder::ThreadState& LogEncoder::_threadState() {
+        ThreadState &state = sThreadState;
+        if (state.encoderID != _id) {
+            // First call on this thread (or since it logged to a different LogEncoder):
+            if (state.buffer)
+                state.buffer->abandoned = true;
+            state.buffer = make_shared<ThreadBuffer>();
+            state.encoderID = _id;
+            lock_guard<mutex> lock(_mutex);
+            _threadBuffers.push_back(state.buffer);
+        }
+        return state;
+    }
+
+
+#pragma mark - LOGGING:
+
 
     LogEncoder::LogEncoder(ostream &out)
-    :_out(out)
+    :_id(++sLastEncoderID)
+    ,_out(out)
     ,_flushTimer(bind(&LogEncoder::performScheduledFlush, this))
     {
         _writer.write(&kMagicNumber, 4);
@@ -66,9 +253,6 @@ namespace litecore {
     }
 
 
-#pragma mark - LOGGING:
-
-
     void LogEncoder::log(int8_t level, const char *domain, ObjectRef object, const char *format, ...) {
         va_list args;
         va_start(args, format);
@@ -83,30 +267,36 @@ namespace litecore {
 
 
     void LogEncoder::vlog(int8_t level, const char *domain, ObjectRef object, const char *format, va_list args) {
-        lock_guard<mutex> lock(_mutex);
-
-        // Write the number of ticks elapsed since the last message:
-        auto elapsed = _timeElapsed();
-        uint64_t delta = elapsed - _lastElapsed;
-        _lastElapsed = elapsed;
-        _writeUVarInt(delta);
-
-        // Write level, domain, format string:
-        _writer.write(&level, sizeof(level));
-        _writeStringToken(domain ? domain : "");
-
-        _writeUVarInt((unsigned)object);
-        if (object != ObjectRef::None) {
-            auto i = _objects.find(unsigned(object));
-            if (i != _objects.end()) {
-                _writer.write(slice(i->second));
-                _writer.write("\0", 1);
-                _objects.erase(i);
+        ThreadState &state = _threadState();
+        EntryBuilder &entry = state.entry;
+        entry.begin(level, domain, unsigned(object), format, _timeElapsed());
+        encodeArgs(entry, format, args);
+        entry.finish();
+
+        if (!state.buffer->push(entry)) {
+            // My buffer is full, so merge all the buffers now, and if the entry is too big for an
+            // empty buffer, write it directly:
+            lock_guard<mutex> lock(_mutex);
+            _drainThreadBuffers();
+            if (!state.buffer->push(entry))
+                _writeEntry(entry.header(), entry.tokens(), entry.args(), entry.strings());
+            if (_writer.length() > kBufferSize)
+                _flush();
+        } else if (state.buffer->used() > kThreadBufferSize / 2) {
+            // Getting full; merge the buffers unless another thread is already doing so:
+            unique_lock<mutex> lock(_mutex, try_to_lock);
+            if (lock.owns_lock()) {
+                _drainThreadBuffers();
+                if (_writer.length() > kBufferSize)
+                    _flush();
             }
         }
+        _scheduleFlush();
+    }
 
-        _writeStringToken(format);
 
+    // Encodes the arguments of a log call, as described by the format string.
+    void LogEncoder::encodeArgs(EntryBuilder &out, const char *format, va_list args) {
         // Parse the format string looking for substitutions:
         for (const char *c = format; *c != '\0'; ++c) {
             if (*c == '%') {
@@ -148,8 +338,8 @@ namespace litecore {
                         else
                             param = va_arg(args, long long);
                         uint8_t sign = (param < 0) ? 1 : 0;
-                        _writer.write(&sign, 1);
-                        _writeUVarInt(abs(param));
+                        out.write(&sign, 1);
+                        out.writeUVarInt(abs(param));
                         break;
                     }
                     case 'u':
@@ -165,7 +355,7 @@ namespace litecore {
                             param = va_arg(args, unsigned long);
                         else
                             param = va_arg(args, unsigned long long);
-                        _writeUVarInt(param);
+                        out.writeUVarInt(param);
                         break;
                     }
                     case 'e': case 'E':
@@ -173,7 +363,7 @@ namespace litecore {
                     case 'g': case 'G':
                     case 'a': case 'A': {
                         littleEndianDouble param = va_arg(args, double);
-                        _writer.write(&param, sizeof(param));
+                        out.write(&param, sizeof(param));
                         break;
                     }
                     case 's': {
@@ -187,10 +377,10 @@ namespace litecore {
                             size = strlen(str);
                         }
                         if (minus && !dotStar) {
-                            _writeStringToken(str);
+                            out.writeToken(str);
                         } else {
-                            _writeUVarInt(size);
-                            _writer.write(str, size);
+                            out.writeUVarInt(size);
+                            out.write(str, size);
                         }
                         break;
                     }
@@ -200,7 +390,7 @@ namespace litecore {
                             param = _encLittle64(param);
                         else
                             param = _encLittle32(param);
-                        _writer.write(&param, sizeof(param));
+                        out.write(&param, sizeof(param));
                         break;
                     }
 #if __APPLE__
@@ -208,8 +398,8 @@ namespace litecore {
                         // "%@" substitutes an Objective-C or CoreFoundation object's description.
                         CFTypeRef param = va_arg(args, CFTypeRef);
                         if (param == nullptr) {
-                            _writeUVarInt(6);
-                            _writer.write("(null)", 6);
+                            out.writeUVarInt(6);
+                            out.write("(null)", 6);
                         } else {
                             CFStringRef description;
                             if (CFGetTypeID(param) == CFStringGetTypeID())
@@ -217,8 +407,8 @@ namespace litecore {
                             else
                                 description = CFCopyDescription(param);
                             nsstring_slice descSlice(description);
-                            _writeUVarInt(descSlice.size);
-                            _writer.write(descSlice);
+                            out.writeUVarInt(descSlice.size);
+                            out.write(descSlice);
                             if (description != param)
                                 CFRelease(description);
                         }
@@ -232,11 +422,80 @@ namespace litecore {
                 }
             }
         }
+    }
+
+
+    // Merges all the threads' buffered entries, in timestamp order, into _writer.
+    void LogEncoder::_drainThreadBuffers() {
+        vector<uint8_t> entries;
+        for (auto i = _threadBuffers.begin(); i != _threadBuffers.end(); ) {
+            bool abandoned = (*i)->abandoned;
+            (*i)->drain(entries);
+            if (abandoned)
+                i = _threadBuffers.erase(i);    // No more entries will be written to it
+            else
+                ++i;
+        }
+        if (entries.empty())
+            return;
 
-        if (_writer.length() > kBufferSize)
-            _flush();
-        else
-            _scheduleFlush();
+        // Each buffer's entries are already in order, so a stable sort preserves their order
+        // even if timestamps are equal:
+        vector<const EntryHeader*> sorted;
+        for (size_t pos = 0; pos < entries.size(); ) {
+            auto header = (const EntryHeader*)&entries[pos];
+            sorted.push_back(header);
+            pos += header->size;
+        }
+        stable_sort(sorted.begin(), sorted.end(), [](const EntryHeader *a, const EntryHeader *b) {
+            return a->elapsed < b->elapsed;
+        });
+
+        for (auto header : sorted) {
+            auto tokens = (const TokenRef*)(header + 1);
+            auto args = (const uint8_t*)(tokens + header->numTokens);
+            _writeEntry(*header, tokens, args, (const char*)(args + header->argsSize));
+        }
+    }
+
+
+    // Writes an entry to _writer, in the file format.
+    void LogEncoder::_writeEntry(const EntryHeader &entry,
+                                 const TokenRef *tokens,
+                                 const uint8_t *args,
+                                 const char *strings)
+    {
+        // Write the number of ticks elapsed since the last message. (An entry may be older than
+        // the last one written, if its thread was preempted before adding it to its buffer.)
+        auto elapsed = max(entry.elapsed, _lastElapsed);
+        uint64_t delta = elapsed - _lastElapsed;
+        _lastElapsed = elapsed;
+        _writeUVarInt(delta);
+
+        // Write level, domain, format string:
+        _writer.write(&entry.level, sizeof(entry.level));
+        _writeStringToken(entry.domain, strings);
+
+        _writeUVarInt(entry.object);
+        if (entry.object != ObjectRef::None) {
+            auto i = _objects.find(entry.object);
+            if (i != _objects.end()) {
+                _writer.write(slice(i->second));
+                _writer.write("\0", 1);
+                _objects.erase(i);
+            }
+        }
+
+        _writeStringToken(entry.format, strings);
+
+        // Write the arguments, inserting the tokenized strings:
+        size_t pos = 0;
+        for (uint16_t t = 0; t < entry.numTokens; ++t) {
+            _writer.write(args + pos, tokens[t].offset - pos);
+            _writeStringToken(tokens[t], strings);
+            pos = tokens[t].offset;
+        }
+        _writer.write(args + pos, entry.argsSize - pos);
     }
 
 
@@ -252,6 +511,7 @@ namespace litecore {
     void LogEncoder::unregisterObject(ObjectRef obj) {
         lock_guard<mutex> lock(_mutex);
 
+        _drainThreadBuffers();      // in case buffered entries still need the description
         _objects.erase(unsigned(obj));
     }
 
@@ -262,13 +522,14 @@ namespace litecore {
     }
 
 
-    void LogEncoder::_writeStringToken(const char *token) {
-        auto i = _formats.find((size_t)token);
+    void LogEncoder::_writeStringToken(const TokenRef &token, const char *strings) {
+        auto i = _formats.find((size_t)token.key);
         if (i == _formats.end()) {
             unsigned n = (unsigned)_formats.size();
-            _formats.insert({(size_t)token, n});
+            _formats.insert({(size_t)token.key, n});
             _writeUVarInt(n);
-            _writer.write(token, strlen(token)+1);  // add the actual string the first time
+            const char *str = strings + token.strOffset;
+            _writer.write(str, strlen(str)+1);      // add the actual string the first time
         } else {
             _writeUVarInt(i->second);
         }
@@ -280,6 +541,7 @@ namespace litecore {
 
     void LogEncoder::flush() {
         lock_guard<mutex> lock(_mutex);
+        _drainThreadBuffers();
         _flush();
     }
     
@@ -291,12 +553,13 @@ namespace litecore {
             _out << s;
         _writer.reset();
         _out.flush();
-        _lastSaved = _lastElapsed;
     }
 
 
+    // Called without the mutex, so it uses the _flushScheduled flag to avoid touching the timer
+    // on every call.
     void LogEncoder::_scheduleFlush() {
-        if (!_flushTimer.scheduled()) {
+        if (!_flushScheduled.load(memory_order_relaxed) && !_flushScheduled.exchange(true)) {
             _flushTimer.fireAfter(std::chrono::microseconds(kSaveInterval));
         }
     }
@@ -304,15 +567,10 @@ namespace litecore {
 
     // This is called on a background thread by the Timer
     void LogEncoder::performScheduledFlush() {
+        _flushScheduled = false;
         lock_guard<mutex> lock(_mutex);
-
-        // Don't flush if there's already been a flush since the timer started:
-        auto timeSinceSave = _timeElapsed() - _lastSaved;
-        if (timeSinceSave >= kSaveInterval) {
-            _flush();
-        } else {
-            _flushTimer.fireAfter(std::chrono::microseconds(kSaveInterval - timeSinceSave));
-        }
+        _drainThreadBuffers();
+        _flush();
     }
 
 }
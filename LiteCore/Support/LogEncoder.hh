@@ -22,16 +22,21 @@
 #include "Timer.hh"
 #include "PlatformCompat.hh"
 #include <stdarg.h>
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <vector>
 
 namespace litecore {
 
     /** A very fast & compact logging service.
         The output is written in a binary format to avoid the CPU and space overhead of converting
         everything to ASCII. It can be decoded by the LogDecoder class.
-        The API is thread-safe. */
+        The API is thread-safe. To keep threads from contending with each other, each thread's
+        log calls are written without locking to a buffer of its own; the buffers are merged, in
+        timestamp order, when the log is flushed (at least once a second.) */
     class LogEncoder {
     public:
         static const uint8_t kMagicNumber[4];
@@ -68,23 +73,38 @@ namespace litecore {
 
     private:
         friend class LogDecoder;
+        struct EntryHeader;
+        struct TokenRef;
+        class EntryBuilder;
+        class ThreadBuffer;
+        struct ThreadState;
 
         int64_t _timeElapsed() const;
+        ThreadState& _threadState();
+        static void encodeArgs(EntryBuilder&, const char *format, va_list args);
+        void _writeEntry(const EntryHeader&, const TokenRef *tokens, const uint8_t *args,
+                         const char *strings);
+        void _drainThreadBuffers();
         void _writeUVarInt(uint64_t);
-        void _writeStringToken(const char *token);
+        void _writeStringToken(const TokenRef&, const char *strings);
         void _flush();
         void _scheduleFlush();
         void performScheduledFlush();
 
         static constexpr uint8_t kFormatVersion = 1;
 
-        std::mutex _mutex;
+        static thread_local ThreadState sThreadState;
+
+        uint64_t const _id;                         // Unique ID, for per-thread state
+        std::atomic<bool> _flushScheduled {false};
+
+        std::mutex _mutex;                          // Guards everything below
+        std::vector<std::shared_ptr<ThreadBuffer>> _threadBuffers;
         fleece::Writer _writer;
         std::ostream &_out;
         actor::Timer _flushTimer;
         fleece::Stopwatch _st;
         int64_t _lastElapsed {0};
-        int64_t _lastSaved {0};
         std::unordered_map<size_t, unsigned> _formats;
         std::unordered_map<unsigned, std::string> _objects;
         ObjectRef _lastObjectRef {ObjectRef::None};
@@ -23,8 +23,10 @@
 #include "PlatformIO.hh"
 #include "FilePath.hh"
 #include <string>
+#include <atomic>
 #include <fstream>
 #include <mutex>
+#include <thread>
 
 
 #if __APPLE__
@@ -56,7 +58,8 @@ namespace litecore {
     static bool sCallbackPreformatted = false;
     LogLevel LogDomain::sFileMinLevel = LogLevel::None;
     static ofstream *sFileOut = nullptr;
-    static LogEncoder* sLogEncoder = nullptr;
+    static atomic<LogEncoder*> sLogEncoder {nullptr};
+    static atomic<int> sLogEncoderUsers {0};    // # of threads using sLogEncoder without the mutex
     static mutex sLogMutex;
     static const int kNumLogFiles = 10;
 
@@ -85,6 +88,16 @@ namespace litecore {
     }
 
 
+    // Replaces sLogEncoder, then deletes the old one as soon as no thread is using it.
+    // Only call while holding sLogMutex!
+    static void setLogEncoder(LogEncoder *encoder) {
+        LogEncoder *oldEncoder = sLogEncoder.exchange(encoder);
+        while (sLogEncoderUsers > 0)
+            this_thread::yield();
+        delete oldEncoder;
+    }
+
+
 #pragma mark - GLOBAL SETTINGS:
 
 
@@ -102,8 +115,7 @@ namespace litecore {
                                        const string &initialMessage)
     {
         unique_lock<mutex> lock(sLogMutex);
-        delete sLogEncoder;
-        sLogEncoder = nullptr;
+        setLogEncoder(nullptr);
         delete sFileOut;
         sFileOut = nullptr;
         if (filePath.empty()) {
@@ -112,22 +124,23 @@ namespace litecore {
             sFileMinLevel = atLevel;
             purgeOldLogs(filePath);
             sFileOut = new ofstream(filePath, ofstream::out|ofstream::trunc|ofstream::binary);
-            sLogEncoder = new LogEncoder(*sFileOut);
+            auto encoder = new LogEncoder(*sFileOut);
             if (!initialMessage.empty())
-                sLogEncoder->log((int)LogLevel::Info, "", LogEncoder::None,
-                                 "---- %s ----", initialMessage.c_str());
+                encoder->log((int)LogLevel::Info, "", LogEncoder::None,
+                             "---- %s ----", initialMessage.c_str());
+            setLogEncoder(encoder);
 
             // Make sure to flush the log when the process exits:
             static once_flag f;
             call_once(f, []{
                 atexit([]{
                     unique_lock<mutex> lock(sLogMutex);
-                    if (sLogEncoder)
-                        sLogEncoder->log((int)LogLevel::Info, "", LogEncoder::None,
-                                         "---- END ----");
-                    delete sLogEncoder;
+                    LogEncoder *encoder = sLogEncoder;
+                    if (encoder)
+                        encoder->log((int)LogLevel::Info, "", LogEncoder::None,
+                                     "---- END ----");
+                    setLogEncoder(nullptr);
                     delete sFileOut;
-                    sLogEncoder = nullptr;
                     sFileOut = nullptr;
                 });
             });
@@ -256,6 +269,29 @@ namespace litecore {
         if (!willLog(level))
             return;
 
+        // Write to the encoded log file. This doesn't need sLogMutex, since LogEncoder is
+        // thread-safe and doesn't make threads wait for each other:
+        if (level >= sFileMinLevel) {
+            ++sLogEncoderUsers;
+            LogEncoder *encoder = sLogEncoder;
+            if (encoder) {
+                va_list args2;
+                va_copy(args2, args);
+                try {
+                    encoder->vlog((int8_t)level, _name, (LogEncoder::ObjectRef)objRef, fmt, args2);
+                } catch (...) {
+                    va_end(args2);
+                    --sLogEncoderUsers;
+                    throw;
+                }
+                va_end(args2);
+            }
+            --sLogEncoderUsers;
+        }
+
+        // (Checking the callback level requires the mutex, but skip it if possible.)
+        if (level < sCallbackMinLevel)
+            return;
         unique_lock<mutex> lock(sLogMutex);
 
         // Invoke the client callback:
@@ -289,11 +325,6 @@ namespace litecore {
             }
             va_end(args2);
         }
-
-        // Write to the encoded log file:
-        if (sLogEncoder && level >= sFileMinLevel) {
-            sLogEncoder->vlog((int8_t)level, _name, (LogEncoder::ObjectRef)objRef, fmt, args);
-        }
     }
 
 
@@ -352,8 +383,9 @@ namespace litecore {
     {
         unique_lock<mutex> lock(sLogMutex);
         unsigned objRef;
-        if (sLogEncoder)
-            objRef = sLogEncoder->registerObject(description);
+        LogEncoder *encoder = sLogEncoder;
+        if (encoder)
+            objRef = encoder->registerObject(description);
         else
             objRef = ++_lastObjRef;
 
@@ -59,6 +59,50 @@ namespace litecore {
         return outSize;
     }
 
+
+    AES256Context::AES256Context(bool encrypt, slice key)
+    :_encrypt(encrypt)
+    {
+        DebugAssert(key.size == kCCKeySizeAES256);
+        memcpy(_key, key.buf, sizeof(_key));
+        CCCryptorRef cryptor;
+        CCCryptorStatus status = CCCryptorCreate((encrypt ? kCCEncrypt : kCCDecrypt),
+                                                 kCCAlgorithmAES, 0,
+                                                 key.buf, key.size,
+                                                 nullptr,
+                                                 &cryptor);
+        if (status != kCCSuccess)
+            error::_throw(error::CryptoError);
+        _context = cryptor;
+    }
+
+
+    AES256Context::~AES256Context() {
+        CCCryptorRelease((CCCryptorRef)_context);
+    }
+
+
+    size_t AES256Context::crypt(slice iv, bool padding, slice dst, slice src) {
+        if (padding) {
+            // The cryptor was created without padding, so fall back to the one-shot function.
+            // (This only happens for the last block of a stream.)
+            return AES256(_encrypt, slice(_key, sizeof(_key)), iv, true, dst, src);
+        }
+        DebugAssert(iv.buf == nullptr || iv.size == kCCBlockSizeAES128, "IV is wrong size");
+        auto cryptor = (CCCryptorRef)_context;
+        size_t outSize;
+        CCCryptorStatus status = CCCryptorReset(cryptor, iv.buf);
+        if (status == kCCSuccess)
+            status = CCCryptorUpdate(cryptor, src.buf, src.size, (void*)dst.buf, dst.size,
+                                     &outSize);
+        if (status != kCCSuccess) {
+            Assert(status != kCCParamError && status != kCCBufferTooSmall &&
+                   status != kCCUnimplemented);
+            error::_throw(error::CryptoError);
+        }
+        return outSize;
+    }
+
 #elif defined(_CRYPTO_MBEDTLS)
 
 	size_t AES(size_t key_size,
@@ -107,6 +151,51 @@ namespace litecore {
         return AES(kAES256KeySize, MBEDTLS_CIPHER_AES_256_CBC, encrypt, key, iv, padding, dst, src);
     }
 
+
+    AES256Context::AES256Context(bool encrypt, slice key)
+    :_encrypt(encrypt)
+    {
+        DebugAssert(key.size == kAES256KeySize);
+        const mbedtls_cipher_info_t *cipher_info =
+                                    mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_256_CBC);
+        if(cipher_info == nullptr) {
+            Warn("mbedtls_cipher_info_from_type failed");
+            error::_throw(error::CryptoError);
+        }
+        auto cipher_ctx = new mbedtls_cipher_context_t;
+        mbedtls_cipher_init(cipher_ctx);
+        if (mbedtls_cipher_setup(cipher_ctx, cipher_info) != 0
+                || mbedtls_cipher_setkey(cipher_ctx, (const unsigned char*)key.buf,
+                                         (int)kAES256KeySize * 8,
+                                         encrypt ? MBEDTLS_ENCRYPT : MBEDTLS_DECRYPT) != 0) {
+            mbedtls_cipher_free(cipher_ctx);
+            delete cipher_ctx;
+            error::_throw(error::CryptoError);
+        }
+        _context = cipher_ctx;
+    }
+
+
+    AES256Context::~AES256Context() {
+        auto cipher_ctx = (mbedtls_cipher_context_t*)_context;
+        mbedtls_cipher_free(cipher_ctx);
+        delete cipher_ctx;
+    }
+
+
+    size_t AES256Context::crypt(slice iv, bool padding, slice dst, slice src) {
+        DebugAssert(iv.buf == nullptr || iv.size == kAESBlockSize, "IV is wrong size");
+        auto cipher_ctx = (mbedtls_cipher_context_t*)_context;
+        mbedtls_cipher_set_padding_mode(cipher_ctx,
+                                        padding ? MBEDTLS_PADDING_PKCS7 : MBEDTLS_PADDING_NONE);
+        size_t out_len = dst.size;
+        if (mbedtls_cipher_crypt(cipher_ctx, (const unsigned char*)iv.buf, iv.size,
+                                 (const unsigned char*)src.buf, src.size,
+                                 (unsigned char*)dst.buf, &out_len) != 0)
+            error::_throw(error::CryptoError);
+        return out_len;
+    }
+
 #endif
 
 }
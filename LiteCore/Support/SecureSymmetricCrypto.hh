@@ -41,6 +41,33 @@ namespace litecore {
 
     // TODO: Combine these into a single Encrypt() function that takes an algorithm parameter.
 
+
+    /** Like AES256(), but with the key and direction fixed, so that the key schedule is only
+        computed once. This is much faster when encrypting many small buffers with the same key,
+        like the blocks of an EncryptedStream. (The crypto library uses the CPU's AES
+        instructions when they're available.) */
+    class AES256Context {
+    public:
+        AES256Context(bool encrypt,    // true=encrypt, false=decrypt
+                      slice key);      // pointer to 32-byte key
+        ~AES256Context();
+
+        size_t crypt(slice iv,         // pointer to 16-byte initialization vector
+                     bool padding,     // true=PKCS7 padding, false=no padding
+                     slice dst,        // output buffer & capacity
+                     slice src);       // input data
+
+    private:
+        AES256Context(const AES256Context&) =delete;
+        AES256Context& operator=(const AES256Context&) =delete;
+
+        bool const _encrypt;
+        void* _context;                // CCCryptorRef or mbedtls_cipher_context_t*
+    #if defined(_CRYPTO_CC)
+        uint8_t _key[kAES256KeySize];  // (CommonCrypto can't change padding after creation)
+    #endif
+    };
+
 #else
 #define AES256_AVAILABLE 0
 #endif
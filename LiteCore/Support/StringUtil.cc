@@ -21,6 +21,18 @@
 #include "PlatformIO.hh"
 #include <sstream>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define LITECORE_SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define LITECORE_SIMD_NEON 1
+#endif
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
 
 namespace litecore {
 
@@ -99,8 +111,187 @@ namespace litecore {
     }
 
     void toLowercase(std::string &str) {
-        for (char &c : str)
-            c = (char)tolower(c);
+        ASCIIChangeCase((const uint8_t*)str.data(), (uint8_t*)&str[0], str.size(), false);
+    }
+
+
+#pragma mark - ASCII FAST PATHS:
+
+
+    /*  These process 16 bytes at a time with SSE2 (always available on x86-64) or NEON (always
+        available on ARM64, and on most ARMv7 devices). The small set of vector operations they
+        need is wrapped below, so the algorithms are written once. Masks have one bit per byte,
+        lowest bit = first byte.
+        (Wider AVX2 vectors would need runtime CPU detection and separately compiled code, which
+        isn't worth it for the short strings typically found in documents.) */
+
+#if LITECORE_SIMD_SSE2 || LITECORE_SIMD_NEON
+    namespace simd {
+        static constexpr size_t kWidth = 16;
+
+    #if LITECORE_SIMD_SSE2
+        using vec = __m128i;
+
+        static inline vec load(const uint8_t *p)            {return _mm_loadu_si128((const vec*)p);}
+        static inline void store(uint8_t *p, vec v)         {_mm_storeu_si128((vec*)p, v);}
+        static inline vec splat(uint8_t c)                  {return _mm_set1_epi8((char)c);}
+        static inline vec bitOr(vec a, vec b)               {return _mm_or_si128(a, b);}
+        static inline vec bitXor(vec a, vec b)              {return _mm_xor_si128(a, b);}
+        static inline vec bitAnd(vec a, vec b)              {return _mm_and_si128(a, b);}
+        static inline uint32_t highBits(vec v)              {return (uint32_t)_mm_movemask_epi8(v);}
+        static inline uint32_t equalMask(vec a, vec b)      {return highBits(_mm_cmpeq_epi8(a, b));}
+
+        // Bytes in the range [lo, hi] become 0xFF, others 0x00. Only valid for ASCII lo and hi;
+        // bytes >= 0x80 are negative as signed chars so they're never in range.
+        static inline vec inRange(vec v, uint8_t lo, uint8_t hi) {
+            return _mm_and_si128(_mm_cmpgt_epi8(v, splat(lo - 1)),
+                                 _mm_cmplt_epi8(v, splat(hi + 1)));
+        }
+    #else
+        using vec = uint8x16_t;
+
+        static inline vec load(const uint8_t *p)            {return vld1q_u8(p);}
+        static inline void store(uint8_t *p, vec v)         {vst1q_u8(p, v);}
+        static inline vec splat(uint8_t c)                  {return vdupq_n_u8(c);}
+        static inline vec bitOr(vec a, vec b)               {return vorrq_u8(a, b);}
+        static inline vec bitXor(vec a, vec b)              {return veorq_u8(a, b);}
+        static inline vec bitAnd(vec a, vec b)              {return vandq_u8(a, b);}
+
+        static inline uint32_t highBits(vec v) {
+            // NEON has no movemask, so weight each byte's high bit by its position and add.
+            // (Pairwise adds, since the across-vector vaddv is only available on ARM64.)
+            static const uint8_t kWeights[16] = {1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128};
+            vec bits = vandq_u8(vreinterpretq_u8_s8(vshrq_n_s8(vreinterpretq_s8_u8(v), 7)),
+                                vld1q_u8(kWeights));
+            uint8x8_t sums = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+            sums = vpadd_u8(sums, sums);
+            sums = vpadd_u8(sums, sums);
+            return vget_lane_u8(sums, 0) | (uint32_t(vget_lane_u8(sums, 1)) << 8);
+        }
+        static inline uint32_t equalMask(vec a, vec b)      {return highBits(vceqq_u8(a, b));}
+
+        static inline vec inRange(vec v, uint8_t lo, uint8_t hi) {
+            return vandq_u8(vcgeq_u8(v, splat(lo)), vcleq_u8(v, splat(hi)));
+        }
+    #endif
+
+        static constexpr uint32_t kAllBits = 0xFFFF;
+
+        // Converts ASCII uppercase letters to lowercase, or vice versa.
+        static inline vec changeCase(vec v, bool toUppercase) {
+            vec letters = toUppercase ? inRange(v, 'a', 'z') : inRange(v, 'A', 'Z');
+            return bitXor(v, bitAnd(letters, splat(0x20)));
+        }
+
+        static inline unsigned firstBit(uint32_t mask) {
+        #ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return (unsigned)index;
+        #else
+            return (unsigned)__builtin_ctz(mask);
+        #endif
+        }
+    }
+#endif
+
+
+    size_t ASCIIVectorWidth() noexcept {
+#if LITECORE_SIMD_SSE2 || LITECORE_SIMD_NEON
+        return simd::kWidth;
+#else
+        return 0;
+#endif
+    }
+
+
+    size_t ASCIIPrefixLength(slice str) noexcept {
+        auto s = (const uint8_t*)str.buf;
+        size_t i = 0, n = str.size;
+#if LITECORE_SIMD_SSE2 || LITECORE_SIMD_NEON
+        for (; i + simd::kWidth <= n; i += simd::kWidth) {
+            uint32_t nonASCII = simd::highBits(simd::load(s + i));
+            if (nonASCII)
+                return i + simd::firstBit(nonASCII);
+        }
+#endif
+        while (i < n && s[i] < 0x80)
+            ++i;
+        return i;
+    }
+
+
+    size_t ASCIIMatchLengthIgnoringCase(const uint8_t *a, const uint8_t *b, size_t n,
+                                        size_t &firstCaseDiff) noexcept
+    {
+        size_t i = 0;
+        firstCaseDiff = SIZE_MAX;
+#if LITECORE_SIMD_SSE2 || LITECORE_SIMD_NEON
+        for (; i + simd::kWidth <= n; i += simd::kWidth) {
+            simd::vec va = simd::load(a + i), vb = simd::load(b + i);
+            if (simd::highBits(simd::bitOr(va, vb)))
+                break;                                  // Non-ASCII; caller must handle it
+            uint32_t equal = simd::equalMask(va, vb);
+            if (equal == simd::kAllBits)
+                continue;
+            if (simd::equalMask(simd::changeCase(va, false),
+                                simd::changeCase(vb, false)) != simd::kAllBits)
+                break;                                  // Differ other than by case
+            if (firstCaseDiff == SIZE_MAX)
+                firstCaseDiff = i + simd::firstBit(~equal & simd::kAllBits);
+        }
+#endif
+        if (firstCaseDiff == SIZE_MAX)
+            firstCaseDiff = i;
+        return i;
+    }
+
+
+    void ASCIIChangeCase(const uint8_t *src, uint8_t *dst, size_t n, bool toUppercase) noexcept {
+        size_t i = 0;
+#if LITECORE_SIMD_SSE2 || LITECORE_SIMD_NEON
+        for (; i + simd::kWidth <= n; i += simd::kWidth)
+            simd::store(dst + i, simd::changeCase(simd::load(src + i), toUppercase));
+#endif
+        for (; i < n; ++i) {
+            uint8_t c = src[i];
+            if (toUppercase ? (c >= 'a' && c <= 'z') : (c >= 'A' && c <= 'Z'))
+                c ^= 0x20;
+            dst[i] = c;
+        }
+    }
+
+
+    const void* findBytes(slice str, slice target) noexcept {
+        if (target.size == 0)
+            return str.buf;
+        if (target.size > str.size)
+            return nullptr;
+        auto s = (const uint8_t*)str.buf, t = (const uint8_t*)target.buf;
+        size_t lastStart = str.size - target.size;     // last offset where target could start
+        size_t i = 0;
+#if LITECORE_SIMD_SSE2 || LITECORE_SIMD_NEON
+        // Find candidate offsets where both the first and last bytes of the target match, 16 at a
+        // time, and only compare the rest at those offsets.
+        // <http://0x80.pl/articles/simd-strfind.html>
+        simd::vec first = simd::splat(t[0]), last = simd::splat(t[target.size - 1]);
+        for (; i + simd::kWidth - 1 <= lastStart; i += simd::kWidth) {
+            uint32_t candidates =
+                simd::equalMask(simd::load(s + i), first)
+              & simd::equalMask(simd::load(s + i + target.size - 1), last);
+            while (candidates) {
+                unsigned bit = simd::firstBit(candidates);
+                if (memcmp(s + i + bit + 1, t + 1, target.size - 1) == 0)
+                    return s + i + bit;
+                candidates &= candidates - 1;
+            }
+        }
+#endif
+        for (; i <= lastStart; ++i) {
+            if (s[i] == t[0] && memcmp(s + i + 1, t + 1, target.size - 1) == 0)
+                return s + i;
+        }
+        return nullptr;
     }
 
     // Based on utf8_check.c by Markus Kuhn, 2005
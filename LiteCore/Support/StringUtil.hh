@@ -82,6 +82,31 @@ namespace litecore {
     /** Converts an ASCII string to lowercase, in place. */
     void toLowercase(std::string &);
 
+    //////// ASCII FAST PATHS (vectorized with SSE2 or NEON where available):
+
+    /** The number of bytes the functions below process per vector step, or 0 if they aren't
+        vectorized on this CPU (then they fall back to byte loops, and
+        ASCIIMatchLengthIgnoringCase always returns 0.) */
+    size_t ASCIIVectorWidth() noexcept;
+
+    /** Returns the number of leading bytes of `str` that are ASCII (< 0x80). */
+    size_t ASCIIPrefixLength(fleece::slice str) noexcept;
+
+    /** Compares two byte arrays 16 bytes at a time, skipping blocks that are all ASCII and equal
+        except for the case of letters. Returns the number of bytes skipped, a multiple of 16;
+        the caller must compare the rest. `firstCaseDiff` is set to the offset of the first
+        difference in case within the skipped bytes, or to the return value if there is none. */
+    size_t ASCIIMatchLengthIgnoringCase(const uint8_t *a, const uint8_t *b, size_t n,
+                                        size_t &firstCaseDiff) noexcept;
+
+    /** Copies `n` bytes from `src` to `dst`, converting ASCII letters to upper- or lowercase.
+        Non-ASCII bytes are copied unchanged. `src` and `dst` may be equal. */
+    void ASCIIChangeCase(const uint8_t *src, uint8_t *dst, size_t n, bool toUppercase) noexcept;
+
+    /** Returns a pointer to the first occurrence of `target` in `str`, or nullptr if none.
+        An empty target is found at the start of `str`. */
+    const void* findBytes(fleece::slice str, fleece::slice target) noexcept;
+
     //////// UNICODE_AWARE FUNCTIONS:
 
     /** Returns true if the UTF-8 encoded slice contains no characters with code points < 32. */
@@ -17,6 +17,9 @@
 //
 
 #include "DataFile.hh"
+#include "SQLiteDataFile.hh"
+#include "SQLiteCheckpointer.hh"
+#include "SecureSymmetricCrypto.hh"
 #include "RecordEnumerator.hh"
 #include "Error.hh"
 #include "FilePath.hh"
@@ -25,6 +28,8 @@
 #ifndef _MSC_VER
 #include <sys/stat.h>
 #endif
+#include <atomic>
+#include <thread>
 
 #include "LiteCoreTest.hh"
 
@@ -173,6 +178,157 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile EnumerateDocsDescending",
 }
 
 
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile EnumerateDocs Range", "[DataFile]") {
+    createNumberedDocs(store);
+
+    auto collect = [&](const RecordEnumerator::Options &opts) {
+        vector<string> keys;
+        for (RecordEnumerator e(*store, opts); e.next(); )
+            keys.push_back(e->key().asString());
+        return keys;
+    };
+
+    RecordEnumerator::Options opts;
+    opts.startKey = "rec-010"_sl;
+    opts.endKey = "rec-013"_sl;
+    CHECK(collect(opts) == (vector<string>{"rec-010", "rec-011", "rec-012", "rec-013"}));
+    opts.inclusiveStart = opts.inclusiveEnd = false;
+    CHECK(collect(opts) == (vector<string>{"rec-011", "rec-012"}));
+
+    opts = RecordEnumerator::Options();
+    opts.descending = true;
+    opts.startKey = "rec-013"_sl;
+    opts.endKey = "rec-010"_sl;
+    opts.inclusiveEnd = false;
+    CHECK(collect(opts) == (vector<string>{"rec-013", "rec-012", "rec-011"}));
+
+    opts = RecordEnumerator::Options();
+    opts.startKey = "rec-090"_sl;
+    opts.skip = 5;
+    opts.limit = 3;
+    CHECK(collect(opts) == (vector<string>{"rec-095", "rec-096", "rec-097"}));
+    opts.skip = 0;
+    opts.limit = 0;
+    CHECK(collect(opts).empty());
+
+    // By sequence, with a limit:
+    opts = RecordEnumerator::Options();
+    opts.limit = 2;
+    {
+        vector<sequence_t> seqs;
+        for (RecordEnumerator e(*store, 50, opts); e.next(); )
+            seqs.push_back(e->sequence());
+        CHECK(seqs == (vector<sequence_t>{51, 52}));
+    }
+
+    // Two open enumerators with the same options can't share a statement:
+    opts = RecordEnumerator::Options();
+    opts.startKey = "rec-098"_sl;
+    RecordEnumerator e1(*store, opts);
+    REQUIRE(e1.next());
+    opts.startKey = "rec-050"_sl;
+    RecordEnumerator e2(*store, opts);
+    REQUIRE(e2.next());
+    CHECK(e2->key() == "rec-050"_sl);
+    CHECK(e1->key() == "rec-098"_sl);
+    REQUIRE(e1.next());
+    CHECK(e1->key() == "rec-099"_sl);
+    REQUIRE(e2.next());
+    CHECK(e2->key() == "rec-051"_sl);
+    e1.close();
+
+    // ...but once one is closed its statement is reused:
+    opts.startKey = "rec-100"_sl;
+    RecordEnumerator e3(*store, opts);
+    REQUIRE(e3.next());
+    CHECK(e3->key() == "rec-100"_sl);
+    CHECK_FALSE(e3.next());
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Borrowed Reads", "[DataFile]") {
+    createNumberedDocs(store);
+
+    bool called = false;
+    CHECK(store->getBorrowed("rec-042"_sl, kDefaultContent, [&](const RecordLite &rec) {
+        CHECK(rec.exists);
+        CHECK(rec.key == "rec-042"_sl);
+        CHECK(rec.sequence == 42);
+        CHECK(rec.body == "rec-042"_sl);
+        CHECK(rec.bodySize == 7);
+        called = true;
+    }));
+    CHECK(called);
+
+    CHECK(store->getBorrowed("rec-042"_sl, kMetaOnly, [&](const RecordLite &rec) {
+        CHECK(rec.body.buf == nullptr);
+        CHECK(rec.bodySize == 7);
+    }));
+
+    CHECK_FALSE(store->getBorrowed("nope"_sl, kDefaultContent, [&](const RecordLite &rec) {
+        FAIL("Callback shouldn't be called for a missing record");
+    }));
+
+    // The enumerator's RecordLite and (copied) Record agree:
+    int i = 1;
+    for (RecordEnumerator e(*store); e.next(); ++i) {
+        auto &lite = e.recordLite();
+        string expectedDocID = stringWithFormat("rec-%03d", i);
+        REQUIRE(lite.key == slice(expectedDocID));
+        REQUIRE(lite.sequence == (sequence_t)i);
+        REQUIRE(lite.body == slice(expectedDocID));
+        REQUIRE(e.record().key() == lite.key);
+        REQUIRE(e.record().body() == lite.body);
+        REQUIRE(e.record().sequence() == lite.sequence);
+    }
+    REQUIRE(i == 101);
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile GetManyBorrowed", "[DataFile]") {
+    createNumberedDocs(store);
+
+    // Keys out of order, with a missing key, and more keys than fit in one query:
+    vector<string> keyStrings;
+    for (int i = 100; i >= 1; i -= 3)
+        keyStrings.push_back(stringWithFormat("rec-%03d", i));
+    keyStrings.push_back("nope");
+    for (int i = 0; i < 300; ++i)
+        keyStrings.push_back(stringWithFormat("missing-%03d", i));
+    vector<slice> keys;
+    for (auto &key : keyStrings)
+        keys.push_back(slice(key));
+
+    int expected = 1;
+    store->getManyBorrowed(keys, kDefaultContent, [&](const RecordLite &rec) {
+        string expectedDocID = stringWithFormat("rec-%03d", expected);
+        CHECK(rec.exists);
+        CHECK(rec.key == slice(expectedDocID));
+        CHECK(rec.sequence == (sequence_t)expected);
+        CHECK(rec.body == slice(expectedDocID));
+        expected += 3;
+    });
+    CHECK(expected == 103);
+
+    unsigned count = 0;
+    store->getManyBorrowed(keys, kMetaOnly, [&](const RecordLite &rec) {
+        CHECK(rec.body.buf == nullptr);
+        CHECK(rec.bodySize == 7);
+        ++count;
+    });
+    CHECK(count == 34);
+
+    // A key repeated often enough to span several queries is still only reported once:
+    keys.assign(300, "rec-005"_sl);
+    count = 0;
+    store->getManyBorrowed(keys, kMetaOnly, [&](const RecordLite &rec) {
+        CHECK(rec.key == "rec-005"_sl);
+        ++count;
+    });
+    CHECK(count == 1);
+}
+
+
 N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile AbortTransaction", "[DataFile]") {
     // Initial record:
     {
@@ -350,6 +506,261 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Conditional Write", "[Dat
 }
 
 
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile SetMany", "[DataFile]") {
+    createNumberedDocs(store);
+    vector<string> keys;
+    for (int i = 95; i <= 104; i++)
+        keys.push_back(stringWithFormat("rec-%03d", i));     // 6 existing, 4 new
+    vector<KeyStore::SetRequest> requests;
+    for (auto &key : keys)
+        requests.push_back({slice(key), "v"_sl, "many"_sl, DocumentFlags::kNone});
+    {
+        Transaction t(db);
+        CHECK(store->setMany(requests, t) == 101);
+        CHECK(store->lastSequence() == 110);
+        CHECK(store->setMany({}, t) == 0);
+        t.commit();
+    }
+    REQUIRE(store->lastSequence() == 110);
+    CHECK(store->recordCount() == 104);
+    sequence_t seq = 101;
+    for (auto &key : keys) {
+        Record rec = store->get(slice(key));
+        CHECK(rec.sequence() == seq++);
+        CHECK(rec.version() == "v"_sl);
+        CHECK(rec.body() == "many"_sl);
+    }
+    CHECK(store->get((sequence_t)94).key() == "rec-094"_sl);
+
+    // Insert-only requests skip existing records without using up a sequence:
+    requests.clear();
+    requests.push_back({"rec-001"_sl, "v"_sl, "nope"_sl, DocumentFlags::kNone, true});
+    requests.push_back({"rec-200"_sl, "v"_sl, "new"_sl, DocumentFlags::kNone, true});
+    requests.push_back({"rec-002"_sl, "v"_sl, "replaced"_sl});
+    {
+        Transaction t(db);
+        vector<sequence_t> sequences;
+        CHECK(store->setMany(requests, t, &sequences) == 111);
+        CHECK(sequences == (vector<sequence_t>{0, 111, 112}));
+        CHECK(store->lastSequence() == 112);
+        t.commit();
+    }
+    CHECK(store->get("rec-001"_sl).sequence() == 1);
+    CHECK(store->get("rec-200"_sl).body() == "new"_sl);
+    CHECK(store->get("rec-002"_sl).body() == "replaced"_sl);
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile SetMany Performance", "[DataFile][Perf][.slow]") {
+    static constexpr int kNumRecords = 100000;
+    static constexpr size_t kBatchSize = 1000;
+    vector<string> keys;
+    for (int i = 0; i < kNumRecords; i++)
+        keys.push_back(stringWithFormat("rec-%07d", i));
+    const slice body = "{\"some\":\"body\",\"of\":\"modest\",\"size\":12345678}"_sl;
+
+    {
+        Stopwatch st;
+        Transaction t(db);
+        for (auto &key : keys)
+            store->set(slice(key), "1-abcd"_sl, body, DocumentFlags::kNone, t);
+        t.commit();
+        st.printReport("set()", kNumRecords, "record");
+    }
+
+    KeyStore &many = db->getKeyStore("many");
+    {
+        Stopwatch st;
+        Transaction t(db);
+        vector<KeyStore::SetRequest> requests;
+        requests.reserve(kBatchSize);
+        for (auto &key : keys) {
+            requests.push_back({slice(key), "1-abcd"_sl, body, DocumentFlags::kNone});
+            if (requests.size() == kBatchSize) {
+                many.setMany(requests, t);
+                requests.clear();
+            }
+        }
+        many.setMany(requests, t);
+        t.commit();
+        st.printReport("setMany()", kNumRecords, "record");
+    }
+    CHECK(many.recordCount() == (uint64_t)kNumRecords);
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Concurrent Reads", "[DataFile]") {
+    createNumberedDocs(store);
+    Transaction t(db);
+    store->set("rec-001"_sl, "changed"_sl, t);
+    store->set("rec-999"_sl, "new"_sl, t);
+    store->del("rec-002"_sl, t);
+
+    // The Transaction's own thread sees its changes:
+    CHECK(store->get("rec-001"_sl).body() == alloc_slice("changed"));
+    CHECK(store->get("rec-999"_sl).exists());
+    CHECK(!store->get("rec-002"_sl).exists());
+
+    // Other threads see the last committed state, without waiting for the Transaction:
+    thread([&]{
+        CHECK(store->get("rec-001"_sl).body() == alloc_slice("rec-001"));
+        CHECK(!store->get("rec-999"_sl).exists());
+        CHECK(store->get("rec-002"_sl).exists());
+        CHECK(store->get((sequence_t)100).key() == "rec-100"_sl);
+        unsigned n = 0;
+        for (RecordEnumerator e(*store); e.next(); )
+            ++n;
+        CHECK(n == 100);
+    }).join();
+
+    t.commit();
+    thread([&]{
+        CHECK(store->get("rec-001"_sl).body() == alloc_slice("changed"));
+        CHECK(store->get("rec-999"_sl).exists());
+    }).join();
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Concurrent Reads Performance", "[DataFile][Perf][.slow]") {
+    static constexpr int kNumRecords = 10000;
+    static constexpr int kReadsPerThread = 100000;
+    vector<string> keys;
+    {
+        Transaction t(db);
+        for (int i = 0; i < kNumRecords; i++) {
+            keys.push_back(stringWithFormat("rec-%07d", i));
+            store->set(slice(keys.back()), "{\"some\":\"body\",\"of\":\"modest\",\"size\":1}"_sl, t);
+        }
+        t.commit();
+    }
+
+    // Readers run while a Transaction is open on this thread, as when the replicator is
+    // inserting revisions:
+    Transaction t(db);
+    atomic<int> missing {0};
+    for (unsigned nThreads = 1; nThreads <= 8; nThreads *= 2) {
+        Stopwatch st;
+        vector<thread> threads;
+        for (unsigned n = 0; n < nThreads; ++n) {
+            threads.emplace_back([&, n]{
+                for (int i = 0; i < kReadsPerThread; ++i) {
+                    Record rec = store->get(slice(keys[(i * 7 + n) % kNumRecords]));
+                    if (!rec.exists())
+                        ++missing;
+                }
+            });
+        }
+        for (auto &th : threads)
+            th.join();
+        st.printReport(stringWithFormat("get() with %u threads", nThreads).c_str(),
+                       kReadsPerThread * nThreads, "read");
+    }
+    t.abort();
+    CHECK(missing == 0);
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile WAL Checkpoints", "[DataFile]") {
+    SQLiteCheckpointer *checkpointer = ((SQLiteDataFile*)db)->checkpointer();
+    REQUIRE(checkpointer);
+    checkpointer->setThresholds({20, 1000, 2000});
+
+    // Each commit adds pages to the WAL; past 20 pages the background thread checkpoints it:
+    string body(8000, 'x');
+    for (int i = 0; i < 50; i++) {
+        Transaction t(db);
+        store->set(slice(stringWithFormat("rec-%03d", i)), slice(body), t);
+        t.commit();
+    }
+    for (int i = 0; i < 100 && checkpointer->stats().checkpoints == 0; i++)
+        this_thread::sleep_for(chrono::milliseconds(20));
+    auto stats = checkpointer->stats();
+    CHECK(stats.checkpoints > 0);
+    CHECK(stats.restarts == 0);
+    CHECK(stats.truncates == 0);
+    CHECK(stats.maxWALPages >= 20);
+    CHECK(stats.pagesCheckpointed > 0);
+
+    // An explicit TRUNCATE checkpoint empties the WAL:
+    CHECK(checkpointer->checkpointNow(true));
+    stats = checkpointer->stats();
+    CHECK(stats.truncates == 1);
+    CHECK(stats.walPages == 0);
+    CHECK(stats.maxTime >= stats.lastTime);
+    CHECK(store->get("rec-049"_sl).body() == slice(body));
+}
+
+
+static int64_t pragmaValue(DataFile *db, const char *pragma) {
+    alloc_slice result = db->rawQuery(string("PRAGMA ") + pragma);
+    return Value::fromData(result)->asArray()->get(0)->asArray()->get(0)->asInt();
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Storage Tuning", "[DataFile]") {
+    DataFile::Options options = db->options();
+    options.tuning.cacheSize = 3 * 1024 * 1024;
+    options.tuning.journalSizeLimit = 1024 * 1024;
+    options.tuning.checkpointPages = 100;
+    options.tuning.workerThreads = -1;
+    reopenDatabase(&options);
+
+    CHECK(pragmaValue(db, "cache_size") == -3072);
+    CHECK(pragmaValue(db, "threads") == 0);
+    CHECK(pragmaValue(db, "journal_size_limit") == 1024 * 1024);
+    CHECK(pragmaValue(db, "page_size") == 4096);
+    auto thresholds = ((SQLiteDataFile*)db)->checkpointer()->thresholds();
+    CHECK(thresholds.passivePages == 100);
+    CHECK(thresholds.restartPages == 400);
+    CHECK(thresholds.truncatePages == 1600);
+
+    // Reopening without the tuning goes back to the default thresholds:
+    options.tuning.checkpointPages = 0;
+    reopenDatabase(&options);
+    thresholds = ((SQLiteDataFile*)db)->checkpointer()->thresholds();
+    CHECK(thresholds.passivePages == SQLiteCheckpointer::Thresholds::defaults.passivePages);
+    CHECK(thresholds.restartPages == SQLiteCheckpointer::Thresholds::defaults.restartPages);
+    CHECK(thresholds.truncatePages == SQLiteCheckpointer::Thresholds::defaults.truncatePages);
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Storage Tuning Performance", "[DataFile][Perf][.slow]") {
+    static constexpr int kNumRecords = 200000;
+    {
+        string body(500, 'x');
+        Transaction t(db);
+        for (int i = 0; i < kNumRecords; i++)
+            store->set(slice(stringWithFormat("rec-%07d", i)), slice(body), t);
+        t.commit();
+    }
+
+    struct Config {const char *name; uint64_t cacheSize; int64_t mmapSize;};
+    static const Config kConfigs[] = {
+        {"small cache, no mmap",      1 * 1024 * 1024,   -1},
+        {"default",                   0,                 0},
+        {"large cache, no mmap",      256 * 1024 * 1024, -1},
+        {"large cache, 1GB mmap",     256 * 1024 * 1024, 1024 * 1024 * 1024},
+    };
+    for (auto &config : kConfigs) {
+        DataFile::Options options = db->options();
+        options.tuning.cacheSize = config.cacheSize;
+        options.tuning.mmapSize = config.mmapSize;
+        reopenDatabase(&options);
+
+        // The first scan warms up the cache (or the mapping); the rest are timed:
+        for (int pass = 0; pass < 4; pass++) {
+            Stopwatch st;
+            int n = 0;
+            for (RecordEnumerator e(*store); e.next(); )
+                ++n;
+            CHECK(n == kNumRecords);
+            if (pass > 0)
+                st.printReport(stringWithFormat("Scan with %s", config.name).c_str(), n, "record");
+        }
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile KeyStoreDelete", "[DataFile]") {
     KeyStore &s = db->getKeyStore("store");
     alloc_slice key("key");
@@ -586,6 +997,54 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "Verify Encryption Unsupported", "[
 #endif // COUCHBASE_ENTERPRISE
 
 
+#if AES256_AVAILABLE
+TEST_CASE("AES256 Block Encryption Performance", "[Encryption][Perf][.slow]") {
+    // Compares setting up the cipher for every 4KB block, as EncryptedStream used to, with
+    // reusing one AES256Context for all the blocks:
+    static constexpr size_t kBlockSize = 4096, kNumBlocks = 64 * 1024;
+    uint8_t key[kAES256KeySize], iv[kAESIVSize] = {};
+    for (size_t i = 0; i < sizeof(key); ++i)
+        key[i] = (uint8_t)(i * 31);
+    vector<uint8_t> plaintext(kBlockSize), ciphertext(kBlockSize + kAESBlockSize);
+    for (size_t i = 0; i < kBlockSize; ++i)
+        plaintext[i] = (uint8_t)(i * 7 + i / 256);
+    slice src(plaintext.data(), kBlockSize), dst(ciphertext.data(), ciphertext.size());
+
+    for (bool encrypt : {true, false}) {
+        const char *what = encrypt ? "encrypt" : "decrypt";
+        {
+            Stopwatch st;
+            for (size_t b = 0; b < kNumBlocks; ++b) {
+                memcpy(iv, &b, sizeof(b));
+                AES256(encrypt, slice(key, sizeof(key)), slice(iv, sizeof(iv)), false, dst, src);
+            }
+            st.printReport(stringWithFormat("AES256(%s) per block", what).c_str(),
+                           kNumBlocks, "block");
+        }
+        {
+            Stopwatch st;
+            AES256Context context(encrypt, slice(key, sizeof(key)));
+            for (size_t b = 0; b < kNumBlocks; ++b) {
+                memcpy(iv, &b, sizeof(b));
+                context.crypt(slice(iv, sizeof(iv)), false, dst, src);
+            }
+            st.printReport(stringWithFormat("AES256Context(%s)", what).c_str(),
+                           kNumBlocks, "block");
+        }
+    }
+
+    // Both produce the same output:
+    vector<uint8_t> expected(ciphertext.size());
+    size_t size1 = AES256(true, slice(key, sizeof(key)), slice(iv, sizeof(iv)), false,
+                          slice(expected.data(), expected.size()), src);
+    size_t size2 = AES256Context(true, slice(key, sizeof(key))).crypt(slice(iv, sizeof(iv)),
+                                                                      false, dst, src);
+    REQUIRE(size1 == size2);
+    CHECK(memcmp(expected.data(), ciphertext.data(), size1) == 0);
+}
+#endif
+
+
 #pragma mark - MISC.
 
 
@@ -17,6 +17,7 @@
 //
 
 #include "LiteCoreTest.hh"
+#include "DocumentKeys.hh"
 #include "FleeceImpl.hh"
 
 using namespace fleece;
@@ -58,12 +59,15 @@ const DataFile::Options DocumentKeysTestFixture::kOptions = {
 
 
 TEST_CASE_METHOD(DocumentKeysTestFixture, "Create docs", "[SharedKeys]") {
+    auto keys = static_cast<DocumentKeys*>(db->documentKeys());
     {
         Transaction t(db);
         createDoc("doc1", "{\"foo\": 1}", t);
         createDoc("doc2", "{\"foo\": 2, \"bar\": 1}", t);
         t.commit();
     }
+    alloc_slice committedState = keys->persistedState();
+    CHECK(committedState);
 
     // Add "zog" as a key, but abort the transaction so it doesn't take effect:
     {
@@ -74,6 +78,7 @@ TEST_CASE_METHOD(DocumentKeysTestFixture, "Create docs", "[SharedKeys]") {
     }
 
     CHECK(db->documentKeys()->byKey() == (vector<alloc_slice>{alloc_slice("foo"), alloc_slice("bar")}));
+    CHECK(keys->persistedState() == committedState);
 
     Dict::key foo("foo"_sl);
     Dict::key bar("bar"_sl);
@@ -17,6 +17,7 @@
 //
 
 #include "DataFile.hh"
+#include "SQLiteKeyStore.hh"
 #include "Query.hh"
 #include "Error.hh"
 
@@ -38,22 +39,23 @@ public:
     FTSTest() {
         {
             Transaction t(store->dataFile());
-            for (int i = 0; i < sizeof(kStrings)/sizeof(kStrings[0]); i++) {
-                string docID = stringWithFormat("rec-%03d", i);
-
-                fleece::impl::Encoder enc;
-                enc.beginDictionary();
-                enc.writeKey("sentence");
-                enc.writeString(kStrings[i]);
-                enc.endDictionary();
-                alloc_slice body = enc.finish();
-
-                store->set(slice(docID), body, t);
-            }
+            for (int i = 0; i < sizeof(kStrings)/sizeof(kStrings[0]); i++)
+                writeSentence(stringWithFormat("rec-%03d", i), kStrings[i], t);
             t.commit();
         }
     }
 
+    void writeSentence(const string &docID, const char *sentence, Transaction &t) {
+        fleece::impl::Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("sentence");
+        enc.writeString(sentence);
+        enc.endDictionary();
+        alloc_slice body = enc.finish();
+
+        store->set(slice(docID), body, t);
+    }
+
     void createIndex(KeyStore::IndexOptions options) {
         store->createIndex("sentence"_sl, "[[\".sentence\"]]"_sl, KeyStore::kFullTextIndex, &options);
     }
@@ -161,3 +163,110 @@ TEST_CASE_METHOD(FTSTest, "Query Full-Text Custom stop-words", "[Query][FTS]") {
               {4, 2});
 }
 
+
+
+TEST_CASE_METHOD(FTSTest, "Query Full-Text Parallel Build", "[Query][FTS]") {
+    // With one-record chunks, even this little index is populated by worker threads:
+    unsigned chunkSize = SQLiteKeyStore::indexBuildChunkSize();
+    SQLiteKeyStore::setIndexBuildChunkSize(1);
+    try {
+        createIndex({"english", true});
+    } catch (...) {
+        SQLiteKeyStore::setIndexBuildChunkSize(chunkSize);
+        throw;
+    }
+    SQLiteKeyStore::setIndexBuildChunkSize(chunkSize);
+    testQuery(
+        "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'],\
+                    ORDER_BY: [['DESC', ['rank()', 'sentence']]],\
+                        WHAT: [['.sentence']]}]",
+              {1, 2, 0, 4},
+              {3, 3, 1, 1});
+
+    // Afterwards the index is kept up to date as usual:
+    {
+        Transaction t(store->dataFile());
+        store->del("rec-001"_sl, t);
+        t.commit();
+    }
+    testQuery(
+        "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'],\
+                    ORDER_BY: [['DESC', ['rank()', 'sentence']]],\
+                        WHAT: [['.sentence']]}]",
+              {2, 0, 4},
+              {3, 1, 1});
+}
+
+
+TEST_CASE_METHOD(FTSTest, "Query Full-Text Parallel Build With Changes", "[Query][FTS][!throws]") {
+    // Records change between the chunks of the build, and queries made meanwhile fail instead of
+    // returning partial results:
+    static const char *kQuery = "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'],\
+                                             ORDER_BY: [['._id']],\
+                                                 WHAT: [['.sentence']]}]";
+    unsigned chunkSize = SQLiteKeyStore::indexBuildChunkSize();
+    SQLiteKeyStore::setIndexBuildChunkSize(1);
+    unsigned chunksBuilt = 0;
+    SQLiteKeyStore::setIndexBuildChunkCallback([&](unsigned chunk) {
+        ++chunksBuilt;
+        if (chunk == 1) {
+            Transaction t(store->dataFile());
+            store->del("rec-000"_sl, t);                // already indexed
+            store->del("rec-004"_sl, t);                // not indexed yet
+            writeSentence("rec-005", kStrings[4], t);   // after the last chunk
+            t.commit();
+        }
+        ExpectException(error::LiteCore, error::NoSuchIndex, [&]{
+            Retained<Query> query{ store->compileQuery(json5(kQuery)) };
+        });
+    });
+    try {
+        createIndex({"english", true});
+    } catch (...) {
+        SQLiteKeyStore::setIndexBuildChunkSize(chunkSize);
+        SQLiteKeyStore::setIndexBuildChunkCallback(nullptr);
+        throw;
+    }
+    SQLiteKeyStore::setIndexBuildChunkSize(chunkSize);
+    SQLiteKeyStore::setIndexBuildChunkCallback(nullptr);
+    CHECK(chunksBuilt == 5);
+
+    testQuery(kQuery, {1, 2, 4}, {3, 3, 1});
+}
+
+
+TEST_CASE_METHOD(FTSTest, "Query Full-Text Parallel Build With Other Connection", "[Query][FTS]") {
+    // Another connection opened during the build doesn't take the build over as if it had been
+    // interrupted, and creating the same index on it doesn't disturb the build:
+    unsigned chunkSize = SQLiteKeyStore::indexBuildChunkSize();
+    SQLiteKeyStore::setIndexBuildChunkSize(1);
+    unsigned chunksBuilt = 0;
+    SQLiteKeyStore::setIndexBuildChunkCallback([&](unsigned chunk) {
+        ++chunksBuilt;
+        if (chunk == 1) {
+            DataFile::Options options = db->options();
+            unique_ptr<DataFile> other { newDatabase(db->filePath(), &options) };
+            KeyStore::IndexOptions indexOptions {"english", true};
+            CHECK(other->defaultKeyStore().createIndex("sentence"_sl, "[[\".sentence\"]]"_sl,
+                                                       KeyStore::kFullTextIndex,
+                                                       &indexOptions) == false);
+        }
+    });
+    try {
+        createIndex({"english", true});
+    } catch (...) {
+        SQLiteKeyStore::setIndexBuildChunkSize(chunkSize);
+        SQLiteKeyStore::setIndexBuildChunkCallback(nullptr);
+        throw;
+    }
+    SQLiteKeyStore::setIndexBuildChunkSize(chunkSize);
+    SQLiteKeyStore::setIndexBuildChunkCallback(nullptr);
+    CHECK(chunksBuilt == 5);
+
+    testQuery(
+        "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'],\
+                    ORDER_BY: [['DESC', ['rank()', 'sentence']]],\
+                        WHAT: [['.sentence']]}]",
+              {1, 2, 0, 4},
+              {3, 3, 1, 1});
+}
@@ -21,9 +21,11 @@
 #include "LogDecoder.hh"
 #include "LiteCoreTest.hh"
 #include "StringUtil.hh"
+#include "Benchmark.hh"
 #include <regex>
 #include <sstream>
 #include <fstream>
+#include <thread>
 
 #define DATESTAMP "\\w+, \\d{2}/\\d{2}/\\d{2}"
 #define TIMESTAMP "\\d{2}:\\d{2}:\\d{2}\\.\\d{6}\\| "
@@ -123,6 +125,28 @@ TEST_CASE("LogEncoder tokens", "[Log]") {
 }
 
 
+TEST_CASE("LogEncoder temporary strings", "[Log]") {
+    // Entries are written to the file later, so the caller's strings mustn't be needed then:
+    stringstream out;
+    {
+        LogEncoder logger(out);
+        string domain = "Temp", format = "Token %-s", token = "first";
+        logger.log(2, domain.c_str(), LogEncoder::None, format.c_str(), token.c_str());
+        domain.assign(domain.size(), 'x');
+        format.assign(format.size(), 'x');
+        token.assign(token.size(), 'x');
+    }
+    string encoded = out.str();
+    string result = dumpLog(encoded, {});
+    CHECK(result.find("Token first") != string::npos);
+
+    stringstream in(encoded);
+    LogDecoder decoder(in);
+    REQUIRE(decoder.next());
+    CHECK(string(decoder.domain()) == "Temp");
+}
+
+
 TEST_CASE("LogEncoder auto-flush", "[Log]") {
     stringstream out;
     LogEncoder logger(out);
@@ -144,6 +168,65 @@ TEST_CASE("LogEncoder auto-flush", "[Log]") {
     CHECK(!result.empty());
 }
 
+TEST_CASE("LogEncoder threads", "[Log]") {
+    // Each thread's messages are buffered separately; make sure they all come out, in order:
+    static const int kNumThreads = 8, kNumMessages = 5000;
+    stringstream out;
+    {
+        LogEncoder logger(out);
+        vector<thread> threads;
+        for (int t = 0; t < kNumThreads; ++t) {
+            threads.emplace_back([&logger, t]{
+                for (int i = 0; i < kNumMessages; ++i)
+                    logger.log(1, "Thread", LogEncoder::None, "thread %d, message %d (%-s)",
+                               t, i, (i % 2 ? "odd" : "even"));
+            });
+        }
+        for (auto &th : threads)
+            th.join();
+    }
+
+    stringstream in(out.str());
+    LogDecoder decoder(in);
+    vector<int> nextMessage(kNumThreads, 0);
+    int count = 0;
+    while (decoder.next()) {
+        int t, i;
+        char parity[10];
+        string message = decoder.readMessage();
+        REQUIRE(sscanf(message.c_str(), "thread %d, message %d (%9[a-z])", &t, &i, parity) == 3);
+        REQUIRE(t >= 0);
+        REQUIRE(t < kNumThreads);
+        CHECK(i == nextMessage[t]);
+        CHECK(string(parity) == (i % 2 ? "odd" : "even"));
+        nextMessage[t] = i + 1;
+        ++count;
+    }
+    CHECK(count == kNumThreads * kNumMessages);
+}
+
+
+TEST_CASE("LogEncoder threads performance", "[Log][Perf][.slow]") {
+    static const int kNumThreads = 8, kNumMessages = 500000;
+    stringstream out;
+    LogEncoder logger(out);
+    Stopwatch st;
+    vector<thread> threads;
+    for (int t = 0; t < kNumThreads; ++t) {
+        threads.emplace_back([&logger, t]{
+            slice str("some data");
+            for (int i = 0; i < kNumMessages; ++i)
+                logger.log(1, "Thread", LogEncoder::None, "thread %d, message %d: '%.*s' %-s",
+                           t, i, SPLAT(str), "token");
+        });
+    }
+    for (auto &th : threads)
+        th.join();
+    logger.flush();
+    st.printReport("Logging from 8 threads", kNumThreads * kNumMessages, "call");
+}
+
+
 TEST_CASE("Logging prune old files", "[Log]") {
     FilePath tmpLogDir = FilePath::tempDirectory()["Log_Prune/"];
     tmpLogDir.mkdir();
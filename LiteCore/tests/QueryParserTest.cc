@@ -44,6 +44,9 @@ public:
     virtual bool tableExists(const string &tableName) const override {
         return tablesExist;
     }
+    virtual bool hasCollationKeyIndex(const string &collationName) const override {
+        return collationKeyIndexExists;
+    }
 
 protected:
     string parse(string json) {
@@ -69,6 +72,7 @@ protected:
     }
 
     bool tablesExist {false};
+    bool collationKeyIndexExists {false};
 
 };
 
@@ -303,6 +307,23 @@ TEST_CASE_METHOD(QueryParserTest, "QueryParser Collate", "[Query][Collation]") {
 }
 
 
+TEST_CASE_METHOD(QueryParserTest, "QueryParser Collate with sort keys", "[Query][Collation]") {
+    collationKeyIndexExists = true;
+    CHECK(parse("{WHAT: ['.title'], \
+                 WHERE: ['COLLATE', {'unicode':true, 'case':false}, ['=', ['.author'], ['$AUTHOR']]], \
+              ORDER_BY: [ ['DESC', ['COLLATE', {'unicode':true, 'case':false}, ['.title']]] ]}")
+          == "SELECT fl_result(fl_value(_doc.body, 'title')) FROM kv_default AS _doc "
+              "WHERE (fl_value(_doc.body, 'author') COLLATE \"LCUnicode_C__\" = $_AUTHOR) "
+                "AND (_doc.flags & 1) = 0 "
+           "ORDER BY collation_key(fl_value(_doc.body, 'title'), 'LCUnicode_C__') DESC");
+    // Non-Unicode collations are unaffected:
+    CHECK(parse("{WHAT: ['.title'], ORDER_BY: [ ['COLLATE', {'case':false}, ['.title']] ]}")
+          == "SELECT fl_result(fl_value(_doc.body, 'title')) FROM kv_default AS _doc "
+              "WHERE (_doc.flags & 1) = 0 "
+           "ORDER BY fl_value(_doc.body, 'title') COLLATE \"NOCASE\"");
+}
+
+
 TEST_CASE_METHOD(QueryParserTest, "QueryParser errors", "[Query][!throws]") {
     mustFail("['poop()', 1]");
     mustFail("['power()', 1]");
@@ -17,6 +17,8 @@
 //
 
 #include "QueryTest.hh"
+#include "QueryCache.hh"
+#include "SQLiteDataFile.hh"
 
 using namespace fleece::impl;
 
@@ -244,6 +246,166 @@ TEST_CASE_METHOD(QueryTest, "Query refresh", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Query refresh with changes", "[Query]") {
+    addNumberedDocs();
+    Retained<Query> query{ store->compileQuery(json5(
+                     "{WHAT: ['.num'], WHERE: ['>', ['.num'], 10], ORDER_BY: [['.num']]}")) };
+    unique_ptr<QueryEnumerator> e(query->createEnumerator());
+    REQUIRE(e->canRefreshIncrementally());
+    CHECK(e->getRowCount() == 90);
+
+    // Change a doc that doesn't match, before or after:
+    sequence_t seq;
+    {
+        Transaction t(db);
+        seq = writeNumberedDoc(5, "changed"_sl, t);
+        t.commit();
+    }
+    CHECK(e->refreshWithChanges({alloc_slice("rec-005"_sl)}, seq) == nullptr);
+
+    // If the changes don't cover the latest sequence, the query has to be re-run:
+    {
+        Transaction t(db);
+        seq = writeNumberedDoc(6, "changed"_sl, t);
+        t.commit();
+    }
+    CHECK(e->refreshWithChanges({}, seq - 1) == nullptr);   // re-run, but results are the same
+
+    // Change a doc that didn't match before, but does now:
+    {
+        Transaction t(db);
+        seq = writeNumberedDoc(500, nullslice, t);
+        t.commit();
+    }
+    unique_ptr<QueryEnumerator> e2(e->refreshWithChanges({alloc_slice("rec-500"_sl)}, seq));
+    REQUIRE(e2 != nullptr);
+    CHECK(e2->getRowCount() == 91);
+
+    // Delete a doc that matched before:
+    {
+        Transaction t(db);
+        seq = store->set("rec-050"_sl, "2-ffff"_sl, nullslice, DocumentFlags::kDeleted, t);
+        t.commit();
+    }
+    unique_ptr<QueryEnumerator> e3(e2->refreshWithChanges({alloc_slice("rec-050"_sl)}, seq));
+    REQUIRE(e3 != nullptr);
+    CHECK(e3->getRowCount() == 90);
+
+    // A parameter that's only used in the WHAT clause doesn't affect matching:
+    Query::Options opts;
+    opts.paramBindings = R"({"factor": 2, "min": 10})"_sl;
+    query = store->compileQuery(json5(
+                     "{WHAT: [['*', ['.num'], ['$factor']]], WHERE: ['>', ['.num'], ['$min']]}"));
+    e.reset(query->createEnumerator(&opts));
+    REQUIRE(e->canRefreshIncrementally());
+    {
+        Transaction t(db);
+        seq = writeNumberedDoc(7, "changed"_sl, t);
+        t.commit();
+    }
+    CHECK(e->refreshWithChanges({alloc_slice("rec-007"_sl)}, seq) == nullptr);
+
+    // Aggregate and LIMIT queries can't be refreshed incrementally:
+    query = store->compileQuery(json5("{WHAT: [['count()']], WHERE: ['>', ['.num'], 10]}"));
+    e.reset(query->createEnumerator());
+    CHECK(!e->canRefreshIncrementally());
+    query = store->compileQuery(json5("{WHAT: ['.num'], ORDER_BY: [['.num']], LIMIT: 10}"));
+    e.reset(query->createEnumerator());
+    CHECK(!e->canRefreshIncrementally());
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Query cache", "[Query]") {
+    addNumberedDocs();
+    QueryCache &cache = ((SQLiteDataFile&)store->dataFile()).queryCache();
+    cache.clear();
+    auto hits = cache.hits(), misses = cache.misses();
+
+    Retained<Query> query1{ store->compileQuery(json5("{WHAT: ['.num'], WHERE: ['>', ['.num'], ['$max']]}")) };
+    CHECK(cache.misses() == misses + 1);
+    CHECK(cache.count() == 1);
+
+    // Same query with different property order and whitespace is a cache hit:
+    Retained<Query> query2{ store->compileQuery(json5("{WHERE: ['>', ['.num'],['$max']],  WHAT: ['.num']}")) };
+    CHECK(cache.hits() == hits + 1);
+    CHECK(query2 == query1);
+
+    Retained<Query> query3{ store->compileQuery(json5("{WHAT: ['.num'], WHERE: ['<', ['.num'], ['$max']]}")) };
+    CHECK(query3 != query1);
+    CHECK(cache.count() == 2);
+
+    // Two enumerators on the same cached query, one streaming so it keeps the statement busy:
+    Query::Options options;
+    options.paramBindings = R"({"max": 95})"_sl;
+    options.streaming = true;
+    unique_ptr<QueryEnumerator> e1(query1->createEnumerator(&options));
+    options.paramBindings = R"({"max": 98})"_sl;
+    options.streaming = false;
+    unique_ptr<QueryEnumerator> e2(query2->createEnumerator(&options));
+    int n1 = 0, n2 = 0;
+    while (e1->next())
+        ++n1;
+    while (e2->next())
+        ++n2;
+    CHECK(n1 == 5);
+    CHECK(n2 == 2);
+    e1.reset();
+    e2.reset();
+
+    // Creating an index invalidates the cache:
+    store->createIndex("num"_sl, "[[\".num\"]]"_sl);
+    CHECK(cache.count() == 0);
+    Retained<Query> query4{ store->compileQuery(json5("{WHAT: ['.num'], WHERE: ['>', ['.num'], ['$max']]}")) };
+    CHECK(query4 != query1);
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Query streaming", "[Query]") {
+    addNumberedDocs();
+    Retained<Query> query{ store->compileQuery(json5(
+                     "{WHAT: ['.num', ['*', ['.num'], ['.num']]], WHERE: ['>', ['.num'], 10]}")) };
+    Query::Options options;
+    options.streaming = true;
+
+    // Two streaming enumerators on the same query can be interleaved:
+    unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+    unique_ptr<QueryEnumerator> e2(query->createEnumerator(&options));
+    int num = 11;
+    while (e->next()) {
+        REQUIRE(e2->next());
+        auto cols = e->columns();
+        REQUIRE(cols.count() == 2);
+        CHECK(cols[0]->asInt() == num);
+        CHECK(cols[1]->asInt() == num * num);
+        CHECK(e2->columns()[0]->asInt() == num);
+        CHECK(e->missingColumns() == 0);
+        ++num;
+    }
+    CHECK(num == 101);
+    CHECK(!e2->next());
+
+    ExpectException(error::LiteCore, error::UnsupportedOperation, [&]{
+        e->getRowCount();
+    });
+    ExpectException(error::LiteCore, error::UnsupportedOperation, [&]{
+        e->seek(1);
+    });
+
+    CHECK(e->refresh() == nullptr);
+    {
+        Transaction t(db);
+        writeNumberedDoc(200, nullslice, t);
+        t.commit();
+    }
+    unique_ptr<QueryEnumerator> e3(e->refresh());
+    REQUIRE(e3 != nullptr);
+    num = 11;
+    while (e3->next())
+        ++num;
+    CHECK(num == 102);
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query boolean", "[Query]") {
     {
         Transaction t(store->dataFile());
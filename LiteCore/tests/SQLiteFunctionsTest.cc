@@ -19,6 +19,7 @@
 #include "LiteCoreTest.hh"
 #include "SQLite_Internal.hh"
 #include "StringUtil.hh"
+#include "Stopwatch.hh"
 #include "UnicodeCollator.hh"
 #include "FleeceImpl.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
@@ -334,6 +335,139 @@ TEST_CASE("Unicode string functions", "[Query]") {
     testTrim(u"\u2028\u2029\u2030\u205f\u3000", 2, 2);
 }
 
+TEST_CASE("ASCII string functions", "[Query]") {
+    // Strings longer than 16 bytes exercise the vectorized code paths as well as the tails:
+    const string longStr = "The Quick Brown Fox Jumps Over The Lazy Dog @[`{ 0123";
+    CHECK(ASCIIPrefixLength(""_sl) == 0);
+    CHECK(ASCIIPrefixLength("cafe"_sl) == 4);
+    CHECK(ASCIIPrefixLength("café"_sl) == 3);
+    CHECK(ASCIIPrefixLength(slice(longStr)) == longStr.size());
+    CHECK(ASCIIPrefixLength(slice(longStr + "é")) == longStr.size());
+    CHECK(ASCIIPrefixLength(slice(string(20, 'x') + "é" + longStr)) == 20);
+
+    string str = longStr;
+    ASCIIChangeCase((const uint8_t*)str.data(), (uint8_t*)&str[0], str.size(), false);
+    CHECK(str == "the quick brown fox jumps over the lazy dog @[`{ 0123");
+    ASCIIChangeCase((const uint8_t*)str.data(), (uint8_t*)&str[0], str.size(), true);
+    CHECK(str == "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG @[`{ 0123");
+    str = string(20, 'a') + "é" + string(20, 'b');
+    ASCIIChangeCase((const uint8_t*)str.data(), (uint8_t*)&str[0], str.size(), true);
+    CHECK(str == string(20, 'A') + "é" + string(20, 'B'));
+
+    // ASCIIMatchLengthIgnoringCase only skips whole vectors, so its results depend on the
+    // vector width; without SIMD it skips nothing and leaves everything to the caller.
+    const size_t width = ASCIIVectorWidth();
+    REQUIRE((width == 0 || width == 16));
+    auto vectorBytes = [&](size_t n) {return width ? n : 0;};
+    size_t caseDiff;
+    const string a = "0123456789abcdef0123456789ABCDEF0123456789xyz";
+    const string b = "0123456789abcdef0123456789abcdef0123456789XYZ";
+    CHECK(ASCIIMatchLengthIgnoringCase((const uint8_t*)a.data(), (const uint8_t*)a.data(),
+                                       a.size(), caseDiff) == vectorBytes(32));
+    CHECK(caseDiff == vectorBytes(32));
+    CHECK(ASCIIMatchLengthIgnoringCase((const uint8_t*)a.data(), (const uint8_t*)b.data(),
+                                       a.size(), caseDiff) == vectorBytes(32));
+    CHECK(caseDiff == vectorBytes(26));
+    const string c = "0123456789abcdef0123456789ABCDEX0123456789xyz";
+    CHECK(ASCIIMatchLengthIgnoringCase((const uint8_t*)b.data(), (const uint8_t*)c.data(),
+                                       b.size(), caseDiff) == vectorBytes(16));
+
+    const slice hay(longStr);
+    CHECK(findBytes(hay, "The"_sl) == hay.buf);
+    CHECK(findBytes(hay, "Lazy Dog"_sl) == hay.find("Lazy Dog"_sl).buf);
+    CHECK(findBytes(hay, "0123"_sl) == hay.find("0123"_sl).buf);
+    CHECK(findBytes(hay, "3"_sl) == (const uint8_t*)hay.buf + hay.size - 1);
+    CHECK(findBytes(hay, "Lazy Cat"_sl) == nullptr);
+    CHECK(findBytes(hay, ""_sl) == hay.buf);
+    CHECK(findBytes("Dog"_sl, "Dogs"_sl) == nullptr);
+}
+
+
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "ASCII string functions performance", "[Query][Perf][.slow]") {
+    static constexpr int kIterations = 1000000;
+    const string str1 = "Benjamin Franklin Elementary School, Springfield",
+                 str2 = "BENJAMIN FRANKLIN ELEMENTARY SCHOOL, springfield";
+    // Each fast path is timed along with the byte-at-a-time code it replaced:
+    {
+        // The UTF-16 instantiation of CompareASCII still uses only the character loop:
+        const u16string wstr1(str1.begin(), str1.end()), wstr2(str2.begin(), str2.end());
+        Stopwatch st;
+        int result = 0;
+        for (int i = 0; i < kIterations; i++)
+            result += CompareASCII((int)wstr1.size(), wstr1.data(),
+                                   (int)wstr2.size(), wstr2.data(), false);
+        st.printReport("CompareASCII, case-insensitive, character loop", kIterations, "comparison");
+        CHECK(result == 0);
+    }
+    {
+        Stopwatch st;
+        int result = 0;
+        for (int i = 0; i < kIterations; i++)
+            result += CompareASCII((int)str1.size(), (const uint8_t*)str1.data(),
+                                   (int)str2.size(), (const uint8_t*)str2.data(), false);
+        st.printReport("CompareASCII, case-insensitive", kIterations, "comparison");
+        CHECK(result == 0);
+    }
+    {
+        Stopwatch st;
+        size_t length = 0;
+        for (int i = 0; i < kIterations; i++) {
+            alloc_slice lower(str1.size());
+            auto dst = (uint8_t*)lower.buf;
+            for (char c : str1)
+                *dst++ = (uint8_t)tolower(c);
+            length += lower.size;
+        }
+        st.printReport("tolower loop", kIterations, "string");
+        CHECK(length == kIterations * str1.size());
+    }
+    {
+        Stopwatch st;
+        size_t length = 0;
+        for (int i = 0; i < kIterations; i++) {
+            alloc_slice lower(str1.size());
+            ASCIIChangeCase((const uint8_t*)str1.data(), (uint8_t*)lower.buf, str1.size(), false);
+            length += lower.size;
+        }
+        st.printReport("ASCIIChangeCase", kIterations, "string");
+        CHECK(length == kIterations * str1.size());
+    }
+    {
+        Stopwatch st;
+        int found = 0;
+        for (int i = 0; i < kIterations; i++)
+            found += (slice(str1).find("Springfield"_sl).buf != nullptr);
+        st.printReport("slice::find", kIterations, "search");
+        CHECK(found == kIterations);
+    }
+    {
+        Stopwatch st;
+        int found = 0;
+        for (int i = 0; i < kIterations; i++)
+            found += (findBytes(slice(str1), "Springfield"_sl) != nullptr);
+        st.printReport("findBytes", kIterations, "search");
+        CHECK(found == kIterations);
+    }
+
+    db.exec("BEGIN");
+    for (int i = 0; i < 100000; i++)
+        insert(stringWithFormat("doc-%06d %s", i, str1.c_str()).c_str(), "{}");
+    db.exec("COMMIT");
+    {
+        Stopwatch st;
+        auto result = query("SELECT count(*) FROM kv WHERE N1QL_lower(key) = key");
+        st.printReport("N1QL_lower", 100000, "row");
+        CHECK(result == (vector<string>{"0"}));
+    }
+    {
+        Stopwatch st;
+        auto result = query("SELECT count(*) FROM kv WHERE contains(key, 'Springfield')");
+        st.printReport("contains", 100000, "row");
+        CHECK(result == (vector<string>{"100000"}));
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "N1QL string functions", "[Query]") {
     CHECK(query("SELECT N1QL_length('')") == (vector<string>{"0"}));
     CHECK(query("SELECT N1QL_length('12345')") == (vector<string>{"5"}));
@@ -345,11 +479,60 @@ N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "N1QL string functions", "[Query]")
     CHECK(query("SELECT N1QL_lower('cAFÉS17•')") == (vector<string>{"cafés17•"}));
     CHECK(query("SELECT N1QL_upper('cafés17')") == (vector<string>{"CAFÉS17"}));
 #endif
+    CHECK(query("SELECT N1QL_lower('A Long String That Takes More Than One Vector Step')")
+          == (vector<string>{"a long string that takes more than one vector step"}));
+    CHECK(query("SELECT contains('Benjamin Franklin Elementary School', 'School')")
+          == (vector<string>{"1"}));
+    CHECK(query("SELECT contains('Benjamin Franklin Elementary School', 'school')")
+          == (vector<string>{"0"}));
+    CHECK(query("SELECT contains('Ben', '')") == (vector<string>{"1"}));
     CHECK(query("SELECT N1QL_ltrim('  x  ')") == (vector<string>{"x  "}));
     CHECK(query("SELECT N1QL_rtrim('  x  ')") == (vector<string>{"  x"}));
     CHECK(query("SELECT N1QL_trim('  x  ')") == (vector<string>{"x"}));
 }
 
+
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "N1QL regexp functions", "[Query]") {
+    CHECK(query("SELECT regexp_like('cafes17', '^[a-z]+[0-9]+$')") == (vector<string>{"1"}));
+    CHECK(query("SELECT regexp_like('cafes', '[0-9]')") == (vector<string>{"0"}));
+    CHECK(query("SELECT regexp_position('cafes17', '[0-9]')") == (vector<string>{"5"}));
+    CHECK(query("SELECT regexp_position('cafes', '[0-9]')") == (vector<string>{"-1"}));
+    CHECK(query("SELECT regexp_replace('a1b22c333', '[0-9]+', '#')") == (vector<string>{"a#b#c#"}));
+    CHECK(query("SELECT regexp_replace('a1b22c333', '[0-9]+', '#', 1)") == (vector<string>{"a#b22c333"}));
+    CHECK(query("SELECT regexp_like('x', NULL)") == (vector<string>{"MISSING"}));
+    CHECK_THROWS_AS(query("SELECT regexp_like('x', '[')"), SQLite::Exception);
+
+    // Patterns that vary per row can't use SQLite's auxdata, so they go through the RegexCache:
+    insert("a", "{}");
+    insert("b", "{}");
+    insert("c", "{}");
+    CHECK(query("SELECT regexp_like(key, CASE WHEN key < 'b' THEN '^a' ELSE '^c' END) "
+                "FROM kv ORDER BY key") == (vector<string>{"1", "0", "1"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "N1QL regexp performance", "[Query][Perf][.slow]") {
+    static constexpr int kNumDocs = 100000;
+    db.exec("BEGIN");
+    for (int i = 0; i < kNumDocs; i++)
+        insert(stringWithFormat("doc-%06d", i).c_str(), "{}");
+    db.exec("COMMIT");
+    const vector<string> expected {to_string(kNumDocs / 10)};
+    {
+        Stopwatch st;
+        auto result = query("SELECT count(*) FROM kv WHERE regexp_like(key, '^doc-[0-9]*7$')");
+        st.printReport("regexp_like with constant pattern", kNumDocs, "row");
+        CHECK(result == expected);
+    }
+    {
+        Stopwatch st;
+        auto result = query("SELECT count(*) FROM kv WHERE regexp_like(key, "
+                            "CASE WHEN key < 'doc-05' THEN '^doc-[0-9]*7$' ELSE '^doc-[0-9]*3$' END)");
+        st.printReport("regexp_like with per-row pattern", kNumDocs, "row");
+        CHECK(result == expected);
+    }
+}
+
 #if __APPLE__ || defined(_MSC_VER) || LITECORE_USES_ICU //FIXME: collator isn't available on all platforms yet
 TEST_CASE("Unicode collation", "[Query][Collation]") {
     struct {slice a; slice b; int result; bool caseSensitive; bool diacriticSensitive;} tests[] = {
@@ -381,6 +564,12 @@ TEST_CASE("Unicode collation", "[Query][Collation]") {
         {"abcdef"_sl, "abcdefghijklm"_sl, -1,    false, true},
         {"abcdeF"_sl, "abcdefghijklm"_sl, -1,    false, true},
 
+        // Longer than 16 bytes, so the common prefix is compared in vectors:
+        {"commonprefix is long enough 1"_sl, "COMMONPREFIX IS LONG ENOUGH 2"_sl, -1, false, true},
+        {"commonprefix is long enough"_sl,   "COMMONPREFIX IS LONG ENOUGH"_sl,    0, false, true},
+        {"abcdefghijklmnopQrs"_sl,           "abcdefghijklmnopqrS"_sl,            1, true,  true},
+        {"ABCDEFGHIJKLMNOPQRSTUVWXYz"_sl,    "abcdefghijklmnopqrstuvwxyZ"_sl,     1, true,  true},
+
         //---- Now bring in non-ASCII characters:
 
         {"a"_sl,  "á"_sl, -1,   false, true},
@@ -407,6 +596,7 @@ TEST_CASE("Unicode collation", "[Query][Collation]") {
         {"test á"_sl, "test Á"_sl, -1,      true, true },
         {"test á"_sl, "test b"_sl, -1,      true, true },
         {"test u"_sl, "test Ü"_sl, -1,      true, true },
+        {"0123456789abcdefá"_sl, "0123456789abcdefb"_sl, -1, true, true },
 
         // Case sensitive, diacritic insensitive:
         {"abc"_sl,    "ABC"_sl, -1,    true, false},
@@ -452,6 +642,11 @@ TEST_CASE("Unicode locale collation", "[Query][Collation]") {
     CHECK(CompareUTF8("Å"_sl, "A"_sl, coll) == 1);
     CHECK(CompareUTF8("Å"_sl, "B"_sl, coll) == 1);
     CHECK(CompareUTF8("Å"_sl, "Z"_sl, coll) == 1);
+
+    // In Czech, "ch" is a letter that sorts after "h", even though it's all ASCII:
+    coll.localeName = "cs"_sl;
+    CHECK(CompareUTF8("ch"_sl, "cz"_sl, coll) == 1);
+    CHECK(CompareUTF8("ch"_sl, "i"_sl, coll) == -1);
 }
 
 N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite collation", "[Query][Collation]") {
@@ -508,6 +508,8 @@ namespace litecore { namespace repl {
         vector<bool> whichRequested(changes.count());
         unsigned itemsWritten = 0, requested = 0;
         vector<alloc_slice> ancestors;
+        if (!proposed)
+            findAncestors(changes, ancestors);
         auto &encoder = response.jsonBody();
         encoder.beginArray();
         int i = -1;
@@ -542,17 +544,14 @@ namespace litecore { namespace repl {
 
             } else {
                 // "changes" entry: [sequence, docID, revID, deleted?, bodySize?]
-                if (!findAncestors(docID, revID, ancestors)) {
+                if (ancestors[i]) {
                     // I don't have this revision, so request it:
                     ++requested;
                     whichRequested[i] = true;
 
                     while (itemsWritten++ < i)
                         encoder.writeInt(0);
-                    encoder.beginArray();
-                    for (slice ancestor : ancestors)
-                        encoder.writeString(ancestor);
-                    encoder.endArray();
+                    encoder.writeRaw(ancestors[i]);     // already a JSON array
                 }
             }
         }
@@ -567,34 +566,43 @@ namespace litecore { namespace repl {
     }
 
 
-    // Returns true if revision exists; else returns false and sets ancestors to an array of
-    // ancestor revisions I do have (empty if doc doesn't exist at all)
-    bool DBWorker::findAncestors(slice docID, slice revID, vector<alloc_slice> &ancestors) {
-        C4Error err;
-        c4::ref<C4Document> doc = c4doc_get(_db, docID, true, &err);
-        if (doc && c4doc_selectRevision(doc, revID, false, &err)) {
-            // I already have this revision. Make sure it's marked as current for this remote:
-            if (_remoteDBID) {
-                alloc_slice remoteRevID(c4doc_getRemoteAncestor(doc, _remoteDBID));
-                if (remoteRevID != revID)
-                    updateRemoteRev(doc);
-            }
-            return true;
+    // Looks up all the revisions in a "changes" message at once. For each one I already have,
+    // sets its item of `ancestors` to null; else to a JSON array of ancestor revisions I do have
+    // (empty if doc doesn't exist at all.)
+    void DBWorker::findAncestors(Array changes, vector<alloc_slice> &ancestors) {
+        auto count = changes.count();
+        vector<C4String> docIDs(count), revIDs(count);
+        unsigned i = 0;
+        for (auto item : changes) {
+            auto change = item.asArray();
+            docIDs[i] = change[1].asString();
+            revIDs[i] = change[2].asString();
+            ++i;
         }
-        
-        ancestors.resize(0);
-        if (doc) {
-            // Revision isn't found, but look for ancestors:
-            if (c4doc_selectFirstPossibleAncestorOf(doc, revID)) {
-                do {
-                    ancestors.emplace_back(doc->selectedRev.revID);
-                } while (c4doc_selectNextPossibleAncestorOf(doc, revID)
-                         && ancestors.size() < kMaxPossibleAncestors);
-            }
-        } else if (!isNotFoundError(err)) {
+
+        vector<C4RevAncestors> results(count);
+        C4Error err;
+        if (!c4db_findDocAncestors(_db, count, docIDs.data(), revIDs.data(),
+                                   kMaxPossibleAncestors, _remoteDBID, results.data(), &err))
             gotError(err);
+
+        ancestors.resize(count);
+        for (i = 0; i < count; ++i) {
+            if (results[i].revExists) {
+                ancestors[i] = nullslice;
+                // I already have this revision. Make sure it's marked as current for this remote:
+                if (_remoteDBID && !results[i].isRemoteRev) {
+                    c4::ref<C4Document> doc = c4doc_get(_db, docIDs[i], true, &err);
+                    if (doc && c4doc_selectRevision(doc, revIDs[i], false, &err))
+                        updateRemoteRev(doc);
+                }
+            } else if (results[i].ancestors.buf) {
+                ancestors[i] = alloc_slice(results[i].ancestors.buf, results[i].ancestors.size);
+                c4slice_free(results[i].ancestors);
+            } else {
+                ancestors[i] = alloc_slice("[]"_sl);
+            }
         }
-        return false;
     }
 
 
@@ -621,8 +629,7 @@ namespace litecore { namespace repl {
                                      alloc_slice &outCurrentRevID)
     {
         C4Error err;
-        //OPT: We don't need the document body, just its metadata, but there's no way to say that
-        c4::ref<C4Document> doc = c4doc_get(_db, docID, true, &err);
+        c4::ref<C4Document> doc = c4doc_getWithContent(_db, docID, true, kDocGetMetadata, &err);
         if (!doc) {
             if (isNotFoundError(err)) {
                 // Doc doesn't exist; it's a conflict if the peer thinks it does:
@@ -864,6 +871,12 @@ namespace litecore { namespace repl {
     }
 
 
+    // Called on the IncomingRev's thread, to take the re-encoding out of the insertion transaction.
+    alloc_slice DBWorker::encodeRevisionBody(slice fleeceBody) {
+        return c4db_encodeWithPersistedKeys(_db, fleeceBody);
+    }
+
+
     // Insert all the revisions queued for insertion, and sync the ones queued for syncing.
     void DBWorker::_insertRevisionsNow() {
         auto revs = _revsToInsert.pop();
@@ -875,6 +888,8 @@ namespace litecore { namespace repl {
 
         logVerbose("Inserting %zu revs:", revs->size());
         Stopwatch st;
+        LatencyTimer timer(metric::revInsertTime);
+        metric::revInsertBatchSize.record(revs->size());
 
         C4Error transactionErr;
         c4::Transaction transaction(_db);
@@ -884,22 +899,18 @@ namespace litecore { namespace repl {
             for (RevToInsert *rev : *revs) {
                 // Add a revision:
                 logVerbose("    {'%.*s' #%.*s}", SPLAT(rev->docID), SPLAT(rev->revID));
-                vector<C4String> history;
-                history.reserve(10);
-                history.push_back(rev->revID);
-                for (const void *pos=rev->historyBuf.buf, *end = rev->historyBuf.end(); pos < end;) {
-                    auto comma = slice(pos, end).findByteOrEnd(',');
-                    history.push_back(slice(pos, comma));
-                    pos = comma + 1;
-                }
 
                 // rev->body is Fleece, but sadly we can't insert it directly because it doesn't
                 // use the db's SharedKeys, so all of its Dict keys are strings. Putting this into
-                // the db would cause failures looking up those keys (see #156). So re-encode:
-                Value root = Value::fromData(rev->body, kFLTrusted);
-                enc.writeValue(root);
-                alloc_slice bodyForDB = enc.finish();
-                enc.reset();
+                // the db would cause failures looking up those keys (see #156). IncomingRev has
+                // usually re-encoded it already; if not, it has new keys, so re-encode it here:
+                alloc_slice bodyForDB = move(rev->bodyForDB);
+                if (!bodyForDB) {
+                    Value root = Value::fromData(rev->body, kFLTrusted);
+                    enc.writeValue(root);
+                    bodyForDB = enc.finish();
+                    enc.reset();
+                }
                 rev->body = nullslice;
 
                 C4DocPutRequest put = {};
@@ -908,8 +919,8 @@ namespace litecore { namespace repl {
                 put.revFlags = rev->flags;
                 put.existingRevision = true;
                 put.allowConflict = !rev->noConflicts;
-                put.history = history.data();
-                put.historyCount = history.size();
+                put.history = rev->history.data();
+                put.historyCount = rev->history.size();
                 put.remoteDBID = _remoteDBID;
                 put.save = true;
 
@@ -939,6 +950,7 @@ namespace litecore { namespace repl {
             transactionErr = { };
         else
             warn("Transaction failed!");
+        timer.stop();
 
         // Notify all revs (that didn't already fail):
         for (auto rev : *revs) {
@@ -951,6 +963,14 @@ namespace litecore { namespace repl {
         } else {
             double t = st.elapsed();
             log("Inserted %zu revs in %.2fms (%.0f/sec)", revs->size(), t*1000, revs->size()/t);
+
+            // Report the transaction time; the Puller's flow control reacts to it indirectly,
+            // since it's part of the time each IncomingRev takes.
+            _insertionTime = _insertionTime ? (7 * _insertionTime + t) / 8 : t;
+            FlowControlStatus flow = {};
+            flow.insertionTime = _insertionTime;
+            flow.revsPerInsertion = (unsigned)revs->size();
+            setFlowControl(flow);
         }
     }
 
@@ -82,6 +82,10 @@ namespace litecore { namespace repl {
 
         void insertRevision(RevToInsert *rev);
 
+        /** Re-encodes a received revision body so it can be inserted into the database.
+            Thread-safe. Returns null if it has to be re-encoded during insertion instead. */
+        alloc_slice encodeRevisionBody(slice fleeceBody);
+
         void markRevSynced(Rev *rev);
 
         void setCookie(slice setCookieHeader) {
@@ -134,8 +138,7 @@ namespace litecore { namespace repl {
         void writeRevWithLegacyAttachments(fleece::Encoder&,
                                            fleece::Dict rev,
                                            unsigned revpos);
-        bool findAncestors(slice docID, slice revID,
-                           std::vector<alloc_slice> &ancestors);
+        void findAncestors(fleece::Array changes, std::vector<alloc_slice> &ancestors);
         int findProposedChange(slice docID, slice revID, slice parentRevID,
                                alloc_slice &outCurrentRevID);
         void updateRemoteRev(C4Document* NONNULL);
@@ -159,6 +162,7 @@ namespace litecore { namespace repl {
         actor::Batcher<DBWorker,RevToInsert> _revsToInsert; // Pending revs to be added to db
         actor::Batcher<DBWorker,Rev> _revsToMarkSynced;     // Pending revs to be marked as synced
         bool _insertionScheduled {false};                   // True if call to insert/sync pending
+        double _insertionTime {0};                          // Moving avg of insertion txn time
         std::mutex _insertionQueueMutex;                    // For safe access to the above
         bool _disableBlobSupport {false};                   // for testing only
     };
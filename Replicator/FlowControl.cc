@@ -0,0 +1,78 @@
+//
+// FlowControl.cc
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "FlowControl.hh"
+#include <algorithm>
+
+using namespace std;
+
+namespace litecore { namespace repl {
+
+    constexpr double AdaptiveLimit::kCongestionRatio;
+    constexpr double AdaptiveLimit::kDecreaseFactor;
+
+    // Weight of a new sample in the moving average (same as TCP's SRTT)
+    static constexpr double kSmoothing = 1.0 / 8;
+
+    // How fast the baseline creeps up toward the average, so that it forgets a minimum measured
+    // under conditions that no longer hold (e.g. after the device switches networks.)
+    static constexpr double kBaselineDrift = 1.0 / 1024;
+
+    // Latencies are clamped to this, so a timer resolution of 0 can't make the baseline 0.
+    static constexpr double kMinLatency = 1.0e-6;
+
+
+    AdaptiveLimit::AdaptiveLimit(unsigned initial, unsigned minimum, unsigned maximum)
+    :_minimum(max(minimum, 1u))
+    ,_maximum(max(maximum, _minimum))
+    ,_value(min(max(initial, _minimum), _maximum))
+    { }
+
+
+    bool AdaptiveLimit::addSample(double latency) {
+        latency = max(latency, kMinLatency);
+        if (_smoothed == 0) {
+            _smoothed = _baseline = latency;
+        } else {
+            _smoothed += (latency - _smoothed) * kSmoothing;
+            _baseline = min(latency, _baseline + (_smoothed - _baseline) * kBaselineDrift);
+        }
+
+        // Only adjust once per window, i.e. after roughly one round of concurrent operations,
+        // so a single change has time to take effect before the next one:
+        if (++_samplesInWindow < _value)
+            return false;
+        _samplesInWindow = 0;
+
+        unsigned newValue;
+        if (_smoothed > _baseline * kCongestionRatio)
+            newValue = max(_minimum, unsigned(_value * kDecreaseFactor));
+        else
+            newValue = min(_maximum, _value + 1);
+        if (newValue == _value)
+            return false;
+        _value = newValue;
+        return true;
+    }
+
+
+    double AdaptiveLimit::secondsSince(time_point start) {
+        return chrono::duration<double>(now() - start).count();
+    }
+
+} }
@@ -0,0 +1,79 @@
+//
+// FlowControl.hh
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "c4Replicator.h"
+#include <chrono>
+
+namespace litecore { namespace repl {
+
+    /** The limits currently chosen by the replicator's flow control, and the measurements they
+        were based on. Each Worker fills in only the fields it controls; the Replicator merges
+        them into its own status, which is public as C4ReplicatorStatus::flowControl. */
+    typedef C4ReplicatorFlowControl FlowControlStatus;
+
+    static inline bool operator== (const FlowControlStatus &a, const FlowControlStatus &b) {
+        return a.maxRevsInFlight == b.maxRevsInFlight
+            && a.maxRevBytesAwaitingReply == b.maxRevBytesAwaitingReply
+            && a.revRoundTripTime == b.revRoundTripTime
+            && a.maxActiveIncomingRevs == b.maxActiveIncomingRevs
+            && a.incomingRevTime == b.incomingRevTime
+            && a.insertionTime == b.insertionTime
+            && a.revsPerInsertion == b.revsPerInsertion;
+    }
+    static inline bool operator!= (const FlowControlStatus &a, const FlowControlStatus &b) {
+        return !(a == b);
+    }
+
+
+    /** Adjusts a concurrency limit at runtime using AIMD (additive increase, multiplicative
+        decrease), in the manner of TCP congestion control.
+        It's given the latency of each operation that the limit applies to. Once per window of
+        `value()` samples, it compares the smoothed latency to the lowest recently seen: if
+        latency has grown past kCongestionRatio times that baseline, the extra concurrency is
+        only building up queues, so the limit is multiplied by kDecreaseFactor; otherwise it's
+        incremented. The limit always stays within the [minimum, maximum] range. */
+    class AdaptiveLimit {
+    public:
+        static constexpr double kCongestionRatio = 2.0;
+        static constexpr double kDecreaseFactor  = 0.75;
+
+        AdaptiveLimit(unsigned initial, unsigned minimum, unsigned maximum);
+
+        unsigned value() const                  {return _value;}
+        double smoothedLatency() const          {return _smoothed;}
+        double baselineLatency() const          {return _baseline;}
+
+        /** Records the latency of a completed operation, in seconds.
+            Returns true if this changed the limit. */
+        bool addSample(double latency);
+
+        /** Convenience for measuring the latency of an operation. */
+        using time_point = std::chrono::steady_clock::time_point;
+        static time_point now()                 {return std::chrono::steady_clock::now();}
+        static double secondsSince(time_point);
+
+    private:
+        unsigned const _minimum, _maximum;
+        unsigned _value;
+        double _smoothed {0};                   // Exponentially-weighted moving average
+        double _baseline {0};                   // Lowest recent latency (slowly forgets)
+        unsigned _samplesInWindow {0};
+    };
+
+} }
@@ -17,7 +17,6 @@
 //
 
 #include "IncomingRev.hh"
-#include "IncomingBlob.hh"
 #include "DBWorker.hh"
 #include "Puller.hh"
 #include "StringUtil.hh"
@@ -44,12 +43,10 @@ namespace litecore { namespace repl {
 
     // Resets the object so it can be reused for another revision.
     void IncomingRev::clear() {
-        Assert(_pendingCallbacks == 0 && !_currentBlob && _pendingBlobs.empty());
+        Assert(_pendingCallbacks == 0 && _pendingBlobs == 0);
         _revMessage = nullptr;
         _rev = nullptr;
         _error = {};
-        _currentBlob = nullptr;
-        _pendingBlobs.clear();
     }
 
     
@@ -125,50 +122,42 @@ namespace litecore { namespace repl {
             }
         }
 
-        // Check for blobs, and queue up requests for any I don't have yet:
-        _dbWorker->findBlobReferences(root, [=](FLDeepIterator i, Dict blob, const C4BlobKey &key) {
+        // Check for blobs, and collect the ones I don't have yet:
+        auto blobStore = _dbWorker->blobStore();
+        vector<PendingBlob> blobs;
+        _dbWorker->findBlobReferences(root, [&](FLDeepIterator i, Dict blob, const C4BlobKey &key) {
             _rev->flags |= kRevHasAttachments;
-            _pendingBlobs.push_back({key,
-                                     blob["length"_sl].asUnsigned(),
-                                     c4doc_blobIsCompressible(blob)});
+            if (c4blob_getSize(blobStore, key) >= 0)
+                return;
+            for (auto &b : blobs)
+                if (memcmp(&b.key, &key, sizeof(key)) == 0)
+                    return;
+            blobs.push_back({key,
+                             blob["length"_sl].asUnsigned(),
+                             c4doc_blobIsCompressible(blob)});
         });
 
-        // Request the first blob, or if there are none, finish:
-        if (!fetchNextBlob())
+        // Have the Puller download the blobs, or if there are none, insert the revision now:
+        if (blobs.empty()) {
             insertRevision();
-    }
-
-
-    bool IncomingRev::fetchNextBlob() {
-        auto blobStore = _dbWorker->blobStore();
-        while (!_pendingBlobs.empty()) {
-            PendingBlob first = _pendingBlobs.front();
-            _pendingBlobs.erase(_pendingBlobs.begin());
-            if (c4blob_getSize(blobStore, first.key) < 0) {
-                if (!_currentBlob)
-                    _currentBlob = new IncomingBlob(this, blobStore);
-                _currentBlob->start(first.key, first.length, first.compressible);
-                return true;
-            }
+        } else {
+            logVerbose("Waiting for %zu blobs", blobs.size());
+            _pendingBlobs = (unsigned)blobs.size();
+            _puller->fetchBlobs(this, move(blobs));
         }
-        _currentBlob = nullptr;
-        return false;
     }
 
 
-    void IncomingRev::_childChangedStatus(Worker *task, Status status) {
-        addProgress(status.progressDelta);
-        if (status.level == kC4Idle) {
-            if (status.error.code && !_error.code)
-                _error = status.error;
-            if (!fetchNextBlob()) {
-                // All blobs completed, now finish:
-                if (_error.code == 0) {
-                    logVerbose("All blobs received, now inserting revision");
-                    insertRevision();
-                } else {
-                    finish();
-                }
+    void IncomingRev::_blobFetched(C4Error err) {
+        if (err.code && !_error.code)
+            _error = err;
+        if (decrement(_pendingBlobs) == 0) {
+            // All blobs completed, now finish:
+            if (_error.code == 0) {
+                logVerbose("All blobs received, now inserting revision");
+                insertRevision();
+            } else {
+                finish();
             }
         }
     }
@@ -176,7 +165,7 @@ namespace litecore { namespace repl {
 
     // Asks the DBAgent to insert the revision, then sends the reply and notifies the Puller.
     void IncomingRev::insertRevision() {
-        Assert(_pendingBlobs.empty() && !_currentBlob);
+        Assert(_pendingBlobs == 0);
         increment(_pendingCallbacks);
         _rev->onInserted = asynchronize([this](C4Error err) {
             // Callback that will run _after_ insertRevision() completes:
@@ -185,6 +174,10 @@ namespace litecore { namespace repl {
             finish();
         });
 
+        // Do the CPU-heavy re-encoding here, so the DBWorker's transaction only has to insert:
+        if (_rev->body)
+            _rev->bodyForDB = _dbWorker->encodeRevisionBody(_rev->body);
+
         _dbWorker->insertRevision(_rev);
     }
 
@@ -205,13 +198,15 @@ namespace litecore { namespace repl {
             // (though it did get inserted), so notify the delegate of the conflict:
             gotDocumentError(_rev->docID, {LiteCoreDomain, kC4ErrorConflict}, false, true);
         }
+        _processingTime = AdaptiveLimit::secondsSince(_startTime);
         _puller->revWasHandled(this, _rev->docID, remoteSequence(), (_error.code == 0));
         clear();
     }
 
 
     Worker::ActivityLevel IncomingRev::computeActivityLevel() const {
-        if (Worker::computeActivityLevel() == kC4Busy || _pendingCallbacks > 0 || _currentBlob) {
+        if (Worker::computeActivityLevel() == kC4Busy || _pendingCallbacks > 0
+                || _pendingBlobs > 0) {
             return kC4Busy;
         } else {
             return kC4Stopped;
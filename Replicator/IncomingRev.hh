@@ -24,7 +24,6 @@
 
 namespace litecore { namespace repl {
     class DBWorker;
-    class IncomingBlob;
     class Puller;
 
 
@@ -34,9 +33,17 @@ namespace litecore { namespace repl {
         IncomingRev(Puller*, DBWorker*);
 
         void handleRev(blip::MessageIn* revMessage) {
+            _startTime = AdaptiveLimit::now();
             enqueue(&IncomingRev::_handleRev, retained(revMessage));
         }
 
+        /** Called by the Puller when a blob requested by fetchBlobs() has been downloaded
+            (or has failed, if the error code is nonzero.) */
+        void blobFetched(C4Error err)           {enqueue(&IncomingRev::_blobFetched, err);}
+
+        /** Time taken to handle the last revision, from handleRev() to telling the Puller. */
+        double processingTime() const           {return _processingTime;}
+
         bool nonPassive() const                 {return _options.pull > kC4Passive;}
 
         static bool shouldCompress(fleece::Dict meta);
@@ -46,30 +53,23 @@ namespace litecore { namespace repl {
 
     private:
         void _handleRev(Retained<blip::MessageIn>);
-        bool fetchNextBlob();
+        void _blobFetched(C4Error);
         void insertRevision();
         void finish();
         void clear();
-        virtual void _childChangedStatus(Worker *task, Status status) override;
 
         slice remoteSequence() const            {return _revMessage->property(slice("sequence"));}
 
-        struct PendingBlob {
-            C4BlobKey key;
-            uint64_t length;
-            bool compressible;
-        };
-
-        C4BlobStore *_blobStore;
         Puller* _puller;
         DBWorker* _dbWorker;
         Retained<blip::MessageIn> _revMessage;
         Retained<RevToInsert> _rev;
         unsigned _pendingCallbacks {0};
-        std::vector<PendingBlob> _pendingBlobs;
-        Retained<IncomingBlob> _currentBlob;
+        unsigned _pendingBlobs {0};         // # of blobs the Puller is fetching for me
         C4Error _error {};
         int _peerError {0};
+        AdaptiveLimit::time_point _startTime;
+        double _processingTime {0};
     };
 
 } }
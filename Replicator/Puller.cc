@@ -21,6 +21,7 @@
 #include "ReplicatorTuning.hh"
 #include "DBWorker.hh"
 #include "IncomingRev.hh"
+#include "IncomingBlob.hh"
 #include "Error.hh"
 #include "StringUtil.hh"
 #include "BLIP.hh"
@@ -197,7 +198,7 @@ namespace litecore { namespace repl {
 
     // Received an incoming "rev" message, which contains a revision body to insert
     void Puller::handleRev(Retained<MessageIn> msg) {
-        if (_activeIncomingRevs < tuning::kMaxActiveIncomingRevs) {
+        if (_activeIncomingRevs < _maxActiveIncomingRevs.value()) {
             startIncomingRev(msg);
         } else {
             logDebug("Delaying handling 'rev' message for '%.*s' [%zu waiting]",
@@ -254,18 +255,41 @@ namespace litecore { namespace repl {
         }
 
         _spareIncomingRevs.push_back(inc);
+        incomingRevCompleted(inc->processingTime());
 
         decrement(_activeIncomingRevs);
-        if (_activeIncomingRevs < tuning::kMaxActiveIncomingRevs && !_waitingRevMessages.empty()) {
-            auto msg = _waitingRevMessages.front();
-            _waitingRevMessages.pop_front();
-            startIncomingRev(msg);
+        if (_activeIncomingRevs < _maxActiveIncomingRevs.value() && !_waitingRevMessages.empty()) {
+            // (The limit may have just grown, so start as many as it allows)
+            do {
+                auto msg = _waitingRevMessages.front();
+                _waitingRevMessages.pop_front();
+                startIncomingRev(msg);
+            } while (_activeIncomingRevs < _maxActiveIncomingRevs.value()
+                        && !_waitingRevMessages.empty());
         } else {
             handleMoreChanges();
         }
     }
 
 
+    // Feeds the time an IncomingRev took into flow control. This time mostly depends on how fast
+    // the DBWorker can insert revisions, so running more of them at once stops helping when the
+    // insertion transactions can't keep up.
+    void Puller::incomingRevCompleted(double latency) {
+        if (_maxActiveIncomingRevs.addSample(latency)
+                || status().flowControl.maxActiveIncomingRevs == 0) {
+            logVerbose("Flow control: handling up to %u revs at once (%.0fms per rev, baseline %.0fms)",
+                       _maxActiveIncomingRevs.value(),
+                       _maxActiveIncomingRevs.smoothedLatency() * 1000,
+                       _maxActiveIncomingRevs.baselineLatency() * 1000);
+            FlowControlStatus flow = {};
+            flow.maxActiveIncomingRevs = _maxActiveIncomingRevs.value();
+            flow.incomingRevTime = _maxActiveIncomingRevs.smoothedLatency();
+            setFlowControl(flow);
+        }
+    }
+
+
     // Records that a sequence has been successfully pulled.
     void Puller::completedSequence(alloc_slice sequence) {
         bool wasEarliest;
@@ -281,12 +305,81 @@ namespace litecore { namespace repl {
     }
 
 
+#pragma mark - INCOMING BLOBS:
+
+
+    // Blobs are downloaded here instead of by each IncomingRev, so that a revision's blobs can be
+    // downloaded in parallel, the number (and size) of downloads for all revisions can be limited,
+    // and a blob referenced by several revisions at once is only downloaded once.
+    void Puller::_fetchBlobs(Retained<IncomingRev> inc, vector<PendingBlob> blobs) {
+        for (auto &blob : blobs) {
+            string digest((const char*)&blob.key, sizeof(blob.key));
+            auto i = _blobFetches.find(digest);
+            if (i != _blobFetches.end()) {
+                logDebug("Blob is already being fetched for another revision");
+                i->second.revs.push_back(inc);
+            } else {
+                _blobFetches.emplace(digest, BlobFetch{blob, nullptr, {inc}});
+                _waitingBlobs.push_back(digest);
+            }
+        }
+        startBlobs();
+    }
+
+
+    // Starts downloading waiting blobs, as far as the limits allow.
+    void Puller::startBlobs() {
+        auto blobStore = _dbActor->blobStore();
+        while (!_waitingBlobs.empty() && _activeBlobs.size() < tuning::kMaxBlobsInFlight) {
+            string digest = _waitingBlobs.front();
+            BlobFetch &fetch = _blobFetches[digest];
+            const PendingBlob &blob = fetch.blob;
+            if (!_activeBlobs.empty()
+                    && _activeBlobBytes + blob.length > tuning::kMaxBlobBytesInFlight)
+                break;
+            _waitingBlobs.pop_front();
+            if (c4blob_getSize(blobStore, blob.key) >= 0) {
+                // It was installed since it was requested:
+                blobFinished(digest, {});
+                continue;
+            }
+
+            // (IncomingBlobs aren't reused, since a Worker's status keeps its last error.)
+            fetch.incBlob = new IncomingBlob(this, blobStore);
+            _activeBlobs[fetch.incBlob.get()] = digest;
+            _activeBlobBytes += blob.length;
+            fetch.incBlob->start(blob.key, blob.length, blob.compressible);
+        }
+    }
+
+
+    // Notifies the IncomingRevs waiting for a blob that it's been downloaded, or has failed.
+    void Puller::blobFinished(const string &digest, C4Error err) {
+        auto i = _blobFetches.find(digest);
+        for (auto &inc : i->second.revs)
+            inc->blobFetched(err);
+        _blobFetches.erase(i);
+    }
+
+
 #pragma mark - STATUS / PROGRESS:
 
 
     void Puller::_childChangedStatus(Worker *task, Status status) {
-        // Combine the IncomingRev's progress into mine:
+        // Combine the IncomingRev's or IncomingBlob's progress into mine:
         addProgress(status.progressDelta);
+
+        if (status.level == kC4Idle) {
+            // If it's an IncomingBlob, it's finished:
+            auto i = _activeBlobs.find(task);
+            if (i != _activeBlobs.end()) {
+                string digest = i->second;
+                _activeBlobs.erase(i);
+                _activeBlobBytes -= _blobFetches[digest].blob.length;
+                blobFinished(digest, status.error);
+                startBlobs();
+            }
+        }
     }
 
     
@@ -18,11 +18,16 @@
 
 #pragma once
 #include "Replicator.hh"
+#include "ReplicatorTuning.hh"
+#include "ReplicatorTypes.hh"
 #include "Actor.hh"
 #include "RemoteSequenceSet.hh"
 #include <deque>
+#include <string>
+#include <unordered_map>
 
 namespace litecore { namespace repl {
+    class IncomingBlob;
     class IncomingRev;
 
 
@@ -41,6 +46,12 @@ namespace litecore { namespace repl {
                            slice sequence,
                            bool complete);
 
+        // Called only by IncomingRev. Downloads the blobs, then calls inc->blobFetched()
+        // once for each of them.
+        void fetchBlobs(IncomingRev *inc, std::vector<PendingBlob> blobs) {
+            enqueue(&Puller::_fetchBlobs, retained(inc), blobs);
+        }
+
     protected:
         virtual std::string loggingClassName() const override       {return "Pull";}
         virtual actor::Mailbox* mailboxForChildren() override       {return &_revMailbox;}
@@ -61,7 +72,18 @@ namespace litecore { namespace repl {
         void startIncomingRev(MessageIn*);
         void _revWasHandled(Retained<IncomingRev>, alloc_slice docID, alloc_slice sequence,
                             bool complete);
+        void incomingRevCompleted(double latency);
         void completedSequence(alloc_slice sequence);
+        void _fetchBlobs(Retained<IncomingRev>, std::vector<PendingBlob>);
+        void startBlobs();
+        void blobFinished(const std::string &digest, C4Error);
+
+        // A blob being downloaded, or waiting to be, for one or more IncomingRevs.
+        struct BlobFetch {
+            PendingBlob blob;
+            Retained<IncomingBlob> incBlob;             // Downloader, once it's started
+            std::vector<Retained<IncomingRev>> revs;    // IncomingRevs waiting for the blob
+        };
 
         void _setSkipDeleted()                  {_skipDeleted = true;}
 
@@ -77,6 +99,13 @@ namespace litecore { namespace repl {
         bool _waitingForChangesCallback {false};  // Waiting for DBAgent::findOrRequestRevs?
         unsigned _pendingRevMessages {0};   // # of 'rev' msgs expected but not yet being processed
         unsigned _activeIncomingRevs {0};   // # of IncomingRev workers running
+        AdaptiveLimit _maxActiveIncomingRevs {tuning::kMaxActiveIncomingRevs,
+                                              tuning::kMaxActiveIncomingRevsFloor,
+                                              tuning::kMaxActiveIncomingRevsCeiling};
+        std::unordered_map<std::string, BlobFetch> _blobFetches;  // Requested blobs, by key
+        std::deque<std::string> _waitingBlobs;      // Keys of blobs not being downloaded yet
+        std::unordered_map<Worker*, std::string> _activeBlobs; // IncomingBlobs running
+        uint64_t _activeBlobBytes {0};      // Total size of blobs being downloaded
 #if __APPLE__
         actor::Mailbox _revMailbox;
 #endif
@@ -336,8 +336,8 @@ namespace litecore { namespace repl {
 
 
     void Pusher::maybeSendMoreRevs() {
-        while (_revisionsInFlight < tuning::kMaxRevsInFlight
-                   && _revisionBytesAwaitingReply <= tuning::kMaxRevBytesAwaitingReply
+        while (_revisionsInFlight < _maxRevsInFlight.value()
+                   && _revisionBytesAwaitingReply <= maxRevBytesAwaitingReply()
                    && !_revsToSend.empty()) {
             sendRevision(move(_revsToSend.front()));
             _revsToSend.pop_front();
@@ -356,7 +356,8 @@ namespace litecore { namespace repl {
         increment(_revisionsInFlight);
         logVerbose("Uploading rev %.*s %.*s (seq #%llu) [%d/%d]",
                    SPLAT(rev->docID), SPLAT(rev->revID), rev->sequence,
-                   _revisionsInFlight, tuning::kMaxRevsInFlight);
+                   _revisionsInFlight, _maxRevsInFlight.value());
+        auto startTime = AdaptiveLimit::now();
         _dbWorker->sendRevision(rev, asynchronize([=](MessageProgress progress) {
             // message progress callback:
             if (progress.state == MessageProgress::kDisconnected) {
@@ -372,6 +373,7 @@ namespace litecore { namespace repl {
             }
             if (progress.state == MessageProgress::kComplete) {
                 decrement(_revisionBytesAwaitingReply, progress.bytesSent);
+                revRoundTripCompleted(AdaptiveLimit::secondsSince(startTime));
                 bool completed = !progress.reply->isError();
                 if (completed) {
                     logVerbose("Completed rev %.*s #%.*s (seq #%llu)",
@@ -405,6 +407,30 @@ namespace litecore { namespace repl {
     }
 
 
+    // Feeds the time between starting to send a rev and getting its reply into flow control.
+    void Pusher::revRoundTripCompleted(double latency) {
+        if (_maxRevsInFlight.addSample(latency) || status().flowControl.maxRevsInFlight == 0) {
+            logVerbose("Flow control: sending up to %u revs / %u bytes at once "
+                       "(round-trip %.0fms, baseline %.0fms)",
+                       _maxRevsInFlight.value(), (unsigned)maxRevBytesAwaitingReply(),
+                       _maxRevsInFlight.smoothedLatency() * 1000,
+                       _maxRevsInFlight.baselineLatency() * 1000);
+            FlowControlStatus flow = {};
+            flow.maxRevsInFlight = _maxRevsInFlight.value();
+            flow.maxRevBytesAwaitingReply = (unsigned)maxRevBytesAwaitingReply();
+            flow.revRoundTripTime = _maxRevsInFlight.smoothedLatency();
+            setFlowControl(flow);
+        }
+    }
+
+
+    // The byte limit scales along with the adaptive rev count limit.
+    MessageSize Pusher::maxRevBytesAwaitingReply() const {
+        return (MessageSize)((uint64_t)tuning::kMaxRevBytesAwaitingReply
+                                * _maxRevsInFlight.value() / tuning::kMaxRevsInFlight);
+    }
+
+
 #pragma mark - SENDING ATTACHMENTS:
 
 
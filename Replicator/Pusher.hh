@@ -66,6 +66,8 @@ namespace litecore { namespace repl {
         void sendRevision(Retained<RevToSend>);
         void _couldntSendRevision(Retained<RevToSend>);
         void doneWithRev(const RevToSend*, bool successful);
+        void revRoundTripCompleted(double latency);
+        MessageSize maxRevBytesAwaitingReply() const;
         void updateCheckpoint();
         void handleGetAttachment(Retained<MessageIn>);
         void handleProveAttachment(Retained<MessageIn>);
@@ -93,6 +95,9 @@ namespace litecore { namespace repl {
         unsigned _changeListsInFlight {0};        // # change lists being requested from db or sent to peer
         unsigned _revisionsInFlight {0};          // # 'rev' messages being sent
         MessageSize _revisionBytesAwaitingReply {0}; // # 'rev' message bytes sent but not replied
+        AdaptiveLimit _maxRevsInFlight {tuning::kMaxRevsInFlight,       // Adjusted by rev RTT
+                                        tuning::kMaxRevsInFlightFloor,
+                                        tuning::kMaxRevsInFlightCeiling};
         unsigned _blobsInFlight {0};              // # of blobs being sent
         std::deque<Retained<RevToSend>> _revsToSend;  // Revs to send to peer but not sent yet
         std::unordered_map<alloc_slice, Retained<RevToSend>, fleece::sliceHash> _activeDocs;
@@ -125,6 +125,14 @@ namespace litecore { namespace repl {
 
         setProgress(_pushStatus.progress + _pullStatus.progress);
 
+        // Combine the workers' flow-control limits into my status:
+        FlowControlStatus flow = _pushStatus.flowControl;
+        flow.maxActiveIncomingRevs = _pullStatus.flowControl.maxActiveIncomingRevs;
+        flow.incomingRevTime       = _pullStatus.flowControl.incomingRevTime;
+        flow.insertionTime         = _dbStatus.flowControl.insertionTime;
+        flow.revsPerInsertion      = _dbStatus.flowControl.revsPerInsertion;
+        setFlowControl(flow);
+
         if (SyncBusyLog.effectiveLevel() <= LogLevel::Info) {
             log("pushStatus=%-s, pullStatus=%-s, dbStatus=%-s, progress=%llu/%llu",
                 kC4ReplicatorActivityLevelNames[_pushStatus.level],
@@ -26,7 +26,9 @@ namespace litecore { namespace repl {
         each other, and changing them can have unexpected and counter-intuitive effects.
         Their behavior also varies with things like network speed, latency, and whether the
         peer is LiteCore or Sync Gateway.
-        I'm not sure the current values are optimal, but they've been tweaked a lot. --Jens */
+        I'm not sure the current values are optimal, but they've been tweaked a lot. --Jens
+        The in-flight limits below are now only starting points: the Pusher and Puller adjust
+        them at runtime (see AdaptiveLimit in FlowControl.hh) within the Floor/Ceiling bounds. */
     namespace tuning {
 
         //// DBWorker:
@@ -55,6 +57,22 @@ namespace litecore { namespace repl {
             GCD dispatch queues results in lots of threads being created.) */
         constexpr unsigned kMaxActiveIncomingRevs = 100;
 
+        /* Bounds of kMaxActiveIncomingRevs as the Puller adjusts it, based on how long incoming
+            revisions take to be handled (which mostly depends on database insertion speed.)
+            The ceiling stays at the fixed limit above, since that's what keeps the number of
+            IncomingRev actors, and the threads behind them, under control. */
+        constexpr unsigned kMaxActiveIncomingRevsFloor = 10;
+        constexpr unsigned kMaxActiveIncomingRevsCeiling = kMaxActiveIncomingRevs;
+
+        /* Maximum number of blobs (attachments) the puller downloads at once, for all the
+            incoming revisions combined. Each one is assigned an IncomingBlob actor with an open
+            BlobStore write stream. */
+        constexpr unsigned kMaxBlobsInFlight = 8;
+
+        /* Maximum total size of the blobs being downloaded at once. A blob bigger than this can
+            still be downloaded, but only by itself. */
+        constexpr uint64_t kMaxBlobBytesInFlight = 8*1024*1024;
+
         //// Pusher:
 
         /* If true, `changes` messages are sent in BLIP Urgent mode, which means they get
@@ -72,8 +90,15 @@ namespace litecore { namespace repl {
         /* Max # of `rev` messages to be transmitting at once. */
         constexpr unsigned kMaxRevsInFlight = 10;
 
+        /* Bounds of kMaxRevsInFlight as the Pusher adjusts it, based on the round-trip time of
+            `rev` messages: it grows while the round-trip time holds steady, so long fat pipes (like
+            satellite links) can be kept full, and shrinks when messages start queueing up. */
+        constexpr unsigned kMaxRevsInFlightFloor = 2;
+        constexpr unsigned kMaxRevsInFlightCeiling = 100;
+
         /* Max desirable number of bytes of revisions that have been sent but not replied to
-            yet. This is limited to avoid flooding the peer with too much JSON data. */
+            yet. This is limited to avoid flooding the peer with too much JSON data.
+            It's scaled in proportion as the Pusher adjusts kMaxRevsInFlight. */
         constexpr unsigned kMaxRevBytesAwaitingReply = 2*1024*1024;
 
         //// Replicator:
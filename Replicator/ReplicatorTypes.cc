@@ -62,6 +62,15 @@ namespace litecore { namespace repl {
         if (deleted_)
             flags |= kRevDeleted;
         noConflicts = noConflicts_;
+
+        // Split the comma-separated history here, rather than in the DBWorker's transaction:
+        history.reserve(10);
+        history.push_back(revID);
+        for (const void *pos=historyBuf.buf, *end = historyBuf.end(); pos < end;) {
+            auto comma = slice(pos, end).findByteOrEnd(',');
+            history.push_back(slice(pos, comma));
+            pos = comma + 1;
+        }
     }
 
 } }
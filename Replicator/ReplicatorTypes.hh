@@ -106,7 +106,9 @@ namespace litecore { namespace repl {
     class RevToInsert : public Rev {
     public:
         const alloc_slice historyBuf;
-        alloc_slice body;
+        std::vector<C4String> history;      // revID followed by its ancestors (from historyBuf)
+        alloc_slice body;                   // Fleece body, not using the db's SharedKeys
+        alloc_slice bodyForDB;              // Body re-encoded for the db, if it could be done early
         std::function<void(C4Error)> onInserted;
 
         RevToInsert(slice docID_, slice revID_,
@@ -118,4 +120,12 @@ namespace litecore { namespace repl {
         ~RevToInsert() =default;
     };
 
+
+    /** A blob referenced by an incoming revision, that isn't in the local BlobStore yet. */
+    struct PendingBlob {
+        C4BlobKey key;
+        uint64_t length;
+        bool compressible;
+    };
+
 } }
@@ -212,6 +212,14 @@ namespace litecore { namespace repl {
     }
 
 
+    void Worker::setFlowControl(const FlowControlStatus &flow) {
+        if (flow != _status.flowControl) {
+            _status.flowControl = flow;
+            _statusChanged = true;
+        }
+    }
+
+
 
     Worker::ActivityLevel Worker::computeActivityLevel() const {
         if (eventCount() > 1 || _pendingResponseCount > 0)
@@ -26,6 +26,7 @@
 #include "c4Private.h"
 #include "fleece/Fleece.hh"
 #include "Error.hh"
+#include "FlowControl.hh"
 #include <chrono>
 #include <functional>
 
@@ -134,7 +135,7 @@ namespace litecore { namespace repl {
 
         struct Status : public C4ReplicatorStatus {
             Status(ActivityLevel lvl =kC4Stopped) {
-                level = lvl; error = {}; progress = progressDelta = {};
+                level = lvl; error = {}; progress = progressDelta = {}; flowControl = {};
             }
             C4Progress progressDelta;
         };
@@ -209,6 +210,7 @@ namespace litecore { namespace repl {
         virtual void changedStatus();
         void addProgress(C4Progress);
         void setProgress(C4Progress);
+        void setFlowControl(const FlowControlStatus&);
 
         virtual void _childChangedStatus(Worker *task, Status) { }
 
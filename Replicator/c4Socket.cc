@@ -23,6 +23,7 @@
 #include "c4Socket+Internal.hh"
 #include "Address.hh"
 #include "Error.hh"
+#include "Instrumentation.hh"
 #include "WebSocketImpl.hh"
 #include "StringUtil.hh"
 #include <atomic>
@@ -118,6 +119,7 @@ namespace litecore { namespace repl {
     }
 
     void C4SocketImpl::sendBytes(alloc_slice bytes) {
+        metric::bytesSent.add(bytes.size);
         _factory.write(this, C4SliceResult(bytes));
     }
 
@@ -182,5 +184,6 @@ void c4socket_completedWrite(C4Socket *socket, size_t byteCount) C4API {
 }
 
 void c4socket_received(C4Socket *socket, C4Slice data) C4API {
+    metric::bytesReceived.add(data.size);
     internal(socket)->onReceive(data);
 }
@@ -0,0 +1,84 @@
+//
+// FlowControlTest.cc
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "FlowControl.hh"
+#include "LiteCoreTest.hh"
+
+using namespace litecore::repl;
+using namespace std;
+
+
+// Feeds `n` identical samples; returns the number of times the limit changed.
+static unsigned feed(AdaptiveLimit &limit, unsigned n, double latency) {
+    unsigned changes = 0;
+    for (unsigned i = 0; i < n; ++i)
+        if (limit.addSample(latency))
+            ++changes;
+    return changes;
+}
+
+
+TEST_CASE("AdaptiveLimit bounds", "[Push][Pull]") {
+    CHECK(AdaptiveLimit(10, 2, 100).value() == 10);
+    CHECK(AdaptiveLimit(1, 2, 100).value() == 2);
+    CHECK(AdaptiveLimit(500, 2, 100).value() == 100);
+    CHECK(AdaptiveLimit(0, 0, 0).value() == 1);
+}
+
+
+TEST_CASE("AdaptiveLimit additive increase", "[Push][Pull]") {
+    AdaptiveLimit limit(10, 2, 12);
+    // The limit grows by one after each window of `value` samples at steady latency:
+    CHECK(feed(limit, 9, 0.05) == 0);
+    CHECK(limit.value() == 10);
+    CHECK(feed(limit, 1, 0.05) == 1);
+    CHECK(limit.value() == 11);
+    CHECK(feed(limit, 11, 0.05) == 1);
+    CHECK(limit.value() == 12);
+    // ...but not past the maximum:
+    CHECK(feed(limit, 100, 0.05) == 0);
+    CHECK(limit.value() == 12);
+    CHECK(limit.smoothedLatency() == Approx(0.05));
+    CHECK(limit.baselineLatency() == Approx(0.05));
+}
+
+
+TEST_CASE("AdaptiveLimit multiplicative decrease", "[Push][Pull]") {
+    AdaptiveLimit limit(40, 4, 100);
+    feed(limit, 40, 0.05);
+    CHECK(limit.value() == 41);
+
+    // Latency jumps up, i.e. requests are queueing; the limit shrinks by 25% per window:
+    CHECK(feed(limit, 41, 1.0) == 1);
+    CHECK(limit.value() == 30);
+    CHECK(limit.smoothedLatency() > 2 * limit.baselineLatency());
+    CHECK(feed(limit, 30, 1.0) == 1);
+    CHECK(limit.value() == 22);
+
+    // ...but not below the minimum:
+    feed(limit, 100, 1.0);
+    CHECK(limit.value() == 4);
+
+    // If the higher latency persists, it eventually becomes the new baseline:
+    feed(limit, 1000, 1.0);
+    CHECK(limit.value() > 4);
+
+    // A return to low latency resets the baseline immediately:
+    feed(limit, 100, 0.05);
+    CHECK(limit.baselineLatency() == Approx(0.05));
+}
@@ -11,6 +11,7 @@
 #include "Timer.hh"
 #include "Database.hh"
 #include "PrebuiltCopier.hh"
+#include "Stopwatch.hh"
 #include <chrono>
 
 using namespace litecore::actor;
@@ -115,6 +116,10 @@ TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push large docs", "[Push]") {
     runPushReplication();
     compareDatabases();
     validateCheckpoints(db, db2, "{\"local\":100}");
+
+    // The push's flow-control measurements are part of the replicator's status:
+    CHECK(_statusReceived.flowControl.maxRevsInFlight > 0);
+    CHECK(_statusReceived.flowControl.revRoundTripTime > 0.0);
 }
 
 
@@ -227,6 +232,16 @@ TEST_CASE_METHOD(ReplicatorLoopbackTest, "Pull large database no-conflicts", "[P
 }
 
 
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Pull large database performance", "[Pull][Perf][.slow]") {
+    importJSONLines(sFixturesDir + "iTunesMusicLibrary.json");
+    _expectedDocumentCount = 12189;
+    Stopwatch st;
+    runPullReplication();
+    st.printReport("Pulling", _expectedDocumentCount, "rev");
+    compareDatabases();
+}
+
+
 TEST_CASE_METHOD(ReplicatorLoopbackTest, "Pull Empty DB", "[Pull]") {
     runPullReplication();
     compareDatabases();
@@ -635,6 +650,31 @@ TEST_CASE_METHOD(ReplicatorLoopbackTest, "Pull Lots Of Attachments", "[Pull][blo
 }
 
 
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Pull Shared Attachments", "[Pull][blob]") {
+    // Many docs referencing the same blobs, which will be in flight for several revs at once:
+    static const int kNumDocs = 50, kNumBlobsPerDoc = 20;
+    vector<string> attachments;
+    for (int iAtt = 0; iAtt < kNumBlobsPerDoc; iAtt++)
+        attachments.push_back(format("shared attachment #%d", iAtt) + string(10000 * iAtt, '*'));
+    vector<C4BlobKey> blobKeys;
+    {
+        TransactionHelper t(db);
+        char docid[100];
+        for (int iDoc = 0; iDoc < kNumDocs; ++iDoc) {
+            sprintf(docid, "doc%03d", iDoc);
+            blobKeys = addDocWithAttachments(c4str(docid), attachments, "text/plain");
+            ++_expectedDocumentCount;
+        }
+    }
+
+    runPullReplication();
+    compareDatabases();
+    validateCheckpoints(db2, db, format("{\"remote\":%d}", kNumDocs).c_str());
+
+    checkAttachments(db2, blobKeys, attachments);
+}
+
+
 TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push Uncompressible Blob", "[Push][blob]") {
     // Test case for issue #354
     alloc_slice image = readFile(sFixturesDir + "for#354.jpg");